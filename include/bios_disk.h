@@ -54,6 +54,12 @@ public:
 	virtual Bit8u Write_Sector(Bit32u head,Bit32u cylinder,Bit32u sector,void * data);
 	virtual Bit8u Read_AbsoluteSector(Bit32u sectnum, void * data);
 	virtual Bit8u Write_AbsoluteSector(Bit32u sectnum, void * data);
+	/* count sectors at once, the data buffer holds all of them */
+	virtual Bit8u Read_Sectors(Bit32u sectnum, Bit32u count, void * data);
+	virtual Bit8u Write_Sectors(Bit32u sectnum, Bit32u count, void * data);
+	Bit32u Get_AbsoluteSector(Bit32u head,Bit32u cylinder,Bit32u sector) {
+		return ( (cylinder * heads + head) * sectors ) + sector - 1L;
+	}
 
 	virtual void Set_Reserved_Cylinders(Bitu resCyl);
 	virtual Bit32u Get_Reserved_Cylinders();
@@ -62,7 +68,7 @@ public:
 	virtual Bit8u GetBiosType(void);
 	virtual Bit32u getSectSize(void);
 	imageDisk(FILE *imgFile, Bit8u *imgName, Bit32u imgSizeK, bool isHardDisk);
-	virtual ~imageDisk() { if(diskimg != NULL) { fclose(diskimg); }	};
+	virtual ~imageDisk();
 
 	int class_id;
 
@@ -92,6 +98,12 @@ public:
 		if (ret == 0 && auto_delete_on_refcount_zero) delete this;
 		return ret;
 	}
+private:
+	void Setup_IO(void);
+	bool io_ready;
+	Bit8u *mapped;			/* The whole image when it could be mapped */
+	Bit64u mapped_size;
+	bool mapped_writable;
 };
 
 void updateDPT(void);
@@ -0,0 +1,67 @@
+/*
+ *  Copyright (C) 2002-2015  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef DOSBOX_COW_DISK_H
+#define DOSBOX_COW_DISK_H
+
+#include <string>
+#include <vector>
+#include "bios_disk.h"
+
+/* Raw image that is never written to. The base file is opened read only, so
+   the mapping set up by imageDisk is shared by every instance that uses the
+   same image. Writes go into a delta file as whole blocks, a bitmap in the
+   delta file records which blocks are there.
+
+   Delta file layout, little endian:
+     0   "DBXCOWD1"
+     8   Bit32u version
+     12  Bit32u block size in bytes
+     16  Bit64u size of the base image in bytes
+     24  Bit64u offset of the first block
+     32  base image name, informational
+     512 bitmap, one bit per block
+   followed by the blocks, block n at first block + n * block size. Blocks
+   that were never written are holes in the file. */
+class imageDiskCOW : public imageDisk {
+public:
+	virtual Bit8u Read_Sectors(Bit32u sectnum, Bit32u count, void * data);
+	virtual Bit8u Write_Sectors(Bit32u sectnum, Bit32u count, void * data);
+
+	imageDiskCOW(FILE *baseFile, const char *deltaName, Bit8u *imgName, Bit32u imgSizeK, bool isHardDisk);
+	virtual ~imageDiskCOW();
+
+	bool created_successfully;
+private:
+	bool Open_Delta(const char *deltaName);
+	bool Block_Dirty(Bit64u block) const {
+		return (bitmap[(size_t)(block >> 3)] >> (block & 7)) & 1;
+	}
+	bool Delta_Read(Bit64u offset, void *data, Bit64u len);
+	bool Delta_Write(Bit64u offset, const void *data, Bit64u len);
+
+	FILE *delta;
+	Bit32u block_size;
+	Bit64u base_size;
+	Bit64u block_count;
+	Bit64u data_offset;
+	std::vector<Bit8u> bitmap;
+	std::vector<Bit8u> copy_buffer;
+};
+
+#endif
@@ -21,6 +21,9 @@
 #define DOSBOX_DOS_SYSTEM_H
 
 #include <vector>
+#include <map>
+#include <string>
+#include <unordered_map>
 #ifndef DOSBOX_DOSBOX_H
 #include "dosbox.h"
 #endif
@@ -91,6 +94,7 @@ public:
 	virtual void	AddRef()					{ refCtr++; };
 	virtual Bits	RemoveRef()					{ return --refCtr; };
 	virtual bool	UpdateDateTimeFromHost()	{ return true; }
+	virtual void	Flush()						{ }
 	virtual Bit32u	GetSeekPos()	{ return 0xffffffff; }
 	void SetDrive(Bit8u drv) { hdrive=drv;}
 	Bit8u GetDrive(void) { return hdrive;}
@@ -179,21 +183,32 @@ public:
 			isDir = false;
 			id = MAX_OPENDIRS;
 			nextEntry = shortNr = 0;
+			watch = -1;
 		}
 		~CFileInfo(void) {
 			for (Bit32u i=0; i<fileList.size(); i++) delete fileList[i];
 			fileList.clear();
-			longNameList.clear();
+			ClearLookup();
 		};
+		void ClearLookup(void) {
+			shortNames.clear();
+			longNames.clear();
+			aliasNumbers.clear();
+		}
 		char		orgname		[CROSS_LEN];
 		char		shortname	[DOS_NAMELENGTH_ASCII];
 		bool		isDir;
 		Bit16u		id;
 		Bitu		nextEntry;
 		Bitu		shortNr;
-		// contents
+		int		watch;			// inotify watch of the host directory, -1 if none
+		// contents, in the order they were added
 		std::vector<CFileInfo*>	fileList;
-		std::vector<CFileInfo*>	longNameList;
+		// index into fileList by short name and by host name
+		std::unordered_map<std::string,Bitu>	shortNames;
+		std::unordered_map<std::string,Bitu>	longNames;
+		// last ~N used for names starting with these (up to 8) characters
+		std::unordered_map<std::string,Bitu>	aliasNumbers;
 	};
 
 private:
@@ -203,14 +218,18 @@ private:
 	bool		RemoveTrailingDot	(char* shortname);
 	Bits		GetLongName		(CFileInfo* info, char* shortname);
 	void		CreateShortName		(CFileInfo* dir, CFileInfo* info);
-	Bitu		CreateShortNameID	(CFileInfo* dir, const char* name);
-	int		CompareShortname	(const char* compareName, const char* shortName);
 	bool		SetResult		(CFileInfo* dir, char * &result, Bitu entryNr);
 	bool		IsCachedIn		(CFileInfo* dir);
 	CFileInfo*	FindDirInfo		(const char* path, char* expandedPath);
 	bool		RemoveSpaces		(char* str);
 	bool		OpenDir			(CFileInfo* dir, const char* path, Bit16u& id);
 	void		CreateEntry		(CFileInfo* dir, const char* name, bool query_directory);
+	void		AppendEntry		(CFileInfo* dir, CFileInfo* info);
+	bool		LoadFromIndex		(CFileInfo* dir, const char* path, Bit64u mtime, Bit32u mtime_ns);
+	void		StoreInIndex		(CFileInfo* dir, const char* path, Bit64u mtime, Bit32u mtime_ns);
+	void		CacheOutDir		(CFileInfo* dir);
+	void		WatchDir		(CFileInfo* dir, const char* path);
+	void		PollWatches		(void);
 	void		CopyEntry		(CFileInfo* dir, CFileInfo* from);
 	Bit16u		GetFreeID		(CFileInfo* dir);
 	void		Clear			(void);
@@ -233,6 +252,9 @@ private:
 
 	char		label				[CROSS_LEN];
 	bool		updatelabel;
+
+	int		watchFd;
+	std::map<int,CFileInfo*>	watches;
 };
 
 class DOS_Drive {
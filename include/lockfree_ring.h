@@ -0,0 +1,146 @@
+/*
+ *  Copyright (C) 2002-2015  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef DOSBOX_LOCKFREE_RING_H
+#define DOSBOX_LOCKFREE_RING_H
+
+#include <atomic>
+#include "SDL.h"
+#include "SDL_thread.h"
+
+/* Ring buffer between one producer thread and one consumer thread. Items are
+   filled and read in place, size has to be a power of two. */
+template <class T,Bitu size> class LockFreeRing {
+public:
+	LockFreeRing() : head(0), tail(0) {}
+
+	/* Producer: item to fill in, NULL when the ring is full */
+	T * WriteSlot(void) {
+		Bitu h=head.load(std::memory_order_relaxed);
+		if (h-tail.load(std::memory_order_acquire)>=size) return NULL;
+		return &items[h & (size-1)];
+	}
+	/* Producer: make the item from WriteSlot visible to the consumer */
+	void Push(void) {
+		head.store(head.load(std::memory_order_relaxed)+1,std::memory_order_seq_cst);
+	}
+
+	/* Consumer: oldest item, NULL when the ring is empty */
+	T * ReadSlot(void) {
+		Bitu t=tail.load(std::memory_order_relaxed);
+		if (head.load(std::memory_order_acquire)==t) return NULL;
+		return &items[t & (size-1)];
+	}
+	/* Consumer: hand the item from ReadSlot back to the producer */
+	void Pop(void) {
+		tail.store(tail.load(std::memory_order_relaxed)+1,std::memory_order_seq_cst);
+	}
+
+	Bitu Used(void) const {
+		return head.load(std::memory_order_acquire)-tail.load(std::memory_order_acquire);
+	}
+	/* Only when neither side is using the ring */
+	void Reset(void) {
+		head.store(0);
+		tail.store(0);
+	}
+private:
+	T items[size];
+	std::atomic<Bitu> head,tail;
+};
+
+/* Triple buffer between one producer thread and one consumer thread. Only
+   the numbers of the three buffers change hands: the producer fills one, the
+   consumer reads one and the third holds the newest finished one, which the
+   producer replaces when it finishes another. */
+class LockFreeTriple {
+public:
+	LockFreeTriple() { Reset(); }
+
+	/* Producer: buffer to fill */
+	Bitu Back(void) const {
+		return back;
+	}
+	/* Producer: hand the filled buffer over and get another one to fill. True
+	   when the one it replaced was never taken by the consumer. */
+	bool Publish(void) {
+		Bitu old=ready.exchange(back|FRESH,std::memory_order_acq_rel);
+		back=old & ~(Bitu)FRESH;
+		return (old & FRESH)!=0;
+	}
+
+	/* Consumer: buffer taken last */
+	Bitu Front(void) const {
+		return front;
+	}
+	/* Consumer: take the newest finished buffer, false when there is none */
+	bool Take(void) {
+		/* Only the consumer clears FRESH, so it is still there for the exchange */
+		if (!(ready.load(std::memory_order_acquire) & FRESH)) return false;
+		front=ready.exchange(front,std::memory_order_acq_rel) & ~(Bitu)FRESH;
+		return true;
+	}
+
+	/* Only when neither side is using the buffers */
+	void Reset(void) {
+		back=0;
+		front=2;
+		ready.store(1);
+	}
+private:
+	enum { FRESH=4 };				//The ready buffer wasn't taken yet
+	Bitu back,front;				//Each belongs to one side
+	std::atomic<Bitu> ready;
+};
+
+/* Lets one side of a ring sleep until the other side made progress. The
+   sleeping side calls Prepare(), checks again and then either Wait() or
+   Cancel(), the other side calls Notify() after each change to the ring. */
+class RingSignal {
+public:
+	RingSignal() : sem(NULL), waiting(false) {}
+
+	void Open(void) {
+		if (!sem) sem=SDL_CreateSemaphore(0);
+		waiting.store(false);
+	}
+	void Close(void) {
+		if (sem) SDL_DestroySemaphore(sem);
+		sem=NULL;
+	}
+
+	void Prepare(void) {
+		waiting.store(true,std::memory_order_seq_cst);
+	}
+	void Wait(void) {
+		SDL_SemWait(sem);
+	}
+	void Cancel(void) {
+		/* A Notify() that already took the flag posts the semaphore, eat it */
+		if (!waiting.exchange(false)) SDL_SemWait(sem);
+	}
+	void Notify(void) {
+		if (waiting.load(std::memory_order_seq_cst) && waiting.exchange(false))
+			SDL_SemPost(sem);
+	}
+private:
+	SDL_sem * sem;
+	std::atomic<bool> waiting;
+};
+
+#endif
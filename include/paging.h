@@ -28,9 +28,11 @@
 #include "mem.h"
 #endif
 
-// disable this to reduce the size of the TLB
-// NOTE: does not work with the dynamic core (dynrec is fine)
+// the dynamic core on 32-bit x86 hosts reads paging.tlb directly and needs the full TLB,
+// everywhere else the smaller TLB is used (dynrec is fine)
+#if (C_DYNAMIC_X86) && (defined(__i386__) || defined(_M_IX86))
 #define USE_FULL_TLB
+#endif
 
 class PageHandler;
 class MEM_CalloutObject;
@@ -65,13 +67,13 @@ static inline const Bitu MEMMASK_Combine(const Bitu a,const Bitu b) {
 #define MEM_PAGE_SIZE	(4096)
 #define XMS_START		(0x110)
 
-#if defined(USE_FULL_TLB)
 #define TLB_SIZE		(1024*1024)
-#else
-#define TLB_SIZE		65536	// This must a power of 2 and greater then LINK_START
-#define BANK_SHIFT		28
-#define BANK_MASK		0xffff // always the same as TLB_SIZE-1?
-#define TLB_BANKS		((1024*1024/TLB_SIZE)-1)
+#if !defined(USE_FULL_TLB)
+/* The compact TLB is split into banks of one page table (4MB) each, which are
+   only allocated once a page in them gets linked */
+#define TLB_BANK_SHIFT	10
+#define TLB_BANK_SIZE	(1 << TLB_BANK_SHIFT)
+#define TLB_BANKS		(TLB_SIZE >> TLB_BANK_SHIFT)
 #endif
 
 #define PFLAG_READABLE		0x1
@@ -280,8 +282,12 @@ struct PagingBlock {
 		Bit32u	phys_page[TLB_SIZE];
 	} tlb;
 #else
-	tlb_entry tlbh[TLB_SIZE];
-	tlb_entry *tlbh_banks[TLB_BANKS];
+	tlb_entry *tlbh_banks[TLB_BANKS];	// Banks that are not allocated point to a shared bank of unlinked entries
+	struct {
+		Bitu banks;						// Allocated banks
+		Bitu peak;
+		Bit32u links[TLB_BANKS];		// Pages linked in each bank
+	} tlb_stats;
 #endif
 	struct {
 		Bitu used;
@@ -347,17 +353,8 @@ static INLINE PhysPt PAGING_GetPhysicalAddress(PhysPt linAddr) {
 
 #else
 
-void PAGING_InitTLBBank(tlb_entry **bank);
-
 static INLINE tlb_entry *get_tlb_entry(PhysPt address) {
-	Bitu index=(address>>12);
-	if (TLB_BANKS && (index > TLB_SIZE)) {
-		Bitu bank=(address>>BANK_SHIFT) - 1;
-		if (!paging.tlbh_banks[bank])
-			PAGING_InitTLBBank(&paging.tlbh_banks[bank]);
-		return &paging.tlbh_banks[bank][index & BANK_MASK];
-	}
-	return &paging.tlbh[index];
+	return &paging.tlbh_banks[address>>(12+TLB_BANK_SHIFT)][(address>>12)&(TLB_BANK_SIZE-1)];
 }
 
 static INLINE HostPt get_tlb_read(PhysPt address) {
@@ -385,6 +382,22 @@ static INLINE PhysPt PAGING_GetPhysicalAddress(PhysPt linAddr) {
 }
 #endif
 
+/* Block access: host pointer to the memory at address when its page is plain
+   memory, valid up to the end of that page. NULL when the page has to go through
+   its handler (not linked yet, MMIO, VGA, code pages, read-only) */
+static INLINE HostPt mem_span_read(PhysPt address) {
+	HostPt tlb_addr=get_tlb_read(address);
+	return tlb_addr ? tlb_addr+address : NULL;
+}
+static INLINE HostPt mem_span_write(PhysPt address) {
+	HostPt tlb_addr=get_tlb_write(address);
+	return tlb_addr ? tlb_addr+address : NULL;
+}
+/* Bytes from address up to the end of its page */
+static INLINE Bitu mem_span_size(PhysPt address) {
+	return MEM_PAGE_SIZE-(address&(MEM_PAGE_SIZE-1));
+}
+
 /* Special inlined memory reading/writing */
 
 static INLINE Bit8u mem_readb_inline(PhysPt address) {
@@ -25,6 +25,7 @@
 #include <fstream>
 #include <iomanip>
 #include <stdint.h>
+#include <vector>
 #include "config.h"
 #include "bios_disk.h"
 
@@ -59,9 +60,27 @@ public:
 	Bit8u read_sector(Bit32u sectnum, Bit8u* data);
 
 	Bit8u write_sector(Bit32u sectnum, Bit8u* data);
+
+	Bit8u read_sectors(Bit32u sectnum, Bit32u count, Bit8u* data);
+
+	Bit8u write_sectors(Bit32u sectnum, Bit32u count, Bit8u* data);
+
+	Bit8u flush_metadata();
+
+	static void flush_all();
 	
 private:
 
+	/* An L2 table or refcount block, kept until it is the least recently used */
+	struct CachedTable {
+		Bit64u offset;
+		Bit64u last_use;
+		bool refcount_block;
+		bool dirty;
+		std::vector<Bit8u> data;
+	};
+	static const Bitu table_cache_size;
+
 	FILE* file;
 	QCow2Header header;
 	static const Bit64u copy_flag;
@@ -77,6 +96,13 @@ private:
 	Bit64u refcount_mask;
 	Bit64u refcount_bits;
 	QCow2Image* backing_image;
+	std::vector<CachedTable> table_cache;
+	Bit64u table_cache_clock;
+	std::vector<Bit64u> l1_table;
+	std::vector<Bit64u> refcount_table;
+	std::vector<Bit8u> cluster_buffer;
+	bool l1_dirty;
+	bool metadata_dirty;
 
 	static Bit16u host_read16(Bit16u buffer);
 
@@ -86,6 +112,16 @@ private:
 
 	static Bit64u mask64(Bit64u bits);
 	
+	Bit8u allocate_cluster(Bit64u& cluster_offset, Bit8u* data);
+
+	Bit8u get_table(Bit64u table_offset, bool refcount_block, bool fresh, Bit8u*& table);
+
+	void load_tables();
+
+	Bit8u lookup_cluster(Bit64u address, Bit64u& data_cluster_offset);
+
+	void mark_dirty(Bit8u* table);
+
 	Bit8u pad_file(Bit64u& new_file_length);
 
 	Bit8u read_allocated_data(Bit64u file_offset, Bit8u* data, Bit64u data_size);
@@ -98,13 +134,13 @@ private:
 
 	Bit8u read_refcount_table(Bit64u data_cluster_offset, Bit64u& refcount_cluster_offset);
 
-	Bit8u read_table(Bit64u entry_offset, Bit64u entry_mask, Bit64u& entry_value);
-
 	Bit8u read_unallocated_cluster(Bit64u data_cluster_number, Bit8u* data);
 
-	Bit8u read_unallocated_sector(Bit32u sectnum, Bit8u* data);
+	Bit8u read_unallocated_sectors(Bit32u sectnum, Bit32u count, Bit8u* data);
 
-	Bit8u update_reference_count(Bit64u cluster_offset, Bit8u* cluster_buffer);
+	Bit8u sync_file();
+
+	Bit8u update_reference_count(Bit64u cluster_offset);
 
 	Bit8u write_data(Bit64u file_offset, Bit8u* data, Bit64u data_size);
 
@@ -131,6 +167,10 @@ public:
 
 	virtual Bit8u Write_AbsoluteSector(Bit32u sectnum, void* data);
 
+	virtual Bit8u Read_Sectors(Bit32u sectnum, Bit32u count, void* data);
+
+	virtual Bit8u Write_Sectors(Bit32u sectnum, Bit32u count, void* data);
+
 private:
 
 	QCow2Image qcowImage;
@@ -29,7 +29,8 @@
 
 #define RENDER_SKIP_CACHE	16
 //Enable this for scalers to support 0 input for empty lines
-//#define RENDER_NULL_INPUT
+//The VGA emulation leaves out lines it knows to be unchanged this way
+#define RENDER_NULL_INPUT
 
 typedef struct {
 	struct { 
@@ -77,10 +78,8 @@ typedef struct {
 		ScalerComplexHandler_t complexHandler;
 		Bitu blocks, lastBlock;
 		Bitu outPitch;
-		Bit8u *outWrite;
 		Bitu cachePitch;
-		Bit8u *cacheRead;
-		Bitu inHeight, inLine, outLine;
+		Bitu inHeight;
 	} scale;
 	RenderPal_t pal;
 	bool updating;
@@ -89,6 +88,7 @@ typedef struct {
 	bool fullFrame;
 	bool forceUpdate;
 	bool autofit;
+	bool headless;
 } Render_t;
 
 extern Render_t render;
@@ -96,6 +96,7 @@ extern ScalerLineHandler_t RENDER_DrawLine;
 void RENDER_SetSize(Bitu width,Bitu height,Bitu bpp,float fps,double scrn_ratio);
 bool RENDER_StartUpdate(void);
 void RENDER_EndUpdate(bool abort);
+void RENDER_PresentFrame(void);
 void RENDER_SetPal(Bit8u entry,Bit8u red,Bit8u green,Bit8u blue);
 
 
@@ -391,14 +391,16 @@ typedef struct {
 	Bit8u* linear_orgptr;
 } VGA_Memory;
 
+#define VGA_CHANGE_SHIFT	9
+
 typedef struct {
-	//Add a few more just to be safe
-	Bit8u*	map; /* allocated dynamically: [(VGA_MEMORY >> VGA_CHANGE_SHIFT) + 32] */
-	Bit8u	checkMask, frame, writeMask;
-	bool	active;
-	Bit32u  clearMask;
-	Bit32u	start, last;
-	Bit32u	lastAddress;
+	Bit32u*	map;		/* Frame in which each (1 << VGA_CHANGE_SHIFT) byte block of video memory was last written */
+	Bitu	blocks;
+	Bit32u	frame;		/* Counts the frames handed to the renderer */
+	Bit32u	generation;	/* Changes when anything but video memory changes the picture */
+	bool	enabled;
+	bool	trap_direct;	/* Also trap writes to the direct mapped memory and the LFB */
+	bool	active;		/* Every write to video memory in the current mode ends up in the map */
 } VGA_Changes;
 
 typedef struct {
@@ -433,6 +435,7 @@ typedef struct {
 	Bit32u vmemsize;
     Bit32u vmemsize_alloced;
 	VGA_LFB lfb;
+	VGA_Changes changes;
 } VGA_Type;
 
 
@@ -486,6 +489,16 @@ void VGA_SetOverride(bool vga_override);
 
 extern VGA_Type vga;
 
+/* Video memory at linear offset addr was written to */
+static INLINE void VGA_MarkChanged(Bitu addr) {
+	vga.changes.map[addr >> VGA_CHANGE_SHIFT] = vga.changes.frame;
+}
+
+/* Something besides video memory changed the picture, draw all lines again */
+static INLINE void VGA_InvalidateChanges(void) {
+	vga.changes.generation++;
+}
+
 /* Support for modular SVGA implementation */
 /* Video mode extra data to be passed to FinishSetMode_SVGA().
    This structure will be in flux until all drivers (including S3)
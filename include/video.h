@@ -53,6 +53,7 @@ struct GFX_PalEntry {
 #define GFX_HARDWARE	0x2000
 
 #define GFX_CAN_RANDOM	0x4000		//If the interface can also do random access surface
+#define GFX_HEADLESS	0x8000		//Nothing is shown, frames are only drawn for the capture code
 
 void GFX_Events(void);
 void GFX_SetPalette(Bitu start,Bitu count,GFX_PalEntry * entries);
@@ -60,6 +60,18 @@
 #define DYN_PAGE_HASH	(4096>>DYN_HASH_SHIFT)
 #define DYN_LINKS		(16)
 
+// target cpus that have a code generator, these match the values of C_TARGETCPU
+#define X86			0x01
+#define X86_64		0x02
+
+#if C_TARGETCPU == X86_64
+// generated code addresses the host variables rip-relative, keep the code cache within their reach
+#define CACHE_STATIC_CODE
+#endif
+
+// the tiers the blocks of a code page ended up in can be kept in a file, see core_dyn_x86/persist.h
+#define CACHE_PERSIST
+
 //#define DYN_LOG 1 //Turn logging on
 
 
@@ -118,7 +130,15 @@ enum BlockReturn {
 #endif
 	BR_Iret,
 	BR_CallBack,
-	BR_SMCBlock
+	BR_SMCBlock,
+	BR_SegGuard,
+	BR_Hot
+};
+
+enum BlockTier {
+	TIER_BASE=0,		//Plain translation, counting down to the hot tier
+	TIER_HOT,			//Retranslated with dead flags left out and the segment bases folded in
+	TIER_HOT_PLAIN		//Retranslated with dead flags left out, no segment bases folded
 };
 
 #define SMC_CURRENT_BLOCK	0xffff
@@ -178,7 +198,11 @@ static struct {
 } dyn_dh_fpu;
 
 
+#if C_TARGETCPU == X86_64
+#include "core_dyn_x86/risc_x64.h"
+#else
 #include "core_dyn_x86/risc_x86.h"
+#endif
 
 struct DynState {
 	DynReg regs[G_MAX];
@@ -231,6 +255,9 @@ static void dyn_restoreregister(DynReg * src_reg, DynReg * dst_reg) {
 	dst_reg->genreg->dynreg=dst_reg;	// necessary when register has been released
 }
 
+extern int dynamic_core_cache_block_size;
+extern int dynamic_core_hot_threshold;
+
 #include "core_dyn_x86/decoder.h"
 
 #if defined (_MSC_VER)
@@ -256,7 +283,7 @@ static void dyn_restoreregister(DynReg * src_reg, DynReg * dst_reg) {
 }
 #endif
 
-extern int dynamic_core_cache_block_size;
+#include "core_dyn_x86/persist.h"
 
 Bits CPU_Core_Dyn_X86_Run(void) {
 	/* Determine the linear address of CS:EIP */
@@ -281,6 +308,7 @@ restart_core:
 	if (!block) {
 		if (!chandler->invalidation_map || (chandler->invalidation_map[ip_point&4095]<4)) {
 			block=CreateCacheBlock(chandler,ip_point,dynamic_core_cache_block_size);
+			if (GCC_UNLIKELY(chandler->persist_hashed)) persist_seed(chandler,block);
 		} else {
 			Bitu old_cycles=CPU_Cycles;
 			CPU_Cycles=1;
@@ -357,6 +385,27 @@ run_block:
 		if (dyn_dh_fpu.state_used) DH_FPU_SAVE_REINIT
 		return CPU_Core_Full_Run();
 #endif
+	case BR_SegGuard:
+		/* A folded segment base changed, go back to a plain translation */
+		{
+			CodePageHandler * temp_handler=cache.block.running->page.handler;
+			cache.block.running->Clear();
+			block=CreateCacheBlock(temp_handler,SegPhys(cs)+reg_eip,dynamic_core_cache_block_size,TIER_HOT_PLAIN);
+		}
+		goto run_block;
+	case BR_Hot:
+		/* The block used up its countdown on entry, wherever it was entered from.
+		   Clearing it sends the blocks linked to it back here, so they link to
+		   the new translation. */
+		{
+			CacheBlock * hot_block=cache.block.running;
+			CodePageHandler * temp_handler=hot_block->page.handler;
+			Bitu fold_segs=hot_block->hot.segs;
+			hot_block->Clear();
+			block=CreateCacheBlock(temp_handler,SegPhys(cs)+reg_eip,dynamic_core_cache_block_size,
+				fold_segs ? TIER_HOT : TIER_HOT_PLAIN,fold_segs);
+		}
+		goto run_block;
 	case BR_Link1:
 	case BR_Link2:
 		{
@@ -480,20 +529,65 @@ void CPU_Core_Dyn_X86_Init(void) {
 void CPU_Core_Dyn_X86_Cache_Init(bool enable_cache) {
 	/* Initialize code cache and dynamic blocks */
 	cache_init(enable_cache);
+	if (!enable_cache) cache_release_pages();
+#if C_TARGETCPU == X86_64
+	gen_init_runcode();
+#endif
 }
 
 void CPU_Core_Dyn_X86_Cache_Close(void) {
 	cache_close();
+	persist_save();
 }
 
 void CPU_Core_Dyn_X86_Cache_Reset(void) {
 	cache_reset();
+#if C_TARGETCPU == X86_64
+	gen_init_runcode();
+#endif
 }
 
 void CPU_Core_Dyn_X86_SetFPUMode(bool dh_fpu) {
 	dyn_dh_fpu.dh_fpu_enabled=dh_fpu;
 }
 
+void CPU_Core_Dyn_X86_SetTierHintCache(const char * filename) {
+	if (persist.filename==filename) return;
+	persist.filename=filename;
+	if (!persist.filename.empty()) persist_load();
+}
+
+#if C_DEBUG
+/* List the most executed blocks of the code cache in the debugger */
+void CPU_Core_Dyn_X86_LogHotBlocks(Bitu count) {
+	static const char * tier_names[3]={"base","hot","hot (plain)"};
+	CacheBlock * list[64];
+	Bitu used=0;
+	if (!count || count>64) count=64;
+	for (CacheBlock * block=cache.block.first;block;block=block->cache.next) {
+		if (!block->page.handler) continue;
+		Bitu pos=used;
+		while (pos>0 && list[pos-1]->hot.count<block->hot.count) {
+			if (pos<count) list[pos]=list[pos-1];
+			pos--;
+		}
+		if (pos<count) {
+			list[pos]=block;
+			if (used<count) used++;
+		}
+	}
+	DEBUG_ShowMsg("Dynamic core blocks by execution count:\n");
+	DEBUG_ShowMsg("Phys.Addr      Count  Bytes  Tier\n");
+	for (Bitu i=0;i<used;i++) {
+		CacheBlock * block=list[i];
+		DEBUG_ShowMsg("%08X %10u %6u  %s\n",
+			(unsigned int)((block->page.handler->GetPhysPage() << 12)+block->page.start),
+			(unsigned int)block->hot.count,(unsigned int)block->cache.size,
+			tier_names[block->hot.tier]);
+	}
+}
+#endif
+
 Bit32u fpu_state[32];
 
 void CPU_Core_Dyn_X86_SaveDHFPUState(void) {
@@ -17,6 +17,13 @@
  */
 
 
+#if defined (CACHE_PERSIST)
+class CacheBlock;
+static void persist_setup(CodePageHandler * cph);
+static void persist_record(CodePageHandler * cph,CacheBlock * block);
+static void persist_translated(CacheBlock * block);
+#endif
+
 class CacheBlock {
 public:
 	void Clear(void);
@@ -29,6 +36,8 @@ public:
 	struct {
 		Bit16u start,end;				//Where the page is the original code
 		CodePageHandler * handler;		//Page containing this code
+		bool big;						//Translated for a 32bit code segment
+		Bit32u check;					//Checksum of the translated code
 	} page;
 	struct {
 		Bit8u * start;					//Where in the cache are we
@@ -47,6 +56,12 @@ public:
 		CacheBlock * next;
 		CacheBlock * from;
 	} link[2];
+	struct {
+		Bit32u count;					//Times the block was entered
+		Bit32u left;					//Entries until a base block exits to be retranslated
+		Bit8u tier;						//BlockTier of this translation
+		Bit8u segs;						//Segment bases added to addresses, ES=bit 0
+	} hot;
 	CacheBlock * crossblock;
 };
 
@@ -69,6 +84,9 @@ class CodePageHandler : public PageHandler {
 public:
 	CodePageHandler() : PageHandler(0) {
 		invalidation_map=NULL;
+#if defined (CACHE_PERSIST)
+		persist_hashed=false;
+#endif
 	}
 
 	void SetupAt(Bitu _phys_page,PageHandler * _old_pagehandler) {
@@ -85,6 +103,9 @@ public:
 			free(invalidation_map);
 			invalidation_map=NULL;
 		}
+#if defined (CACHE_PERSIST)
+		persist_setup(this);
+#endif
 	}
 	bool InvalidateRange(Bitu start,Bitu end) {
 		Bits index=1+(end>>DYN_HASH_SHIFT);
@@ -299,7 +320,17 @@ public:
 		cache.free_pages=this;
 		prev=0;
 	}
+#if defined (CACHE_PERSIST)
+	void RecordBlocks(void) {
+		for (Bitu index=1;index<(1+DYN_PAGE_HASH);index++) {
+			for (CacheBlock * block=hash_map[index];block;block=block->hash.next) persist_record(this,block);
+		}
+	}
+#endif
 	void ClearRelease(void) {
+#if defined (CACHE_PERSIST)
+		RecordBlocks();
+#endif
 		for (Bitu index=0;index<(1+DYN_PAGE_HASH);index++) {
 			CacheBlock * block=hash_map[index];
 			while (block) {
@@ -326,10 +357,17 @@ public:
 	HostPt GetHostWritePt(Bitu phys_page) { 
 		return GetHostReadPt( phys_page );
 	}
+	Bitu GetPhysPage(void) {
+		return phys_page;
+	}
 public:
 	Bit8u write_map[4096];
 	Bit8u * invalidation_map;
 	CodePageHandler * next, * prev;
+#if defined (CACHE_PERSIST)
+	Bit64u persist_hash;				//Contents of the page when it became a code page
+	bool persist_hashed;
+#endif
 private:
 	PageHandler * old_pagehandler;
 	CacheBlock * hash_map[1+DYN_PAGE_HASH];
@@ -483,6 +521,12 @@ static CacheBlock * cache_blocks=NULL;
 #define PAGESIZE_TEMP 4096
 #endif
 
+#if defined (CACHE_STATIC_CODE)
+/* code cache in the data segment, used when the generated code has to reach
+   the static variables with 32bit displacements */
+static Bit8u cache_code_static[CACHE_TOTAL+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP];
+#endif
+
 static bool cache_initialized = false;
 
 static void cache_init(bool enable) {
@@ -502,7 +546,9 @@ static void cache_init(bool enable) {
 			}
 		}
 		if (cache_code_start_ptr==NULL) {
-#if defined (WIN32)
+#if defined (CACHE_STATIC_CODE)
+			cache_code_start_ptr=cache_code_static;
+#elif defined (WIN32)
 			cache_code_start_ptr=(Bit8u*)VirtualAlloc(0,CACHE_TOTAL+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP,
 				MEM_COMMIT,PAGE_EXECUTE_READWRITE);
 			if (!cache_code_start_ptr)
@@ -520,6 +566,10 @@ static void cache_init(bool enable) {
 #if (C_HAVE_MPROTECT)
 			if(mprotect(cache_code_link_blocks,CACHE_TOTAL+CACHE_MAXSIZE+PAGESIZE_TEMP,PROT_WRITE|PROT_READ|PROT_EXEC))
 				LOG_MSG("Setting excute permission on the code cache has failed!");
+#elif defined (CACHE_STATIC_CODE) && defined (WIN32)
+			DWORD old_protect;
+			if(!VirtualProtect(cache_code_link_blocks,CACHE_TOTAL+CACHE_MAXSIZE+PAGESIZE_TEMP,PAGE_EXECUTE_READWRITE,&old_protect))
+				LOG_MSG("Setting excute permission on the code cache has failed!");
 #endif
 			CacheBlock * block=cache_getblock();
 			cache.block.first=block;
@@ -548,6 +598,9 @@ static void cache_init(bool enable) {
 }
 
 static void cache_close(void) {
+#if defined (CACHE_PERSIST)
+	for (CodePageHandler * cpage=cache.used_pages;cpage;cpage=cpage->next) cpage->RecordBlocks();
+#endif
 /*	for (;;) {
 		if (cache.used_pages) {
 			CodePageHandler * cpage=cache.used_pages;
@@ -572,6 +625,13 @@ static void cache_close(void) {
 	cache_initialized = false; */
 }
 
+/* Give the pages back to their old handlers, with both dynamic cores compiled in
+   the other one must not find code pages of this one */
+static void cache_release_pages(void) {
+	while (cache.used_pages) cache.used_pages->ClearRelease();
+	cache.block.running=0;
+}
+
 static void cache_reset(void) {
 	if (cache_initialized) {
 		for (;;) {
@@ -597,7 +657,9 @@ static void cache_reset(void) {
 		}
 
 		if (cache_code_start_ptr==NULL) {
-#if defined (WIN32)
+#if defined (CACHE_STATIC_CODE)
+			cache_code_start_ptr=cache_code_static;
+#elif defined (WIN32)
 			cache_code_start_ptr=(Bit8u*)VirtualAlloc(0,CACHE_TOTAL+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP,
 				MEM_COMMIT,PAGE_EXECUTE_READWRITE);
 			if (!cache_code_start_ptr)
@@ -615,6 +677,10 @@ static void cache_reset(void) {
 #if (C_HAVE_MPROTECT)
 			if(mprotect(cache_code_link_blocks,CACHE_TOTAL+CACHE_MAXSIZE+PAGESIZE_TEMP,PROT_WRITE|PROT_READ|PROT_EXEC))
 				LOG_MSG("Setting excute permission on the code cache has failed!");
+#elif defined (CACHE_STATIC_CODE) && defined (WIN32)
+			DWORD old_protect;
+			if(!VirtualProtect(cache_code_link_blocks,CACHE_TOTAL+CACHE_MAXSIZE+PAGESIZE_TEMP,PAGE_EXECUTE_READWRITE,&old_protect))
+				LOG_MSG("Setting excute permission on the code cache has failed!");
 #endif
 		}
 
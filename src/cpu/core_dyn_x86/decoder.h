@@ -18,7 +18,10 @@
 
 
 #define X86_DYNFPU_DH_ENABLED
+#if C_TARGETCPU != X86_64
+// the inlined tlb lookup is written for 32bit host pointers
 #define X86_INLINED_MEMACCESS
+#endif
 
 #define X86_DYNREC_MMX_ENABLED
 
@@ -54,6 +57,16 @@ static struct DynDecode {
 		Bitu reg;
 	} modrm;
 	DynReg * segprefix;
+	struct {
+		Bitu used;					//Segment bases added to addresses
+		Bitu written;				//Segments loaded inside the block
+		Bitu fold;					//Segment bases taken as constants
+		Bit32u base[6];
+	} seg;
+	struct {
+		Bitu page;					//Page of the walked opcodes, hot blocks only
+		Bit32u dead[4096/32];		//Opcodes whose flags are overwritten unread
+	} flags;
 } decode;
 
 static bool MakeCodePage(Bitu lin_addr,CodePageHandler * &cph) {
@@ -247,6 +260,196 @@ static bool decode_fetchd_imm(Bitu & val) {
 	return false;
 }
 
+/* Flag liveness of hot blocks: the opcodes of the block that lie on its first
+   page are walked before translating it again, and those whose flags get
+   overwritten before anything reads them are marked. Such opcodes can leave
+   out restoring the flags they would otherwise keep. Opcodes that neither read
+   nor set all flags pass on whether they are live. An opcode that is not
+   known here ends the walk, the flags are live from there on. */
+#define FLW_MAX_OPCODES	128
+
+enum {
+	FLW_READ=1,				//Uses the flags it finds or can fault with them
+	FLW_WRITE=2,			//Sets all the arithmetic flags
+	FLW_FAULT=4				//Can fault after changing the flags
+};
+
+static bool dyn_flags_fetch(PhysPt & pos,Bit8u & val) {
+	if ((pos >> 12)!=decode.flags.page) return false;
+	if (decode.page.invmap && decode.page.invmap[pos & 4095]>=4) return false;
+	val=mem_readb(pos++);
+	return true;
+}
+
+static void dyn_flags_liveness(PhysPt start,Bitu max_opcodes) {
+	Bit16u offsets[FLW_MAX_OPCODES];
+	Bit8u effects[FLW_MAX_OPCODES];
+	Bitu count=0;
+	decode.flags.page=start >> 12;
+	memset(decode.flags.dead,0,sizeof(decode.flags.dead));
+	if (max_opcodes>FLW_MAX_OPCODES) max_opcodes=FLW_MAX_OPCODES;
+	PhysPt pos=start;
+	while (count<max_opcodes) {
+		Bitu offset=pos & 4095;
+		bool big_op=cpu.code.big,big_addr=cpu.code.big;
+		Bit8u opcode,modrm=0;
+		for (;;) {
+			if (!dyn_flags_fetch(pos,opcode)) goto walked;
+			if (opcode==0x66) big_op=!cpu.code.big;
+			else if (opcode==0x67) big_addr=!cpu.code.big;
+			else if (opcode!=0x26 && opcode!=0x2e && opcode!=0x36 && opcode!=0x3e &&
+				opcode!=0x64 && opcode!=0x65) break;
+		}
+		Bitu effect=0,imm=0;
+		bool has_modrm=false,memory=false,shift_imm=false;
+		if (opcode<0x40 && (opcode&7)<6) {
+			/* ADD OR ADC SBB AND SUB XOR CMP, ADC and SBB use the carry */
+			effect=((opcode>>3)==2 || (opcode>>3)==3) ? FLW_READ : FLW_WRITE;
+			switch (opcode&7) {
+			case 4:imm=1;break;
+			case 5:imm=big_op ? 4 : 2;break;
+			default:has_modrm=true;break;
+			}
+		} else if (opcode>=0x40 && opcode<0x50) {
+			/* INC/DEC keep the carry */
+		} else if (opcode>=0x50 && opcode<0x60) {
+			memory=true;
+		} else if (opcode>=0x90 && opcode<0x9a) {
+			/* XCHG, CBW and CWD leave the flags alone */
+		} else if (opcode>=0xb0 && opcode<0xc0) {
+			imm=(opcode<0xb8) ? 1 : (big_op ? 4 : 2);
+		} else switch (opcode) {
+		case 0x69:case 0x6b:			//IMUL
+			has_modrm=true;
+			imm=(opcode==0x6b) ? 1 : (big_op ? 4 : 2);
+			break;
+		case 0x80:case 0x81:case 0x83:	//GRP1
+			has_modrm=true;
+			imm=(opcode==0x81) ? (big_op ? 4 : 2) : 1;
+			break;
+		case 0x84:case 0x85:			//TEST
+			has_modrm=true;
+			effect=FLW_WRITE;
+			break;
+		case 0x86:case 0x87:case 0x88:case 0x89:case 0x8a:case 0x8b:case 0x8d:
+			has_modrm=true;
+			break;
+		case 0xa0:case 0xa1:case 0xa2:case 0xa3:
+			imm=big_addr ? 4 : 2;
+			memory=true;
+			break;
+		case 0xa8:case 0xa9:			//TEST
+			imm=(opcode==0xa8) ? 1 : (big_op ? 4 : 2);
+			effect=FLW_WRITE;
+			break;
+		case 0xc6:case 0xc7:
+			has_modrm=true;
+			imm=(opcode==0xc6) ? 1 : (big_op ? 4 : 2);
+			break;
+		case 0xc0:case 0xc1:
+			has_modrm=true;
+			imm=1;
+			break;
+		case 0xd0:case 0xd1:case 0xd2:case 0xd3:case 0xf6:case 0xf7:case 0xfe:case 0xff:
+			has_modrm=true;
+			break;
+		default:
+			goto walked;
+		}
+		if (has_modrm) {
+			if (!dyn_flags_fetch(pos,modrm)) goto walked;
+			Bitu reg=(modrm >> 3) & 7;
+			switch (opcode) {
+			case 0x80:case 0x81:case 0x83:
+				effect=(reg==2 || reg==3) ? FLW_READ : FLW_WRITE;
+				break;
+			case 0xd0:case 0xd1:		//Shifts by 1 set all, RCL/RCR use the carry
+				if (reg>=4) effect=FLW_WRITE;
+				else if (reg>=2) effect=FLW_READ;
+				break;
+			case 0xd2:case 0xd3:		//A count of 0 keeps them all
+				if (reg==2 || reg==3) effect=FLW_READ;
+				break;
+			case 0xc0:case 0xc1:
+				if (reg==2 || reg==3) effect=FLW_READ;
+				else if (reg>=4) shift_imm=true;
+				break;
+			case 0xf6:case 0xf7:
+				switch (reg) {
+				case 0:imm=(opcode==0xf6) ? 1 : (big_op ? 4 : 2);effect=FLW_WRITE;break;
+				case 3:effect=FLW_WRITE;break;
+				case 2:case 4:case 5:break;
+				default:goto walked;	//DIV can fault, TEST alias not handled
+				}
+				break;
+			case 0xfe:case 0xff:
+				if (reg>1) goto walked;
+				break;
+			}
+			Bitu mod=modrm >> 6,rm=modrm & 7;
+			if (mod<3) {
+				if (opcode!=0x8d) memory=true;
+				if (big_addr) {
+					if (rm==4) {
+						Bit8u sib;
+						if (!dyn_flags_fetch(pos,sib)) goto walked;
+						if (mod==0 && (sib & 7)==5) pos+=4;
+					} else if (mod==0 && rm==5) pos+=4;
+					if (mod==1) pos+=1;
+					else if (mod==2) pos+=4;
+				} else {
+					if (mod==0 && rm==6) pos+=2;
+					else if (mod==1) pos+=1;
+					else if (mod==2) pos+=2;
+				}
+			}
+		}
+		if (shift_imm) {
+			Bit8u count_imm;
+			if (!dyn_flags_fetch(pos,count_imm)) goto walked;
+			/* A count that gets written to is read at run time and can be 0 */
+			bool patched=decode.page.invmap && decode.page.invmap[(pos-1) & 4095];
+			if ((count_imm & 0x1f) && !patched) effect=FLW_WRITE;
+		} else pos+=imm;
+		if (((pos-1) >> 12)!=decode.flags.page) break;
+		/* A page fault or a write to this block's code restarts the opcode with
+		   the flags it found */
+		if (memory) effect|=FLW_READ|FLW_FAULT;
+		offsets[count]=(Bit16u)offset;
+		effects[count]=(Bit8u)effect;
+		count++;
+	}
+walked:
+	bool live=true;
+	while (count--) {
+		if (!live && !(effects[count] & FLW_FAULT)) decode.flags.dead[offsets[count] >> 5]|=1u << (offsets[count] & 31);
+		live=(effects[count] & FLW_READ) || (!(effects[count] & FLW_WRITE) && live);
+	}
+}
+
+static bool dyn_flags_dead(void) {
+	if ((decode.op_start >> 12)!=decode.flags.page) return false;
+	Bitu offset=decode.op_start & 4095;
+	return (decode.flags.dead[offset >> 5] >> (offset & 31)) & 1;
+}
+
+static void dyn_needflags(void) {
+	if (dyn_flags_dead()) gen_discardflags();
+	else gen_needflags();
+}
+
+static void dyn_needcarry(void) {
+	if (dyn_flags_dead()) gen_discardflags();
+	else gen_needcarry();
+}
+
+/* Shifts by a count that isn't 0 set all flags, the others keep some */
+static void dyn_shift_flags(bool count_set) {
+	if (decode.modrm.reg==2 || decode.modrm.reg==3) gen_needflags();	//RCL/RCR use the carry
+	else if (decode.modrm.reg<4 || !count_set) dyn_needflags();
+	else gen_discardflags();
+}
+
 
 static void dyn_reduce_cycles(void) {
 	gen_protectflags();
@@ -296,7 +499,7 @@ static INLINE void dyn_set_eip_last(void) {
 }
 
 
-enum save_info_type {db_exception, cycle_check, normal, fpu_restore};
+enum save_info_type {db_exception, cycle_check, normal, fpu_restore, seg_guard, hot_exit};
 
 
 static struct {
@@ -387,6 +590,12 @@ static void dyn_fill_blocks(void) {
 			case cycle_check:
 				gen_return(BR_Cycles);
 				break;
+			case seg_guard:
+				gen_return(BR_SegGuard);
+				break;
+			case hot_exit:
+				gen_return(BR_Hot);
+				break;
 			case normal:
 				dyn_loadstate(&save_info[sct].state);
 				gen_dop_word_imm(DOP_ADD,decode.big_op,DREG(EIP),save_info[sct].eip_change);
@@ -398,12 +607,8 @@ static void dyn_fill_blocks(void) {
 				gen_load_host(&dyn_dh_fpu.state_used,DREG(TMPB),4);
 				gen_sop_word(SOP_INC,true,DREG(TMPB));
 				gr=FindDynReg(DREG(TMPB));
-				cache_addb(0xdd);	// FRSTOR fpu.state (fpu_restore)
-				cache_addb(0x25);
-				cache_addd((Bit32u)(&(dyn_dh_fpu.state[0])));
-				cache_addb(0x89);	// mov fpu.state_used,1
-				cache_addb(0x05|(gr->index<<3));
-				cache_addd((Bit32u)(&(dyn_dh_fpu.state_used)));
+				gen_memop_host(0xdd,4,&(dyn_dh_fpu.state[0]));	// FRSTOR fpu.state (fpu_restore)
+				gen_memop_host(0x89,gr->index,&(dyn_dh_fpu.state_used));	// mov fpu.state_used,1
 				gen_releasereg(DREG(TMPB));
 				dyn_synchstate(&save_info[sct].state);
 				gen_create_jump(save_info[sct].return_pos);
@@ -417,7 +622,7 @@ static void dyn_fill_blocks(void) {
 #if !defined(X86_INLINED_MEMACCESS)
 static void dyn_read_byte(DynReg * addr,DynReg * dst,Bitu high) {
 	gen_protectflags();
-	gen_call_function((void *)&mem_readb_checked,"%Dd%Id",addr,&core_dyn.readdata);
+	gen_call_function((void *)&mem_readb_checked,"%Dd%Ip",addr,&core_dyn.readdata);
 	dyn_check_bool_exception_al();
 	gen_mov_host(&core_dyn.readdata,dst,1,high);
 }
@@ -429,8 +634,8 @@ static void dyn_write_byte(DynReg * addr,DynReg * val,Bitu high) {
 }
 static void dyn_read_word(DynReg * addr,DynReg * dst,bool dword) {
 	gen_protectflags();
-	if (dword) gen_call_function((void *)&mem_readd_checked,"%Dd%Id",addr,&core_dyn.readdata);
-	else gen_call_function((void *)&mem_readw_checked,"%Dd%Id",addr,&core_dyn.readdata);
+	if (dword) gen_call_function((void *)&mem_readd_checked,"%Dd%Ip",addr,&core_dyn.readdata);
+	else gen_call_function((void *)&mem_readw_checked,"%Dd%Ip",addr,&core_dyn.readdata);
 	dyn_check_bool_exception_al();
 	gen_mov_host(&core_dyn.readdata,dst,dword?4:2);
 }
@@ -442,7 +647,7 @@ static void dyn_write_word(DynReg * addr,DynReg * val,bool dword) {
 }
 static void dyn_read_byte_release(DynReg * addr,DynReg * dst,Bitu high) {
 	gen_protectflags();
-	gen_call_function((void *)&mem_readb_checked,"%Ddr%Id",addr,&core_dyn.readdata);
+	gen_call_function((void *)&mem_readb_checked,"%Ddr%Ip",addr,&core_dyn.readdata);
 	dyn_check_bool_exception_al();
 	gen_mov_host(&core_dyn.readdata,dst,1,high);
 }
@@ -454,8 +659,8 @@ static void dyn_write_byte_release(DynReg * addr,DynReg * val,Bitu high) {
 }
 static void dyn_read_word_release(DynReg * addr,DynReg * dst,bool dword) {
 	gen_protectflags();
-	if (dword) gen_call_function((void *)&mem_readd_checked,"%Ddr%Id",addr,&core_dyn.readdata);
-	else gen_call_function((void *)&mem_readw_checked,"%Ddr%Id",addr,&core_dyn.readdata);
+	if (dword) gen_call_function((void *)&mem_readd_checked,"%Ddr%Ip",addr,&core_dyn.readdata);
+	else gen_call_function((void *)&mem_readw_checked,"%Ddr%Ip",addr,&core_dyn.readdata);
 	dyn_check_bool_exception_al();
 	gen_mov_host(&core_dyn.readdata,dst,dword?4:2);
 }
@@ -624,7 +829,7 @@ static void dyn_read_word(DynReg * addr,DynReg * dst,bool dword) {
 		gen_fill_jump(jmp_loc);
 	} else {
 		gen_protectflags();
-		gen_call_function((void *)&mem_readw_checked,"%Dd%Id",addr,&core_dyn.readdata);
+		gen_call_function((void *)&mem_readw_checked,"%Dd%Ip",addr,&core_dyn.readdata);
 		dyn_check_bool_exception_al();
 		gen_mov_host(&core_dyn.readdata,dst,2);
 	}
@@ -670,7 +875,7 @@ static void dyn_read_word_release(DynReg * addr,DynReg * dst,bool dword) {
 		gen_fill_jump(jmp_loc);
 	} else {
 		gen_protectflags();
-		gen_call_function((void *)&mem_readw_checked,"%Ddr%Id",addr,&core_dyn.readdata);
+		gen_call_function((void *)&mem_readw_checked,"%Ddr%Ip",addr,&core_dyn.readdata);
 		dyn_check_bool_exception_al();
 		gen_mov_host(&core_dyn.readdata,dst,2);
 	}
@@ -885,13 +1090,29 @@ static void dyn_write_word_release(DynReg * addr,DynReg * val,bool dword) {
 
 #endif
 
+/* Hot blocks take the segment bases that were constant on entry as displacement */
+static bool dyn_seg_folded(DynReg * seg,Bit32u & base) {
+	Bitu index=seg-&DynRegs[G_ES];
+	decode.seg.used|=1 << index;
+	if (!(decode.seg.fold & (1 << index))) return false;
+	base=decode.seg.base[index];
+	return true;
+}
+
+static void dyn_add_segbase(DynReg * ddr,DynReg * dsr,DynReg * seg,Bits imm) {
+	Bit32u base;
+	if (dyn_seg_folded(seg,base)) gen_lea(ddr,dsr,0,0,imm+(Bit32s)base);
+	else if (dsr) gen_lea(ddr,dsr,seg,0,imm);
+	else gen_lea(ddr,seg,0,0,imm);
+}
+
 static void dyn_push_unchecked(DynReg * dynreg) {
 	gen_protectflags();
 	gen_lea(DREG(STACK),DREG(ESP),0,0,decode.big_op?(-4):(-2));
 	gen_dop_word_var(DOP_AND,true,DREG(STACK),&cpu.stack.mask);
 	gen_dop_word_var(DOP_AND,true,DREG(ESP),&cpu.stack.notmask);
 	gen_dop_word(DOP_OR,true,DREG(ESP),DREG(STACK));
-	gen_dop_word(DOP_ADD,true,DREG(STACK),DREG(SS));
+	dyn_add_segbase(DREG(STACK),DREG(STACK),DREG(SS),0);
 	if (decode.big_op) {
 		gen_call_function((void *)&mem_writed,"%Drd%Dd",DREG(STACK),dynreg);
 	} else {
@@ -907,7 +1128,7 @@ static void dyn_push(DynReg * dynreg) {
 	gen_dop_word_var(DOP_AND,true,DREG(STACK),&cpu.stack.mask);
 	gen_dop_word_var(DOP_AND,true,DREG(NEWESP),&cpu.stack.notmask);
 	gen_dop_word(DOP_OR,true,DREG(NEWESP),DREG(STACK));
-	gen_dop_word(DOP_ADD,true,DREG(STACK),DREG(SS));
+	dyn_add_segbase(DREG(STACK),DREG(STACK),DREG(SS),0);
 	if (decode.big_op) {
 		gen_call_function((void *)&mem_writed_checked,"%Drd%Dd",DREG(STACK),dynreg);
 	} else {
@@ -924,12 +1145,12 @@ static void dyn_pop(DynReg * dynreg,bool checked=true) {
 	gen_protectflags();
 	gen_dop_word(DOP_MOV,true,DREG(STACK),DREG(ESP));
 	gen_dop_word_var(DOP_AND,true,DREG(STACK),&cpu.stack.mask);
-	gen_dop_word(DOP_ADD,true,DREG(STACK),DREG(SS));
+	dyn_add_segbase(DREG(STACK),DREG(STACK),DREG(SS),0);
 	if (checked) {
 		if (decode.big_op) {
-			gen_call_function((void *)&mem_readd_checked,"%Drd%Id",DREG(STACK),&core_dyn.readdata);
+			gen_call_function((void *)&mem_readd_checked,"%Drd%Ip",DREG(STACK),&core_dyn.readdata);
 		} else {
-			gen_call_function((void *)&mem_readw_checked,"%Drd%Id",DREG(STACK),&core_dyn.readdata);
+			gen_call_function((void *)&mem_readw_checked,"%Drd%Ip",DREG(STACK),&core_dyn.readdata);
 		}
 		dyn_check_bool_exception_al();
 		gen_mov_host(&core_dyn.readdata,dynreg,decode.big_op?4:2);
@@ -1012,7 +1233,7 @@ static void dyn_fill_ea(bool addseg=true, DynReg * reg_ea=DREG(EA)) {
 		gen_extend_word(false,reg_ea,extend_src);
 skip_extend_word:
 		if (addseg) {
-			gen_lea(reg_ea,reg_ea,decode.segprefix ? decode.segprefix : segbase,0,0);
+			dyn_add_segbase(reg_ea,reg_ea,decode.segprefix ? decode.segprefix : segbase,0);
 		}
 	} else {
 		Bits imm=0;
@@ -1050,7 +1271,7 @@ skip_extend_word:
 							} else {
 								DynReg** seg = decode.segprefix ? &decode.segprefix : &segbase;
 								gen_lea(DREG(EA),DREG(EA),scaled,scale,0);
-								gen_lea(reg_ea,DREG(EA),*seg,0,0);
+								dyn_add_segbase(reg_ea,DREG(EA),*seg,0);
 							}
 							return;
 						}
@@ -1085,14 +1306,14 @@ skip_extend_word:
 					DynReg** seg = decode.segprefix ? &decode.segprefix : &segbase;
 					if (!base) {
 						gen_lea(DREG(EA),DREG(EA),scaled,scale,0);
-						gen_lea(reg_ea,DREG(EA),*seg,0,0);
+						dyn_add_segbase(reg_ea,DREG(EA),*seg,0);
 					} else if (!scaled) {
-						gen_lea(DREG(EA),DREG(EA),*seg,0,0);
+						dyn_add_segbase(DREG(EA),DREG(EA),*seg,0);
 						gen_lea(reg_ea,DREG(EA),base,0,0);
 					} else {
 						gen_lea(DREG(EA),DREG(EA),scaled,scale,0);
 						gen_lea(DREG(EA),DREG(EA),base,0,0);
-						gen_lea(reg_ea,DREG(EA),decode.segprefix ? decode.segprefix : segbase,0,0);
+						dyn_add_segbase(reg_ea,DREG(EA),decode.segprefix ? decode.segprefix : segbase,0);
 					}
 				}
 				return;
@@ -1106,7 +1327,9 @@ skip_extend_word:
 			gen_lea(reg_ea,base,scaled,scale,imm);
 		} else {
 			DynReg** seg = decode.segprefix ? &decode.segprefix : &segbase;
-			if (!base) gen_lea(reg_ea,*seg,scaled,scale,imm);
+			Bit32u segconst;
+			if (dyn_seg_folded(*seg,segconst)) gen_lea(reg_ea,base,scaled,scale,imm+(Bit32s)segconst);
+			else if (!base) gen_lea(reg_ea,*seg,scaled,scale,imm);
 			else if (!scaled) gen_lea(reg_ea,base,*seg,0,imm);
 			else {
 				gen_lea(DREG(EA),base,scaled,scale,imm);
@@ -1258,7 +1481,7 @@ static void dyn_imul_gvev(Bitu immsize) {
 	} else {
 		src=&DynRegs[decode.modrm.rm];
 	}
-	gen_needflags();
+	dyn_needflags();
 	switch (immsize) {
 	case 0:gen_imul_word(decode.big_op,rm_reg,src);break;
 	case 1:gen_imul_word_imm(decode.big_op,rm_reg,src,(Bit8s)decode_fetchb());break;
@@ -1420,7 +1643,7 @@ static void dyn_dshift_ev_gv(bool left,bool immediate) {
 		dyn_fill_ea();ea_reg=DREG(TMPW);
 		dyn_read_word(DREG(EA),DREG(TMPW),decode.big_op);
 	} else ea_reg=&DynRegs[decode.modrm.rm];
-	gen_needflags();
+	dyn_needflags();
 	if (immediate) gen_dshift_imm(decode.big_op,left,ea_reg,rm_reg,decode_fetchb());
 	else gen_dshift_cl(decode.big_op,left,ea_reg,rm_reg,DREG(ECX));
 	if (decode.modrm.mod<3) {
@@ -1503,23 +1726,19 @@ static void dyn_grp2_eb(grp2_types type) {
 	}
 	switch (type) {
 	case grp2_1:
-		/* rotates (first 4 ops) alter cf/of only; shifts (last 4 ops) alter all flags */
-		if (decode.modrm.reg < 4) gen_needflags();
-		else gen_discardflags();
+		dyn_shift_flags(true);
 		gen_shift_byte_imm(decode.modrm.reg,src,src_i,1);
 		break;
 	case grp2_imm: {
 		Bit8u imm=decode_fetchb();
 		if (imm) {
-			/* rotates (first 4 ops) alter cf/of only; shifts (last 4 ops) alter all flags */
-			if (decode.modrm.reg < 4) gen_needflags();
-			else gen_discardflags();
+			dyn_shift_flags(true);
 			gen_shift_byte_imm(decode.modrm.reg,src,src_i,imm);
 		} else return;
 		}
 		break;
 	case grp2_cl:
-		gen_needflags();	/* flags must not be changed on ecx==0 */
+		dyn_shift_flags(false);	/* flags must not be changed on ecx==0 */
 		gen_shift_byte_cl (decode.modrm.reg,src,src_i,DREG(ECX));
 		break;
 	}
@@ -1539,16 +1758,13 @@ static void dyn_grp2_ev(grp2_types type) {
 	}
 	switch (type) {
 	case grp2_1:
-		/* rotates (first 4 ops) alter cf/of only; shifts (last 4 ops) alter all flags */
-		if (decode.modrm.reg < 4) gen_needflags();
-		else gen_discardflags();
+		dyn_shift_flags(true);
 		gen_shift_word_imm(decode.modrm.reg,decode.big_op,src,1);
 		break;
 	case grp2_imm: {
 		Bitu val;
 		if (decode_fetchb_imm(val)) {
-			if (decode.modrm.reg < 4) gen_needflags();
-			else gen_discardflags();
+			dyn_shift_flags(true);
 			gen_load_host((void*)val,DREG(TMPB),1);
 			gen_shift_word_cl(decode.modrm.reg,decode.big_op,src,DREG(TMPB));
 			gen_releasereg(DREG(TMPB));
@@ -1556,15 +1772,13 @@ static void dyn_grp2_ev(grp2_types type) {
 		}
 		Bit8u imm=(Bit8u)val;
 		if (imm) {
-			/* rotates (first 4 ops) alter cf/of only; shifts (last 4 ops) alter all flags */
-			if (decode.modrm.reg < 4) gen_needflags();
-			else gen_discardflags();
+			dyn_shift_flags(true);
 			gen_shift_word_imm(decode.modrm.reg,decode.big_op,src,imm);
 		} else return;
 		}
 		break;
 	case grp2_cl:
-		gen_needflags();	/* flags must not be changed on ecx==0 */
+		dyn_shift_flags(false);	/* flags must not be changed on ecx==0 */
 		gen_shift_word_cl (decode.modrm.reg,decode.big_op,src,DREG(ECX));
 		break;
 	}
@@ -1596,10 +1810,10 @@ static void dyn_grp3_eb(void) {
 		set_skipflags(false);gen_sop_byte(SOP_NEG,src,src_i);
 		break;
 	case 0x4:	/* mul Eb */
-		gen_needflags();gen_mul_byte(false,DREG(EAX),src,src_i);
+		dyn_needflags();gen_mul_byte(false,DREG(EAX),src,src_i);
 		goto skipsave;
 	case 0x5:	/* imul Eb */
-		gen_needflags();gen_mul_byte(true,DREG(EAX),src,src_i);
+		dyn_needflags();gen_mul_byte(true,DREG(EAX),src,src_i);
 		goto skipsave;
 	case 0x6:	/* div Eb */
 	case 0x7:	/* idiv Eb */
@@ -1636,10 +1850,10 @@ static void dyn_grp3_ev(void) {
 		set_skipflags(false);gen_sop_word(SOP_NEG,decode.big_op,src);
 		break;
 	case 0x4:	/* mul Eb */
-		gen_needflags();gen_mul_word(false,DREG(EAX),DREG(EDX),decode.big_op,src);
+		dyn_needflags();gen_mul_word(false,DREG(EAX),DREG(EDX),decode.big_op,src);
 		goto skipsave;
 	case 0x5:	/* imul Eb */
-		gen_needflags();gen_mul_word(true,DREG(EAX),DREG(EDX),decode.big_op,src);
+		dyn_needflags();gen_mul_word(true,DREG(EAX),DREG(EDX),decode.big_op,src);
 		goto skipsave;
 	case 0x6:	/* div Eb */
 	case 0x7:	/* idiv Eb */
@@ -1674,6 +1888,8 @@ static void dyn_mov_ev_seg(void) {
 }
 
 static void dyn_load_seg(SegNames seg,DynReg * src) {
+	decode.seg.written|=1 << seg;
+	decode.seg.fold&=~(1 << seg);
 	gen_call_function((void *)&CPU_SetSegGeneral,"%Rd%Id%Drw",DREG(TMPB),seg,src);
 	dyn_check_bool_exception(DREG(TMPB));
 	gen_releasereg(DREG(TMPB));
@@ -1715,6 +1931,8 @@ static void dyn_push_seg(SegNames seg) {
 
 static void dyn_pop_seg(SegNames seg) {
 	gen_releasereg(DREG(ESP));
+	decode.seg.written|=1 << seg;
+	decode.seg.fold&=~(1 << seg);
 	gen_call_function((void *)&CPU_PopSeg,"%Rd%Id%Id",DREG(TMPB),seg,decode.big_op);
 	dyn_check_bool_exception(DREG(TMPB));
 	gen_releasereg(DREG(TMPB));
@@ -1973,7 +2191,7 @@ static void dyn_add_iocheck_var(Bit8u accessed_port,Bitu access_size) {
 #define dyn_mmx_check() if ((dyn_dh_fpu.dh_fpu_enabled) && (!fpu_used)) {dh_fpu_startup();}
 #endif
 
-static CacheBlock * CreateCacheBlock(CodePageHandler * codepage,PhysPt start,Bitu max_opcodes) {
+static CacheBlock * CreateCacheBlock(CodePageHandler * codepage,PhysPt start,Bitu max_opcodes,BlockTier tier=TIER_BASE,Bitu fold_segs=0) {
 	Bits i;
 /* Init a load of variables */
 	decode.code_start=start;
@@ -1985,16 +2203,43 @@ static CacheBlock * CreateCacheBlock(CodePageHandler * codepage,PhysPt start,Bit
 	decode.page.first=start >> 12;
 	decode.active_block=decode.block=cache_openblock();
 	decode.block->page.start=decode.page.index;
+	decode.block->page.big=cpu.code.big;
+	decode.block->hot.count=0;
+	decode.block->hot.tier=tier;
+	decode.block->hot.left=(tier==TIER_BASE && dynamic_core_hot_threshold>0) ? (Bit32u)dynamic_core_hot_threshold : 0;
 	codepage->AddCacheBlock(decode.block);
-
-	gen_save_host_direct(&cache.block.running,(Bit32u)decode.block);
+	decode.seg.used=0;
+	decode.seg.written=0;
+	decode.seg.fold=fold_segs;
+	if (tier!=TIER_BASE) dyn_flags_liveness(start,max_opcodes);
+	else decode.flags.page=~0;
+
+	gen_save_host_direct(&cache.block.running,(Bits)decode.block);
+	gen_inc_host_direct(&decode.block->hot.count);
 	for (i=0;i<G_MAX;i++) {
 		DynRegs[i].flags&=~(DYNFLG_ACTIVE|DYNFLG_CHANGED);
 		DynRegs[i].genreg=0;
 	}
 	gen_reinit();
-	/* Start with the cycles check */
 	gen_protectflags();
+	/* Count down to the hot tier on every entry, linked ones included */
+	if (decode.block->hot.left) {
+		gen_dec_host_direct(&decode.block->hot.left);
+		save_info[used_save_info].branch_pos=gen_create_branch_long(BR_Z);
+		save_info[used_save_info].type=hot_exit;
+		used_save_info++;
+	}
+	/* Check that the folded segment bases still hold */
+	for (i=0;i<6;i++) {
+		if (!(fold_segs & (1 << i))) continue;
+		decode.seg.base[i]=Segs.phys[i];
+		gen_dop_word_imm(DOP_CMP,true,&DynRegs[G_ES+i],(Bit32s)Segs.phys[i]);
+		gen_releasereg(&DynRegs[G_ES+i]);
+		save_info[used_save_info].branch_pos=gen_create_branch_long(BR_NZ);
+		save_info[used_save_info].type=seg_guard;
+		used_save_info++;
+	}
+	/* Start with the cycles check */
 	gen_dop_word_imm(DOP_CMP,true,DREG(CYCLES),0);
 	save_info[used_save_info].branch_pos=gen_create_branch_long(BR_LE);
 	save_info[used_save_info].type=cycle_check;
@@ -2180,10 +2425,10 @@ restart_prefix:
 
 		/* INC/DEC general register */
 		case 0x40:case 0x41:case 0x42:case 0x43:case 0x44:case 0x45:case 0x46:case 0x47:	
-			gen_needcarry();gen_sop_word(SOP_INC,decode.big_op,&DynRegs[opcode&7]);
+			dyn_needcarry();gen_sop_word(SOP_INC,decode.big_op,&DynRegs[opcode&7]);
 			break;
 		case 0x48:case 0x49:case 0x4a:case 0x4b:case 0x4c:case 0x4d:case 0x4e:case 0x4f:	
-			gen_needcarry();gen_sop_word(SOP_DEC,decode.big_op,&DynRegs[opcode&7]);
+			dyn_needcarry();gen_sop_word(SOP_DEC,decode.big_op,&DynRegs[opcode&7]);
 			break;
 		/* PUSH/POP General register */
 		case 0x50:case 0x51:case 0x52:case 0x53:case 0x55:case 0x56:case 0x57:	
@@ -2306,13 +2551,13 @@ restart_prefix:
 			break;
 		/* MOV AL,direct addresses */
 		case 0xa0:
-			gen_lea(DREG(EA),decode.segprefix ? decode.segprefix : DREG(DS),0,0,
+			dyn_add_segbase(DREG(EA),0,decode.segprefix ? decode.segprefix : DREG(DS),
 				decode.big_addr ? decode_fetchd() : decode_fetchw());
 			dyn_read_byte_release(DREG(EA),DREG(EAX),false);
 			break;
 		/* MOV AX,direct addresses */
 		case 0xa1:
-			gen_lea(DREG(EA),decode.segprefix ? decode.segprefix : DREG(DS),0,0,
+			dyn_add_segbase(DREG(EA),0,decode.segprefix ? decode.segprefix : DREG(DS),
 				decode.big_addr ? decode_fetchd() : decode_fetchw());
 			dyn_read_word_release(DREG(EA),DREG(EAX),decode.big_op);
 			break;
@@ -2321,19 +2566,20 @@ restart_prefix:
 			if (decode.big_addr) {
 				Bitu val;
 				if (decode_fetchd_imm(val)) {
-					gen_lea_imm_mem(DREG(EA),decode.segprefix ? decode.segprefix : DREG(DS),(void*)val);
+					gen_mov_host((void*)val,DREG(EA),4);
+					dyn_add_segbase(DREG(EA),DREG(EA),decode.segprefix ? decode.segprefix : DREG(DS),0);
 				} else {
-					gen_lea(DREG(EA),decode.segprefix ? decode.segprefix : DREG(DS),0,0,(Bits)val);
+					dyn_add_segbase(DREG(EA),0,decode.segprefix ? decode.segprefix : DREG(DS),(Bits)val);
 				}
 				dyn_write_byte_release(DREG(EA),DREG(EAX),false);
 			} else {
-				gen_lea(DREG(EA),decode.segprefix ? decode.segprefix : DREG(DS),0,0,decode_fetchw());
+				dyn_add_segbase(DREG(EA),0,decode.segprefix ? decode.segprefix : DREG(DS),decode_fetchw());
 				dyn_write_byte_release(DREG(EA),DREG(EAX),false);
 			}
 			break;
 		/* MOV direct addresses,AX */
 		case 0xa3:
-			gen_lea(DREG(EA),decode.segprefix ? decode.segprefix : DREG(DS),0,0,
+			dyn_add_segbase(DREG(EA),0,decode.segprefix ? decode.segprefix : DREG(DS),
 				decode.big_addr ? decode_fetchd() : decode_fetchw());
 			dyn_write_word_release(DREG(EA),DREG(EAX),decode.big_op);
 			break;
@@ -2616,12 +2862,12 @@ restart_prefix:
 			case 0x1://DEC Eb
 				if (decode.modrm.mod<3) {
 					dyn_fill_ea();dyn_read_byte(DREG(EA),DREG(TMPB),false);
-					gen_needcarry();
+					dyn_needcarry();
 					gen_sop_byte(decode.modrm.reg==0 ? SOP_INC : SOP_DEC,DREG(TMPB),0);
 					dyn_write_byte_release(DREG(EA),DREG(TMPB),false);
 					gen_releasereg(DREG(TMPB));
 				} else {
-					gen_needcarry();
+					dyn_needcarry();
 					gen_sop_byte(decode.modrm.reg==0 ? SOP_INC : SOP_DEC,
 						&DynRegs[decode.modrm.rm&3],decode.modrm.rm&4);
 				}
@@ -2648,7 +2894,7 @@ restart_prefix:
 			switch (decode.modrm.reg) {
 			case 0x0://INC Ev
 			case 0x1://DEC Ev
-				gen_needcarry();
+				dyn_needcarry();
 				gen_sop_word(decode.modrm.reg==0 ? SOP_INC : SOP_DEC,decode.big_op,src);
 				if (decode.modrm.mod<3){
 					dyn_write_word_release(DREG(EA),DREG(TMPW),decode.big_op);
@@ -2725,6 +2971,10 @@ illegalopcode:
 finish_block:
 	/* Setup the correct end-address */
 	decode.active_block->page.end=--decode.page.index;
+	decode.block->hot.segs=(Bit8u)(decode.seg.used & ~decode.seg.written);
+#if defined (CACHE_PERSIST)
+	persist_translated(decode.block);
+#endif
 //	LOG_MSG("Created block size %d start %d end %d",decode.block->cache.size,decode.block->page.start,decode.block->page.end);
 	return decode.block;
 }
@@ -156,9 +156,7 @@ static void dh_fpu_esc0(){
 	} else { 
 		dyn_fill_ea();
 		gen_call_function((void*)&FPU_FLD_32,"%Ddr",DREG(EA)); 
-		cache_addb(0xd8);
-		cache_addb(0x05|(decode.modrm.reg<<3));
-		cache_addd((Bit32u)(&(dyn_dh_fpu.temp.m1)));
+		gen_memop_host(0xd8,decode.modrm.reg,&(dyn_dh_fpu.temp.m1));
 	}
 }
 
@@ -174,41 +172,29 @@ static void dh_fpu_esc1(){
 		switch(group){
 		case 0x00: /* FLD float*/
 			gen_call_function((void*)&FPU_FLD_32,"%Ddr",DREG(EA));
-			cache_addb(0xd9);
-			cache_addb(0x05|(decode.modrm.reg<<3));
-			cache_addd((Bit32u)(&(dyn_dh_fpu.temp.m1)));
+			gen_memop_host(0xd9,decode.modrm.reg,&(dyn_dh_fpu.temp.m1));
 			break;
 		case 0x01: /* UNKNOWN */
 			LOG(LOG_FPU,LOG_WARN)("ESC EA 1:Unhandled group %d subfunction %d",group,sub);
 			break;
 		case 0x02: /* FST float*/
-			cache_addb(0xd9);
-			cache_addb(0x05|(decode.modrm.reg<<3));
-			cache_addd((Bit32u)(&(dyn_dh_fpu.temp.m1)));
+			gen_memop_host(0xd9,decode.modrm.reg,&(dyn_dh_fpu.temp.m1));
 			gen_call_function((void*)&FPU_FST_32,"%Ddr",DREG(EA));
 			break;
 		case 0x03: /* FSTP float*/
-			cache_addb(0xd9);
-			cache_addb(0x05|(decode.modrm.reg<<3));
-			cache_addd((Bit32u)(&(dyn_dh_fpu.temp.m1)));
+			gen_memop_host(0xd9,decode.modrm.reg,&(dyn_dh_fpu.temp.m1));
 			gen_call_function((void*)&FPU_FST_32,"%Ddr",DREG(EA));
 			break;
 		case 0x04: /* FLDENV */
 			gen_call_function((void*)&FPU_FLDENV_DH,"%Ddr",DREG(EA));
-			cache_addb(0xd9);
-			cache_addb(0x05|(decode.modrm.reg<<3));
-			cache_addd((Bit32u)(&(dyn_dh_fpu.temp.m1)));
+			gen_memop_host(0xd9,decode.modrm.reg,&(dyn_dh_fpu.temp.m1));
 			break;
 		case 0x05: /* FLDCW */
 			gen_call_function((void *)&FPU_FLDCW_DH,"%Ddr",DREG(EA));
-			cache_addb(0xd9);
-			cache_addb(0x05|(decode.modrm.reg<<3));
-			cache_addd((Bit32u)(&(dyn_dh_fpu.temp.m1)));
+			gen_memop_host(0xd9,decode.modrm.reg,&(dyn_dh_fpu.temp.m1));
 			break;
 		case 0x06: /* FSTENV */
-			cache_addb(0xd9);
-			cache_addb(0x05|(decode.modrm.reg<<3));
-			cache_addd((Bit32u)(&(dyn_dh_fpu.temp.m1)));
+			gen_memop_host(0xd9,decode.modrm.reg,&(dyn_dh_fpu.temp.m1));
 			gen_call_function((void*)&FPU_FSTENV_DH,"%Ddr",DREG(EA));
 			break;
 		case 0x07:  /* FNSTCW*/
@@ -229,9 +215,7 @@ static void dh_fpu_esc2(){
 	} else {
 		dyn_fill_ea(); 
 		gen_call_function((void*)&FPU_FLD_32,"%Ddr",DREG(EA)); 
-		cache_addb(0xda);
-		cache_addb(0x05|(decode.modrm.reg<<3));
-		cache_addd((Bit32u)(&(dyn_dh_fpu.temp.m1)));
+		gen_memop_host(0xda,decode.modrm.reg,&(dyn_dh_fpu.temp.m1));
 	}
 }
 
@@ -275,35 +259,25 @@ static void dh_fpu_esc3(){
 		switch(group){
 		case 0x00:	/* FILD */
 			gen_call_function((void*)&FPU_FLD_32,"%Ddr",DREG(EA));
-			cache_addb(0xdb);
-			cache_addb(0x05|(decode.modrm.reg<<3));
-			cache_addd((Bit32u)(&(dyn_dh_fpu.temp.m1)));
+			gen_memop_host(0xdb,decode.modrm.reg,&(dyn_dh_fpu.temp.m1));
 			break;
 		case 0x01:	/* FISTTP */
 			LOG(LOG_FPU,LOG_WARN)("ESC 3 EA:Unhandled group %d subfunction %d",group,sub);
 			break;
 		case 0x02:	/* FIST */
-			cache_addb(0xdb);
-			cache_addb(0x05|(decode.modrm.reg<<3));
-			cache_addd((Bit32u)(&(dyn_dh_fpu.temp.m1)));
+			gen_memop_host(0xdb,decode.modrm.reg,&(dyn_dh_fpu.temp.m1));
 			gen_call_function((void*)&FPU_FST_32,"%Ddr",DREG(EA));
 			break;
 		case 0x03:	/* FISTP */
-			cache_addb(0xdb);
-			cache_addb(0x05|(decode.modrm.reg<<3));
-			cache_addd((Bit32u)(&(dyn_dh_fpu.temp.m1)));
+			gen_memop_host(0xdb,decode.modrm.reg,&(dyn_dh_fpu.temp.m1));
 			gen_call_function((void*)&FPU_FST_32,"%Ddr",DREG(EA));
 			break;
 		case 0x05:	/* FLD 80 Bits Real */
 			gen_call_function((void*)&FPU_FLD_80,"%Ddr",DREG(EA));
-			cache_addb(0xdb);
-			cache_addb(0x05|(decode.modrm.reg<<3));
-			cache_addd((Bit32u)(&(dyn_dh_fpu.temp.m1)));
+			gen_memop_host(0xdb,decode.modrm.reg,&(dyn_dh_fpu.temp.m1));
 			break;
 		case 0x07:	/* FSTP 80 Bits Real */
-			cache_addb(0xdb);
-			cache_addb(0x05|(decode.modrm.reg<<3));
-			cache_addd((Bit32u)(&(dyn_dh_fpu.temp.m1)));
+			gen_memop_host(0xdb,decode.modrm.reg,&(dyn_dh_fpu.temp.m1));
 			gen_call_function((void*)&FPU_FST_80,"%Ddr",DREG(EA));
 			break;
 		default:
@@ -320,9 +294,7 @@ static void dh_fpu_esc4(){
 	} else { 
 		dyn_fill_ea(); 
 		gen_call_function((void*)&FPU_FLD_64,"%Ddr",DREG(EA)); 
-		cache_addb(0xdc);
-		cache_addb(0x05|(decode.modrm.reg<<3));
-		cache_addd((Bit32u)(&(dyn_dh_fpu.temp.m1)));
+		gen_memop_host(0xdc,decode.modrm.reg,&(dyn_dh_fpu.temp.m1));
 	}
 }
 
@@ -338,43 +310,31 @@ static void dh_fpu_esc5(){
 		switch(group){
 		case 0x00:  /* FLD double real*/
 			gen_call_function((void*)&FPU_FLD_64,"%Ddr",DREG(EA));
-			cache_addb(0xdd);
-			cache_addb(0x05|(decode.modrm.reg<<3));
-			cache_addd((Bit32u)(&(dyn_dh_fpu.temp.m1)));
+			gen_memop_host(0xdd,decode.modrm.reg,&(dyn_dh_fpu.temp.m1));
 			break;
 		case 0x01:  /* FISTTP longint*/
 			LOG(LOG_FPU,LOG_WARN)("ESC 5 EA:Unhandled group %d subfunction %d",group,sub);
 			break;
 		case 0x02:   /* FST double real*/
-			cache_addb(0xdd);
-			cache_addb(0x05|(decode.modrm.reg<<3));
-			cache_addd((Bit32u)(&(dyn_dh_fpu.temp.m1)));
+			gen_memop_host(0xdd,decode.modrm.reg,&(dyn_dh_fpu.temp.m1));
 			gen_call_function((void*)&FPU_FST_64,"%Ddr",DREG(EA));
 			break;
 		case 0x03:	/* FSTP double real*/
-			cache_addb(0xdd);
-			cache_addb(0x05|(decode.modrm.reg<<3));
-			cache_addd((Bit32u)(&(dyn_dh_fpu.temp.m1)));
+			gen_memop_host(0xdd,decode.modrm.reg,&(dyn_dh_fpu.temp.m1));
 			gen_call_function((void*)&FPU_FST_64,"%Ddr",DREG(EA));
 			break;
 		case 0x04:	/* FRSTOR */
 			gen_call_function((void*)&FPU_FRSTOR_DH,"%Ddr",DREG(EA));
-			cache_addb(0xdd);
-			cache_addb(0x05|(decode.modrm.reg<<3));
-			cache_addd((Bit32u)(&(dyn_dh_fpu.temp_state[0])));
+			gen_memop_host(0xdd,decode.modrm.reg,&(dyn_dh_fpu.temp_state[0]));
 			break;
 		case 0x06:	/* FSAVE */
-			cache_addb(0xdd);
-			cache_addb(0x05|(decode.modrm.reg<<3));
-			cache_addd((Bit32u)(&(dyn_dh_fpu.temp_state[0])));
+			gen_memop_host(0xdd,decode.modrm.reg,&(dyn_dh_fpu.temp_state[0]));
 			gen_call_function((void*)&FPU_FSAVE_DH,"%Ddr",DREG(EA));
 			cache_addb(0xdb);
 			cache_addb(0xe3);
 			break;
 		case 0x07:   /* FNSTSW */
-			cache_addb(0xdd);
-			cache_addb(0x05|(decode.modrm.reg<<3));
-			cache_addd((Bit32u)(&(dyn_dh_fpu.temp.m1)));
+			gen_memop_host(0xdd,decode.modrm.reg,&(dyn_dh_fpu.temp.m1));
 			gen_call_function((void*)&FPU_FST_16,"%Ddr",DREG(EA));
 			break;
 		default:
@@ -391,9 +351,7 @@ static void dh_fpu_esc6(){
 	} else {
 		dyn_fill_ea(); 
 		gen_call_function((void*)&FPU_FLD_16,"%Ddr",DREG(EA)); 
-		cache_addb(0xde);
-		cache_addb(0x05|(decode.modrm.reg<<3));
-		cache_addd((Bit32u)(&(dyn_dh_fpu.temp.m1)));
+		gen_memop_host(0xde,decode.modrm.reg,&(dyn_dh_fpu.temp.m1));
 	}
 }
 
@@ -419,9 +377,7 @@ static void dh_fpu_esc7(){
 		case 0x04:
 			switch(sub){
 				case 0x00:     /* FNSTSW AX*/
-					cache_addb(0xdd);
-					cache_addb(0x05|(0x07<<3));
-					cache_addd((Bit32u)(&(dyn_dh_fpu.temp.m1)));
+					gen_memop_host(0xdd,0x07,&(dyn_dh_fpu.temp.m1));
 					gen_load_host(&(dyn_dh_fpu.temp.m1),DREG(TMPB),4);
 					gen_dop_word(DOP_MOV,false,DREG(EAX),DREG(TMPB));
 					gen_releasereg(DREG(TMPB));
@@ -440,47 +396,33 @@ static void dh_fpu_esc7(){
 		switch(group){
 		case 0x00:  /* FILD Bit16s */
 			gen_call_function((void*)&FPU_FLD_16,"%Ddr",DREG(EA));
-			cache_addb(0xdf);
-			cache_addb(0x05|(decode.modrm.reg<<3));
-			cache_addd((Bit32u)(&(dyn_dh_fpu.temp.m1)));
+			gen_memop_host(0xdf,decode.modrm.reg,&(dyn_dh_fpu.temp.m1));
 			break;
 		case 0x01:
 			LOG(LOG_FPU,LOG_WARN)("ESC 7 EA:Unhandled group %d subfunction %d",group,sub);
 			break;
 		case 0x02:   /* FIST Bit16s */
-			cache_addb(0xdf);
-			cache_addb(0x05|(decode.modrm.reg<<3));
-			cache_addd((Bit32u)(&(dyn_dh_fpu.temp.m1)));
+			gen_memop_host(0xdf,decode.modrm.reg,&(dyn_dh_fpu.temp.m1));
 			gen_call_function((void*)&FPU_FST_16,"%Ddr",DREG(EA));
 			break;
 		case 0x03:	/* FISTP Bit16s */
-			cache_addb(0xdf);
-			cache_addb(0x05|(decode.modrm.reg<<3));
-			cache_addd((Bit32u)(&(dyn_dh_fpu.temp.m1)));
+			gen_memop_host(0xdf,decode.modrm.reg,&(dyn_dh_fpu.temp.m1));
 			gen_call_function((void*)&FPU_FST_16,"%Ddr",DREG(EA));
 			break;
 		case 0x04:   /* FBLD packed BCD */
 			gen_call_function((void*)&FPU_FLD_80,"%Ddr",DREG(EA));
-			cache_addb(0xdf);
-			cache_addb(0x05|(decode.modrm.reg<<3));
-			cache_addd((Bit32u)(&(dyn_dh_fpu.temp.m1)));
+			gen_memop_host(0xdf,decode.modrm.reg,&(dyn_dh_fpu.temp.m1));
 			break;
 		case 0x05:  /* FILD Bit64s */
 			gen_call_function((void*)&FPU_FLD_64,"%Ddr",DREG(EA));
-			cache_addb(0xdf);
-			cache_addb(0x05|(decode.modrm.reg<<3));
-			cache_addd((Bit32u)(&(dyn_dh_fpu.temp.m1)));
+			gen_memop_host(0xdf,decode.modrm.reg,&(dyn_dh_fpu.temp.m1));
 			break;
 		case 0x06:	/* FBSTP packed BCD */
-			cache_addb(0xdf);
-			cache_addb(0x05|(decode.modrm.reg<<3));
-			cache_addd((Bit32u)(&(dyn_dh_fpu.temp.m1)));
+			gen_memop_host(0xdf,decode.modrm.reg,&(dyn_dh_fpu.temp.m1));
 			gen_call_function((void*)&FPU_FST_80,"%Ddr",DREG(EA));
 			break;
 		case 0x07:  /* FISTP Bit64s */
-			cache_addb(0xdf);
-			cache_addb(0x05|(decode.modrm.reg<<3));
-			cache_addd((Bit32u)(&(dyn_dh_fpu.temp.m1)));
+			gen_memop_host(0xdf,decode.modrm.reg,&(dyn_dh_fpu.temp.m1));
 			gen_call_function((void*)&FPU_FST_64,"%Ddr",DREG(EA));
 			break;
 		default:
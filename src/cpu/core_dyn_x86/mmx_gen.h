@@ -38,9 +38,7 @@ void dyn_mmx_op(Bit8u op) {
 	if (decode.modrm.mod < 3) {
 		dyn_fill_ea();
 		gen_call_function((void*)&MMX_LOAD_64, "%Ddr", DREG(EA));
-		cache_addw(0x0F | (op << 8));
-		cache_addb(0x05 | (decode.modrm.val & 0x38));
-		cache_addd((Bit32u)&mmxtmp);
+		gen_memop_host(0x0F | (op << 8), decode.modrm.reg, &mmxtmp);
 	} else dyn_mmx_simple(op, decode.modrm.val);
 }
 
@@ -62,9 +60,7 @@ void dyn_mmx_movd_pqed() {
 		// generate call to mmxtmp load
 		gen_call_function((void*)&MMX_LOAD_32, "%Ddr", DREG(EA));
 		// mmxtmp contains loaded value - finish by loading it to mm
-		cache_addw(0x6E0F);	// movd  mm, m32
-		cache_addb(0x05 | (decode.modrm.val & 0x38));
-		cache_addd((Bit32u)&mmxtmp);
+		gen_memop_host(0x6E0F, decode.modrm.reg, &mmxtmp);	// movd  mm, m32
 	}
 	else {
 		// movd mm, r32 - r32->mmxtmp->mm
@@ -73,13 +69,9 @@ void dyn_mmx_movd_pqed() {
 		// resolve genreg
 		GenReg *gr = FindDynReg(reg);
 		// move from genreg to mmxtmp
-		cache_addb(0x89);	// mov m32, r32
-		cache_addb(0x05 | (gr->index << 3));
-		cache_addd((Bit32u)&mmxtmp);
+		gen_memop_host(0x89, gr->index, &mmxtmp);	// mov m32, r32
 		// mmxtmp contains loaded value - finish by loading it to mm
-		cache_addw(0x6E0F);	// movd  mm, m32
-		cache_addb(0x05 | (decode.modrm.val & 0x38));
-		cache_addd((Bit32u)&mmxtmp);
+		gen_memop_host(0x6E0F, decode.modrm.reg, &mmxtmp);	// movd  mm, m32
 	}
 }
 
@@ -94,9 +86,7 @@ void dyn_mmx_movq_pqqq() {
 		// generate call to mmxtmp load
 		gen_call_function((void*)&MMX_LOAD_64, "%Ddr", DREG(EA));
 		// mmxtmp contains loaded value - finish by loading it to mm
-		cache_addw(0x6F0F);	// movq  mm, m64
-		cache_addb(0x05 | (decode.modrm.val & 0x38));
-		cache_addd((Bit32u)&mmxtmp);
+		gen_memop_host(0x6F0F, decode.modrm.reg, &mmxtmp);	// movq  mm, m64
 	}
 	else {
 		// movq mm, mm
@@ -112,9 +102,7 @@ void dyn_mmx_movd_edpq() {
 		// movd m32, mm - resolve EA and load data
 		dyn_fill_ea();
 		// fill mmxtmp
-		cache_addw(0x7E0F);	// movd  mm, m32
-		cache_addb(0x05 | (decode.modrm.val & 0x38));
-		cache_addd((Bit32u)&mmxtmp);
+		gen_memop_host(0x7E0F, decode.modrm.reg, &mmxtmp);	// movd  mm, m32
 		// generate call to mmxtmp store
 		gen_call_function((void*)&MMX_STORE_32, "%Ddr", DREG(EA));
 	}
@@ -125,13 +113,9 @@ void dyn_mmx_movd_edpq() {
 		// resolve genreg
 		GenReg *gr = FindDynReg(reg);
 		// fill mmxtmp
-		cache_addw(0x7E0F);	// movd  mm, m32
-		cache_addb(0x05 | (decode.modrm.val & 0x38));
-		cache_addd((Bit32u)&mmxtmp);
+		gen_memop_host(0x7E0F, decode.modrm.reg, &mmxtmp);	// movd  mm, m32
 		// move from mmxtmp to genreg
-		cache_addb(0x8b);	// mov r32, m32
-		cache_addb(0x05 | (gr->index << 3));
-		cache_addd((Bit32u)&mmxtmp);
+		gen_memop_host(0x8b, gr->index, &mmxtmp);	// mov r32, m32
 		// mark dynreg as changed
 		reg->flags |= DYNFLG_CHANGED;
 	}
@@ -145,9 +129,7 @@ void dyn_mmx_movq_qqpq() {
 		// movq m64, mm - resolve EA and load data
 		dyn_fill_ea();
 		// fill mmxtmp
-		cache_addw(0x7F0F);	// movq  mm, m64
-		cache_addb(0x05 | (decode.modrm.val & 0x38));
-		cache_addd((Bit32u)&mmxtmp);
+		gen_memop_host(0x7F0F, decode.modrm.reg, &mmxtmp);	// movq  mm, m64
 		// generate call to mmxtmp store
 		gen_call_function((void*)&MMX_STORE_64, "%Ddr", DREG(EA));
 	}
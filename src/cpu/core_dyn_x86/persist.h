@@ -0,0 +1,214 @@
+/*
+ *  Copyright (C) 2002-2015  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+	Tier hint cache file
+
+	No translated code is kept: the generated code contains absolute host
+	addresses (registers, the cache blocks and their links) so it can't be
+	reused by another process. The file only keeps hints about which tier the
+	blocks of a code page ended up in, keyed by a hash of the page contents at
+	the time it became a code page. Every block is still translated when it is
+	first run, as without the file, but one that was hot before gets
+	retranslated on its next run instead of after counting down from the
+	threshold, and one that had to stay plain doesn't fold segment bases.
+	Code can be put into a page after it became a code page without going
+	through the page handler, so every entry also keeps a checksum of the
+	bytes its block was translated from and only applies when they match.
+
+	The file is little endian: the magic, a Bit32u version, then for every
+	page a Bit64u hash, a Bit32u count and count entries of 9 bytes.
+*/
+
+#include <map>
+#include <vector>
+#include <string>
+
+#define PERSIST_MAGIC	"DBXDYNTC"
+#define PERSIST_VERSION	2
+
+#define PERSIST_BIG		0x01		//Block was translated for a 32bit code segment
+#define PERSIST_HOT		0x02		//Block reached the hot threshold
+#define PERSIST_PLAIN	0x04		//Hot block that can't fold segment bases
+
+struct PersistEntry {
+	Bit16u start,end;
+	Bit8u flags;
+	Bit32u check;					//Checksum of the bytes start to end
+};
+
+struct PersistPage {
+	std::vector<PersistEntry> entries;
+};
+
+static struct {
+	std::string filename;
+	std::map<Bit64u,PersistPage> pages;
+} persist;
+
+static Bit64u persist_hashpage(HostPt mem) {
+	Bit64u hash=0xcbf29ce484222325ULL;		//FNV-1a
+	for (Bitu i=0;i<4096;i++) {
+		hash^=mem[i];
+		hash*=0x100000001b3ULL;
+	}
+	return hash;
+}
+
+static Bit32u persist_checkrange(HostPt mem,Bitu start,Bitu end) {
+	Bit32u check=0x811c9dc5;
+	for (Bitu i=start;i<=end;i++) {
+		check^=mem[i];
+		check*=0x01000193;
+	}
+	return check;
+}
+
+static void persist_setup(CodePageHandler * cph) {
+	cph->persist_hashed=false;
+	if (persist.filename.empty()) return;
+	HostPt mem=cph->GetHostReadPt(cph->GetPhysPage());
+	if (!mem) return;
+	cph->persist_hash=persist_hashpage(mem);
+	cph->persist_hashed=true;
+}
+
+/* Called when a block is done, the bytes in memory are still the ones that
+   were translated */
+static void persist_translated(CacheBlock * block) {
+	CodePageHandler * cph=block->page.handler;
+	block->page.check=0;
+	if (!cph->persist_hashed || block->page.end<block->page.start) return;
+	HostPt mem=cph->GetHostReadPt(cph->GetPhysPage());
+	if (mem) block->page.check=persist_checkrange(mem,block->page.start,block->page.end);
+}
+
+static void persist_record(CodePageHandler * cph,CacheBlock * block) {
+	if (!cph->persist_hashed || block->crossblock || !block->page.check) return;
+	Bit32u check=block->page.check;
+	Bit8u flags=block->page.big ? PERSIST_BIG : 0;
+	switch (block->hot.tier) {
+	case TIER_HOT:
+		flags|=PERSIST_HOT;
+		break;
+	case TIER_HOT_PLAIN:
+		flags|=PERSIST_PLAIN;
+		break;
+	}
+	std::vector<PersistEntry> & entries=persist.pages[cph->persist_hash].entries;
+	for (Bitu i=0;i<entries.size();i++) {
+		if (entries[i].start==block->page.start) {
+			if (entries[i].check!=check || entries[i].end!=block->page.end) {
+				entries[i].end=block->page.end;
+				entries[i].check=check;
+				entries[i].flags=flags;
+			} else if (flags & (PERSIST_HOT|PERSIST_PLAIN)) entries[i].flags=flags;
+			return;
+		}
+	}
+	PersistEntry entry;
+	entry.start=block->page.start;
+	entry.end=block->page.end;
+	entry.flags=flags;
+	entry.check=check;
+	entries.push_back(entry);
+}
+
+/* A block was just translated, start it out the way it ended up before */
+static void persist_seed(CodePageHandler * cph,CacheBlock * block) {
+	if (!block->page.check) return;
+	std::map<Bit64u,PersistPage>::iterator it=persist.pages.find(cph->persist_hash);
+	if (it==persist.pages.end()) return;
+	std::vector<PersistEntry> & entries=it->second.entries;
+	for (Bitu i=0;i<entries.size();i++) {
+		PersistEntry & entry=entries[i];
+		if (entry.start!=block->page.start) continue;
+		if (entry.end!=block->page.end || entry.check!=block->page.check ||
+			((entry.flags & PERSIST_BIG)!=0)!=block->page.big) return;
+		/* Hot blocks go to the hot tier on their first run */
+		if ((entry.flags & (PERSIST_HOT|PERSIST_PLAIN)) && dynamic_core_hot_threshold>0) {
+			if (entry.flags & PERSIST_PLAIN) block->hot.segs=0;
+			block->hot.left=1;
+		}
+		return;
+	}
+}
+
+static void persist_load(void) {
+	persist.pages.clear();
+	FILE * f=fopen(persist.filename.c_str(),"rb");
+	if (!f) return;
+	Bit8u header[12];
+	if (fread(header,12,1,f)!=1 || memcmp(header,PERSIST_MAGIC,8) ||
+		host_readd(&header[8])!=PERSIST_VERSION) {
+		LOG_MSG("DYNX86:Ignoring tier hint cache %s of an unknown format",persist.filename.c_str());
+		fclose(f);
+		return;
+	}
+	Bit8u head[12];
+	while (fread(head,12,1,f)==1) {
+		Bit64u hash=host_readq(&head[0]);
+		Bit32u count=host_readd(&head[8]);
+		if (count>4096) break;
+		std::vector<PersistEntry> & entries=persist.pages[hash].entries;
+		entries.resize(count);
+		for (Bitu i=0;i<count;i++) {
+			Bit8u data[9];
+			if (fread(data,9,1,f)!=1) {
+				entries.resize(i);
+				break;
+			}
+			entries[i].start=host_readw(&data[0]);
+			entries[i].end=host_readw(&data[2]);
+			entries[i].flags=data[4];
+			entries[i].check=host_readd(&data[5]);
+		}
+	}
+	fclose(f);
+	LOG_MSG("DYNX86:Loaded %d code pages from tier hint cache %s",(int)persist.pages.size(),persist.filename.c_str());
+}
+
+static void persist_save(void) {
+	if (persist.filename.empty() || persist.pages.empty()) return;
+	FILE * f=fopen(persist.filename.c_str(),"wb");
+	if (!f) {
+		LOG_MSG("DYNX86:Can't write tier hint cache %s",persist.filename.c_str());
+		return;
+	}
+	Bit8u header[12];
+	memcpy(header,PERSIST_MAGIC,8);
+	host_writed(&header[8],PERSIST_VERSION);
+	fwrite(header,12,1,f);
+	for (std::map<Bit64u,PersistPage>::iterator it=persist.pages.begin();it!=persist.pages.end();++it) {
+		std::vector<PersistEntry> & entries=it->second.entries;
+		Bit32u count=(Bit32u)entries.size();
+		Bit8u head[12];
+		host_writeq(&head[0],it->first);
+		host_writed(&head[8],count);
+		fwrite(head,12,1,f);
+		for (Bitu i=0;i<count;i++) {
+			Bit8u data[9];
+			host_writew(&data[0],entries[i].start);
+			host_writew(&data[2],entries[i].end);
+			data[4]=entries[i].flags;
+			host_writed(&data[5],entries[i].check);
+			fwrite(data,9,1,f);
+		}
+	}
+	fclose(f);
+}
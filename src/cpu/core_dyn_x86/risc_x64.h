@@ -0,0 +1,1163 @@
+/*
+ *  Copyright (C) 2002-2015  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* x86-64 code generator for the dynamic core.
+
+   Generated code keeps the 32bit register model of the x86 backend: all
+   operations on guest values are 32bit or narrower, so the upper half of a
+   host register holding a DynReg is always zero. The additional registers
+   r8-r15 extend the pool the DynRegs are mapped into, r11 is kept free as
+   scratch for addressing and stack alignment.
+
+   Host variables are addressed rip-relative. The code cache is placed in the
+   data segment (see CACHE_STATIC_CODE) so that all variables of the emulator
+   are within reach, pointers into the heap (guest memory, cache blocks) are
+   loaded into r11 first. */
+
+#include "dos_inc.h"
+static void gen_init(void);
+
+/* End of needed */
+
+#define X86_REGS		14
+#define X86_REG_EAX		0x00
+#define X86_REG_ECX		0x01
+#define X86_REG_EDX		0x02
+#define X86_REG_EBX		0x03
+#define X86_REG_EBP		0x04
+#define X86_REG_ESI		0x05
+#define X86_REG_EDI		0x06
+#define X86_REG_R8		0x07
+#define X86_REG_R9		0x08
+#define X86_REG_R10		0x09
+#define X86_REG_R12		0x0a
+#define X86_REG_R13		0x0b
+#define X86_REG_R14		0x0c
+#define X86_REG_R15		0x0d
+
+#define X86_REG_MASK(_REG_) (1 << X86_REG_ ## _REG_)
+
+// host register numbers of the argument registers
+#if defined (_WIN64)
+#define X64_ARGS		4
+static const Bit8u x64_argregs[X64_ARGS]={1,2,8,9};			// rcx,rdx,r8,r9
+#define X64_SHADOW		32									// home space for the arguments
+#else
+#define X64_ARGS		6
+static const Bit8u x64_argregs[X64_ARGS]={7,6,2,1,8,9};		// rdi,rsi,rdx,rcx,r8,r9
+#define X64_SHADOW		0
+#endif
+
+#define X64_REX_W		0x08
+
+static struct {
+	bool flagsactive;
+	Bitu last_used;
+	GenReg * regs[X86_REGS];
+	BlockReturn (*runcode)(Bit8u*);
+	Bit32u scratch;
+} x86gen;
+
+static INLINE void cache_addq(Bit64u val) {
+	*(Bit64u*)cache.pos=val;
+	cache.pos+=8;
+}
+
+/* Rex prefix for a register/register operation, only emitted when needed */
+static void gen_rex(Bit8u w,Bitu reg,Bitu rm) {
+	Bit8u rex=w|((reg&8)>>1)|((rm&8)>>3);
+	if (rex) cache_addb(0x40|rex);
+}
+
+/* Check if a host variable can be addressed rip-relative from the current
+   cache position, leaves some room for the instruction bytes */
+static bool gen_near(void * data) {
+	Bit64s diff=(Bit64s)((Bit8u*)data-cache.pos);
+	return (diff>-0x7fffff00LL) && (diff<0x7fffff00LL);
+}
+
+/* Emit an instruction that accesses a host variable. A two byte opcode is
+   passed as for cache_addw, reg is the modrm reg field and imm_size the
+   amount of immediate bytes the caller appends. Variables that are out of
+   rip-relative range are addressed through r11. */
+static void gen_memop(Bitu op,bool word,Bit8u w,Bitu reg,void * data,Bitu imm_size=0) {
+	bool near_data=gen_near(data);
+	if (!near_data) {
+		cache_addw(0xbb49);		//MOV R11,imm64
+		cache_addq((Bit64u)data);
+	}
+	if (word) cache_addb(0x66);
+	gen_rex(w,reg,near_data ? 0 : 8);
+	if (op>0xff) cache_addw((Bit16u)op);
+	else cache_addb((Bit8u)op);
+	if (near_data) {
+		cache_addb(0x05+((reg&7)<<3));
+		cache_addd((Bit32u)((Bit8u*)data-(cache.pos+4+imm_size)));
+	} else {
+		cache_addb(0x03+((reg&7)<<3));	//[R11]
+	}
+}
+
+/* Byte operations may use ah-bh and so can't take a rex prefix, variables
+   out of reach are copied into the scratch variable first */
+static void * gen_near_byte(void * data) {
+	if (gen_near(data)) return data;
+	cache_addw(0xbb49);				//MOV R11,imm64
+	cache_addq((Bit64u)data);
+	cache_addw(0x8a45);				//MOV R11B,[R11]
+	cache_addb(0x1b);
+	gen_memop(0x88,false,0,11,&x86gen.scratch);	//MOV [scratch],R11B
+	return &x86gen.scratch;
+}
+
+class GenReg {
+public:
+	GenReg(Bit8u _index) {
+		index=_index;
+		notusable=false;dynreg=0;
+	}
+	DynReg  * dynreg;
+	Bitu last_used;			//Keeps track of last assigned regs
+    Bit8u index;
+	bool notusable;
+	void Load(DynReg * _dynreg,bool stale=false) {
+		if (!_dynreg) return;
+		if (GCC_UNLIKELY((Bitu)dynreg)) Clear();
+		dynreg=_dynreg;
+		last_used=x86gen.last_used;
+		dynreg->flags&=~DYNFLG_CHANGED;
+		dynreg->genreg=this;
+		if ((!stale) && (dynreg->flags & (DYNFLG_LOAD|DYNFLG_ACTIVE))) {
+			gen_memop(0x8b,false,0,index,dynreg->data);		//Mov reg,[data]
+		}
+		dynreg->flags|=DYNFLG_ACTIVE;
+	}
+	void Save(void) {
+		if (GCC_UNLIKELY(!((Bitu)dynreg))) IllegalOption("GenReg->Save");
+		dynreg->flags&=~DYNFLG_CHANGED;
+		gen_memop(0x89,false,0,index,dynreg->data);			//Mov [data],reg
+	}
+	void Release(void) {
+		if (GCC_UNLIKELY(!((Bitu)dynreg))) return;
+		if (dynreg->flags&DYNFLG_CHANGED && dynreg->flags&DYNFLG_SAVE) {
+			Save();
+		}
+		dynreg->flags&=~(DYNFLG_CHANGED|DYNFLG_ACTIVE);
+		dynreg->genreg=0;dynreg=0;
+	}
+	void Clear(void) {
+		if (!dynreg) return;
+		if (dynreg->flags&DYNFLG_CHANGED) {
+			Save();
+		}
+		dynreg->genreg=0;dynreg=0;
+	}
+};
+
+static BlockReturn gen_runcode(Bit8u * code) {
+	return x86gen.runcode(code);
+}
+
+/* Generate the entry code into the link block page, this replaces the inline
+   assembly of the x86 backend that isn't available for all 64bit compilers */
+static void gen_init_runcode(void) {
+	if (!cache_code_link_blocks) return;
+	cache.pos=&cache_code_link_blocks[64];
+	x86gen.runcode=(BlockReturn (*)(Bit8u*))cache.pos;
+	cache_addw(0x5553);				//PUSH RBX,RBP
+	cache_addd(0x55415441);			//PUSH R12,R13
+	cache_addd(0x57415641);			//PUSH R14,R15
+#if defined (_WIN64)
+	cache_addw(0x5756);				//PUSH RSI,RDI
+	cache_addw(0x8b4c);				//MOV R11,RCX
+	cache_addb(0xd9);
+#else
+	cache_addw(0x8b4c);				//MOV R11,RDI
+	cache_addb(0xdf);
+#endif
+	cache_addw(0x8d48);				//LEA RAX,[return address]
+	cache_addb(0x05);
+	Bit8u * ret_addr=cache.pos;
+	cache_addd(0);
+	cache_addb(0x50);				//PUSH RAX
+	gen_memop(0x8b,false,0,1,&reg_flags);	//MOV ECX,[reg_flags]
+	cache_addw(0xe181);				//AND ECX,FMASK_TEST
+	cache_addd(FMASK_TEST);
+	cache_addb(0x51);				//PUSH RCX
+	cache_addw(0xff41);				//JMP R11
+	cache_addb(0xe3);
+	*(Bit32u*)ret_addr=(Bit32u)(cache.pos-(ret_addr+4));
+	/* return here with flags in ecx */
+	cache_addw(0xe181);				//AND ECX,FMASK_TEST
+	cache_addd(FMASK_TEST);
+	gen_memop(0x8b,false,0,2,&reg_flags);	//MOV EDX,[reg_flags]
+	cache_addw(0xe281);				//AND EDX,~FMASK_TEST
+	cache_addd(~FMASK_TEST);
+	cache_addw(0xd10b);				//OR EDX,ECX
+	gen_memop(0x89,false,0,2,&reg_flags);	//MOV [reg_flags],EDX
+#if defined (_WIN64)
+	cache_addw(0x5e5f);				//POP RDI,RSI
+#endif
+	cache_addd(0x5e415f41);			//POP R15,R14
+	cache_addd(0x5c415d41);			//POP R13,R12
+	cache_addw(0x5b5d);				//POP RBP,RBX
+	cache_addb(0xc3);				//RET
+}
+
+static GenReg * FindDynReg(DynReg * dynreg,bool stale=false) {
+	x86gen.last_used++;
+	if (dynreg->genreg) {
+		dynreg->genreg->last_used=x86gen.last_used;
+		return dynreg->genreg;
+	}
+	/* Find best match for selected global reg */
+	Bits i;
+	Bits first_used,first_index;
+	first_used=-1;
+	if (dynreg->flags & DYNFLG_HAS8) {
+		/* Has to be eax,ebx,ecx,edx */
+		for (i=first_index=0;i<=X86_REG_EBX;i++) {
+			GenReg * genreg=x86gen.regs[i];
+			if (genreg->notusable) continue;
+			if (!(genreg->dynreg)) {
+				genreg->Load(dynreg,stale);
+				return genreg;
+			}
+			if (genreg->last_used<(Bitu)first_used) {
+				first_used=genreg->last_used;
+				first_index=i;
+			}
+		}
+	} else {
+		for (i=first_index=X86_REGS-1;i>=0;i--) {
+			GenReg * genreg=x86gen.regs[i];
+			if (genreg->notusable) continue;
+			if (!(genreg->dynreg)) {
+				genreg->Load(dynreg,stale);
+				return genreg;
+			}
+			if (genreg->last_used<(Bitu)first_used) {
+				first_used=genreg->last_used;
+				first_index=i;
+			}
+		}
+	}
+	/* No free register found use earliest assigned one */
+	GenReg * newreg=x86gen.regs[first_index];
+	newreg->Load(dynreg,stale);
+	return newreg;
+}
+
+static GenReg * ForceDynReg(GenReg * genreg,DynReg * dynreg) {
+	genreg->last_used=++x86gen.last_used;
+	if (dynreg->genreg==genreg) return genreg;
+	if (genreg->dynreg) genreg->Clear();
+	if (dynreg->genreg) dynreg->genreg->Clear();
+	genreg->Load(dynreg);
+	return genreg;
+}
+
+static void gen_preloadreg(DynReg * dynreg) {
+	FindDynReg(dynreg);
+}
+
+static void gen_releasereg(DynReg * dynreg) {
+	GenReg * genreg=dynreg->genreg;
+	if (genreg) genreg->Release();
+	else dynreg->flags&=~(DYNFLG_ACTIVE|DYNFLG_CHANGED);
+}
+
+static void gen_setupreg(DynReg * dnew,DynReg * dsetup) {
+	dnew->flags=dsetup->flags;
+	if (dnew->genreg==dsetup->genreg) return;
+	/* Not the same genreg must be wrong */
+	if (dnew->genreg) {
+		/* Check if the genreg i'm changing is actually linked to me */
+		if (dnew->genreg->dynreg==dnew) dnew->genreg->dynreg=0;
+	}
+	dnew->genreg=dsetup->genreg;
+	if (dnew->genreg) dnew->genreg->dynreg=dnew;
+}
+
+static void gen_synchreg(DynReg * dnew,DynReg * dsynch) {
+	/* First make sure the registers match */
+	if (dnew->genreg!=dsynch->genreg) {
+		if (dnew->genreg) dnew->genreg->Clear();
+		if (dsynch->genreg) {
+			dsynch->genreg->Load(dnew);
+		}
+	}
+	/* Always use the loadonce flag from either state */
+	dnew->flags|=(dsynch->flags & dnew->flags&DYNFLG_ACTIVE);
+	if ((dnew->flags ^ dsynch->flags) & DYNFLG_CHANGED) {
+		/* Ensure the changed value gets saved */
+		if (dnew->flags & DYNFLG_CHANGED) {
+			dnew->genreg->Save();
+		} else dnew->flags|=DYNFLG_CHANGED;
+	}
+}
+
+static void gen_needflags(void) {
+	if (!x86gen.flagsactive) {
+		x86gen.flagsactive=true;
+		cache_addb(0x9d);		//POPFQ
+	}
+}
+
+static void gen_protectflags(void) {
+	if (x86gen.flagsactive) {
+		x86gen.flagsactive=false;
+		cache_addb(0x9c);		//PUSHFQ
+	}
+}
+
+static void gen_discardflags(void) {
+	if (!x86gen.flagsactive) {
+		x86gen.flagsactive=true;
+		cache_addd(0x08c48348);		//ADD RSP,8
+	}
+}
+
+static void gen_needcarry(void) {
+	if (!x86gen.flagsactive) {
+		x86gen.flagsactive=true;
+		cache_addw(0x2cd1);			//SHR DWORD [RSP],1
+		cache_addb(0x24);
+		cache_addb(0x48);			//LEA RSP,[RSP+8]
+		cache_addd(0x0824648d);
+	}
+}
+
+static void gen_setzeroflag(void) {
+	if (x86gen.flagsactive) IllegalOption("gen_setzeroflag");
+	cache_addw(0x0c83);			//OR DWORD [RSP],0x40
+	cache_addw(0x4024);
+}
+
+static void gen_clearzeroflag(void) {
+	if (x86gen.flagsactive) IllegalOption("gen_clearzeroflag");
+	cache_addw(0x2483);			//AND DWORD [RSP],~0x40
+	cache_addw(0xbf24);
+}
+
+static bool skip_flags=false;
+
+static void set_skipflags(bool state) {
+	if (!state) gen_discardflags();
+	skip_flags=state;
+}
+
+static void gen_reinit(void) {
+	x86gen.last_used=0;
+	x86gen.flagsactive=false;
+	for (Bitu i=0;i<X86_REGS;i++) {
+		x86gen.regs[i]->dynreg=0;
+	}
+}
+
+
+static void gen_load_host(void * data,DynReg * dr1,Bitu size) {
+	GenReg * gr1=FindDynReg(dr1,true);
+	switch (size) {
+	case 1:gen_memop(0xb60f,false,0,gr1->index,data);break;	//movzx byte
+	case 2:gen_memop(0xb70f,false,0,gr1->index,data);break;	//movzx word
+	case 4:gen_memop(0x8b,false,0,gr1->index,data);break;	//mov
+	default:
+		IllegalOption("gen_load_host");
+	}
+	dr1->flags|=DYNFLG_CHANGED;
+}
+
+static void gen_mov_host(void * data,DynReg * dr1,Bitu size,Bit8u di1=0) {
+	GenReg * gr1=FindDynReg(dr1,(size==4));
+	switch (size) {
+	case 1:gen_memop(0x8a,false,0,gr1->index+(di1?4:0),gen_near_byte(data));break;	//mov byte
+	case 2:gen_memop(0x8b,true,0,gr1->index,data);break;	//mov word
+	case 4:gen_memop(0x8b,false,0,gr1->index,data);break;	//mov
+	default:
+		IllegalOption("gen_load_host");
+	}
+	dr1->flags|=DYNFLG_CHANGED;
+}
+
+/* Instruction on a host variable for code emitted outside the backend */
+static void gen_memop_host(Bitu op,Bitu reg,void * data) {
+	gen_memop(op,false,0,reg,data);
+}
+
+
+static void gen_dop_byte(DualOps op,DynReg * dr1,Bit8u di1,DynReg * dr2,Bit8u di2) {
+	GenReg * gr1=FindDynReg(dr1);GenReg * gr2=FindDynReg(dr2);
+	Bit8u tmp;
+	switch (op) {
+	case DOP_ADD:	tmp=0x02; break;
+	case DOP_ADC:	tmp=0x12; break;
+	case DOP_SUB:	tmp=0x2a; break;
+	case DOP_SBB:	tmp=0x1a; break;
+	case DOP_CMP:	tmp=0x3a; goto nochange;
+	case DOP_XOR:	tmp=0x32; break;
+	case DOP_AND:	tmp=0x22; if ((dr1==dr2) && (di1==di2)) goto nochange; break;
+	case DOP_OR:	tmp=0x0a; if ((dr1==dr2) && (di1==di2)) goto nochange; break;
+	case DOP_TEST:	tmp=0x84; goto nochange;
+	case DOP_MOV:	if ((dr1==dr2) && (di1==di2)) return; tmp=0x8a; break;
+	case DOP_XCHG:	tmp=0x86; dr2->flags|=DYNFLG_CHANGED; break;
+	default:
+		IllegalOption("gen_dop_byte");
+	}
+	dr1->flags|=DYNFLG_CHANGED;
+nochange:
+	cache_addw(tmp|(0xc0+((gr1->index+di1)<<3)+gr2->index+di2)<<8);
+}
+
+static void gen_dop_byte_imm(DualOps op,DynReg * dr1,Bit8u di1,Bitu imm) {
+	GenReg * gr1=FindDynReg(dr1);
+	Bit16u tmp;
+	switch (op) {
+	case DOP_ADD:	tmp=0xc080; break;
+	case DOP_ADC:	tmp=0xd080; break;
+	case DOP_SUB:	tmp=0xe880; break;
+	case DOP_SBB:	tmp=0xd880; break;
+	case DOP_CMP:	tmp=0xf880; goto nochange;	//Doesn't change
+	case DOP_XOR:	tmp=0xf080; break;
+	case DOP_AND:	tmp=0xe080; break;
+	case DOP_OR:	tmp=0xc880; break;
+	case DOP_TEST:	tmp=0xc0f6; goto nochange;	//Doesn't change
+	case DOP_MOV:	cache_addb(0xb0+gr1->index+di1);
+					dr1->flags|=DYNFLG_CHANGED;
+					goto finish;
+	default:
+		IllegalOption("gen_dop_byte_imm");
+	}
+	dr1->flags|=DYNFLG_CHANGED;
+nochange:
+	cache_addw(tmp+((gr1->index+di1)<<8));
+finish:
+	cache_addb(imm);
+}
+
+static void gen_dop_byte_imm_mem(DualOps op,DynReg * dr1,Bit8u di1,void* data) {
+	GenReg * gr1=FindDynReg(dr1);
+	Bit8u tmp;
+	switch (op) {
+	case DOP_ADD:	tmp=0x02; break;
+	case DOP_ADC:	tmp=0x12; break;
+	case DOP_SUB:	tmp=0x2a; break;
+	case DOP_SBB:	tmp=0x1a; break;
+	case DOP_CMP:	tmp=0x3a; goto nochange;	//Doesn't change
+	case DOP_XOR:	tmp=0x32; break;
+	case DOP_AND:	tmp=0x22; break;
+	case DOP_OR:	tmp=0x0a; break;
+	case DOP_TEST:	tmp=0x84; goto nochange;	//Doesn't change
+	case DOP_MOV:	tmp=0x8a; break;
+	default:
+		IllegalOption("gen_dop_byte_imm_mem");
+	}
+	dr1->flags|=DYNFLG_CHANGED;
+nochange:
+	gen_memop(tmp,false,0,gr1->index+di1,gen_near_byte(data));
+}
+
+static void gen_sop_byte(SingleOps op,DynReg * dr1,Bit8u di1) {
+	GenReg * gr1=FindDynReg(dr1);
+	Bit16u tmp;
+	switch (op) {
+	case SOP_INC: tmp=0xc0FE; break;
+	case SOP_DEC: tmp=0xc8FE; break;
+	case SOP_NOT: tmp=0xd0f6; break;
+	case SOP_NEG: tmp=0xd8f6; break;
+	default:
+		IllegalOption("gen_sop_byte");
+	}
+	cache_addw(tmp + ((gr1->index+di1)<<8));
+	dr1->flags|=DYNFLG_CHANGED;
+}
+
+
+static void gen_extend_word(bool sign,DynReg * ddr,DynReg * dsr) {
+	GenReg * gsr=FindDynReg(dsr);
+	GenReg * gdr=FindDynReg(ddr,true);
+	gen_rex(0,gdr->index,gsr->index);
+	if (sign) cache_addw(0xbf0f);
+	else cache_addw(0xb70f);
+	cache_addb(0xc0+((gdr->index&7)<<3)+(gsr->index&7));
+	ddr->flags|=DYNFLG_CHANGED;
+}
+
+static void gen_extend_byte(bool sign,bool dword,DynReg * ddr,DynReg * dsr,Bit8u dsi) {
+	GenReg * gsr=FindDynReg(dsr);
+	GenReg * gdr=FindDynReg(ddr,dword);
+	Bitu src=gsr->index+dsi;
+	if (dsi && (gdr->index&8)) {
+		/* ah-bh can't be combined with a rex prefix, shift it into r11b */
+		cache_addw(0x8b44);			//MOV R11D,reg
+		cache_addb(0xd8+gsr->index);
+		cache_addd(0x08ebc141);		//SHR R11D,8
+		src=11;
+	}
+	if (!dword) cache_addb(0x66);
+	gen_rex(0,gdr->index,src);
+	if (sign) cache_addw(0xbe0f);
+	else cache_addw(0xb60f);
+	cache_addb(0xc0+((gdr->index&7)<<3)+(src&7));
+	ddr->flags|=DYNFLG_CHANGED;
+}
+
+static void gen_lea(DynReg * ddr,DynReg * dsr1,DynReg * dsr2,Bitu scale,Bits imm) {
+	GenReg * gdr=FindDynReg(ddr);
+	Bitu imm_size;
+	Bit8u rm_base=((gdr->index&7) << 3);
+	Bit8u rex=(gdr->index&8)>>1;
+	if (dsr1) {
+		GenReg * gsr1=FindDynReg(dsr1);
+		rex|=(gsr1->index&8)>>3;
+		if (!imm && ((gsr1->index&7)!=0x5)) {
+			imm_size=0;	rm_base+=0x0;			//no imm
+		} else if ((imm>=-128 && imm<=127)) {
+			imm_size=1;rm_base+=0x40;			//Signed byte imm
+		} else {
+			imm_size=4;rm_base+=0x80;			//Signed dword imm
+		}
+		if (dsr2) {
+			GenReg * gsr2=FindDynReg(dsr2);
+			rex|=(gsr2->index&8)>>2;
+			if (rex) cache_addb(0x40|rex);
+			cache_addb(0x8d);		//LEA
+			cache_addb(rm_base+0x4);			//The sib indicator
+			Bit8u sib=(gsr1->index&7)+((gsr2->index&7)<<3)+(scale<<6);
+			cache_addb(sib);
+		} else {
+			if ((ddr==dsr1) && !imm_size) return;
+			if (rex) cache_addb(0x40|rex);
+			cache_addb(0x8d);		//LEA
+			if ((gsr1->index&7)==0x4) {
+				cache_addb(rm_base+0x4);		//r12 needs a sib
+				cache_addb(0x24);
+			} else cache_addb(rm_base+(gsr1->index&7));
+		}
+	} else {
+		if (dsr2) {
+			GenReg * gsr2=FindDynReg(dsr2);
+			rex|=(gsr2->index&8)>>2;
+			if (rex) cache_addb(0x40|rex);
+			cache_addb(0x8d);			//LEA
+			cache_addb(rm_base+0x4);	//The sib indicator
+			Bit8u sib=(5+((gsr2->index&7)<<3)+(scale<<6));
+			cache_addb(sib);
+			imm_size=4;
+		} else {
+			if (rex) cache_addb(0x40|rex);
+			cache_addb(0x8d);			//LEA
+			cache_addb(rm_base+0x04);	//dword imm, without sib it would be rip-relative
+			cache_addb(0x25);
+			imm_size=4;
+		}
+	}
+	switch (imm_size) {
+	case 0:	break;
+	case 1:cache_addb(imm);break;
+	case 4:cache_addd(imm);break;
+	}
+	ddr->flags|=DYNFLG_CHANGED;
+}
+
+static void gen_dop_word(DualOps op,bool dword,DynReg * dr1,DynReg * dr2) {
+	GenReg * gr2=FindDynReg(dr2);
+	GenReg * gr1=FindDynReg(dr1,dword && op==DOP_MOV);
+	Bit8u tmp;
+	switch (op) {
+	case DOP_ADD:	tmp=0x03; break;
+	case DOP_ADC:	tmp=0x13; break;
+	case DOP_SUB:	tmp=0x2b; break;
+	case DOP_SBB:	tmp=0x1b; break;
+	case DOP_CMP:	tmp=0x3b; goto nochange;
+	case DOP_XOR:	tmp=0x33; break;
+	case DOP_AND:	tmp=0x23; if (dr1==dr2) goto nochange; break;
+	case DOP_OR:	tmp=0x0b; if (dr1==dr2) goto nochange; break;
+	case DOP_TEST:	tmp=0x85; goto nochange;
+	case DOP_MOV:	if (dr1==dr2) return; tmp=0x8b; break;
+	case DOP_XCHG:
+		dr2->flags|=DYNFLG_CHANGED;
+		if (dword && !((dr1->flags&DYNFLG_HAS8) ^ (dr2->flags&DYNFLG_HAS8))) {
+			dr1->genreg=gr2;dr1->genreg->dynreg=dr1;
+			dr2->genreg=gr1;dr2->genreg->dynreg=dr2;
+			dr1->flags|=DYNFLG_CHANGED;
+			return;
+		}
+		tmp=0x87;
+		break;
+	default:
+		IllegalOption("gen_dop_word");
+	}
+	dr1->flags|=DYNFLG_CHANGED;
+nochange:
+	if (!dword) cache_addb(0x66);
+	gen_rex(0,gr1->index,gr2->index);
+	cache_addw(tmp|(0xc0+((gr1->index&7)<<3)+(gr2->index&7))<<8);
+}
+
+static void gen_dop_word_imm(DualOps op,bool dword,DynReg * dr1,Bits imm) {
+	GenReg * gr1=FindDynReg(dr1,dword && op==DOP_MOV);
+	Bit16u tmp;
+	if (!dword) cache_addb(0x66);
+	gen_rex(0,0,gr1->index);
+	switch (op) {
+	case DOP_ADD:	tmp=0xc081; break;
+	case DOP_ADC:	tmp=0xd081; break;
+	case DOP_SUB:	tmp=0xe881; break;
+	case DOP_SBB:	tmp=0xd881; break;
+	case DOP_CMP:	tmp=0xf881; goto nochange;	//Doesn't change
+	case DOP_XOR:	tmp=0xf081; break;
+	case DOP_AND:	tmp=0xe081; break;
+	case DOP_OR:	tmp=0xc881; break;
+	case DOP_TEST:	tmp=0xc0f7; goto nochange;	//Doesn't change
+	case DOP_MOV:	cache_addb(0xb8+(gr1->index&7)); dr1->flags|=DYNFLG_CHANGED; goto finish;
+	default:
+		IllegalOption("gen_dop_word_imm");
+	}
+	dr1->flags|=DYNFLG_CHANGED;
+nochange:
+	cache_addw(tmp+((gr1->index&7)<<8));
+finish:
+	if (dword) cache_addd(imm);
+	else cache_addw(imm);
+}
+
+static void gen_dop_word_imm_mem(DualOps op,bool dword,DynReg * dr1,void* data) {
+	GenReg * gr1=FindDynReg(dr1,dword && op==DOP_MOV);
+	Bit8u tmp;
+	switch (op) {
+	case DOP_ADD:	tmp=0x03; break;
+	case DOP_ADC:	tmp=0x13; break;
+	case DOP_SUB:	tmp=0x2b; break;
+	case DOP_SBB:	tmp=0x1b; break;
+	case DOP_CMP:	tmp=0x3b; goto nochange;	//Doesn't change
+	case DOP_XOR:	tmp=0x33; break;
+	case DOP_AND:	tmp=0x23; break;
+	case DOP_OR:	tmp=0x0b; break;
+	case DOP_TEST:	tmp=0x85; goto nochange;	//Doesn't change
+	case DOP_MOV:
+		gen_mov_host(data,dr1,dword?4:2);
+		dr1->flags|=DYNFLG_CHANGED;
+		return;
+	default:
+		IllegalOption("gen_dop_word_imm_mem");
+	}
+	dr1->flags|=DYNFLG_CHANGED;
+nochange:
+	gen_memop(tmp,!dword,0,gr1->index,data);
+}
+
+static void gen_dop_word_var(DualOps op,bool dword,DynReg * dr1,void* drd) {
+	GenReg * gr1=FindDynReg(dr1,dword && op==DOP_MOV);
+	Bit8u tmp;
+	switch (op) {
+	case DOP_ADD:	tmp=0x03; break;
+	case DOP_ADC:	tmp=0x13; break;
+	case DOP_SUB:	tmp=0x2b; break;
+	case DOP_SBB:	tmp=0x1b; break;
+	case DOP_CMP:	tmp=0x3b; break;
+	case DOP_XOR:	tmp=0x33; break;
+	case DOP_AND:	tmp=0x23; break;
+	case DOP_OR:	tmp=0x0b; break;
+	case DOP_TEST:	tmp=0x85; break;
+	case DOP_MOV:	tmp=0x8b; break;
+	case DOP_XCHG:	tmp=0x87; break;
+	default:
+		IllegalOption("gen_dop_word_var");
+	}
+	gen_memop(tmp,!dword,0,gr1->index,drd);
+}
+
+static void gen_imul_word(bool dword,DynReg * dr1,DynReg * dr2) {
+	GenReg * gr1=FindDynReg(dr1);GenReg * gr2=FindDynReg(dr2);
+	dr1->flags|=DYNFLG_CHANGED;
+	if (!dword) cache_addb(0x66);
+	gen_rex(0,gr1->index,gr2->index);
+	cache_addw(0xaf0f);
+	cache_addb(0xc0+((gr1->index&7)<<3)+(gr2->index&7));
+}
+
+static void gen_imul_word_imm(bool dword,DynReg * dr1,DynReg * dr2,Bits imm) {
+	GenReg * gr1=FindDynReg(dr1);GenReg * gr2=FindDynReg(dr2);
+	if (!dword) cache_addb(0x66);
+	gen_rex(0,gr1->index,gr2->index);
+	if ((imm>=-128 && imm<=127)) {
+		cache_addb(0x6b);
+		cache_addb(0xc0+((gr1->index&7)<<3)+(gr2->index&7));
+		cache_addb(imm);
+	} else {
+		cache_addb(0x69);
+		cache_addb(0xc0+((gr1->index&7)<<3)+(gr2->index&7));
+		if (dword) cache_addd(imm);
+		else cache_addw(imm);
+	}
+	dr1->flags|=DYNFLG_CHANGED;
+}
+
+
+static void gen_sop_word(SingleOps op,bool dword,DynReg * dr1) {
+	GenReg * gr1=FindDynReg(dr1);
+	if (!dword) cache_addb(0x66);
+	gen_rex(0,0,gr1->index);
+	switch (op) {
+	case SOP_INC:cache_addw(0xc0ff+((gr1->index&7)<<8));break;	// 0x40+reg is a rex prefix
+	case SOP_DEC:cache_addw(0xc8ff+((gr1->index&7)<<8));break;
+	case SOP_NOT:cache_addw(0xd0f7+((gr1->index&7)<<8));break;
+	case SOP_NEG:cache_addw(0xd8f7+((gr1->index&7)<<8));break;
+	default:
+		IllegalOption("gen_sop_word");
+	}
+	dr1->flags|=DYNFLG_CHANGED;
+}
+
+static void gen_shift_byte_cl(Bitu op,DynReg * dr1,Bit8u di1,DynReg * drecx) {
+	ForceDynReg(x86gen.regs[X86_REG_ECX],drecx);
+	GenReg * gr1=FindDynReg(dr1);
+	cache_addw(0xc0d2+(((Bit16u)op) << 11)+ ((gr1->index+di1)<<8));
+	dr1->flags|=DYNFLG_CHANGED;
+}
+
+static void gen_shift_byte_imm(Bitu op,DynReg * dr1,Bit8u di1,Bit8u imm) {
+	GenReg * gr1=FindDynReg(dr1);
+	cache_addw(0xc0c0+(((Bit16u)op) << 11) + ((gr1->index+di1)<<8));
+	cache_addb(imm);
+	dr1->flags|=DYNFLG_CHANGED;
+}
+
+static void gen_shift_word_cl(Bitu op,bool dword,DynReg * dr1,DynReg * drecx) {
+	ForceDynReg(x86gen.regs[X86_REG_ECX],drecx);
+	GenReg * gr1=FindDynReg(dr1);
+	if (!dword) cache_addb(0x66);
+	gen_rex(0,0,gr1->index);
+	cache_addw(0xc0d3+(((Bit16u)op) << 11) + ((gr1->index&7)<<8));
+	dr1->flags|=DYNFLG_CHANGED;
+}
+
+static void gen_shift_word_imm(Bitu op,bool dword,DynReg * dr1,Bit8u imm) {
+	GenReg * gr1=FindDynReg(dr1);
+	dr1->flags|=DYNFLG_CHANGED;
+	if (!dword) cache_addb(0x66);
+	gen_rex(0,0,gr1->index);
+	cache_addw(0xc0c1+((Bit16u)op << 11) + ((gr1->index&7)<<8));
+	cache_addb(imm);
+}
+
+static void gen_cbw(bool dword,DynReg * dyn_ax) {
+	ForceDynReg(x86gen.regs[X86_REG_EAX],dyn_ax);
+	if (!dword) cache_addb(0x66);
+	cache_addb(0x98);
+	dyn_ax->flags|=DYNFLG_CHANGED;
+}
+
+static void gen_cwd(bool dword,DynReg * dyn_ax,DynReg * dyn_dx) {
+	ForceDynReg(x86gen.regs[X86_REG_EAX],dyn_ax);
+	ForceDynReg(x86gen.regs[X86_REG_EDX],dyn_dx);
+	dyn_ax->flags|=DYNFLG_CHANGED;
+	dyn_dx->flags|=DYNFLG_CHANGED;
+	if (!dword) cache_addw(0x9966);
+	else cache_addb(0x99);
+}
+
+static void gen_mul_byte(bool imul,DynReg * dyn_ax,DynReg * dr1,Bit8u di1) {
+	ForceDynReg(x86gen.regs[X86_REG_EAX],dyn_ax);
+	GenReg * gr1=FindDynReg(dr1);
+	if (imul) cache_addw(0xe8f6+((gr1->index+di1)<<8));
+	else cache_addw(0xe0f6+((gr1->index+di1)<<8));
+	dyn_ax->flags|=DYNFLG_CHANGED;
+}
+
+static void gen_mul_word(bool imul,DynReg * dyn_ax,DynReg * dyn_dx,bool dword,DynReg * dr1) {
+	ForceDynReg(x86gen.regs[X86_REG_EAX],dyn_ax);
+	ForceDynReg(x86gen.regs[X86_REG_EDX],dyn_dx);
+	GenReg * gr1=FindDynReg(dr1);
+	if (!dword) cache_addb(0x66);
+	gen_rex(0,0,gr1->index);
+	if (imul) cache_addw(0xe8f7+((gr1->index&7)<<8));
+	else cache_addw(0xe0f7+((gr1->index&7)<<8));
+	dyn_ax->flags|=DYNFLG_CHANGED;
+	dyn_dx->flags|=DYNFLG_CHANGED;
+}
+
+static void gen_dshift_imm(bool dword,bool left,DynReg * dr1,DynReg * dr2,Bitu imm) {
+	GenReg * gr1=FindDynReg(dr1);
+	GenReg * gr2=FindDynReg(dr2);
+	if (!dword) cache_addb(0x66);
+	gen_rex(0,gr2->index,gr1->index);
+	if (left) cache_addw(0xa40f);		//SHLD IMM
+	else  cache_addw(0xac0f);			//SHRD IMM
+	cache_addb(0xc0+(gr1->index&7)+((gr2->index&7)<<3));
+	cache_addb(imm);
+	dr1->flags|=DYNFLG_CHANGED;
+}
+
+static void gen_dshift_cl(bool dword,bool left,DynReg * dr1,DynReg * dr2,DynReg * drecx) {
+	ForceDynReg(x86gen.regs[X86_REG_ECX],drecx);
+	GenReg * gr1=FindDynReg(dr1);
+	GenReg * gr2=FindDynReg(dr2);
+	if (!dword) cache_addb(0x66);
+	gen_rex(0,gr2->index,gr1->index);
+	if (left) cache_addw(0xa50f);		//SHLD CL
+	else  cache_addw(0xad0f);			//SHRD CL
+	cache_addb(0xc0+(gr1->index&7)+((gr2->index&7)<<3));
+	dr1->flags|=DYNFLG_CHANGED;
+}
+
+/* Free the registers a called function may change */
+static void gen_clear_volatile(void) {
+	x86gen.regs[X86_REG_ECX]->Clear();
+	x86gen.regs[X86_REG_EDX]->Clear();
+#if !defined (_WIN64)
+	x86gen.regs[X86_REG_ESI]->Clear();
+	x86gen.regs[X86_REG_EDI]->Clear();
+#endif
+	x86gen.regs[X86_REG_R8]->Clear();
+	x86gen.regs[X86_REG_R9]->Clear();
+	x86gen.regs[X86_REG_R10]->Clear();
+}
+
+/* Pop the parameters pushed by gen_call_function into the argument registers */
+static void gen_load_args(Bits paramcount) {
+	if (paramcount>X64_ARGS) IllegalOption("gen_call_function too many params");
+	for (Bits i=0;i<paramcount;i++) {
+		gen_rex(0,0,x64_argregs[i]);
+		cache_addb(0x58+(x64_argregs[i]&7));	//POP reg
+	}
+}
+
+/* Call with the stack aligned to 16 bytes as the abi requires, the
+   generated code itself doesn't keep rsp aligned */
+static void gen_call_aligned(void * func) {
+	cache_addw(0x8b4c);			//MOV R11,RSP
+	cache_addb(0xdc);
+	cache_addd(0xf0e48348);		//AND RSP,-16
+	cache_addw(0x5341);			//PUSH R11
+	cache_addd(0x00ec8348+((8+X64_SHADOW)<<24));	//SUB RSP,8+shadow
+	Bit64s diff=(Bit64s)((Bit8u*)func-(cache.pos+5));
+	if ((diff>=-0x7fffffffLL) && (diff<=0x7fffffffLL)) {
+		cache_addb(0xe8);		//CALL rel32
+		cache_addd((Bit32u)diff);
+	} else {
+		cache_addw(0xb848);		//MOV RAX,imm64
+		cache_addq((Bit64u)func);
+		cache_addw(0xd0ff);		//CALL RAX
+	}
+	cache_addd(0x00c48348+((8+X64_SHADOW)<<24));	//ADD RSP,8+shadow
+	cache_addb(0x5c);			//POP RSP
+}
+
+static void gen_call_function(void * func,char const* ops,...) {
+	Bits paramcount=0;
+	bool release_flags=false;
+	struct ParamInfo {
+		const char * line;
+		Bitu value;
+	} pinfo[32];
+	ParamInfo * retparam=0;
+	/* Clear the EAX Genreg for usage */
+	x86gen.regs[X86_REG_EAX]->Clear();
+	x86gen.regs[X86_REG_EAX]->notusable=true;
+	/* Save the flags */
+	if (GCC_UNLIKELY(!skip_flags)) gen_protectflags();
+	/* Scan for the amount of params */
+	if (ops) {
+		va_list params;
+		va_start(params,ops);
+		Bits pindex=0;
+		while (*ops) {
+			if (*ops=='%') {
+				pinfo[pindex].line=ops+1;
+				pinfo[pindex].value=va_arg(params,Bitu);
+				pindex++;
+			}
+			ops++;
+		}
+		va_end(params);
+
+		/* Push the params in reverse order, they get popped into the
+		   argument registers once the volatile registers are freed */
+		paramcount=0;
+		while (pindex) {
+			pindex--;
+			const char * scan=pinfo[pindex].line;
+			switch (*scan++) {
+			case 'I':				/* immediate value */
+				paramcount++;
+				if (*scan=='p') {		/* full pointer */
+					cache_addw(0xb848);		//MOV RAX,imm64
+					cache_addq((Bit64u)pinfo[pindex].value);
+				} else {
+					cache_addb(0xb8);		//MOV EAX,imm32
+					cache_addd((Bit32u)pinfo[pindex].value);
+				}
+				cache_addb(0x50);			//Push RAX
+				break;
+			case 'D':				/* Dynamic register */
+				{
+					bool release=false;
+					paramcount++;
+					DynReg * dynreg=(DynReg *)pinfo[pindex].value;
+					GenReg * genreg=FindDynReg(dynreg);
+					scanagain:
+					switch (*scan++) {
+					case 'd':
+						gen_rex(0,0,genreg->index);
+						cache_addb(0x50+(genreg->index&7));	//Push reg
+						break;
+					case 'w':
+						gen_rex(0,0,genreg->index);
+						cache_addw(0xb70f);					//MOVZX EAX,reg
+						cache_addb(0xc0+(genreg->index&7));
+						cache_addb(0x50);					//Push RAX
+						break;
+					case 'l':
+						cache_addw(0xb60f);					//MOVZX EAX,reg[0]
+						cache_addb(0xc0+genreg->index);
+						cache_addb(0x50);					//Push RAX
+						break;
+					case 'h':
+						cache_addw(0xb60f);					//MOVZX EAX,reg[1]
+						cache_addb(0xc4+genreg->index);
+						cache_addb(0x50);					//Push RAX
+						break;
+					case 'r':								/* release the reg afterwards */
+						release=true;
+						goto scanagain;
+					default:
+						IllegalOption("gen_call_function param:DREG");
+					}
+					if (release) gen_releasereg(dynreg);
+				}
+				break;
+			case 'R':				/* Dynamic register to get the return value */
+				retparam =&pinfo[pindex];
+				pinfo[pindex].line=scan;
+				break;
+			case 'F':				/* Pass the flags on the stack, released afterwards */
+				paramcount++;
+				release_flags=true;
+				cache_addw(0x34ff);			//PUSH QWORD [RSP]
+				cache_addb(0x24);
+				break;
+			default:
+				IllegalOption("gen_call_function unknown param");
+			}
+		}
+	}
+
+	/* Clear some unprotected registers */
+	gen_clear_volatile();
+	gen_load_args(paramcount);
+	/* Do the actual call to the procedure */
+	gen_call_aligned(func);
+	if (release_flags) cache_addd(0x08c48348);	//ADD RSP,8
+	/* Save the return value in correct register */
+	if (retparam) {
+		DynReg * dynreg=(DynReg *)retparam->value;
+		GenReg * genreg=FindDynReg(dynreg);
+		if (genreg->index)		// test for (e)ax/al
+		switch (*retparam->line) {
+		case 'd':
+			gen_rex(0,genreg->index,0);
+			cache_addw(0xc08b+((genreg->index&7) <<(8+3)));	//mov reg,eax
+			break;
+		case 'w':
+			cache_addb(0x66);
+			gen_rex(0,genreg->index,0);
+			cache_addw(0xc08b+((genreg->index&7) <<(8+3)));	//mov reg,eax
+			break;
+		case 'l':
+			cache_addw(0xc08a+(genreg->index <<(8+3)));	//mov reg,eax
+			break;
+		case 'h':
+			cache_addw(0xc08a+((genreg->index+4) <<(8+3)));	//mov reg,eax
+			break;
+		}
+		dynreg->flags|=DYNFLG_CHANGED;
+	}
+	/* Restore EAX registers to be used again */
+	x86gen.regs[X86_REG_EAX]->notusable=false;
+}
+
+static void gen_call_write(DynReg * dr,Bit32u val,Bitu write_size) {
+	/* Clear the EAX Genreg for usage */
+	x86gen.regs[X86_REG_EAX]->Clear();
+	x86gen.regs[X86_REG_EAX]->notusable=true;
+	gen_protectflags();
+
+	GenReg * genreg=FindDynReg(dr);
+	gen_rex(0,0,genreg->index);
+	cache_addb(0x50+(genreg->index&7));		//PUSH reg
+
+	/* Clear some unprotected registers */
+	gen_clear_volatile();
+	gen_load_args(1);
+	gen_rex(0,0,x64_argregs[1]);
+	cache_addb(0xb8+(x64_argregs[1]&7));	//MOV arg2,val
+	cache_addd(val);
+	/* Do the actual call to the procedure */
+	switch (write_size) {
+		case 1: gen_call_aligned((void *)&mem_writeb_checked); break;
+		case 2: gen_call_aligned((void *)&mem_writew_checked); break;
+		case 4: gen_call_aligned((void *)&mem_writed_checked); break;
+		default: IllegalOption("gen_call_write");
+	}
+
+	x86gen.regs[X86_REG_EAX]->notusable=false;
+	gen_releasereg(dr);
+}
+
+static Bit8u * gen_create_branch(BranchTypes type) {
+	/* First free all registers */
+	cache_addw(0x70+type);
+	return (cache.pos-1);
+}
+
+static void gen_fill_branch(Bit8u * data,Bit8u * from=cache.pos) {
+#if C_DEBUG
+	Bits len=from-data;
+	if (len<0) len=-len;
+	if (len>126) LOG_MSG("Big jump %d",(int)len);
+#endif
+	*data=(from-data-1);
+}
+
+static Bit8u * gen_create_branch_long(BranchTypes type) {
+	cache_addw(0x800f+(type<<8));
+	cache_addd(0);
+	return (cache.pos-4);
+}
+
+static void gen_fill_branch_long(Bit8u * data,Bit8u * from=cache.pos) {
+	*((Bit32u*)data) = (Bit32u)(from-data-4);
+}
+
+static Bit8u * gen_create_jump(Bit8u * to=0) {
+	/* First free all registers */
+	cache_addb(0xe9);
+	cache_addd((Bit32u)(to-(cache.pos+4)));
+	return (cache.pos-4);
+}
+
+static void gen_fill_jump(Bit8u * data,Bit8u * to=cache.pos) {
+	*(Bit32u*)data=(Bit32u)(to-data-4);
+}
+
+
+static void gen_jmp_ptr(void * ptr,Bits imm=0) {
+	cache_addw(0xa148);		//MOV RAX,[imm64]
+	cache_addq((Bit64u)ptr);
+	cache_addb(0xff);		//JMP EA
+	if (!imm) {			//NO EBP
+		cache_addb(0x20);
+    } else if ((imm>=-128 && imm<=127)) {
+		cache_addb(0x60);
+		cache_addb(imm);
+	} else {
+		cache_addb(0xa0);
+		cache_addd(imm);
+	}
+}
+
+static void gen_save_flags(DynReg * dynreg) {
+	if (GCC_UNLIKELY(x86gen.flagsactive)) IllegalOption("gen_save_flags");
+	GenReg * genreg=FindDynReg(dynreg);
+	gen_rex(0,genreg->index,0);
+	cache_addb(0x8b);					//MOV REG,[RSP]
+	cache_addw(0x2404+((genreg->index&7) << 3));
+	dynreg->flags|=DYNFLG_CHANGED;
+}
+
+static void gen_load_flags(DynReg * dynreg) {
+	if (GCC_UNLIKELY(x86gen.flagsactive)) IllegalOption("gen_load_flags");
+	cache_addd(0x08c48348);		//ADD RSP,8
+	GenReg * genreg=FindDynReg(dynreg);
+	gen_rex(0,0,genreg->index);
+	cache_addb(0x50+(genreg->index&7));		//PUSH 64
+}
+
+/* Stores a full Bitu, the variables written this way are pointer sized */
+static void gen_save_host_direct(void * data,Bits imm) {
+	if ((Bit64s)imm==(Bit64s)(Bit32s)imm) {
+		gen_memop(0xc7,false,X64_REX_W,0,data,4);	//MOV [],simm32
+		cache_addd((Bit32u)imm);
+	} else {
+		if (!gen_near(data)) IllegalOption("gen_save_host_direct");
+		cache_addw(0xbb49);		//MOV R11,imm64
+		cache_addq((Bit64u)imm);
+		gen_memop(0x89,false,X64_REX_W,11,data);	//MOV [],R11
+	}
+}
+
+static void gen_inc_host_direct(void * data) {
+	gen_memop(0xff,false,0,0,data);		//INC DWORD []
+}
+
+static void gen_dec_host_direct(void * data) {
+	gen_memop(0xff,false,0,1,data);		//DEC DWORD []
+}
+
+static void gen_return(BlockReturn retcode) {
+	gen_protectflags();
+	cache_addb(0x59);			//POP RCX, the flags
+	if (retcode==0) cache_addw(0xc033);		//MOV EAX, 0
+	else {
+		cache_addb(0xb8);		//MOV EAX, retcode
+		cache_addd(retcode);
+	}
+	cache_addb(0xc3);			//RET
+}
+
+static void gen_return_fast(BlockReturn retcode,bool ret_exception=false) {
+	if (GCC_UNLIKELY(x86gen.flagsactive)) IllegalOption("gen_return_fast");
+	gen_memop(0x8b,false,0,1,&cpu_regs.flags);	//MOV ECX, the flags
+	if (!ret_exception) {
+		cache_addd(0x08c48348);		//ADD RSP,8
+		if (retcode==0) cache_addw(0xc033);		//MOV EAX, 0
+		else {
+			cache_addb(0xb8);		//MOV EAX, retcode
+			cache_addd(retcode);
+		}
+	}
+	cache_addb(0xc3);			//RET
+}
+
+static void gen_init(void) {
+	x86gen.regs[X86_REG_EAX]=new GenReg(0);
+	x86gen.regs[X86_REG_ECX]=new GenReg(1);
+	x86gen.regs[X86_REG_EDX]=new GenReg(2);
+	x86gen.regs[X86_REG_EBX]=new GenReg(3);
+	x86gen.regs[X86_REG_EBP]=new GenReg(5);
+	x86gen.regs[X86_REG_ESI]=new GenReg(6);
+	x86gen.regs[X86_REG_EDI]=new GenReg(7);
+	x86gen.regs[X86_REG_R8]=new GenReg(8);
+	x86gen.regs[X86_REG_R9]=new GenReg(9);
+	x86gen.regs[X86_REG_R10]=new GenReg(10);
+	x86gen.regs[X86_REG_R12]=new GenReg(12);
+	x86gen.regs[X86_REG_R13]=new GenReg(13);
+	x86gen.regs[X86_REG_R14]=new GenReg(14);
+	x86gen.regs[X86_REG_R15]=new GenReg(15);
+}
+
+static void gen_free(void) {
+	for (Bitu i=0;i<X86_REGS;i++) {
+		if (x86gen.regs[i]) {
+			delete x86gen.regs[i];
+			x86gen.regs[i] = NULL;
+		}
+	}
+}
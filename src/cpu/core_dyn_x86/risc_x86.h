@@ -343,6 +343,14 @@ static void gen_mov_host(void * data,DynReg * dr1,Bitu size,Bit8u di1=0) {
 	dr1->flags|=DYNFLG_CHANGED;
 }
 
+/* Instruction on a host variable for code emitted outside the backend */
+static void gen_memop_host(Bitu op,Bitu reg,void * data) {
+	if (op>0xff) cache_addw((Bit16u)op);
+	else cache_addb((Bit8u)op);
+	cache_addb(0x05+(reg<<3));
+	cache_addd((Bit32u)data);
+}
+
 
 static void gen_dop_byte(DualOps op,DynReg * dr1,Bit8u di1,DynReg * dr2,Bit8u di2) {
 	GenReg * gr1=FindDynReg(dr1);GenReg * gr2=FindDynReg(dr2);
@@ -1049,6 +1057,16 @@ static void gen_save_host_direct(void * data,Bits imm) {
 	cache_addd(imm);
 }
 
+static void gen_inc_host_direct(void * data) {
+	cache_addw(0x05ff);		//INC DWORD []
+	cache_addd((Bit32u)data);
+}
+
+static void gen_dec_host_direct(void * data) {
+	cache_addw(0x0dff);		//DEC DWORD []
+	cache_addd((Bit32u)data);
+}
+
 static void gen_return(BlockReturn retcode) {
 	gen_protectflags();
 	cache_addb(0x59);			//POP ECX, the flags
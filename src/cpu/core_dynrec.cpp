@@ -0,0 +1,258 @@
+/*
+ *  Copyright (C) 2002-2015  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+#include "dosbox.h"
+
+#if (C_DYNREC)
+
+#include <assert.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#if defined (WIN32)
+#include <windows.h>
+#include <winbase.h>
+#endif
+
+#if (C_HAVE_MPROTECT)
+#include <sys/mman.h>
+
+#include <limits.h>
+#ifndef PAGESIZE
+#define PAGESIZE 4096
+#endif
+#endif /* C_HAVE_MPROTECT */
+
+#include "callback.h"
+#include "regs.h"
+#include "mem.h"
+#include "cpu.h"
+#include "debug.h"
+#include "paging.h"
+#include "inout.h"
+#include "lazyflags.h"
+#include "instructions.h"
+
+#define CACHE_MAXSIZE	(4096*3)
+#define CACHE_TOTAL		(1024*1024*8)
+#define CACHE_PAGES		(512)
+#define CACHE_BLOCKS	(64*1024)
+#define CACHE_ALIGN		(16)
+#define DYN_HASH_SHIFT	(4)
+#define DYN_PAGE_HASH	(4096>>DYN_HASH_SHIFT)
+
+// target cpus that have a backend, these match the values of C_TARGETCPU
+#define X86_64		0x02
+#define ARMV8LE		0x10
+
+/* The code cache is shared with the dynamic x86 core, keep its classes
+   local to this file so the two cores can be linked into the same binary */
+namespace {
+
+enum BlockReturn {
+	BR_Normal=0,
+	BR_Cycles,
+	BR_Link1,BR_Link2,
+	BR_Opcode,
+	BR_CallBack,
+	BR_Exception
+};
+
+#define SMC_CURRENT_BLOCK	0xffff
+
+class CodePageHandler;
+
+#include "core_dyn_x86/cache.h"
+
+static struct {
+	BlockReturn (*runcode)(const Bit8u*);		// points to code that can start a block
+	Bit32u callback;							// the occurred callback
+	Bit32u readdata;							// spare space used when reading from memory
+} core_dynrec;
+
+#if C_TARGETCPU == X86_64
+#include "core_dynrec/risc_x64.h"
+#elif C_TARGETCPU == ARMV8LE
+#include "core_dynrec/risc_armv8le.h"
+#else
+#error "The recompiling core has no backend for this target cpu"
+#endif
+
+#include "core_dynrec/operators.h"
+#include "core_dynrec/decoder.h"
+
+}
+
+extern int dynamic_core_cache_block_size;
+
+/* POPF and IRET are left to the normal core, which asks for its own trap runner when
+   they set TF. Single step with this core's instead, so it takes over again afterwards */
+static Bits dynrec_run_normal(void) {
+	Bits ret=CPU_Core_Normal_Run();
+	if (cpudecoder==&CPU_Core_Normal_Trap_Run) cpudecoder=&CPU_Core_Dynrec_Trap_Run;
+	return ret;
+}
+
+Bits CPU_Core_Dynrec_Run(void) {
+	/* Determine the linear address of CS:EIP */
+restart_core:
+	PhysPt ip_point=SegPhys(cs)+reg_eip;
+#if C_DEBUG
+#if C_HEAVY_DEBUG
+		if (DEBUG_HeavyIsBreakpoint()) return debugCallback;
+#endif
+#endif
+	CodePageHandler * chandler=0;
+	if (GCC_UNLIKELY(MakeCodePage(ip_point,chandler))) {
+		CPU_Exception(cpu.exception.which,cpu.exception.error);
+		goto restart_core;
+	}
+	if (!chandler) {
+		return dynrec_run_normal();
+	}
+	/* Find correct Dynamic Block to run */
+	CacheBlock * block=chandler->FindCacheBlock(ip_point&4095);
+	if (!block) {
+		if (!chandler->invalidation_map || (chandler->invalidation_map[ip_point&4095]<4)) {
+			block=CreateCacheBlock(chandler,ip_point,dynamic_core_cache_block_size);
+		} else {
+			Bitu old_cycles=CPU_Cycles;
+			CPU_Cycles=1;
+			Bits nc_retcode=dynrec_run_normal();
+			if (!nc_retcode && cpudecoder==&CPU_Core_Dynrec_Run) {
+				CPU_Cycles=old_cycles-1;
+				goto restart_core;
+			}
+			CPU_CycleLeft+=old_cycles;
+			return nc_retcode;
+		}
+	}
+run_block:
+	Bitu CPU_CyclesOld = CPU_Cycles;
+	cache.block.running=0;
+	BlockReturn ret=core_dynrec.runcode(block->cache.start);
+	cycle_count += CPU_CyclesOld - CPU_Cycles;
+	switch (ret) {
+	case BR_Normal:
+#if C_DEBUG
+#if C_HEAVY_DEBUG
+		if (DEBUG_HeavyIsBreakpoint()) {
+			FillFlags();
+			return debugCallback;
+		}
+#endif
+#endif
+		if (GETFLAG(TF)) {
+			FillFlags();
+			cpudecoder=&CPU_Core_Dynrec_Trap_Run;
+			return CBRET_NONE;
+		}
+		goto restart_core;
+	case BR_Cycles:
+		FillFlags();
+#if C_DEBUG
+#if C_HEAVY_DEBUG
+		if (DEBUG_HeavyIsBreakpoint()) return debugCallback;
+#endif
+#endif
+		return CBRET_NONE;
+	case BR_CallBack:
+		FillFlags();
+		return core_dynrec.callback;
+	case BR_Exception:
+		if (cpu.exception.which!=SMC_CURRENT_BLOCK) {
+			FillFlags();
+			CPU_Exception(cpu.exception.which,cpu.exception.error);
+			goto restart_core;
+		}
+//		LOG_MSG("selfmodification of running block at %x:%x",SegValue(cs),reg_eip);
+		cpu.exception.which=0;
+		// fallthrough, let the normal core handle the block-modifying instruction
+	case BR_Opcode:
+		FillFlags();
+		CPU_CycleLeft+=CPU_Cycles;
+		CPU_Cycles=1;
+		return dynrec_run_normal();
+	case BR_Link1:
+	case BR_Link2:
+		{
+			Bitu temp_ip=SegPhys(cs)+reg_eip;
+			CodePageHandler * temp_handler=(CodePageHandler *)get_tlb_readhandler(temp_ip);
+			if (temp_handler->getFlags() & PFLAG_HASCODE) {
+				block=temp_handler->FindCacheBlock(temp_ip & 4095);
+				if (!block) goto restart_core;
+				cache.block.running->LinkTo(ret==BR_Link2,block);
+				goto run_block;
+			}
+		}
+		goto restart_core;
+	}
+	FillFlags();
+	return CBRET_NONE;
+}
+
+Bits CPU_Core_Dynrec_Trap_Run(void) {
+	Bits oldCycles = CPU_Cycles;
+	CPU_Cycles = 1;
+	cpu.trap_skip = false;
+
+	Bits ret=CPU_Core_Normal_Run();
+	if (!cpu.trap_skip) CPU_HW_Interrupt(1);
+	CPU_Cycles = oldCycles-1;
+	cpudecoder = &CPU_Core_Dynrec_Run;
+
+	return ret;
+}
+
+void CPU_Core_Dynrec_Shutdown(void) {
+	cache_close();
+}
+
+void CPU_Core_Dynrec_Init(void) {
+}
+
+// generate the entry code behind the block linkage returns
+static void dynrec_gen_runcode(void) {
+	if (!cache_code_link_blocks) return;
+	cache.pos=&cache_code_link_blocks[64];
+	core_dynrec.runcode=(BlockReturn (*)(const Bit8u*))cache.pos;
+	gen_run_code();
+	cache_block_closing(cache_code_link_blocks,cache.pos-cache_code_link_blocks);
+}
+
+void CPU_Core_Dynrec_Cache_Init(bool enable_cache) {
+	/* Initialize code cache and dynamic blocks */
+	cache_init(enable_cache);
+	if (!enable_cache) cache_release_pages();
+	dynrec_gen_runcode();
+}
+
+void CPU_Core_Dynrec_Cache_Close(void) {
+	cache_close();
+}
+
+void CPU_Core_Dynrec_Cache_Reset(void) {
+	cache_reset();
+	dynrec_gen_runcode();
+}
+
+#endif
@@ -0,0 +1,982 @@
+/*
+ *  Copyright (C) 2002-2015  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+/* The decoder translates a block of guest instructions into host code.
+   Guest state is kept in memory (cpu_regs, Segs, lflags) between instructions,
+   the backend only has to provide simple moves, additions, calls and branches.
+   Instructions that are not handled here end the block and are executed by
+   the normal core. */
+
+enum DualOps {
+	DOP_ADD,DOP_OR,
+	DOP_ADC,DOP_SBB,
+	DOP_AND,DOP_SUB,
+	DOP_XOR,DOP_CMP,
+	DOP_TEST
+};
+
+// operand sizes, used as index into the helper function tables
+enum {
+	OPSIZE_BYTE=0,OPSIZE_WORD,OPSIZE_DWORD
+};
+
+static struct DynDecode {
+	PhysPt code;
+	PhysPt code_start;
+	PhysPt op_start;
+	bool big_op;
+	bool big_addr;
+	Bitu cycles;
+	CacheBlock * block;
+	CacheBlock * active_block;
+	struct {
+		CodePageHandler * code;
+		Bitu index;
+		Bit8u * wmap;
+		Bit8u * invmap;
+		Bitu first;
+	} page;
+	struct {
+		Bitu val;
+		Bitu mod;
+		Bitu rm;
+		Bitu reg;
+	} modrm;
+	Bitu seg_prefix;
+	bool seg_prefix_used;
+} decode;
+
+static bool MakeCodePage(Bitu lin_addr,CodePageHandler * &cph) {
+	Bit8u rdval;
+	//Ensure page contains memory:
+	if (GCC_UNLIKELY(mem_readb_checked(lin_addr,&rdval))) return true;
+	PageHandler * handler=get_tlb_readhandler(lin_addr);
+	if (handler->getFlags() & PFLAG_HASCODE) {
+		cph=( CodePageHandler *)handler;
+		return false;
+	}
+	if (handler->getFlags() & PFLAG_NOCODE) {
+		LOG_MSG("DYNREC:Can't run code in this page!");
+		cph=0;		return false;
+	}
+	Bitu lin_page=lin_addr >> 12;
+	Bitu phys_page=lin_page;
+	if (!PAGING_MakePhysPage(phys_page)) {
+		LOG_MSG("DYNREC:Can't find physpage for lin addr %x",(unsigned int)lin_addr);
+		cph=0;		return false;
+	}
+	/* Find a free CodePage */
+	if (!cache.free_pages) {
+		if (cache.used_pages!=decode.page.code) cache.used_pages->ClearRelease();
+		else {
+			if ((cache.used_pages->next) && (cache.used_pages->next!=decode.page.code))
+				cache.used_pages->next->ClearRelease();
+			else {
+				LOG_MSG("DYNREC:Invalid cache links");
+				cache.used_pages->ClearRelease();
+			}
+		}
+	}
+	CodePageHandler * cpagehandler=cache.free_pages;
+	cache.free_pages=cache.free_pages->next;
+	cpagehandler->prev=cache.last_page;
+	cpagehandler->next=0;
+	if (cache.last_page) cache.last_page->next=cpagehandler;
+	cache.last_page=cpagehandler;
+	if (!cache.used_pages) cache.used_pages=cpagehandler;
+	cpagehandler->SetupAt(phys_page,handler);
+	MEM_SetPageHandler(phys_page,1,cpagehandler);
+	PAGING_UnlinkPages(lin_page,1);
+	cph=cpagehandler;
+	return false;
+}
+
+static Bit8u decode_fetchb(void) {
+	if (GCC_UNLIKELY(decode.page.index>=4096)) {
+        /* Advance to the next page */
+		decode.active_block->page.end=4095;
+		/* trigger possible page fault here */
+		decode.page.first++;
+		Bitu fetchaddr=decode.page.first << 12;
+		mem_readb(fetchaddr);
+		MakeCodePage(fetchaddr,decode.page.code);
+		CacheBlock * newblock=cache_getblock();
+		decode.active_block->crossblock=newblock;
+		newblock->crossblock=decode.active_block;
+		decode.active_block=newblock;
+		decode.active_block->page.start=0;
+		decode.page.code->AddCrossBlock(decode.active_block);
+		decode.page.wmap=decode.page.code->write_map;
+		decode.page.invmap=decode.page.code->invalidation_map;
+		decode.page.index=0;
+	}
+	decode.page.wmap[decode.page.index]+=0x01;
+	decode.page.index++;
+	decode.code+=1;
+	return mem_readb(decode.code-1);
+}
+static Bit16u decode_fetchw(void) {
+	if (GCC_UNLIKELY(decode.page.index>=4095)) {
+   		Bit16u val=decode_fetchb();
+		val|=decode_fetchb() << 8;
+		return val;
+	}
+	*(Bit16u *)&decode.page.wmap[decode.page.index]+=0x0101;
+	decode.code+=2;decode.page.index+=2;
+	return mem_readw(decode.code-2);
+}
+static Bit32u decode_fetchd(void) {
+	if (GCC_UNLIKELY(decode.page.index>=4093)) {
+   		Bit32u val=decode_fetchb();
+		val|=decode_fetchb() << 8;
+		val|=decode_fetchb() << 16;
+		val|=decode_fetchb() << 24;
+		return val;
+	}
+	*(Bit32u *)&decode.page.wmap[decode.page.index]+=0x01010101;
+	decode.code+=4;decode.page.index+=4;
+	return mem_readd(decode.code-4);
+}
+
+// fetch an immediate value of the given operand size
+static Bit32u decode_fetch_imm(Bitu size) {
+	switch (size) {
+	case OPSIZE_BYTE: return decode_fetchb();
+	case OPSIZE_WORD: return decode_fetchw();
+	default: return decode_fetchd();
+	}
+}
+
+// fetch a sign-extended 8bit immediate value and truncate it to the operand size
+static Bit32u decode_fetch_simm8(Bitu size) {
+	Bit32u imm=(Bit32u)(Bit32s)(Bit8s)decode_fetchb();
+	if (size==OPSIZE_WORD) imm&=0xffff;
+	return imm;
+}
+
+
+enum save_info_type {db_exception, cycle_check};
+
+// exits that are generated at the end of the block, the branches
+// to them are created while translating the instructions
+static struct {
+	save_info_type type;
+	Bit8u * branch_pos;
+	Bit32u eip_change;
+	Bitu cycles;
+} save_info_dynrec[512];
+
+static Bitu used_save_info_dynrec=0;
+
+
+static void dyn_reduce_cycles(void) {
+	if (!decode.cycles) decode.cycles++;
+	gen_add_direct_word(&CPU_Cycles,(Bit32u)(-(Bit32s)decode.cycles),true);
+}
+
+static INLINE void dyn_set_eip_last(void) {
+	gen_add_direct_word(&reg_eip,decode.op_start-decode.code_start,cpu.code.big);
+}
+
+static INLINE void dyn_set_eip_end(void) {
+	gen_add_direct_word(&reg_eip,decode.code-decode.code_start,cpu.code.big);
+}
+
+// leave the block through an exception exit if reg is nonzero
+static void dyn_check_exception(HostReg reg) {
+	save_info_dynrec[used_save_info_dynrec].branch_pos=gen_create_branch_long_nonzero(reg);
+	if (!decode.cycles) decode.cycles++;
+	save_info_dynrec[used_save_info_dynrec].cycles=decode.cycles;
+	save_info_dynrec[used_save_info_dynrec].eip_change=decode.op_start-decode.code_start;
+	if (!cpu.code.big) save_info_dynrec[used_save_info_dynrec].eip_change&=0xffff;
+	save_info_dynrec[used_save_info_dynrec].type=db_exception;
+	used_save_info_dynrec++;
+}
+
+static void dyn_fill_blocks(void) {
+	for (Bitu sct=0; sct<used_save_info_dynrec; sct++) {
+		gen_fill_branch_long(save_info_dynrec[sct].branch_pos);
+		switch (save_info_dynrec[sct].type) {
+			case db_exception:
+				gen_add_direct_word(&reg_eip,save_info_dynrec[sct].eip_change,cpu.code.big);
+				gen_add_direct_word(&CPU_Cycles,(Bit32u)(-(Bit32s)save_info_dynrec[sct].cycles),true);
+				gen_return(BR_Exception);
+				break;
+			case cycle_check:
+				gen_return(BR_Cycles);
+				break;
+		}
+	}
+	used_save_info_dynrec=0;
+}
+
+static void dyn_closeblock(void) {
+	dyn_fill_blocks();
+	cache_block_closing(decode.block->cache.start,cache.pos-decode.block->cache.start);
+	cache_closeblock();
+}
+
+// leave the block and continue at the linked block (or the runloop)
+static void dyn_exit_link(Bits eip_change,Bitu link) {
+	gen_add_direct_word(&reg_eip,(Bit32u)eip_change,decode.big_op);
+	dyn_reduce_cycles();
+	gen_jmp_ptr(&decode.block->link[link].to,offsetof(CacheBlock,cache.start));
+}
+
+// conditional exit, cond_func returns nonzero if the branch is taken
+static void dyn_branched_exit(void * cond_func,Bits eip_add) {
+	Bitu eip_base=decode.code-decode.code_start;
+	gen_call_function_raw(cond_func);
+	Bit8u * data=gen_create_branch_long_zero(FC_RETOP);
+	/* Branch taken */
+	dyn_exit_link(eip_base+eip_add,1);
+	gen_fill_branch_long(data);
+	/* Branch not taken */
+	dyn_exit_link(eip_base,0);
+}
+
+
+static void * dyn_reg_ptr(Bitu reg,Bitu size) {
+	switch (size) {
+	case OPSIZE_BYTE:
+		if (reg&4) return &cpu_regs.regs[reg&3].byte[BH_INDEX];
+		return &cpu_regs.regs[reg&3].byte[BL_INDEX];
+	case OPSIZE_WORD:
+		return &cpu_regs.regs[reg].word[W_INDEX];
+	default:
+		return &cpu_regs.regs[reg].dword[DW_INDEX];
+	}
+}
+
+// load a guest register (zero-extended) into a host register
+static void dyn_get_reg(HostReg hr,Bitu reg,Bitu size) {
+	if (size==OPSIZE_BYTE) gen_mov_byte_to_reg_low(hr,dyn_reg_ptr(reg,size));
+	else gen_mov_word_to_reg(hr,dyn_reg_ptr(reg,size),size==OPSIZE_DWORD);
+}
+
+// store a host register into a guest register
+static void dyn_set_reg(HostReg hr,Bitu reg,Bitu size) {
+	if (size==OPSIZE_BYTE) gen_mov_byte_from_reg_low(hr,dyn_reg_ptr(reg,size));
+	else gen_mov_word_from_reg(hr,dyn_reg_ptr(reg,size),size==OPSIZE_DWORD);
+}
+
+static void * const dynrec_read_ops[3]={
+	(void*)&dynrec_read_byte_checked,(void*)&dynrec_read_word_checked,(void*)&dynrec_read_dword_checked
+};
+
+static void * const dynrec_write_ops[3]={
+	(void*)&dynrec_write_byte_checked,(void*)&dynrec_write_word_checked,(void*)&dynrec_write_dword_checked
+};
+
+// read from the guest address in FC_EA into a host register
+static void dyn_read_mem(HostReg hr,Bitu size) {
+	gen_mov_regs(FC_OP1,FC_EA);
+	gen_call_function_raw(dynrec_read_ops[size]);
+	dyn_check_exception(FC_RETOP);
+	if (size==OPSIZE_BYTE) gen_mov_byte_to_reg_low(hr,&core_dynrec.readdata);
+	else gen_mov_word_to_reg(hr,&core_dynrec.readdata,size==OPSIZE_DWORD);
+}
+
+// write a host register to the guest address in FC_EA
+static void dyn_write_mem(HostReg hr,Bitu size) {
+	gen_mov_regs(FC_OP2,hr);
+	gen_mov_regs(FC_OP1,FC_EA);
+	gen_call_function_raw(dynrec_write_ops[size]);
+	dyn_check_exception(FC_RETOP);
+}
+
+// push the value in FC_OP1
+static void dyn_push(Bitu size) {
+	gen_call_function_raw(size==OPSIZE_DWORD ? (void*)&dynrec_push_dword : (void*)&dynrec_push_word);
+	dyn_check_exception(FC_RETOP);
+}
+
+// pop a value into a host register
+static void dyn_pop(HostReg hr,Bitu size) {
+	gen_call_function_raw(size==OPSIZE_DWORD ? (void*)&dynrec_pop_dword : (void*)&dynrec_pop_word);
+	dyn_check_exception(FC_RETOP);
+	gen_mov_word_to_reg(hr,&core_dynrec.readdata,true);
+}
+
+
+static void dyn_get_modrm(void) {
+	decode.modrm.val=decode_fetchb();
+	decode.modrm.mod=(decode.modrm.val >> 6) & 3;
+	decode.modrm.reg=(decode.modrm.val >> 3) & 7;
+	decode.modrm.rm=(decode.modrm.val & 7);
+}
+
+// calculate the effective address of the memory operand into ea_reg,
+// the segment base is added if addseg is set
+static void dyn_fill_ea(HostReg ea_reg,bool addseg=true) {
+	Bitu seg_base=ds;
+	if (!decode.big_addr) {
+		Bits imm=0;
+		switch (decode.modrm.mod) {
+		case 1:imm=(Bit8s)decode_fetchb();break;
+		case 2:imm=(Bit16s)decode_fetchw();break;
+		}
+		Bitu base=8,index=8;
+		switch (decode.modrm.rm) {
+		case 0:base=REGI_BX;index=REGI_SI;break;
+		case 1:base=REGI_BX;index=REGI_DI;break;
+		case 2:base=REGI_BP;index=REGI_SI;seg_base=ss;break;
+		case 3:base=REGI_BP;index=REGI_DI;seg_base=ss;break;
+		case 4:base=REGI_SI;break;
+		case 5:base=REGI_DI;break;
+		case 6:
+			if (!decode.modrm.mod) imm=decode_fetchw();
+			else {
+				base=REGI_BP;
+				seg_base=ss;
+			}
+			break;
+		case 7:base=REGI_BX;break;
+		}
+		if (base!=8) {
+			gen_mov_word_to_reg(ea_reg,dyn_reg_ptr(base,OPSIZE_DWORD),true);
+			if (index!=8) gen_add(ea_reg,dyn_reg_ptr(index,OPSIZE_DWORD));
+			gen_add_imm(ea_reg,(Bit32u)imm);
+			gen_and_imm(ea_reg,0xffff);
+		} else {
+			gen_mov_dword_to_reg_imm(ea_reg,(Bit32u)imm&0xffff);
+		}
+	} else {
+		Bits imm=0;
+		Bitu base=8,index=8,scale=0;
+		if (decode.modrm.rm==4) {
+			Bitu sib=decode_fetchb();
+			base=sib&7;
+			index=(sib>>3)&7;
+			scale=(sib>>6);
+			if (index==4) index=8;
+			if ((base==5) && !decode.modrm.mod) {
+				base=8;
+				imm=(Bit32s)decode_fetchd();
+			}
+		} else if ((decode.modrm.rm==5) && !decode.modrm.mod) {
+			imm=(Bit32s)decode_fetchd();
+		} else base=decode.modrm.rm;
+		switch (decode.modrm.mod) {
+		case 1:imm=(Bit8s)decode_fetchb();break;
+		case 2:imm=(Bit32s)decode_fetchd();break;
+		}
+		if ((base==REGI_SP) || (base==REGI_BP)) seg_base=ss;
+		if (base!=8) {
+			gen_mov_word_to_reg(ea_reg,dyn_reg_ptr(base,OPSIZE_DWORD),true);
+			if (index!=8) {
+				gen_mov_word_to_reg(FC_OP3,dyn_reg_ptr(index,OPSIZE_DWORD),true);
+				gen_lea(ea_reg,FC_OP3,scale,imm);
+			} else gen_add_imm(ea_reg,(Bit32u)imm);
+		} else if (index!=8) {
+			gen_mov_word_to_reg(ea_reg,dyn_reg_ptr(index,OPSIZE_DWORD),true);
+			gen_lea(ea_reg,scale,imm);
+		} else {
+			gen_mov_dword_to_reg_imm(ea_reg,(Bit32u)imm);
+		}
+	}
+	if (addseg) gen_add(ea_reg,&Segs.phys[decode.seg_prefix_used ? decode.seg_prefix : seg_base]);
+}
+
+// load the r/m operand, the effective address has to be in FC_EA for memory operands
+static void dyn_get_rm(HostReg hr,Bitu size) {
+	if (decode.modrm.mod<3) dyn_read_mem(hr,size);
+	else dyn_get_reg(hr,decode.modrm.rm,size);
+}
+
+// store to the r/m operand, the effective address has to be in FC_EA for memory operands
+static void dyn_set_rm(HostReg hr,Bitu size) {
+	if (decode.modrm.mod<3) dyn_write_mem(hr,size);
+	else dyn_set_reg(hr,decode.modrm.rm,size);
+}
+
+
+// ADC/SBB read the carry flag before they modify the lazy flags, so they
+// can not be restarted after a failing memory write and are left to the normal core
+static INLINE bool dyn_dop_restartable(Bitu op) {
+	return (op!=DOP_ADC) && (op!=DOP_SBB);
+}
+
+// dual operand instruction with a register and a r/m operand
+static bool dyn_dop_rm(Bitu op,Bitu size,bool rm_dest) {
+	dyn_get_modrm();
+	bool store=(op!=DOP_CMP) && (op!=DOP_TEST);
+	if (decode.modrm.mod<3) {
+		if (rm_dest && store && !dyn_dop_restartable(op)) return false;
+		dyn_fill_ea(FC_EA);
+		if (rm_dest) {
+			dyn_read_mem(FC_OP1,size);
+			dyn_get_reg(FC_OP2,decode.modrm.reg,size);
+		} else {
+			dyn_read_mem(FC_OP2,size);
+			dyn_get_reg(FC_OP1,decode.modrm.reg,size);
+		}
+	} else {
+		dyn_get_reg(FC_OP1,rm_dest ? decode.modrm.rm : decode.modrm.reg,size);
+		dyn_get_reg(FC_OP2,rm_dest ? decode.modrm.reg : decode.modrm.rm,size);
+	}
+	gen_call_function_raw(dynrec_dual_ops[size][op]);
+	if (store) {
+		if (rm_dest) dyn_set_rm(FC_RETOP,size);
+		else dyn_set_reg(FC_RETOP,decode.modrm.reg,size);
+	}
+	return true;
+}
+
+// dual operand instruction with the accumulator and an immediate value
+static void dyn_dop_acc_imm(Bitu op,Bitu size) {
+	Bit32u imm=decode_fetch_imm(size);
+	dyn_get_reg(FC_OP1,REGI_AX,size);
+	gen_load_param_imm(imm,FC_OP2);
+	gen_call_function_raw(dynrec_dual_ops[size][op]);
+	if ((op!=DOP_CMP) && (op!=DOP_TEST)) dyn_set_reg(FC_RETOP,REGI_AX,size);
+}
+
+// group 1, dual operand instruction with a r/m operand and an immediate value
+static bool dyn_grp1(Bitu size,bool simm8) {
+	dyn_get_modrm();
+	Bitu op=decode.modrm.reg;
+	if (decode.modrm.mod<3) {
+		if ((op!=DOP_CMP) && !dyn_dop_restartable(op)) return false;
+		dyn_fill_ea(FC_EA);
+	}
+	Bit32u imm=simm8 ? decode_fetch_simm8(size) : decode_fetch_imm(size);
+	dyn_get_rm(FC_OP1,size);
+	gen_load_param_imm(imm,FC_OP2);
+	gen_call_function_raw(dynrec_dual_ops[size][op]);
+	if (op!=DOP_CMP) dyn_set_rm(FC_RETOP,size);
+	return true;
+}
+
+// group 2, shift and rotate instructions
+// count is 0 for an immediate count, 1 for a count of one and 2 for cl
+static bool dyn_grp2(Bitu size,Bitu count) {
+	dyn_get_modrm();
+	Bitu op=decode.modrm.reg;
+	if (decode.modrm.mod<3) {
+		// RCL/RCR have the same restart problem as ADC/SBB
+		if ((op==2) || (op==3)) return false;
+		dyn_fill_ea(FC_EA);
+	}
+	Bit32u imm=1;
+	if (count==0) imm=decode_fetchb() & 0x1f;
+	dyn_get_rm(FC_OP1,size);
+	if (count==2) {
+		gen_mov_byte_to_reg_low(FC_OP2,&reg_cl);
+		gen_and_imm(FC_OP2,0x1f);
+	} else gen_load_param_imm(imm,FC_OP2);
+	gen_call_function_raw(dynrec_shift_ops[size][op]);
+	dyn_set_rm(FC_RETOP,size);
+	return true;
+}
+
+// group 3, only TEST, NOT and NEG are handled
+static bool dyn_grp3(Bitu size) {
+	dyn_get_modrm();
+	Bitu op=decode.modrm.reg;
+	if (op>=4) return false;
+	if (decode.modrm.mod<3) dyn_fill_ea(FC_EA);
+	if (op<2) {
+		Bit32u imm=decode_fetch_imm(size);
+		dyn_get_rm(FC_OP1,size);
+		gen_load_param_imm(imm,FC_OP2);
+		gen_call_function_raw(dynrec_dual_ops[size][DOP_TEST]);
+		return true;
+	}
+	dyn_get_rm(FC_OP1,size);
+	gen_call_function_raw(dynrec_notneg_ops[size][op-2]);
+	dyn_set_rm(FC_RETOP,size);
+	return true;
+}
+
+// INC/DEC of a r/m operand, the modrm byte is already decoded
+static void dyn_incdec_rm(Bitu size) {
+	if (decode.modrm.mod<3) dyn_fill_ea(FC_EA);
+	dyn_get_rm(FC_OP1,size);
+	gen_call_function_raw(dynrec_incdec_ops[size][decode.modrm.reg&1]);
+	dyn_set_rm(FC_RETOP,size);
+}
+
+static void dyn_mov_rm(Bitu size,bool rm_dest) {
+	dyn_get_modrm();
+	if (decode.modrm.mod<3) {
+		dyn_fill_ea(FC_EA);
+		if (rm_dest) {
+			dyn_get_reg(FC_OP2,decode.modrm.reg,size);
+			dyn_write_mem(FC_OP2,size);
+		} else {
+			dyn_read_mem(FC_OP1,size);
+			dyn_set_reg(FC_OP1,decode.modrm.reg,size);
+		}
+	} else {
+		dyn_get_reg(FC_OP1,rm_dest ? decode.modrm.reg : decode.modrm.rm,size);
+		dyn_set_reg(FC_OP1,rm_dest ? decode.modrm.rm : decode.modrm.reg,size);
+	}
+}
+
+static bool dyn_mov_rm_imm(Bitu size) {
+	dyn_get_modrm();
+	if (decode.modrm.reg) return false;
+	if (decode.modrm.mod<3) dyn_fill_ea(FC_EA);
+	Bit32u imm=decode_fetch_imm(size);
+	gen_load_param_imm(imm,FC_OP2);
+	dyn_set_rm(FC_OP2,size);
+	return true;
+}
+
+// MOV between the accumulator and a memory offset
+static void dyn_mov_acc_moff(Bitu size,bool to_mem) {
+	Bit32u off=decode.big_addr ? decode_fetchd() : decode_fetchw();
+	gen_mov_dword_to_reg_imm(FC_EA,off);
+	gen_add(FC_EA,&Segs.phys[decode.seg_prefix_used ? decode.seg_prefix : ds]);
+	if (to_mem) {
+		dyn_get_reg(FC_OP2,REGI_AX,size);
+		dyn_write_mem(FC_OP2,size);
+	} else {
+		dyn_read_mem(FC_OP1,size);
+		dyn_set_reg(FC_OP1,REGI_AX,size);
+	}
+}
+
+static void dyn_xchg_rm(Bitu size) {
+	dyn_get_modrm();
+	if (decode.modrm.mod<3) {
+		dyn_fill_ea(FC_EA);
+		// the value read stays in readdata while the register is written to memory
+		dyn_read_mem(FC_OP1,size);
+		dyn_get_reg(FC_OP2,decode.modrm.reg,size);
+		dyn_write_mem(FC_OP2,size);
+		if (size==OPSIZE_BYTE) gen_mov_byte_to_reg_low(FC_OP1,&core_dynrec.readdata);
+		else gen_mov_word_to_reg(FC_OP1,&core_dynrec.readdata,size==OPSIZE_DWORD);
+		dyn_set_reg(FC_OP1,decode.modrm.reg,size);
+	} else {
+		dyn_get_reg(FC_OP1,decode.modrm.reg,size);
+		dyn_get_reg(FC_OP2,decode.modrm.rm,size);
+		dyn_set_reg(FC_OP1,decode.modrm.rm,size);
+		dyn_set_reg(FC_OP2,decode.modrm.reg,size);
+	}
+}
+
+// MOVZX/MOVSX, src_size is the size of the r/m operand
+static void dyn_movx(Bitu src_size,bool sign) {
+	dyn_get_modrm();
+	if (decode.modrm.mod<3) dyn_fill_ea(FC_EA);
+	dyn_get_rm(FC_OP1,src_size);
+	if (sign) {
+		if (src_size==OPSIZE_BYTE) gen_extend_byte(true,FC_OP1);
+		else gen_extend_word(true,FC_OP1);
+	}
+	dyn_set_reg(FC_OP1,decode.modrm.reg,decode.big_op ? OPSIZE_DWORD : OPSIZE_WORD);
+}
+
+// IMUL Gv,Ev and IMUL Gv,Ev,Iv
+static void dyn_imul_gvev(Bitu imm_type) {
+	Bitu size=decode.big_op ? OPSIZE_DWORD : OPSIZE_WORD;
+	dyn_get_modrm();
+	if (decode.modrm.mod<3) dyn_fill_ea(FC_EA);
+	if (imm_type) {
+		Bit32u imm=(imm_type==1) ? decode_fetch_simm8(size) : decode_fetch_imm(size);
+		dyn_get_rm(FC_OP1,size);
+		gen_load_param_imm(imm,FC_OP2);
+	} else {
+		dyn_get_rm(FC_OP2,size);
+		dyn_get_reg(FC_OP1,decode.modrm.reg,size);
+	}
+	gen_call_function_raw(size==OPSIZE_DWORD ? (void*)&dynrec_imul_dword : (void*)&dynrec_imul_word);
+	dyn_set_reg(FC_RETOP,decode.modrm.reg,size);
+}
+
+// push the address of the next instruction
+static void dyn_push_return_eip(void) {
+	gen_mov_word_to_reg(FC_OP1,&reg_eip,true);
+	gen_add_imm(FC_OP1,decode.code-decode.code_start);
+	if (!decode.big_op) gen_and_imm(FC_OP1,0xffff);
+	dyn_push(decode.big_op ? OPSIZE_DWORD : OPSIZE_WORD);
+}
+
+
+static CacheBlock * CreateCacheBlock(CodePageHandler * codepage,PhysPt start,Bitu max_opcodes) {
+/* Init a load of variables */
+	decode.code_start=start;
+	decode.code=start;
+	decode.page.code=codepage;
+	decode.page.index=start&4095;
+	decode.page.wmap=codepage->write_map;
+	decode.page.invmap=codepage->invalidation_map;
+	decode.page.first=start >> 12;
+	decode.active_block=decode.block=cache_openblock();
+	decode.block->page.start=decode.page.index;
+	codepage->AddCacheBlock(decode.block);
+
+	gen_mov_direct_ptr(&cache.block.running,(Bitu)decode.block);
+	/* Start with the cycles check */
+	gen_mov_word_to_reg(FC_RETOP,&CPU_Cycles,true);
+	save_info_dynrec[used_save_info_dynrec].branch_pos=gen_create_branch_long_leqzero(FC_RETOP);
+	save_info_dynrec[used_save_info_dynrec].type=cycle_check;
+	used_save_info_dynrec++;
+	decode.cycles=0;
+
+	while (max_opcodes--) {
+		/* Leave room for the exits that are generated when closing the block */
+		if (GCC_UNLIKELY(((Bitu)(cache.pos-decode.block->cache.start)+used_save_info_dynrec*64>CACHE_MAXSIZE-1024) ||
+			(used_save_info_dynrec>=400))) break;
+/* Init prefixes */
+		decode.big_addr=cpu.code.big;
+		decode.big_op=cpu.code.big;
+		decode.seg_prefix_used=false;
+		decode.cycles++;
+		decode.op_start=decode.code;
+restart_prefix:
+		Bitu opcode;
+		if (!decode.page.invmap) opcode=decode_fetchb();
+		else {
+			if (decode.page.index<4096) {
+				if (GCC_UNLIKELY(decode.page.invmap[decode.page.index]>=4)) goto illegalopcode;
+				opcode=decode_fetchb();
+			} else {
+				opcode=decode_fetchb();
+				if (GCC_UNLIKELY(decode.page.invmap &&
+					(decode.page.invmap[decode.page.index-1]>=4))) goto illegalopcode;
+			}
+		}
+		Bitu vsize=decode.big_op ? OPSIZE_DWORD : OPSIZE_WORD;
+		switch (opcode) {
+		// ADD/OR/ADC/SBB/AND/SUB/XOR/CMP
+		case 0x00:case 0x08:case 0x10:case 0x18:case 0x20:case 0x28:case 0x30:case 0x38:
+			if (!dyn_dop_rm(opcode>>3,OPSIZE_BYTE,true)) goto illegalopcode;
+			break;
+		case 0x01:case 0x09:case 0x11:case 0x19:case 0x21:case 0x29:case 0x31:case 0x39:
+			if (!dyn_dop_rm(opcode>>3,vsize,true)) goto illegalopcode;
+			break;
+		case 0x02:case 0x0a:case 0x12:case 0x1a:case 0x22:case 0x2a:case 0x32:case 0x3a:
+			dyn_dop_rm(opcode>>3,OPSIZE_BYTE,false);
+			break;
+		case 0x03:case 0x0b:case 0x13:case 0x1b:case 0x23:case 0x2b:case 0x33:case 0x3b:
+			dyn_dop_rm(opcode>>3,vsize,false);
+			break;
+		case 0x04:case 0x0c:case 0x14:case 0x1c:case 0x24:case 0x2c:case 0x34:case 0x3c:
+			dyn_dop_acc_imm(opcode>>3,OPSIZE_BYTE);
+			break;
+		case 0x05:case 0x0d:case 0x15:case 0x1d:case 0x25:case 0x2d:case 0x35:case 0x3d:
+			dyn_dop_acc_imm(opcode>>3,vsize);
+			break;
+
+		case 0x0f:
+		{
+			Bitu dual_code=decode_fetchb();
+			switch (dual_code) {
+			/* Near conditional jumps */
+			case 0x80:case 0x81:case 0x82:case 0x83:case 0x84:case 0x85:case 0x86:case 0x87:
+			case 0x88:case 0x89:case 0x8a:case 0x8b:case 0x8c:case 0x8d:case 0x8e:case 0x8f:
+				dyn_branched_exit(dynrec_cond_ops[dual_code&0xf],
+					decode.big_op ? (Bit32s)decode_fetchd() : (Bit16s)decode_fetchw());
+				dyn_closeblock();
+				goto finish_block;
+			/* IMUL Gv,Ev */
+			case 0xaf:dyn_imul_gvev(0);break;
+			/* MOVZX/MOVSX */
+			case 0xb6:dyn_movx(OPSIZE_BYTE,false);break;
+			case 0xb7:dyn_movx(OPSIZE_WORD,false);break;
+			case 0xbe:dyn_movx(OPSIZE_BYTE,true);break;
+			case 0xbf:dyn_movx(OPSIZE_WORD,true);break;
+			default:
+				goto illegalopcode;
+			}
+			break;
+		}
+
+		/* Segment prefixes */
+		case 0x26:decode.seg_prefix=es;decode.seg_prefix_used=true;goto restart_prefix;
+		case 0x2e:decode.seg_prefix=cs;decode.seg_prefix_used=true;goto restart_prefix;
+		case 0x36:decode.seg_prefix=ss;decode.seg_prefix_used=true;goto restart_prefix;
+		case 0x3e:decode.seg_prefix=ds;decode.seg_prefix_used=true;goto restart_prefix;
+		case 0x64:decode.seg_prefix=fs;decode.seg_prefix_used=true;goto restart_prefix;
+		case 0x65:decode.seg_prefix=gs;decode.seg_prefix_used=true;goto restart_prefix;
+
+		/* INC/DEC general register */
+		case 0x40:case 0x41:case 0x42:case 0x43:case 0x44:case 0x45:case 0x46:case 0x47:
+		case 0x48:case 0x49:case 0x4a:case 0x4b:case 0x4c:case 0x4d:case 0x4e:case 0x4f:
+			dyn_get_reg(FC_OP1,opcode&7,vsize);
+			gen_call_function_raw(dynrec_incdec_ops[vsize][(opcode>>3)&1]);
+			dyn_set_reg(FC_RETOP,opcode&7,vsize);
+			break;
+		/* PUSH general register */
+		case 0x50:case 0x51:case 0x52:case 0x53:case 0x54:case 0x55:case 0x56:case 0x57:
+			dyn_get_reg(FC_OP1,opcode&7,vsize);
+			dyn_push(vsize);
+			break;
+		/* POP general register */
+		case 0x58:case 0x59:case 0x5a:case 0x5b:case 0x5c:case 0x5d:case 0x5e:case 0x5f:
+			dyn_pop(FC_OP1,vsize);
+			dyn_set_reg(FC_OP1,opcode&7,vsize);
+			break;
+
+		/* Operand and address size prefixes */
+		case 0x66:decode.big_op=!cpu.code.big;goto restart_prefix;
+		case 0x67:decode.big_addr=!cpu.code.big;goto restart_prefix;
+
+		/* PUSH Iv/Ib */
+		case 0x68:
+			gen_load_param_imm(decode_fetch_imm(vsize),FC_OP1);
+			dyn_push(vsize);
+			break;
+		case 0x6a:
+			gen_load_param_imm(decode_fetch_simm8(vsize),FC_OP1);
+			dyn_push(vsize);
+			break;
+		/* IMUL Gv,Ev,Iv/Ib */
+		case 0x69:dyn_imul_gvev(2);break;
+		case 0x6b:dyn_imul_gvev(1);break;
+
+		/* Short conditional jumps */
+		case 0x70:case 0x71:case 0x72:case 0x73:case 0x74:case 0x75:case 0x76:case 0x77:
+		case 0x78:case 0x79:case 0x7a:case 0x7b:case 0x7c:case 0x7d:case 0x7e:case 0x7f:
+			dyn_branched_exit(dynrec_cond_ops[opcode&0xf],(Bit8s)decode_fetchb());
+			dyn_closeblock();
+			goto finish_block;
+
+		/* Group 1 */
+		case 0x80:case 0x82:
+			if (!dyn_grp1(OPSIZE_BYTE,false)) goto illegalopcode;
+			break;
+		case 0x81:
+			if (!dyn_grp1(vsize,false)) goto illegalopcode;
+			break;
+		case 0x83:
+			if (!dyn_grp1(vsize,true)) goto illegalopcode;
+			break;
+		/* TEST Eb,Gb / Ev,Gv */
+		case 0x84:dyn_dop_rm(DOP_TEST,OPSIZE_BYTE,true);break;
+		case 0x85:dyn_dop_rm(DOP_TEST,vsize,true);break;
+		/* XCHG Eb,Gb / Ev,Gv */
+		case 0x86:dyn_xchg_rm(OPSIZE_BYTE);break;
+		case 0x87:dyn_xchg_rm(vsize);break;
+		/* MOV */
+		case 0x88:dyn_mov_rm(OPSIZE_BYTE,true);break;
+		case 0x89:dyn_mov_rm(vsize,true);break;
+		case 0x8a:dyn_mov_rm(OPSIZE_BYTE,false);break;
+		case 0x8b:dyn_mov_rm(vsize,false);break;
+		/* LEA Gv */
+		case 0x8d:
+			dyn_get_modrm();
+			if (decode.modrm.mod==3) goto illegalopcode;
+			dyn_fill_ea(FC_EA,false);
+			dyn_set_reg(FC_EA,decode.modrm.reg,vsize);
+			break;
+
+		/* NOP */
+		case 0x90:
+			break;
+		/* XCHG general register,eAX */
+		case 0x91:case 0x92:case 0x93:case 0x94:case 0x95:case 0x96:case 0x97:
+			dyn_get_reg(FC_OP1,REGI_AX,vsize);
+			dyn_get_reg(FC_OP2,opcode&7,vsize);
+			dyn_set_reg(FC_OP1,opcode&7,vsize);
+			dyn_set_reg(FC_OP2,REGI_AX,vsize);
+			break;
+		/* CBW/CWDE */
+		case 0x98:
+			gen_call_function_raw(decode.big_op ? (void*)&dynrec_cwde : (void*)&dynrec_cbw);
+			break;
+		/* CWD/CDQ */
+		case 0x99:
+			gen_call_function_raw(decode.big_op ? (void*)&dynrec_cdq : (void*)&dynrec_cwd);
+			break;
+
+		/* MOV accumulator,memory offset */
+		case 0xa0:dyn_mov_acc_moff(OPSIZE_BYTE,false);break;
+		case 0xa1:dyn_mov_acc_moff(vsize,false);break;
+		case 0xa2:dyn_mov_acc_moff(OPSIZE_BYTE,true);break;
+		case 0xa3:dyn_mov_acc_moff(vsize,true);break;
+		/* TEST AL,Ib / eAX,Iv */
+		case 0xa8:dyn_dop_acc_imm(DOP_TEST,OPSIZE_BYTE);break;
+		case 0xa9:dyn_dop_acc_imm(DOP_TEST,vsize);break;
+
+		/* MOV byte register,Ib */
+		case 0xb0:case 0xb1:case 0xb2:case 0xb3:case 0xb4:case 0xb5:case 0xb6:case 0xb7:
+			gen_load_param_imm(decode_fetchb(),FC_OP1);
+			dyn_set_reg(FC_OP1,opcode&7,OPSIZE_BYTE);
+			break;
+		/* MOV general register,Iv */
+		case 0xb8:case 0xb9:case 0xba:case 0xbb:case 0xbc:case 0xbd:case 0xbe:case 0xbf:
+			if (decode.big_op) {
+				gen_mov_direct_dword(dyn_reg_ptr(opcode&7,OPSIZE_DWORD),decode_fetchd());
+			} else {
+				gen_load_param_imm(decode_fetchw(),FC_OP1);
+				dyn_set_reg(FC_OP1,opcode&7,OPSIZE_WORD);
+			}
+			break;
+
+		/* Group 2 with immediate count */
+		case 0xc0:
+			if (!dyn_grp2(OPSIZE_BYTE,0)) goto illegalopcode;
+			break;
+		case 0xc1:
+			if (!dyn_grp2(vsize,0)) goto illegalopcode;
+			break;
+		/* RET near Iw / RET near */
+		case 0xc2:
+		case 0xc3:
+			gen_load_param_imm(opcode==0xc2 ? decode_fetchw() : 0,FC_OP1);
+			gen_call_function_raw(decode.big_op ? (void*)&dynrec_ret_near_dword : (void*)&dynrec_ret_near_word);
+			dyn_check_exception(FC_RETOP);
+			goto core_close_block;
+		/* MOV Eb,Ib / Ev,Iv */
+		case 0xc6:
+			if (!dyn_mov_rm_imm(OPSIZE_BYTE)) goto illegalopcode;
+			break;
+		case 0xc7:
+			if (!dyn_mov_rm_imm(vsize)) goto illegalopcode;
+			break;
+
+		/* Group 2 with a count of one or cl */
+		case 0xd0:
+			if (!dyn_grp2(OPSIZE_BYTE,1)) goto illegalopcode;
+			break;
+		case 0xd1:
+			if (!dyn_grp2(vsize,1)) goto illegalopcode;
+			break;
+		case 0xd2:
+			if (!dyn_grp2(OPSIZE_BYTE,2)) goto illegalopcode;
+			break;
+		case 0xd3:
+			if (!dyn_grp2(vsize,2)) goto illegalopcode;
+			break;
+
+		/* LOOPNZ/LOOPZ/LOOP/JCXZ */
+		case 0xe0:case 0xe1:case 0xe2:case 0xe3:
+			{
+				Bits eip_add=(Bit8s)decode_fetchb();
+				gen_load_param_imm(opcode&3,FC_OP1);
+				dyn_branched_exit(decode.big_addr ? (void*)&dynrec_loop_dword : (void*)&dynrec_loop_word,eip_add);
+				dyn_closeblock();
+				goto finish_block;
+			}
+		/* CALL near */
+		case 0xe8:
+			{
+				Bits eip_add=decode.big_op ? (Bit32s)decode_fetchd() : (Bit16s)decode_fetchw();
+				dyn_push_return_eip();
+				dyn_exit_link((decode.code-decode.code_start)+eip_add,0);
+				dyn_closeblock();
+				goto finish_block;
+			}
+		/* JMP near/short */
+		case 0xe9:
+		case 0xeb:
+			{
+				Bits eip_add;
+				if (opcode==0xeb) eip_add=(Bit8s)decode_fetchb();
+				else eip_add=decode.big_op ? (Bit32s)decode_fetchd() : (Bit16s)decode_fetchw();
+				dyn_exit_link((decode.code-decode.code_start)+eip_add,0);
+				dyn_closeblock();
+				goto finish_block;
+			}
+
+		/* Lock prefix is ignored */
+		case 0xf0:goto restart_prefix;
+		/* CMC */
+		case 0xf5:gen_call_function_raw((void*)&dynrec_cmc);break;
+		/* Group 3 */
+		case 0xf6:
+			if (!dyn_grp3(OPSIZE_BYTE)) goto illegalopcode;
+			break;
+		case 0xf7:
+			if (!dyn_grp3(vsize)) goto illegalopcode;
+			break;
+		/* CLC/STC/CLD/STD */
+		case 0xf8:gen_call_function_raw((void*)&dynrec_clc);break;
+		case 0xf9:gen_call_function_raw((void*)&dynrec_stc);break;
+		case 0xfc:gen_call_function_raw((void*)&dynrec_cld);break;
+		case 0xfd:gen_call_function_raw((void*)&dynrec_std);break;
+
+		/* Group 4 Eb and callbacks */
+		case 0xfe:
+			dyn_get_modrm();
+			switch (decode.modrm.reg) {
+			case 0x0:	/* INC Eb */
+			case 0x1:	/* DEC Eb */
+				dyn_incdec_rm(OPSIZE_BYTE);
+				break;
+			case 0x7:	/* CALLBACK Iw */
+				gen_mov_direct_dword(&core_dynrec.callback,decode_fetchw());
+				dyn_set_eip_end();
+				dyn_reduce_cycles();
+				gen_return(BR_CallBack);
+				dyn_closeblock();
+				goto finish_block;
+			default:
+				goto illegalopcode;
+			}
+			break;
+		/* Group 5 Ev */
+		case 0xff:
+			dyn_get_modrm();
+			switch (decode.modrm.reg) {
+			case 0x0:	/* INC Ev */
+			case 0x1:	/* DEC Ev */
+				dyn_incdec_rm(vsize);
+				break;
+			case 0x2:	/* CALL Ev */
+				if (decode.modrm.mod<3) dyn_fill_ea(FC_EA);
+				dyn_get_rm(FC_EA,vsize);
+				dyn_push_return_eip();
+				gen_mov_word_from_reg(FC_EA,&reg_eip,true);
+				goto core_close_block;
+			case 0x4:	/* JMP Ev */
+				if (decode.modrm.mod<3) dyn_fill_ea(FC_EA);
+				dyn_get_rm(FC_EA,vsize);
+				gen_mov_word_from_reg(FC_EA,&reg_eip,true);
+				goto core_close_block;
+			case 0x6:	/* PUSH Ev */
+				if (decode.modrm.mod<3) dyn_fill_ea(FC_EA);
+				dyn_get_rm(FC_OP1,vsize);
+				dyn_push(vsize);
+				break;
+			default:
+				goto illegalopcode;
+			}
+			break;
+
+		default:
+			goto illegalopcode;
+		}
+	}
+	// link to next block because the maximum number of opcodes has been reached
+	dyn_set_eip_end();
+	dyn_reduce_cycles();
+	gen_jmp_ptr(&decode.block->link[0].to,offsetof(CacheBlock,cache.start));
+	dyn_closeblock();
+	goto finish_block;
+core_close_block:
+	dyn_reduce_cycles();
+	gen_return(BR_Normal);
+	dyn_closeblock();
+	goto finish_block;
+illegalopcode:
+	dyn_set_eip_last();
+	dyn_reduce_cycles();
+	gen_return(BR_Opcode);
+	dyn_closeblock();
+	goto finish_block;
+finish_block:
+	/* Setup the correct end-address */
+	decode.active_block->page.end=--decode.page.index;
+	return decode.block;
+}
@@ -0,0 +1,357 @@
+/*
+ *  Copyright (C) 2002-2015  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+/* Helper functions that are called from the generated code.
+   The arithmetic helpers reuse the lazy flags macros of the interpreting
+   cores, so the flags are always in the format the other cores expect.
+   All helpers that access guest memory use the _checked memory functions
+   and return nonzero if an exception has been raised. */
+
+#define LoadDrc(op) (op)
+#define SaveDrc(op,val) op=(val)
+
+
+#define DRC_DUAL_OP(name,macro,type)									\
+static Bit32u DRC_CALL_CONV name(type op1,type op2) {					\
+	macro(op1,op2,LoadDrc,SaveDrc);										\
+	return op1;															\
+}
+
+DRC_DUAL_OP(dynrec_add_byte,ADDB,Bit8u)
+DRC_DUAL_OP(dynrec_or_byte,ORB,Bit8u)
+DRC_DUAL_OP(dynrec_adc_byte,ADCB,Bit8u)
+DRC_DUAL_OP(dynrec_sbb_byte,SBBB,Bit8u)
+DRC_DUAL_OP(dynrec_and_byte,ANDB,Bit8u)
+DRC_DUAL_OP(dynrec_sub_byte,SUBB,Bit8u)
+DRC_DUAL_OP(dynrec_xor_byte,XORB,Bit8u)
+DRC_DUAL_OP(dynrec_cmp_byte,CMPB,Bit8u)
+DRC_DUAL_OP(dynrec_test_byte,TESTB,Bit8u)
+
+DRC_DUAL_OP(dynrec_add_word,ADDW,Bit16u)
+DRC_DUAL_OP(dynrec_or_word,ORW,Bit16u)
+DRC_DUAL_OP(dynrec_adc_word,ADCW,Bit16u)
+DRC_DUAL_OP(dynrec_sbb_word,SBBW,Bit16u)
+DRC_DUAL_OP(dynrec_and_word,ANDW,Bit16u)
+DRC_DUAL_OP(dynrec_sub_word,SUBW,Bit16u)
+DRC_DUAL_OP(dynrec_xor_word,XORW,Bit16u)
+DRC_DUAL_OP(dynrec_cmp_word,CMPW,Bit16u)
+DRC_DUAL_OP(dynrec_test_word,TESTW,Bit16u)
+
+DRC_DUAL_OP(dynrec_add_dword,ADDD,Bit32u)
+DRC_DUAL_OP(dynrec_or_dword,ORD,Bit32u)
+DRC_DUAL_OP(dynrec_adc_dword,ADCD,Bit32u)
+DRC_DUAL_OP(dynrec_sbb_dword,SBBD,Bit32u)
+DRC_DUAL_OP(dynrec_and_dword,ANDD,Bit32u)
+DRC_DUAL_OP(dynrec_sub_dword,SUBD,Bit32u)
+DRC_DUAL_OP(dynrec_xor_dword,XORD,Bit32u)
+DRC_DUAL_OP(dynrec_cmp_dword,CMPD,Bit32u)
+DRC_DUAL_OP(dynrec_test_dword,TESTD,Bit32u)
+
+// indexed by the reg field of the group 1 opcodes (ADD,OR,ADC,SBB,AND,SUB,XOR,CMP), TEST follows
+static void * const dynrec_dual_ops[3][9]={
+	{	(void*)&dynrec_add_byte,(void*)&dynrec_or_byte,(void*)&dynrec_adc_byte,(void*)&dynrec_sbb_byte,
+		(void*)&dynrec_and_byte,(void*)&dynrec_sub_byte,(void*)&dynrec_xor_byte,(void*)&dynrec_cmp_byte,
+		(void*)&dynrec_test_byte	},
+	{	(void*)&dynrec_add_word,(void*)&dynrec_or_word,(void*)&dynrec_adc_word,(void*)&dynrec_sbb_word,
+		(void*)&dynrec_and_word,(void*)&dynrec_sub_word,(void*)&dynrec_xor_word,(void*)&dynrec_cmp_word,
+		(void*)&dynrec_test_word	},
+	{	(void*)&dynrec_add_dword,(void*)&dynrec_or_dword,(void*)&dynrec_adc_dword,(void*)&dynrec_sbb_dword,
+		(void*)&dynrec_and_dword,(void*)&dynrec_sub_dword,(void*)&dynrec_xor_dword,(void*)&dynrec_cmp_dword,
+		(void*)&dynrec_test_dword	}
+};
+
+
+#define DRC_SINGLE_OP(name,macro,type)									\
+static Bit32u DRC_CALL_CONV name(type op1) {							\
+	macro(op1,LoadDrc,SaveDrc);											\
+	return op1;															\
+}
+
+DRC_SINGLE_OP(dynrec_inc_byte,INCB,Bit8u)
+DRC_SINGLE_OP(dynrec_dec_byte,DECB,Bit8u)
+DRC_SINGLE_OP(dynrec_inc_word,INCW,Bit16u)
+DRC_SINGLE_OP(dynrec_dec_word,DECW,Bit16u)
+DRC_SINGLE_OP(dynrec_inc_dword,INCD,Bit32u)
+DRC_SINGLE_OP(dynrec_dec_dword,DECD,Bit32u)
+
+static void * const dynrec_incdec_ops[3][2]={
+	{	(void*)&dynrec_inc_byte,(void*)&dynrec_dec_byte		},
+	{	(void*)&dynrec_inc_word,(void*)&dynrec_dec_word		},
+	{	(void*)&dynrec_inc_dword,(void*)&dynrec_dec_dword	}
+};
+
+static Bit32u DRC_CALL_CONV dynrec_not_byte(Bit8u op1) {
+	return (Bit8u)~op1;
+}
+
+static Bit32u DRC_CALL_CONV dynrec_not_word(Bit16u op1) {
+	return (Bit16u)~op1;
+}
+
+static Bit32u DRC_CALL_CONV dynrec_not_dword(Bit32u op1) {
+	return ~op1;
+}
+
+static Bit32u DRC_CALL_CONV dynrec_neg_byte(Bit8u op1) {
+	lf_var1b=op1;
+	lf_resb=0-lf_var1b;
+	lflags.type=t_NEGb;
+	return lf_resb;
+}
+
+static Bit32u DRC_CALL_CONV dynrec_neg_word(Bit16u op1) {
+	lf_var1w=op1;
+	lf_resw=0-lf_var1w;
+	lflags.type=t_NEGw;
+	return lf_resw;
+}
+
+static Bit32u DRC_CALL_CONV dynrec_neg_dword(Bit32u op1) {
+	lf_var1d=op1;
+	lf_resd=0-lf_var1d;
+	lflags.type=t_NEGd;
+	return lf_resd;
+}
+
+static void * const dynrec_notneg_ops[3][2]={
+	{	(void*)&dynrec_not_byte,(void*)&dynrec_neg_byte		},
+	{	(void*)&dynrec_not_word,(void*)&dynrec_neg_word		},
+	{	(void*)&dynrec_not_dword,(void*)&dynrec_neg_dword	}
+};
+
+
+// the shift macros leave through break if nothing has to be done
+#define DRC_SHIFT_OP(name,macro,type)									\
+static Bit32u DRC_CALL_CONV name(type op1,Bit8u op2) {					\
+	do {																\
+		macro(op1,op2,LoadDrc,SaveDrc);									\
+	} while (0);														\
+	return op1;															\
+}
+
+DRC_SHIFT_OP(dynrec_rol_byte,ROLB,Bit8u)
+DRC_SHIFT_OP(dynrec_ror_byte,RORB,Bit8u)
+DRC_SHIFT_OP(dynrec_rcl_byte,RCLB,Bit8u)
+DRC_SHIFT_OP(dynrec_rcr_byte,RCRB,Bit8u)
+DRC_SHIFT_OP(dynrec_shl_byte,SHLB,Bit8u)
+DRC_SHIFT_OP(dynrec_shr_byte,SHRB,Bit8u)
+DRC_SHIFT_OP(dynrec_sar_byte,SARB,Bit8u)
+
+DRC_SHIFT_OP(dynrec_rol_word,ROLW,Bit16u)
+DRC_SHIFT_OP(dynrec_ror_word,RORW,Bit16u)
+DRC_SHIFT_OP(dynrec_rcl_word,RCLW,Bit16u)
+DRC_SHIFT_OP(dynrec_rcr_word,RCRW,Bit16u)
+DRC_SHIFT_OP(dynrec_shl_word,SHLW,Bit16u)
+DRC_SHIFT_OP(dynrec_shr_word,SHRW,Bit16u)
+DRC_SHIFT_OP(dynrec_sar_word,SARW,Bit16u)
+
+DRC_SHIFT_OP(dynrec_rol_dword,ROLD,Bit32u)
+DRC_SHIFT_OP(dynrec_ror_dword,RORD,Bit32u)
+DRC_SHIFT_OP(dynrec_rcl_dword,RCLD,Bit32u)
+DRC_SHIFT_OP(dynrec_rcr_dword,RCRD,Bit32u)
+DRC_SHIFT_OP(dynrec_shl_dword,SHLD,Bit32u)
+DRC_SHIFT_OP(dynrec_shr_dword,SHRD,Bit32u)
+DRC_SHIFT_OP(dynrec_sar_dword,SARD,Bit32u)
+
+// indexed by the reg field of the group 2 opcodes, SAL is the same as SHL
+static void * const dynrec_shift_ops[3][8]={
+	{	(void*)&dynrec_rol_byte,(void*)&dynrec_ror_byte,(void*)&dynrec_rcl_byte,(void*)&dynrec_rcr_byte,
+		(void*)&dynrec_shl_byte,(void*)&dynrec_shr_byte,(void*)&dynrec_shl_byte,(void*)&dynrec_sar_byte	},
+	{	(void*)&dynrec_rol_word,(void*)&dynrec_ror_word,(void*)&dynrec_rcl_word,(void*)&dynrec_rcr_word,
+		(void*)&dynrec_shl_word,(void*)&dynrec_shr_word,(void*)&dynrec_shl_word,(void*)&dynrec_sar_word	},
+	{	(void*)&dynrec_rol_dword,(void*)&dynrec_ror_dword,(void*)&dynrec_rcl_dword,(void*)&dynrec_rcr_dword,
+		(void*)&dynrec_shl_dword,(void*)&dynrec_shr_dword,(void*)&dynrec_shl_dword,(void*)&dynrec_sar_dword	}
+};
+
+
+static Bit32u DRC_CALL_CONV dynrec_imul_word(Bit16u op2,Bit16u op3) {
+	Bit16u op1;
+	DIMULW(op1,op2,op3,LoadDrc,SaveDrc);
+	return op1;
+}
+
+static Bit32u DRC_CALL_CONV dynrec_imul_dword(Bit32u op2,Bit32u op3) {
+	Bit32u op1;
+	DIMULD(op1,op2,op3,LoadDrc,SaveDrc);
+	return op1;
+}
+
+
+#define DRC_COND_OP(name,test)											\
+static Bit32u DRC_CALL_CONV name(void) {								\
+	return (test) ? 1 : 0;												\
+}
+
+DRC_COND_OP(dynrec_cond_o,TFLG_O)
+DRC_COND_OP(dynrec_cond_no,TFLG_NO)
+DRC_COND_OP(dynrec_cond_b,TFLG_B)
+DRC_COND_OP(dynrec_cond_nb,TFLG_NB)
+DRC_COND_OP(dynrec_cond_z,TFLG_Z)
+DRC_COND_OP(dynrec_cond_nz,TFLG_NZ)
+DRC_COND_OP(dynrec_cond_be,TFLG_BE)
+DRC_COND_OP(dynrec_cond_nbe,TFLG_NBE)
+DRC_COND_OP(dynrec_cond_s,TFLG_S)
+DRC_COND_OP(dynrec_cond_ns,TFLG_NS)
+DRC_COND_OP(dynrec_cond_p,TFLG_P)
+DRC_COND_OP(dynrec_cond_np,TFLG_NP)
+DRC_COND_OP(dynrec_cond_l,TFLG_L)
+DRC_COND_OP(dynrec_cond_nl,TFLG_NL)
+DRC_COND_OP(dynrec_cond_le,TFLG_LE)
+DRC_COND_OP(dynrec_cond_nle,TFLG_NLE)
+
+// indexed by the low nibble of the conditional jump opcodes
+static void * const dynrec_cond_ops[16]={
+	(void*)&dynrec_cond_o,(void*)&dynrec_cond_no,(void*)&dynrec_cond_b,(void*)&dynrec_cond_nb,
+	(void*)&dynrec_cond_z,(void*)&dynrec_cond_nz,(void*)&dynrec_cond_be,(void*)&dynrec_cond_nbe,
+	(void*)&dynrec_cond_s,(void*)&dynrec_cond_ns,(void*)&dynrec_cond_p,(void*)&dynrec_cond_np,
+	(void*)&dynrec_cond_l,(void*)&dynrec_cond_nl,(void*)&dynrec_cond_le,(void*)&dynrec_cond_nle
+};
+
+// decrement (e)cx and test the loop condition,
+// type is 0 for LOOPNZ, 1 for LOOPZ, 2 for LOOP and 3 for JCXZ
+static Bit32u DRC_CALL_CONV dynrec_loop_word(Bit32u type) {
+	if (type==3) return reg_cx ? 0 : 1;
+	reg_cx--;
+	if (type==2) return reg_cx ? 1 : 0;
+	if (type==1) return (reg_cx && get_ZF()) ? 1 : 0;
+	return (reg_cx && !get_ZF()) ? 1 : 0;
+}
+
+static Bit32u DRC_CALL_CONV dynrec_loop_dword(Bit32u type) {
+	if (type==3) return reg_ecx ? 0 : 1;
+	reg_ecx--;
+	if (type==2) return reg_ecx ? 1 : 0;
+	if (type==1) return (reg_ecx && get_ZF()) ? 1 : 0;
+	return (reg_ecx && !get_ZF()) ? 1 : 0;
+}
+
+
+static void DRC_CALL_CONV dynrec_cbw(void) {
+	reg_ax=(Bit8s)reg_al;
+}
+
+static void DRC_CALL_CONV dynrec_cwde(void) {
+	reg_eax=(Bit16s)reg_ax;
+}
+
+static void DRC_CALL_CONV dynrec_cwd(void) {
+	if (reg_ax & 0x8000) reg_dx=0xffff;
+	else reg_dx=0;
+}
+
+static void DRC_CALL_CONV dynrec_cdq(void) {
+	if (reg_eax & 0x80000000) reg_edx=0xffffffff;
+	else reg_edx=0;
+}
+
+static void DRC_CALL_CONV dynrec_cmc(void) {
+	FillFlags();
+	SETFLAGBIT(CF,!(reg_flags & FLAG_CF));
+}
+
+static void DRC_CALL_CONV dynrec_clc(void) {
+	FillFlags();
+	SETFLAGBIT(CF,false);
+}
+
+static void DRC_CALL_CONV dynrec_stc(void) {
+	FillFlags();
+	SETFLAGBIT(CF,true);
+}
+
+static void DRC_CALL_CONV dynrec_cld(void) {
+	SETFLAGBIT(DF,false);
+	cpu.direction=1;
+}
+
+static void DRC_CALL_CONV dynrec_std(void) {
+	SETFLAGBIT(DF,true);
+	cpu.direction=-1;
+}
+
+
+static Bit32u DRC_CALL_CONV dynrec_read_byte_checked(PhysPt address) {
+	return mem_readb_checked(address,(Bit8u*)&core_dynrec.readdata) ? 1 : 0;
+}
+
+static Bit32u DRC_CALL_CONV dynrec_read_word_checked(PhysPt address) {
+	return mem_readw_checked(address,(Bit16u*)&core_dynrec.readdata) ? 1 : 0;
+}
+
+static Bit32u DRC_CALL_CONV dynrec_read_dword_checked(PhysPt address) {
+	return mem_readd_checked(address,&core_dynrec.readdata) ? 1 : 0;
+}
+
+static Bit32u DRC_CALL_CONV dynrec_write_byte_checked(PhysPt address,Bit8u val) {
+	return mem_writeb_checked(address,val) ? 1 : 0;
+}
+
+static Bit32u DRC_CALL_CONV dynrec_write_word_checked(PhysPt address,Bit16u val) {
+	return mem_writew_checked(address,val) ? 1 : 0;
+}
+
+static Bit32u DRC_CALL_CONV dynrec_write_dword_checked(PhysPt address,Bit32u val) {
+	return mem_writed_checked(address,val) ? 1 : 0;
+}
+
+
+// the stack helpers only modify esp if the memory access succeeded
+static Bit32u DRC_CALL_CONV dynrec_push_word(Bit16u value) {
+	Bit32u new_esp=(reg_esp&cpu.stack.notmask)|((reg_esp-2)&cpu.stack.mask);
+	if (mem_writew_checked(SegPhys(ss)+(new_esp&cpu.stack.mask),value)) return 1;
+	reg_esp=new_esp;
+	return 0;
+}
+
+static Bit32u DRC_CALL_CONV dynrec_push_dword(Bit32u value) {
+	Bit32u new_esp=(reg_esp&cpu.stack.notmask)|((reg_esp-4)&cpu.stack.mask);
+	if (mem_writed_checked(SegPhys(ss)+(new_esp&cpu.stack.mask),value)) return 1;
+	reg_esp=new_esp;
+	return 0;
+}
+
+static Bit32u DRC_CALL_CONV dynrec_pop_word(void) {
+	if (mem_readw_checked(SegPhys(ss)+(reg_esp&cpu.stack.mask),(Bit16u*)&core_dynrec.readdata)) return 1;
+	core_dynrec.readdata&=0xffff;
+	reg_esp=(reg_esp&cpu.stack.notmask)|((reg_esp+2)&cpu.stack.mask);
+	return 0;
+}
+
+static Bit32u DRC_CALL_CONV dynrec_pop_dword(void) {
+	if (mem_readd_checked(SegPhys(ss)+(reg_esp&cpu.stack.mask),&core_dynrec.readdata)) return 1;
+	reg_esp=(reg_esp&cpu.stack.notmask)|((reg_esp+4)&cpu.stack.mask);
+	return 0;
+}
+
+// near return, bytes are released from the stack after popping the return address
+static Bit32u DRC_CALL_CONV dynrec_ret_near_word(Bit32u bytes) {
+	Bit16u val;
+	if (mem_readw_checked(SegPhys(ss)+(reg_esp&cpu.stack.mask),&val)) return 1;
+	reg_esp=(reg_esp&cpu.stack.notmask)|((reg_esp+2+bytes)&cpu.stack.mask);
+	reg_eip=val;
+	return 0;
+}
+
+static Bit32u DRC_CALL_CONV dynrec_ret_near_dword(Bit32u bytes) {
+	Bit32u val;
+	if (mem_readd_checked(SegPhys(ss)+(reg_esp&cpu.stack.mask),&val)) return 1;
+	reg_esp=(reg_esp&cpu.stack.notmask)|((reg_esp+4+bytes)&cpu.stack.mask);
+	reg_eip=val;
+	return 0;
+}
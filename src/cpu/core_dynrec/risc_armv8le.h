@@ -0,0 +1,298 @@
+/*
+ *  Copyright (C) 2002-2015  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+/* ARMv8 (AArch64, little endian) backend for the recompiling core */
+
+
+// calling convention modifier of the helper functions
+#define DRC_CALL_CONV	/* nothing */
+
+// register mapping
+typedef Bit8u HostReg;
+
+#define HOST_x0		0
+#define HOST_x1		1
+#define HOST_x2		2
+#define HOST_x9		9
+#define HOST_x16	16
+#define HOST_x17	17
+#define HOST_x19	19
+#define HOST_x28	28
+#define HOST_x29	29
+#define HOST_x30	30
+#define HOST_sp		31
+#define HOST_zr		31
+
+// registers that hold the parameters of helper function calls
+#define FC_OP1 HOST_x0
+#define FC_OP2 HOST_x1
+#define FC_OP3 HOST_x2
+
+// register that holds the return value of helper functions
+#define FC_RETOP HOST_x0
+
+// callee-saved register that holds the effective address across helper calls
+#define FC_EA HOST_x19
+
+// callee-saved register that points to cpu_regs while generated code runs
+#define FC_REGS_ADDR HOST_x28
+
+// scratch registers that are used by the code generator itself
+#define TEMP_REG_DRC HOST_x16
+#define TEMP_REG_DRC2 HOST_x17
+#define TEMP_REG_DRC3 HOST_x9
+
+
+static INLINE void gen_addins(Bit32u ins) {
+	cache_addd(ins);
+}
+
+// move a 32bit constant value into dest_reg
+static void gen_mov_dword_to_reg_imm(HostReg dest_reg,Bit32u imm) {
+	if ((imm>>16)==0xffff) {
+		gen_addins(0x12800000|((~imm&0xffff)<<5)|dest_reg);				// movn wd,#~imm
+		return;
+	}
+	gen_addins(0x52800000|((imm&0xffff)<<5)|dest_reg);					// movz wd,#imm
+	if (imm>>16) gen_addins(0x72a00000|((imm>>16)<<5)|dest_reg);		// movk wd,#imm,lsl #16
+}
+
+// move a 64bit constant value into dest_reg
+static void gen_mov_qword_to_reg_imm(HostReg dest_reg,Bit64u imm) {
+	gen_addins(0xd2800000|((Bit32u)(imm&0xffff)<<5)|dest_reg);			// movz xd,#imm
+	for (Bitu shift=1;shift<4;shift++) {
+		Bit32u part=(Bit32u)((imm>>(shift*16))&0xffff);
+		if (part) gen_addins(0xf2800000|(shift<<21)|(part<<5)|dest_reg);	// movk xd,#part,lsl #(shift*16)
+	}
+}
+
+// get a base register and offset for a memory access of size bytes,
+// locations inside cpu_regs are addressed through FC_REGS_ADDR
+static HostReg gen_mem_base(void* data,Bitu size,Bitu & offset) {
+	Bits off=(Bits)((Bit8u*)data-(Bit8u*)&cpu_regs);
+	if ((off>=0) && (off<(Bits)sizeof(cpu_regs)) && !(off&(size-1))) {
+		offset=(Bitu)off/size;
+		return FC_REGS_ADDR;
+	}
+	gen_mov_qword_to_reg_imm(TEMP_REG_DRC,(Bit64u)(Bitu)data);
+	offset=0;
+	return TEMP_REG_DRC;
+}
+
+// load size bytes (zero-extended) from data into dest_reg
+static void gen_load_mem(HostReg dest_reg,void* data,Bitu size) {
+	Bitu offset;
+	HostReg base=gen_mem_base(data,size,offset);
+	switch (size) {
+	case 1: gen_addins(0x39400000|(offset<<10)|(base<<5)|dest_reg); break;	// ldrb
+	case 2: gen_addins(0x79400000|(offset<<10)|(base<<5)|dest_reg); break;	// ldrh
+	case 4: gen_addins(0xb9400000|(offset<<10)|(base<<5)|dest_reg); break;	// ldr wd
+	case 8: gen_addins(0xf9400000|(offset<<10)|(base<<5)|dest_reg); break;	// ldr xd
+	}
+}
+
+// store the lower size bytes of src_reg into data
+static void gen_store_mem(HostReg src_reg,void* data,Bitu size) {
+	Bitu offset;
+	HostReg base=gen_mem_base(data,size,offset);
+	switch (size) {
+	case 1: gen_addins(0x39000000|(offset<<10)|(base<<5)|src_reg); break;	// strb
+	case 2: gen_addins(0x79000000|(offset<<10)|(base<<5)|src_reg); break;	// strh
+	case 4: gen_addins(0xb9000000|(offset<<10)|(base<<5)|src_reg); break;	// str wd
+	case 8: gen_addins(0xf9000000|(offset<<10)|(base<<5)|src_reg); break;	// str xd
+	}
+}
+
+
+// move a full register from reg_src to reg_dst
+static void gen_mov_regs(HostReg reg_dst,HostReg reg_src) {
+	if (reg_dst==reg_src) return;
+	gen_addins(0x2a0003e0|(reg_src<<16)|reg_dst);						// mov wd,ws
+}
+
+// move a 32bit (dword==true) or 16bit (dword==false) value from memory into dest_reg
+// 16bit moves are zero-extended
+static void gen_mov_word_to_reg(HostReg dest_reg,void* data,bool dword) {
+	gen_load_mem(dest_reg,data,dword?4:2);
+}
+
+// move an 8bit value from memory into dest_reg, the value is zero-extended
+static void gen_mov_byte_to_reg_low(HostReg dest_reg,void* data) {
+	gen_load_mem(dest_reg,data,1);
+}
+
+// move 32bit (dword==true) or 16bit (dword==false) of a register into memory
+static void gen_mov_word_from_reg(HostReg src_reg,void* dest,bool dword) {
+	gen_store_mem(src_reg,dest,dword?4:2);
+}
+
+// move the lowest 8bit of a register into memory
+static void gen_mov_byte_from_reg_low(HostReg src_reg,void* dest) {
+	gen_store_mem(src_reg,dest,1);
+}
+
+// convert an 8bit value in reg to 32bit, sign-extended if sign==true
+static void gen_extend_byte(bool sign,HostReg reg) {
+	gen_addins((sign?0x13001c00:0x53001c00)|(reg<<5)|reg);				// sxtb/uxtb
+}
+
+// convert a 16bit value in reg to 32bit, sign-extended if sign==true
+static void gen_extend_word(bool sign,HostReg reg) {
+	gen_addins((sign?0x13003c00:0x53003c00)|(reg<<5)|reg);				// sxth/uxth
+}
+
+// add a 32bit constant value to a full register
+static void gen_add_imm(HostReg reg,Bit32u imm) {
+	if (!imm) return;
+	if (imm<4096) {
+		gen_addins(0x11000000|(imm<<10)|(reg<<5)|reg);					// add wd,wd,#imm
+	} else if ((Bit32u)(-(Bit32s)imm)<4096) {
+		gen_addins(0x51000000|((Bit32u)(-(Bit32s)imm)<<10)|(reg<<5)|reg);	// sub wd,wd,#-imm
+	} else {
+		gen_mov_dword_to_reg_imm(TEMP_REG_DRC3,imm);
+		gen_addins(0x0b000000|(TEMP_REG_DRC3<<16)|(reg<<5)|reg);		// add wd,wd,w9
+	}
+}
+
+// add a 32bit value from memory to a full register
+static void gen_add(HostReg reg,void* op) {
+	gen_load_mem(TEMP_REG_DRC2,op,4);
+	gen_addins(0x0b000000|(TEMP_REG_DRC2<<16)|(reg<<5)|reg);			// add wd,wd,w17
+}
+
+// and a 32bit constant value with a full register
+static void gen_and_imm(HostReg reg,Bit32u imm) {
+	if (imm==0xffff) gen_extend_word(false,reg);
+	else if (imm==0xff) gen_extend_byte(false,reg);
+	else {
+		gen_mov_dword_to_reg_imm(TEMP_REG_DRC3,imm);
+		gen_addins(0x0a000000|(TEMP_REG_DRC3<<16)|(reg<<5)|reg);		// and wd,wd,w9
+	}
+}
+
+// effective address calculation, destination is dest_reg
+// scale_reg is scaled by scale (scale_reg*(2^scale)) and
+// added to dest_reg, then the immediate value is added
+static void gen_lea(HostReg dest_reg,HostReg scale_reg,Bitu scale,Bits imm) {
+	gen_addins(0x0b000000|(scale_reg<<16)|(scale<<10)|(dest_reg<<5)|dest_reg);	// add wd,wd,ws,lsl #scale
+	gen_add_imm(dest_reg,(Bit32u)imm);
+}
+
+// effective address calculation, destination is dest_reg
+// dest_reg is scaled by scale (dest_reg*(2^scale)),
+// then the immediate value is added
+static void gen_lea(HostReg dest_reg,Bitu scale,Bits imm) {
+	if (scale) gen_addins(0x53000000|(((32-scale)&31)<<16)|((31-scale)<<10)|(dest_reg<<5)|dest_reg);	// lsl wd,wd,#scale
+	gen_add_imm(dest_reg,(Bit32u)imm);
+}
+
+// move a 32bit constant value into memory
+static void gen_mov_direct_dword(void* dest,Bit32u imm) {
+	gen_mov_dword_to_reg_imm(TEMP_REG_DRC2,imm);
+	gen_store_mem(TEMP_REG_DRC2,dest,4);
+}
+
+// move a pointer sized constant value into memory
+static void gen_mov_direct_ptr(void* dest,Bitu imm) {
+	gen_mov_qword_to_reg_imm(TEMP_REG_DRC2,(Bit64u)imm);
+	gen_store_mem(TEMP_REG_DRC2,dest,8);
+}
+
+// add a 32bit (dword==true) or 16bit (dword==false) constant value to a memory value
+static void gen_add_direct_word(void* dest,Bit32u imm,bool dword) {
+	if (!dword) imm&=0xffff;
+	if (!imm) return;
+	Bitu offset;
+	Bitu size=dword?4:2;
+	HostReg base=gen_mem_base(dest,size,offset);
+	gen_addins((dword?0xb9400000:0x79400000)|(offset<<10)|(base<<5)|TEMP_REG_DRC2);	// ldr(h) w17
+	gen_add_imm(TEMP_REG_DRC2,dword?imm:(Bit32u)(Bit16s)imm);
+	gen_addins((dword?0xb9000000:0x79000000)|(offset<<10)|(base<<5)|TEMP_REG_DRC2);	// str(h) w17
+}
+
+
+// generate a call to a parameterless function
+static void gen_call_function_raw(void* func) {
+	gen_mov_qword_to_reg_imm(TEMP_REG_DRC,(Bit64u)(Bitu)func);
+	gen_addins(0xd63f0000|(TEMP_REG_DRC<<5));							// blr x16
+}
+
+// load a constant value into a function parameter register
+static void gen_load_param_imm(Bitu imm,HostReg param) {
+	gen_mov_dword_to_reg_imm(param,(Bit32u)imm);
+}
+
+
+// branch if the 32bit value of reg is zero,
+// returns the position of the branch which is filled by gen_fill_branch_long
+static Bit8u* gen_create_branch_long_zero(HostReg reg) {
+	gen_addins(0x34000000|reg);											// cbz wd,...
+	return (cache.pos-4);
+}
+
+// branch if the 32bit value of reg is not zero
+static Bit8u* gen_create_branch_long_nonzero(HostReg reg) {
+	gen_addins(0x35000000|reg);											// cbnz wd,...
+	return (cache.pos-4);
+}
+
+// branch if the 32bit value of reg is (signed) less or equal zero
+static Bit8u* gen_create_branch_long_leqzero(HostReg reg) {
+	gen_addins(0x7100001f|(reg<<5));										// cmp wd,#0
+	gen_addins(0x5400000d);												// b.le ...
+	return (cache.pos-4);
+}
+
+// calculate the distance of a long branch to the current position
+static void gen_fill_branch_long(Bit8u* data) {
+	Bit32u offset=(Bit32u)((cache.pos-data)>>2);
+	*(Bit32u*)data=(*(Bit32u*)data&0xff00001f)|((offset&0x7ffff)<<5);
+}
+
+
+// jump to the address that is stored at (*ptr)+imm
+static void gen_jmp_ptr(void* ptr,Bits imm) {
+	gen_mov_qword_to_reg_imm(TEMP_REG_DRC,(Bit64u)(Bitu)ptr);
+	gen_addins(0xf9400000|(TEMP_REG_DRC<<5)|TEMP_REG_DRC);				// ldr x16,[x16]
+	gen_addins(0xf9400000|(((Bitu)imm>>3)<<10)|(TEMP_REG_DRC<<5)|TEMP_REG_DRC);	// ldr x16,[x16,#imm]
+	gen_addins(0xd61f0000|(TEMP_REG_DRC<<5));							// br x16
+}
+
+// return from the generated code to gen_run_code's caller
+static void gen_return(BlockReturn retcode) {
+	gen_addins(0x52800000|((Bit32u)retcode<<5)|HOST_x0);				// mov w0,#retcode
+	gen_addins(0xa9400000|(2<<15)|(FC_REGS_ADDR<<10)|(HOST_sp<<5)|FC_EA);	// ldp x19,x28,[sp,#16]
+	gen_addins(0xa8c00000|(4<<15)|(HOST_x30<<10)|(HOST_sp<<5)|HOST_x29);	// ldp x29,x30,[sp],#32
+	gen_addins(0xd65f03c0);												// ret
+}
+
+// the trampoline that runs a block of generated code (passed as first parameter)
+static void gen_run_code(void) {
+	gen_addins(0xa9800000|(0x7c<<15)|(HOST_x30<<10)|(HOST_sp<<5)|HOST_x29);	// stp x29,x30,[sp,#-32]!
+	gen_addins(0x910003fd);												// mov x29,sp
+	gen_addins(0xa9000000|(2<<15)|(FC_REGS_ADDR<<10)|(HOST_sp<<5)|FC_EA);	// stp x19,x28,[sp,#16]
+	gen_mov_qword_to_reg_imm(FC_REGS_ADDR,(Bit64u)(Bitu)&cpu_regs);
+	gen_addins(0xd61f0000|(FC_OP1<<5));									// br x0
+}
+
+// called when a block of generated code is finished,
+// the instruction cache has to be synchronized with the data cache
+static void cache_block_closing(Bit8u* block_start,Bitu block_size) {
+	__builtin___clear_cache((char*)block_start,(char*)block_start+block_size);
+}
@@ -0,0 +1,372 @@
+/*
+ *  Copyright (C) 2002-2015  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+/* x86-64 (64bit) backend for the recompiling core */
+
+
+// calling convention modifier of the helper functions
+#define DRC_CALL_CONV	/* nothing */
+
+// register mapping
+typedef Bit8u HostReg;
+
+#define HOST_EAX	0
+#define HOST_ECX	1
+#define HOST_EDX	2
+#define HOST_EBX	3
+#define HOST_ESP	4
+#define HOST_EBP	5
+#define HOST_ESI	6
+#define HOST_EDI	7
+#define HOST_R8		8
+#define HOST_R9		9
+#define HOST_R10	10
+#define HOST_R11	11
+#define HOST_R12	12
+#define HOST_R13	13
+#define HOST_R14	14
+#define HOST_R15	15
+
+// registers that hold the parameters of helper function calls
+#if defined (_WIN64)
+#define FC_OP1 HOST_ECX
+#define FC_OP2 HOST_EDX
+#define FC_OP3 HOST_R8
+#else
+#define FC_OP1 HOST_EDI
+#define FC_OP2 HOST_ESI
+#define FC_OP3 HOST_EDX
+#endif
+
+// register that holds the return value of helper functions
+#define FC_RETOP HOST_EAX
+
+// callee-saved register that holds the effective address across helper calls
+#define FC_EA HOST_EBX
+
+// scratch registers that are used by the code generator itself
+#define TEMP_REG_DRC HOST_R11
+#define TEMP_REG_DRC2 HOST_R10
+
+// stack space reserved by gen_run_code, keeps the stack aligned to 16 bytes
+// and contains the register parameter area of the windows calling convention
+#if defined (_WIN64)
+#define DRC_STACK_RESERVE 40
+#else
+#define DRC_STACK_RESERVE 8
+#endif
+
+
+// emit a REX prefix if one is needed to address the registers
+static void gen_rex(bool w,HostReg reg,HostReg index,HostReg rm,bool force) {
+	Bit8u rex=0x40|(w?0x08:0)|((reg&8)?0x04:0)|((index&8)?0x02:0)|((rm&8)?0x01:0);
+	if ((rex!=0x40) || force) cache_addb(rex);
+}
+
+// emit an instruction that accesses the host memory location data,
+// imm_size is the size of an immediate value that follows the displacement.
+// The location is addressed rip-relative if possible, as absolute 32bit address
+// if it is in the low 2GB, and through TEMP_REG_DRC otherwise
+static void gen_memop(bool w,Bit8u prefix,bool twobyte,Bit8u opcode,HostReg reg,void* data,Bitu imm_size,bool byteop) {
+	Bit64s addr=(Bit64s)(Bitu)data;
+	bool force=byteop && ((reg&0xc)==4);
+	bool needrex=w || (reg&8) || force;
+	Bitu len=(prefix?1:0)+(needrex?1:0)+(twobyte?2:1)+1+4+imm_size;
+	Bit64s rel=addr-(Bit64s)(Bitu)(cache.pos+len);
+	if ((rel==(Bit32s)rel) || (addr==(Bit32s)addr)) {
+		if (prefix) cache_addb(prefix);
+		gen_rex(w,reg,0,0,force);
+		if (twobyte) cache_addb(0x0f);
+		cache_addb(opcode);
+		if (rel==(Bit32s)rel) {
+			cache_addb(0x05+((reg&7)<<3));		// [rip+disp32]
+			cache_addd((Bit32u)rel);
+		} else {
+			cache_addb(0x04+((reg&7)<<3));		// [disp32] through sib
+			cache_addb(0x25);
+			cache_addd((Bit32u)addr);
+		}
+	} else {
+		// mov r11,imm64
+		cache_addb(0x49);
+		cache_addb(0xb8+(TEMP_REG_DRC&7));
+		*(Bit64u*)cache.pos=(Bit64u)addr;
+		cache.pos+=8;
+		if (prefix) cache_addb(prefix);
+		cache_addb(0x41|(w?0x08:0)|((reg&8)?0x04:0));
+		if (twobyte) cache_addb(0x0f);
+		cache_addb(opcode);
+		cache_addb(0x00+((reg&7)<<3)+(TEMP_REG_DRC&7));	// [r11]
+	}
+}
+
+
+// move a full register from reg_src to reg_dst
+static void gen_mov_regs(HostReg reg_dst,HostReg reg_src) {
+	if (reg_dst==reg_src) return;
+	gen_rex(false,reg_dst,0,reg_src,false);
+	cache_addb(0x8b);
+	cache_addb(0xc0+((reg_dst&7)<<3)+(reg_src&7));
+}
+
+// move a 32bit constant value into dest_reg
+static void gen_mov_dword_to_reg_imm(HostReg dest_reg,Bit32u imm) {
+	gen_rex(false,0,0,dest_reg,false);
+	cache_addb(0xb8+(dest_reg&7));
+	cache_addd(imm);
+}
+
+// move a 64bit constant value into dest_reg
+static void gen_mov_qword_to_reg_imm(HostReg dest_reg,Bit64u imm) {
+	if (imm==(Bit32u)imm) {
+		gen_mov_dword_to_reg_imm(dest_reg,(Bit32u)imm);
+		return;
+	}
+	gen_rex(true,0,0,dest_reg,false);
+	cache_addb(0xb8+(dest_reg&7));
+	*(Bit64u*)cache.pos=imm;
+	cache.pos+=8;
+}
+
+// move a 32bit (dword==true) or 16bit (dword==false) value from memory into dest_reg
+// 16bit moves are zero-extended
+static void gen_mov_word_to_reg(HostReg dest_reg,void* data,bool dword) {
+	if (dword) gen_memop(false,0,false,0x8b,dest_reg,data,0,false);
+	else gen_memop(false,0,true,0xb7,dest_reg,data,0,false);
+}
+
+// move an 8bit value from memory into dest_reg, the value is zero-extended
+static void gen_mov_byte_to_reg_low(HostReg dest_reg,void* data) {
+	gen_memop(false,0,true,0xb6,dest_reg,data,0,false);
+}
+
+// move 32bit (dword==true) or 16bit (dword==false) of a register into memory
+static void gen_mov_word_from_reg(HostReg src_reg,void* dest,bool dword) {
+	gen_memop(false,dword?0:0x66,false,0x89,src_reg,dest,0,false);
+}
+
+// move the lowest 8bit of a register into memory
+static void gen_mov_byte_from_reg_low(HostReg src_reg,void* dest) {
+	gen_memop(false,0,false,0x88,src_reg,dest,0,true);
+}
+
+// convert an 8bit value in reg to 32bit, sign-extended if sign==true
+static void gen_extend_byte(bool sign,HostReg reg) {
+	gen_rex(false,reg,0,reg,(reg&0xc)==4);
+	cache_addb(0x0f);
+	cache_addb(sign?0xbe:0xb6);
+	cache_addb(0xc0+((reg&7)<<3)+(reg&7));
+}
+
+// convert a 16bit value in reg to 32bit, sign-extended if sign==true
+static void gen_extend_word(bool sign,HostReg reg) {
+	gen_rex(false,reg,0,reg,false);
+	cache_addb(0x0f);
+	cache_addb(sign?0xbf:0xb7);
+	cache_addb(0xc0+((reg&7)<<3)+(reg&7));
+}
+
+// add a 32bit value from memory to a full register
+static void gen_add(HostReg reg,void* op) {
+	gen_memop(false,0,false,0x03,reg,op,0,false);
+}
+
+// add a 32bit constant value to a full register
+static void gen_add_imm(HostReg reg,Bit32u imm) {
+	if (!imm) return;
+	gen_rex(false,0,0,reg,false);
+	if ((Bit32s)imm==(Bit8s)imm) {
+		cache_addb(0x83);
+		cache_addb(0xc0+(reg&7));
+		cache_addb((Bit8u)imm);
+	} else {
+		cache_addb(0x81);
+		cache_addb(0xc0+(reg&7));
+		cache_addd(imm);
+	}
+}
+
+// and a 32bit constant value with a full register
+static void gen_and_imm(HostReg reg,Bit32u imm) {
+	gen_rex(false,0,0,reg,false);
+	cache_addb(0x81);
+	cache_addb(0xe0+(reg&7));
+	cache_addd(imm);
+}
+
+// effective address calculation, destination is dest_reg
+// scale_reg is scaled by scale (scale_reg*(2^scale)) and
+// added to dest_reg, then the immediate value is added
+static void gen_lea(HostReg dest_reg,HostReg scale_reg,Bitu scale,Bits imm) {
+	gen_rex(false,dest_reg,scale_reg,dest_reg,false);
+	cache_addb(0x8d);
+	if (((dest_reg&7)!=HOST_EBP) && !imm) {
+		cache_addb(0x04+((dest_reg&7)<<3));
+		cache_addb((Bit8u)((scale<<6)+((scale_reg&7)<<3)+(dest_reg&7)));
+	} else if ((Bit32s)imm==(Bit8s)imm) {
+		cache_addb(0x44+((dest_reg&7)<<3));
+		cache_addb((Bit8u)((scale<<6)+((scale_reg&7)<<3)+(dest_reg&7)));
+		cache_addb((Bit8u)imm);
+	} else {
+		cache_addb(0x84+((dest_reg&7)<<3));
+		cache_addb((Bit8u)((scale<<6)+((scale_reg&7)<<3)+(dest_reg&7)));
+		cache_addd((Bit32u)imm);
+	}
+}
+
+// effective address calculation, destination is dest_reg
+// dest_reg is scaled by scale (dest_reg*(2^scale)),
+// then the immediate value is added
+static void gen_lea(HostReg dest_reg,Bitu scale,Bits imm) {
+	gen_rex(false,dest_reg,dest_reg,0,false);
+	cache_addb(0x8d);
+	cache_addb(0x04+((dest_reg&7)<<3));
+	cache_addb((Bit8u)((scale<<6)+((dest_reg&7)<<3)+HOST_EBP));	// no base, disp32
+	cache_addd((Bit32u)imm);
+}
+
+// move a 32bit constant value into memory
+static void gen_mov_direct_dword(void* dest,Bit32u imm) {
+	gen_memop(false,0,false,0xc7,0,dest,4,false);
+	cache_addd(imm);
+}
+
+// move a pointer sized constant value into memory
+static void gen_mov_direct_ptr(void* dest,Bitu imm) {
+	if ((Bit64s)imm==(Bit32s)imm) {
+		gen_memop(true,0,false,0xc7,0,dest,4,false);
+		cache_addd((Bit32u)imm);
+	} else {
+		gen_mov_qword_to_reg_imm(TEMP_REG_DRC2,(Bit64u)imm);
+		gen_memop(true,0,false,0x89,TEMP_REG_DRC2,dest,0,false);
+	}
+}
+
+// add a 32bit (dword==true) or 16bit (dword==false) constant value to a memory value
+static void gen_add_direct_word(void* dest,Bit32u imm,bool dword) {
+	if (!dword) imm&=0xffff;
+	if (!imm) return;
+	if ((Bit32s)imm==(Bit8s)imm || (!dword && (Bit16s)imm==(Bit8s)imm)) {
+		gen_memop(false,dword?0:0x66,false,0x83,0,dest,1,false);
+		cache_addb((Bit8u)imm);
+	} else if (dword) {
+		gen_memop(false,0,false,0x81,0,dest,4,false);
+		cache_addd(imm);
+	} else {
+		gen_memop(false,0x66,false,0x81,0,dest,2,false);
+		cache_addw((Bit16u)imm);
+	}
+}
+
+
+// generate a call to a parameterless function
+static void gen_call_function_raw(void* func) {
+	Bit64s rel=(Bit64s)(Bitu)func-(Bit64s)(Bitu)(cache.pos+5);
+	if (rel==(Bit32s)rel) {
+		cache_addb(0xe8);				// call rel32
+		cache_addd((Bit32u)rel);
+	} else {
+		gen_mov_qword_to_reg_imm(HOST_EAX,(Bit64u)(Bitu)func);
+		cache_addb(0xff);				// call rax
+		cache_addb(0xd0);
+	}
+}
+
+// load a constant value into a function parameter register
+static void gen_load_param_imm(Bitu imm,HostReg param) {
+	gen_mov_dword_to_reg_imm(param,(Bit32u)imm);
+}
+
+
+// test a register for zero and emit a conditional jump with 32bit displacement,
+// returns the position of the displacement which is filled by gen_fill_branch_long
+static Bit8u* gen_create_branch_long_cond(HostReg reg,Bit8u cond) {
+	gen_rex(false,reg,0,reg,false);
+	cache_addb(0x85);					// test reg,reg
+	cache_addb(0xc0+((reg&7)<<3)+(reg&7));
+	cache_addb(0x0f);
+	cache_addb(cond);
+	cache_addd(0);
+	return (cache.pos-4);
+}
+
+// branch if the 32bit value of reg is zero
+static Bit8u* gen_create_branch_long_zero(HostReg reg) {
+	return gen_create_branch_long_cond(reg,0x84);
+}
+
+// branch if the 32bit value of reg is not zero
+static Bit8u* gen_create_branch_long_nonzero(HostReg reg) {
+	return gen_create_branch_long_cond(reg,0x85);
+}
+
+// branch if the 32bit value of reg is (signed) less or equal zero
+static Bit8u* gen_create_branch_long_leqzero(HostReg reg) {
+	return gen_create_branch_long_cond(reg,0x8e);
+}
+
+// calculate the distance of a long branch to the current position
+static void gen_fill_branch_long(Bit8u* data) {
+	*(Bit32u*)data=(Bit32u)(cache.pos-data-4);
+}
+
+
+// jump to the address that is stored at (*ptr)+imm
+static void gen_jmp_ptr(void* ptr,Bits imm) {
+	gen_memop(true,0,false,0x8b,HOST_EAX,ptr,0,false);	// mov rax,[ptr]
+	cache_addb(0xff);
+	if ((Bit32s)imm==(Bit8s)imm) {
+		cache_addb(0x60);					// jmp [rax+imm8]
+		cache_addb((Bit8u)imm);
+	} else {
+		cache_addb(0xa0);					// jmp [rax+imm32]
+		cache_addd((Bit32u)imm);
+	}
+}
+
+// return from the generated code to gen_run_code's caller
+static void gen_return(BlockReturn retcode) {
+	cache_addb(0xb8);						// mov eax,retcode
+	cache_addd(retcode);
+	cache_addb(0x48);						// add rsp,DRC_STACK_RESERVE
+	cache_addb(0x83);
+	cache_addb(0xc4);
+	cache_addb(DRC_STACK_RESERVE);
+	cache_addb(0x5d);						// pop rbp
+	cache_addb(0x5b);						// pop rbx
+	cache_addb(0xc3);						// ret
+}
+
+// the trampoline that runs a block of generated code (passed as first parameter)
+static void gen_run_code(void) {
+	cache_addb(0x53);						// push rbx
+	cache_addb(0x55);						// push rbp
+	cache_addb(0x48);						// sub rsp,DRC_STACK_RESERVE
+	cache_addb(0x83);
+	cache_addb(0xec);
+	cache_addb(DRC_STACK_RESERVE);
+	gen_rex(false,0,0,FC_OP1,false);
+	cache_addb(0xff);						// jmp FC_OP1
+	cache_addb(0xe0+(FC_OP1&7));
+}
+
+// called when a block of generated code is finished,
+// x86 hosts keep their instruction cache coherent
+static void cache_block_closing(Bit8u* block_start,Bitu block_size) {
+}
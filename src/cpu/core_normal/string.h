@@ -32,12 +32,80 @@ enum STRING_OP {
 
 extern int cpu_rep_max;
 
+/* Elements of a string op at base+index that stay within one page and don't
+   wrap the index, 0 when even the first one doesn't */
+static INLINE Bitu DoString_Room(PhysPt base,Bitu index,Bitu size,Bits add_index,Bitu add_mask) {
+	if (index+size-1 > add_mask) return 0;
+	PhysPt addr=base+index;
+	Bitu room,wrap;
+	if (add_index>0) {
+		room=mem_span_size(addr)/size;
+		wrap=(add_mask-index-(size-1))/size+1;
+	} else {
+		Bitu first=addr&(MEM_PAGE_SIZE-1);
+		if (first+size>MEM_PAGE_SIZE) return 0;
+		room=first/size+1;
+		wrap=index/size+1;
+	}
+	return room<wrap ? room : wrap;
+}
+
+/* MOVS/STOS on plain memory pages: does as many elements as the pages, the
+   index wrap and the cycles left allow straight on host memory. Returns the
+   number of elements done, 0 leaves the next element to the normal path */
+static Bitu DoString_Block(bool movs,Bitu size,PhysPt si_base,Bitu si_index,PhysPt di_base,Bitu di_index,
+	Bits add_index,Bitu add_mask,Bitu count,Bit32u val) {
+	if (CPU_Cycles<=1 || count<2) return 0;
+	Bitu n=count;
+	if (n>(Bitu)CPU_Cycles) n=(Bitu)CPU_Cycles;
+	Bitu room=DoString_Room(di_base,di_index,size,add_index,add_mask);
+	if (n>room) n=room;
+	if (movs) {
+		room=DoString_Room(si_base,si_index,size,add_index,add_mask);
+		if (n>room) n=room;
+	}
+	if (n<2) return 0;
+	HostPt dst=mem_span_write(di_base+di_index);
+	if (!dst) return 0;
+	Bitu bytes=n*size;
+	Bits step=(add_index>0) ? (Bits)size : -(Bits)size;
+	HostPt dst_low=(add_index>0) ? dst : dst-(bytes-size);
+	if (movs) {
+		HostPt src=mem_span_read(si_base+si_index);
+		if (!src) return 0;
+		HostPt src_low=(add_index>0) ? src : src-(bytes-size);
+		if (dst_low+bytes<=src_low || src_low+bytes<=dst_low) memcpy(dst_low,src_low,bytes);
+		else {
+			/* Overlap, keep the order of the elements */
+			for (Bitu i=0;i<n;i++,dst+=step,src+=step) {
+				Bit32u tmp;
+				memcpy(&tmp,src,size);
+				memcpy(dst,&tmp,size);
+			}
+		}
+	} else {
+		switch (size) {
+		case 1:
+			memset(dst_low,(Bit8u)val,bytes);
+			break;
+		case 2:
+			for (Bitu i=0;i<bytes;i+=2) host_writew(dst_low+i,(Bit16u)val);
+			break;
+		default:
+			for (Bitu i=0;i<bytes;i+=4) host_writed(dst_low+i,val);
+			break;
+		}
+	}
+	return n;
+}
+
 void DoString(STRING_OP type) {
 	static PhysPt  si_base,di_base;
 	static Bitu	si_index,di_index;
 	static Bitu	add_mask;
 	static Bitu	count,count_left;
 	static Bits	add_index;
+	Bitu done;
 
 	count_left=0;
 	si_base=BaseDS;
@@ -124,6 +192,12 @@ void DoString(STRING_OP type) {
 
 				case R_STOSB:
 					do {
+						if ((done=DoString_Block(false,1,si_base,si_index,di_base,di_index,add_index,add_mask,count,reg_al))) {
+							di_index=(di_index+add_index*done) & add_mask;
+							count-=done;
+							if ((CPU_Cycles-=done) <= 0) break;
+							continue;
+						}
 						SaveMb(di_base+di_index,reg_al);
 						di_index=(di_index+add_index) & add_mask;
 						count--;
@@ -133,6 +207,12 @@ void DoString(STRING_OP type) {
 				case R_STOSW:
 					add_index<<=1;
 					do {
+						if ((done=DoString_Block(false,2,si_base,si_index,di_base,di_index,add_index,add_mask,count,reg_ax))) {
+							di_index=(di_index+add_index*done) & add_mask;
+							count-=done;
+							if ((CPU_Cycles-=done) <= 0) break;
+							continue;
+						}
 						SaveMw(di_base+di_index,reg_ax);
 						di_index=(di_index+add_index) & add_mask;
 						count--;
@@ -142,6 +222,12 @@ void DoString(STRING_OP type) {
 				case R_STOSD:
 					add_index<<=2;
 					do {
+						if ((done=DoString_Block(false,4,si_base,si_index,di_base,di_index,add_index,add_mask,count,reg_eax))) {
+							di_index=(di_index+add_index*done) & add_mask;
+							count-=done;
+							if ((CPU_Cycles-=done) <= 0) break;
+							continue;
+						}
 						SaveMd(di_base+di_index,reg_eax);
 						di_index=(di_index+add_index) & add_mask;
 						count--;
@@ -151,6 +237,13 @@ void DoString(STRING_OP type) {
 
 				case R_MOVSB:
 					do {
+						if ((done=DoString_Block(true,1,si_base,si_index,di_base,di_index,add_index,add_mask,count,0))) {
+							di_index=(di_index+add_index*done) & add_mask;
+							si_index=(si_index+add_index*done) & add_mask;
+							count-=done;
+							if ((CPU_Cycles-=done) <= 0) break;
+							continue;
+						}
 						SaveMb(di_base+di_index,LoadMb(si_base+si_index));
 						di_index=(di_index+add_index) & add_mask;
 						si_index=(si_index+add_index) & add_mask;
@@ -161,6 +254,13 @@ void DoString(STRING_OP type) {
 				case R_MOVSW:
 					add_index<<=1;
 					do {
+						if ((done=DoString_Block(true,2,si_base,si_index,di_base,di_index,add_index,add_mask,count,0))) {
+							di_index=(di_index+add_index*done) & add_mask;
+							si_index=(si_index+add_index*done) & add_mask;
+							count-=done;
+							if ((CPU_Cycles-=done) <= 0) break;
+							continue;
+						}
 						SaveMw(di_base+di_index,LoadMw(si_base+si_index));
 						di_index=(di_index+add_index) & add_mask;
 						si_index=(si_index+add_index) & add_mask;
@@ -171,6 +271,13 @@ void DoString(STRING_OP type) {
 				case R_MOVSD:
 					add_index<<=2;
 					do {
+						if ((done=DoString_Block(true,4,si_base,si_index,di_base,di_index,add_index,add_mask,count,0))) {
+							di_index=(di_index+add_index*done) & add_mask;
+							si_index=(si_index+add_index*done) & add_mask;
+							count-=done;
+							if ((CPU_Cycles-=done) <= 0) break;
+							continue;
+						}
 						SaveMd(di_base+di_index,LoadMd(si_base+si_index));
 						di_index=(di_index+add_index) & add_mask;
 						si_index=(si_index+add_index) & add_mask;
@@ -18,6 +18,7 @@
 
 
 #include <stdio.h>
+#include <string.h>
 
 #include "dosbox.h"
 #include "mem.h"
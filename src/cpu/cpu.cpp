@@ -145,6 +145,7 @@ Bit32s CPU_CycleUp = 0;
 Bit32s CPU_CycleDown = 0;
 Bit32s CPU_CyclesSet = 3000;
 Bit64s CPU_IODelayRemoved = 0;
+bool CPU_IdleSkip = false;
 char core_mode[16];
 CPU_Decoder * cpudecoder;
 bool CPU_CycleAutoAdjust = false;
@@ -166,6 +167,13 @@ void CPU_Core_Dyn_X86_Cache_Init(bool enable_cache);
 void CPU_Core_Dyn_X86_Cache_Close(void);
 void CPU_Core_Dyn_X86_SetFPUMode(bool dh_fpu);
 void CPU_Core_Dyn_X86_Cache_Reset(void);
+void CPU_Core_Dyn_X86_SetTierHintCache(const char * filename);
+#endif
+#if (C_DYNREC)
+void CPU_Core_Dynrec_Init(void);
+void CPU_Core_Dynrec_Cache_Init(bool enable_cache);
+void CPU_Core_Dynrec_Cache_Close(void);
+void CPU_Core_Dynrec_Cache_Reset(void);
 #endif
 
 /* called to signal an NMI. */
@@ -2054,6 +2062,17 @@ void CPU_SET_CRX(Bitu cr,Bitu value) {
 					cpudecoder=&CPU_Core_Dyn_X86_Run;
 					strcpy(core_mode, "dynamic");
 				}
+#elif (C_DYNREC)
+				if (CPU_AutoDetermineMode&CPU_AUTODETERMINE_CORE) {
+					if (dosbox_enable_nonrecursive_page_fault) {
+						dosbox_enable_nonrecursive_page_fault = false;
+						_LOG(LOG_CPU,LOG_NORMAL)("nonrecursive page fault not compatible with dynamic core, switching it off");
+					}
+
+					CPU_Core_Dynrec_Cache_Init(true);
+					cpudecoder=&CPU_Core_Dynrec_Run;
+					strcpy(core_mode, "dynamic_rec");
+				}
 #endif
 				CPU_AutoDetermineMode<<=CPU_AUTODETERMINE_SHIFT;
 			} else {
@@ -2572,6 +2591,14 @@ void CPU_HLT(Bitu oldeip) {
 	cpudecoder=&HLT_Decode;
 }
 
+/* The guest waits for an interrupt without halting, like the BIOS keyboard wait.
+   Skip ahead to the next event the way HLT does if idle skipping is on. */
+void CPU_Idle(void) {
+	if (!CPU_IdleSkip) return;
+	CPU_IODelayRemoved += CPU_Cycles;
+	CPU_Cycles=0;
+}
+
 void CPU_ENTER(bool use32,Bitu bytes,Bitu level) {
 	level&=0x1f;
 	Bitu sp_index=reg_esp&cpu.stack.mask;
@@ -2711,6 +2738,16 @@ static void CPU_ToggleDynamicCore(bool pressed) {
 	sec->HandleInputline(tmp);
     }
 }
+#elif (C_DYNREC)
+static void CPU_ToggleDynamicCore(bool pressed) {
+    if (!pressed)
+	return;
+    Section* sec=control->GetSection("cpu");
+    if(sec) {
+	std::string tmp="core=dynamic_rec";
+	sec->HandleInputline(tmp);
+    }
+}
 #endif
 
 static void CPU_ToggleSimpleCore(bool pressed) {
@@ -2740,6 +2777,7 @@ void CPU_Disable_SkipAutoAdjust(void) {
 extern Bit32s ticksDone;
 extern Bit32u ticksScheduled;
 extern int dynamic_core_cache_block_size;
+extern int dynamic_core_hot_threshold;
 
 void CPU_Reset_AutoAdjust(void) {
 	CPU_IODelayRemoved = 0;
@@ -2855,6 +2893,9 @@ public:
 		CPU_Core_Full_Init();
 #if (C_DYNAMIC_X86)
 		CPU_Core_Dyn_X86_Init();
+#endif
+#if (C_DYNREC)
+		CPU_Core_Dynrec_Init();
 #endif
 		MAPPER_AddHandler(CPU_CycleDecrease,MK_f11,MMOD1,"cycledown","Dec Cycles");
 		MAPPER_AddHandler(CPU_CycleIncrease,MK_f12,MMOD1,"cycleup"  ,"Inc Cycles");
@@ -2863,6 +2904,8 @@ public:
 		MAPPER_AddHandler(CPU_ToggleFullCore,MK_2,MMOD1,"full","Tog. Full Core");
 #if (C_DYNAMIC_X86)
 		MAPPER_AddHandler(CPU_ToggleDynamicCore,MK_3,MMOD1,"dynamic","Tog. Dyn. Core");
+#elif (C_DYNREC)
+		MAPPER_AddHandler(CPU_ToggleDynamicCore,MK_3,MMOD1,"dynamic","Tog. Dyn. Core");
 #endif
 		MAPPER_AddHandler(CPU_ToggleSimpleCore,MK_4,MMOD1,"simple","Tog. Simple Core");
 		Change_Config(configuration);	
@@ -2877,6 +2920,7 @@ public:
 
 		dosbox_enable_nonrecursive_page_fault = section->Get_bool("non-recursive page fault");
 		ignore_opcode_63 = section->Get_bool("ignore opcode 63");
+		CPU_IdleSkip = section->Get_bool("idle skip");
 		cpu_double_fault_enable = section->Get_bool("double fault");
 		cpu_triple_fault_reset = section->Get_bool("reset on triple fault");
 		cpu_allow_big16 = section->Get_bool("realbig16");
@@ -2887,6 +2931,8 @@ public:
 
 		dynamic_core_cache_block_size = section->Get_int("dynamic core cache block size");
 		if (dynamic_core_cache_block_size < 1 || dynamic_core_cache_block_size > 65536) dynamic_core_cache_block_size = 32;
+		dynamic_core_hot_threshold = section->Get_int("dynamic core hot threshold");
+		if (dynamic_core_hot_threshold < 0) dynamic_core_hot_threshold = 0;
 
 		Prop_multival* p = section->Get_multival("cycles");
 		std::string type = p->GetSection()->Get_string("type");
@@ -3003,7 +3049,25 @@ public:
 
 			cpudecoder=&CPU_Core_Dyn_X86_Run;
 			CPU_Core_Dyn_X86_SetFPUMode(false);
-#else
+#elif (C_DYNREC)
+			CPU_AutoDetermineMode|=CPU_AUTODETERMINE_CORE;
+		}
+		else if (core == "dynamic") {
+			if (dosbox_enable_nonrecursive_page_fault) {
+				dosbox_enable_nonrecursive_page_fault = false;
+				_LOG(LOG_CPU,LOG_NORMAL)("nonrecursive page fault not compatible with dynamic core, switching it off");
+			}
+
+			cpudecoder=&CPU_Core_Dynrec_Run;
+#endif
+#if (C_DYNREC)
+		} else if (core == "dynamic_rec") {
+			if (dosbox_enable_nonrecursive_page_fault) {
+				dosbox_enable_nonrecursive_page_fault = false;
+				_LOG(LOG_CPU,LOG_NORMAL)("nonrecursive page fault not compatible with dynamic core, switching it off");
+			}
+
+			cpudecoder=&CPU_Core_Dynrec_Run;
 #endif
 		} else {
 			strcpy(core_mode,"normal");
@@ -3012,7 +3076,15 @@ public:
   
 
 #if (C_DYNAMIC_X86)
+		CPU_Core_Dyn_X86_SetTierHintCache(section->Get_string("dynamic core tier hint cache"));
 		CPU_Core_Dyn_X86_Cache_Init((core == "dynamic") || (core == "dynamic_nodhfpu"));
+#endif
+#if (C_DYNREC)
+#if (C_DYNAMIC_X86)
+		CPU_Core_Dynrec_Cache_Init(core == "dynamic_rec");
+#else
+		CPU_Core_Dynrec_Cache_Init((core == "dynamic") || (core == "dynamic_rec"));
+#endif
 #endif
 
 		CPU_ArchitectureType = CPU_ARCHTYPE_MIXED;
@@ -3173,6 +3245,9 @@ static CPU * test;
 void CPU_ShutDown(Section* sec) {
 #if (C_DYNAMIC_X86)
 	CPU_Core_Dyn_X86_Cache_Close();
+#endif
+#if (C_DYNREC)
+	CPU_Core_Dynrec_Cache_Close();
 #endif
 	delete test;
 }
@@ -3235,10 +3310,16 @@ Bit16u CPU_FindDecoderType( CPU_Decoder *decoder )
 	else if( cpudecoder == &CPU_Core_Full_Run ) decoder_idx = 3;
 #if C_DYNAMIC_X86
 	else if( cpudecoder == &CPU_Core_Dyn_X86_Run ) decoder_idx = 4;
+#endif
+#if C_DYNREC
+	else if( cpudecoder == &CPU_Core_Dynrec_Run ) decoder_idx = 5;
 #endif
 	else if( cpudecoder == &CPU_Core_Normal_Trap_Run ) decoder_idx = 100;
 #if C_DYNAMIC_X86
 	else if( cpudecoder == &CPU_Core_Dyn_X86_Trap_Run ) decoder_idx = 101;
+#endif
+#if C_DYNREC
+	else if( cpudecoder == &CPU_Core_Dynrec_Trap_Run ) decoder_idx = 102;
 #endif
 	else if( cpudecoder == &HLT_Decode ) decoder_idx = 200;
 
@@ -3269,7 +3350,25 @@ CPU_Decoder *CPU_IndexDecoderType( Bit16u decoder_idx )
 		case 2: cpudecoder = &CPU_Core_Simple_Run; break;
 		case 3: cpudecoder = &CPU_Core_Full_Run; break;
 #if C_DYNAMIC_X86
-		case 4: cpudecoder = &CPU_Core_Dyn_X86_Run;
+		case 4:
+#if C_DYNREC
+			CPU_Core_Dynrec_Cache_Init(false);
+#endif
+			CPU_Core_Dyn_X86_Cache_Init(true);
+			cpudecoder = &CPU_Core_Dyn_X86_Run;
+			if (dosbox_enable_nonrecursive_page_fault) {
+				dosbox_enable_nonrecursive_page_fault = false;
+				_LOG(LOG_CPU,LOG_NORMAL)("nonrecursive page fault not compatible with dynamic core, switching it off");
+			}
+			break;
+#endif
+#if C_DYNREC
+		case 5:
+#if C_DYNAMIC_X86
+			CPU_Core_Dyn_X86_Cache_Init(false);
+#endif
+			CPU_Core_Dynrec_Cache_Init(true);
+			cpudecoder = &CPU_Core_Dynrec_Run;
 			if (dosbox_enable_nonrecursive_page_fault) {
 				dosbox_enable_nonrecursive_page_fault = false;
 				_LOG(LOG_CPU,LOG_NORMAL)("nonrecursive page fault not compatible with dynamic core, switching it off");
@@ -3278,7 +3377,25 @@ CPU_Decoder *CPU_IndexDecoderType( Bit16u decoder_idx )
 #endif
 		case 100: cpudecoder = &CPU_Core_Normal_Trap_Run; break;
 #if C_DYNAMIC_X86
-		case 101: cpudecoder = &CPU_Core_Dyn_X86_Trap_Run;
+		case 101:
+#if C_DYNREC
+			CPU_Core_Dynrec_Cache_Init(false);
+#endif
+			CPU_Core_Dyn_X86_Cache_Init(true);
+			cpudecoder = &CPU_Core_Dyn_X86_Trap_Run;
+			if (dosbox_enable_nonrecursive_page_fault) {
+				dosbox_enable_nonrecursive_page_fault = false;
+				_LOG(LOG_CPU,LOG_NORMAL)("nonrecursive page fault not compatible with dynamic core, switching it off");
+			}
+			break;
+#endif
+#if C_DYNREC
+		case 102:
+#if C_DYNAMIC_X86
+			CPU_Core_Dyn_X86_Cache_Init(false);
+#endif
+			CPU_Core_Dynrec_Cache_Init(true);
+			cpudecoder = &CPU_Core_Dynrec_Trap_Run;
 			if (dosbox_enable_nonrecursive_page_fault) {
 				dosbox_enable_nonrecursive_page_fault = false;
 				_LOG(LOG_CPU,LOG_NORMAL)("nonrecursive page fault not compatible with dynamic core, switching it off");
@@ -223,6 +223,34 @@ static const Bit8u fault_table[] = {
 #define PHYSPAGE_DITRY 0x10000000
 #define PHYSPAGE_ADDR  0x000FFFFF
 
+/* TLB entries of a linear page for changing them */
+#if defined(USE_FULL_TLB)
+static INLINE HostPt & tlb_read(Bitu page) {return paging.tlb.read[page];}
+static INLINE HostPt & tlb_write(Bitu page) {return paging.tlb.write[page];}
+static INLINE PageHandler* & tlb_readhandler(Bitu page) {return paging.tlb.readhandler[page];}
+static INLINE PageHandler* & tlb_writehandler(Bitu page) {return paging.tlb.writehandler[page];}
+static INLINE Bit32u & tlb_phys_page(Bitu page) {return paging.tlb.phys_page[page];}
+#else
+static tlb_entry tlb_empty_bank[TLB_BANK_SIZE];
+
+static void PAGING_AllocTLBBank(Bitu bank);
+
+/* Allocates the bank of the page when it still is the shared empty one */
+static INLINE tlb_entry * tlb_link_entry(Bitu page) {
+	tlb_entry * bank=paging.tlbh_banks[page >> TLB_BANK_SHIFT];
+	if (GCC_UNLIKELY(bank==tlb_empty_bank)) {
+		PAGING_AllocTLBBank(page >> TLB_BANK_SHIFT);
+		bank=paging.tlbh_banks[page >> TLB_BANK_SHIFT];
+	}
+	return &bank[page & (TLB_BANK_SIZE-1)];
+}
+static INLINE HostPt & tlb_read(Bitu page) {return tlb_link_entry(page)->read;}
+static INLINE HostPt & tlb_write(Bitu page) {return tlb_link_entry(page)->write;}
+static INLINE PageHandler* & tlb_readhandler(Bitu page) {return tlb_link_entry(page)->readhandler;}
+static INLINE PageHandler* & tlb_writehandler(Bitu page) {return tlb_link_entry(page)->writehandler;}
+static INLINE Bit32u & tlb_phys_page(Bitu page) {return tlb_link_entry(page)->phys_page;}
+#endif
+
 // helper functions for calculating table entry addresses
 static inline PhysPt GetPageDirectoryEntryAddr(PhysPt lin_addr) {
 	return paging.base.addr | ((lin_addr >> 22) << 2);
@@ -355,10 +383,10 @@ class PageFoilHandler : public PageHandler {
 private:
 	void work(PhysPt addr) {
 		Bitu lin_page = addr >> 12;
-		Bit32u phys_page = paging.tlb.phys_page[lin_page] & PHYSPAGE_ADDR;
+		Bit32u phys_page = tlb_phys_page(lin_page) & PHYSPAGE_ADDR;
 			
 		// set the page dirty in the tlb
-		paging.tlb.phys_page[lin_page] |= PHYSPAGE_DITRY;
+		tlb_phys_page(lin_page) |= PHYSPAGE_DITRY;
 
 		// mark the page table entry dirty
 		X86PageEntry dir_entry, table_entry;
@@ -393,9 +421,9 @@ private:
 		
 		// replace this handler with the real thing
 		if (handler->getFlags() & PFLAG_WRITEABLE)
-			paging.tlb.write[lin_page] = handler->GetHostWritePt(phys_page) - (lin_page << 12);
-		else paging.tlb.write[lin_page]=0;
-		paging.tlb.writehandler[lin_page]=handler;
+			tlb_write(lin_page) = handler->GetHostWritePt(phys_page) - (lin_page << 12);
+		else tlb_write(lin_page)=0;
+		tlb_writehandler(lin_page)=handler;
 
 		return;
 	}
@@ -450,7 +478,7 @@ class ExceptionPageHandler : public PageHandler {
 private:
 	PageHandler* getHandler(PhysPt addr) {
 		Bitu lin_page = addr >> 12;
-		Bit32u phys_page = paging.tlb.phys_page[lin_page] & PHYSPAGE_ADDR;
+		Bit32u phys_page = tlb_phys_page(lin_page) & PHYSPAGE_ADDR;
 		PageHandler* handler = MEM_GetPageHandler(phys_page);
 		return handler;
 					}
@@ -463,7 +491,7 @@ private:
 		// the exception happens. Here we have gazillions of TLB entries so the
 		// exception occurs if we don't check for it.
 
-		Bitu old_attirbs = paging.tlb.phys_page[addr>>12] >> 30;
+		Bitu old_attirbs = tlb_phys_page(addr>>12) >> 30;
 		X86PageEntry dir_entry, table_entry;
 		
 		dir_entry.load = phys_readd(GetPageDirectoryEntryAddr(addr));
@@ -498,7 +526,7 @@ private:
 
 	Bitu readb_through(PhysPt addr) {
 		Bitu lin_page = addr >> 12;
-		Bit32u phys_page = paging.tlb.phys_page[lin_page] & PHYSPAGE_ADDR;
+		Bit32u phys_page = tlb_phys_page(lin_page) & PHYSPAGE_ADDR;
 		PageHandler* handler = MEM_GetPageHandler(phys_page);
 		if (handler->getFlags() & PFLAG_READABLE) {
 			return host_readb(handler->GetHostReadPt(phys_page) + (addr&0xfff));
@@ -507,7 +535,7 @@ private:
 					}
 	Bitu readw_through(PhysPt addr) {
 		Bitu lin_page = addr >> 12;
-		Bit32u phys_page = paging.tlb.phys_page[lin_page] & PHYSPAGE_ADDR;
+		Bit32u phys_page = tlb_phys_page(lin_page) & PHYSPAGE_ADDR;
 		PageHandler* handler = MEM_GetPageHandler(phys_page);
 		if (handler->getFlags() & PFLAG_READABLE) {
 			return host_readw(handler->GetHostReadPt(phys_page) + (addr&0xfff));
@@ -516,7 +544,7 @@ private:
 			}
 	Bitu readd_through(PhysPt addr) {
 		Bitu lin_page = addr >> 12;
-		Bit32u phys_page = paging.tlb.phys_page[lin_page] & PHYSPAGE_ADDR;
+		Bit32u phys_page = tlb_phys_page(lin_page) & PHYSPAGE_ADDR;
 		PageHandler* handler = MEM_GetPageHandler(phys_page);
 		if (handler->getFlags() & PFLAG_READABLE) {
 			return host_readd(handler->GetHostReadPt(phys_page) + (addr&0xfff));
@@ -526,7 +554,7 @@ private:
 
 	void writeb_through(PhysPt addr, Bitu val) {
 		Bitu lin_page = addr >> 12;
-		Bit32u phys_page = paging.tlb.phys_page[lin_page] & PHYSPAGE_ADDR;
+		Bit32u phys_page = tlb_phys_page(lin_page) & PHYSPAGE_ADDR;
 		PageHandler* handler = MEM_GetPageHandler(phys_page);
 		if (handler->getFlags() & PFLAG_WRITEABLE) {
 			return host_writeb(handler->GetHostWritePt(phys_page) + (addr&0xfff), (Bit8u)val);
@@ -536,7 +564,7 @@ private:
 
 	void writew_through(PhysPt addr, Bitu val) {
 		Bitu lin_page = addr >> 12;
-		Bit32u phys_page = paging.tlb.phys_page[lin_page] & PHYSPAGE_ADDR;
+		Bit32u phys_page = tlb_phys_page(lin_page) & PHYSPAGE_ADDR;
 		PageHandler* handler = MEM_GetPageHandler(phys_page);
 		if (handler->getFlags() & PFLAG_WRITEABLE) {
 			return host_writew(handler->GetHostWritePt(phys_page) + (addr&0xfff), (Bit16u)val);
@@ -546,7 +574,7 @@ private:
 
 	void writed_through(PhysPt addr, Bitu val) {
 		Bitu lin_page = addr >> 12;
-		Bit32u phys_page = paging.tlb.phys_page[lin_page] & PHYSPAGE_ADDR;
+		Bit32u phys_page = tlb_phys_page(lin_page) & PHYSPAGE_ADDR;
 		PageHandler* handler = MEM_GetPageHandler(phys_page);
 		if (handler->getFlags() & PFLAG_WRITEABLE) {
 			return host_writed(handler->GetHostWritePt(phys_page) + (addr&0xfff), val);
@@ -828,30 +856,85 @@ Bitu PAGING_GetDirBase(void) {
 }
 
 #if defined(USE_FULL_TLB)
+static INLINE void tlb_unlink(Bitu page) {
+	paging.tlb.read[page]=0;
+	paging.tlb.write[page]=0;
+	paging.tlb.readhandler[page]=&init_page_handler;
+	paging.tlb.writehandler[page]=&init_page_handler;
+}
+
+void PAGING_InitTLB(void) {
+	for (Bitu i=0;i<TLB_SIZE;i++) tlb_unlink(i);
+	paging.ur_links.used=0;
+	paging.krw_links.used=0;
+	paging.kr_links.used=0;
+	paging.links.used=0;
+}
+#else
+/* Pages in a bank that was never allocated are unlinked already */
+static INLINE void tlb_unlink(Bitu page) {
+	tlb_entry * bank=paging.tlbh_banks[page >> TLB_BANK_SHIFT];
+	if (bank==tlb_empty_bank) return;
+	tlb_entry * entry=&bank[page & (TLB_BANK_SIZE-1)];
+	entry->read=0;
+	entry->write=0;
+	entry->readhandler=&init_page_handler;
+	entry->writehandler=&init_page_handler;
+}
+
+static void PAGING_AllocTLBBank(Bitu bank) {
+	tlb_entry * entries=(tlb_entry *)malloc(sizeof(tlb_entry)*TLB_BANK_SIZE);
+	if (!entries) E_Exit("Out of Memory");
+	memcpy(entries,tlb_empty_bank,sizeof(tlb_entry)*TLB_BANK_SIZE);
+	paging.tlbh_banks[bank]=entries;
+	if (++paging.tlb_stats.banks>paging.tlb_stats.peak) paging.tlb_stats.peak=paging.tlb_stats.banks;
+}
+
+static void PAGING_FreeTLBBanks(void) {
+	for (Bitu i=0;i<TLB_BANKS;i++) {
+		if (paging.tlbh_banks[i] && paging.tlbh_banks[i]!=tlb_empty_bank) free(paging.tlbh_banks[i]);
+		paging.tlbh_banks[i]=tlb_empty_bank;
+	}
+	paging.tlb_stats.banks=0;
+}
+
 void PAGING_InitTLB(void) {
-	for (Bitu i=0;i<TLB_SIZE;i++) {
-		paging.tlb.read[i]=0;
-		paging.tlb.write[i]=0;
-		paging.tlb.readhandler[i]=&init_page_handler;
-		paging.tlb.writehandler[i]=&init_page_handler;
+	for (Bitu i=0;i<TLB_BANK_SIZE;i++) {
+		tlb_empty_bank[i].read=0;
+		tlb_empty_bank[i].write=0;
+		tlb_empty_bank[i].readhandler=&init_page_handler;
+		tlb_empty_bank[i].writehandler=&init_page_handler;
+		tlb_empty_bank[i].phys_page=0;
 	}
+	PAGING_FreeTLBBanks();
+	memset(paging.tlb_stats.links,0,sizeof(paging.tlb_stats.links));
 	paging.ur_links.used=0;
 	paging.krw_links.used=0;
 	paging.kr_links.used=0;
 	paging.links.used=0;
 }
 
+static void PAGING_ShutDown(Section * sec) {
+	Bitu used=0;
+	for (Bitu i=0;i<TLB_BANKS;i++) {
+		if (!paging.tlb_stats.links[i]) continue;
+		used++;
+		LOG(LOG_PAGING,LOG_NORMAL)("TLB bank %03X (linear %08X): %u links",
+			(int)i,(int)(i << (TLB_BANK_SHIFT+12)),(unsigned int)paging.tlb_stats.links[i]);
+	}
+	LOG(LOG_PAGING,LOG_NORMAL)("TLB: %d banks used, at most %d allocated at once (%d KB)",
+		(int)used,(int)paging.tlb_stats.peak,(int)(paging.tlb_stats.peak*sizeof(tlb_entry)*TLB_BANK_SIZE/1024));
+	PAGING_FreeTLBBanks();
+}
+#endif
+
 void PAGING_ClearTLB(void) {
 //	LOG_MSG("CLEAR                          m% 4u, kr% 4u, krw% 4u, ur% 4u",
 //		paging.links.used, paging.kro_links.used, paging.krw_links.used, paging.ure_links.used);
 
 	Bit32u * entries=&paging.links.entries[0];
 	for (;paging.links.used>0;paging.links.used--) {
-		Bitu page=*entries++;
-		paging.tlb.read[page]=0;
-		paging.tlb.write[page]=0;
-		paging.tlb.readhandler[page]=&init_page_handler;
-		paging.tlb.writehandler[page]=&init_page_handler;
+		tlb_unlink(*entries++);
 	}
 	paging.ur_links.used=0;
 	paging.krw_links.used=0;
@@ -860,22 +943,13 @@ void PAGING_ClearTLB(void) {
 }
 
 void PAGING_UnlinkPages(Bitu lin_page,Bitu pages) {
-	for (;pages>0;pages--) {
-		paging.tlb.read[lin_page]=0;
-		paging.tlb.write[lin_page]=0;
-		paging.tlb.readhandler[lin_page]=&init_page_handler;
-		paging.tlb.writehandler[lin_page]=&init_page_handler;
-		lin_page++;
-	}
+	for (;pages>0;pages--) tlb_unlink(lin_page++);
 }
 
 void PAGING_MapPage(Bitu lin_page,Bitu phys_page) {
 	if (lin_page<LINK_START) {
 		paging.firstmb[lin_page]=phys_page;
-		paging.tlb.read[lin_page]=0;
-		paging.tlb.write[lin_page]=0;
-		paging.tlb.readhandler[lin_page]=&init_page_handler;
-		paging.tlb.writehandler[lin_page]=&init_page_handler;
+		tlb_unlink(lin_page);
 	} else {
 		PAGING_LinkPage(lin_page,phys_page);
 	}
@@ -902,41 +976,41 @@ static void PAGING_LinkPageNew(Bitu lin_page, Bitu phys_page, Bitu linkmode, boo
 	// bit31-30 ACMAP_
 	// bit29	dirty
 	// these bits are shifted off at the places paging.tlb.phys_page is read
-	paging.tlb.phys_page[lin_page]= phys_page | (linkmode<< 30) | (dirty? PHYSPAGE_DITRY:0);
+	tlb_phys_page(lin_page)= phys_page | (linkmode<< 30) | (dirty? PHYSPAGE_DITRY:0);
 	switch(outcome) {
 	case ACMAP_RW:
 		// read
-		if (handler->getFlags() & PFLAG_READABLE) paging.tlb.read[lin_page] = 
+		if (handler->getFlags() & PFLAG_READABLE) tlb_read(lin_page) = 
 			handler->GetHostReadPt(phys_page)-lin_base;
-	else paging.tlb.read[lin_page]=0;
-	paging.tlb.readhandler[lin_page]=handler;
+	else tlb_read(lin_page)=0;
+	tlb_readhandler(lin_page)=handler;
 		
 		// write
 		if (dirty) { // in case it is already dirty we don't need to check
-			if (handler->getFlags() & PFLAG_WRITEABLE) paging.tlb.write[lin_page] = 
+			if (handler->getFlags() & PFLAG_WRITEABLE) tlb_write(lin_page) = 
 				handler->GetHostWritePt(phys_page)-lin_base;
-			else paging.tlb.write[lin_page]=0;
-	paging.tlb.writehandler[lin_page]=handler;
+			else tlb_write(lin_page)=0;
+	tlb_writehandler(lin_page)=handler;
 		} else {
-			paging.tlb.writehandler[lin_page]= &foiling_handler;
-			paging.tlb.write[lin_page]=0;
+			tlb_writehandler(lin_page)= &foiling_handler;
+			tlb_write(lin_page)=0;
 		}
 		break;
 	case ACMAP_RE:
 		// read
-		if (handler->getFlags() & PFLAG_READABLE) paging.tlb.read[lin_page] = 
+		if (handler->getFlags() & PFLAG_READABLE) tlb_read(lin_page) = 
 			handler->GetHostReadPt(phys_page)-lin_base;
-		else paging.tlb.read[lin_page]=0;
-		paging.tlb.readhandler[lin_page]=handler;
+		else tlb_read(lin_page)=0;
+		tlb_readhandler(lin_page)=handler;
 		// exception
-		paging.tlb.writehandler[lin_page]= &exception_handler;
-		paging.tlb.write[lin_page]=0;
+		tlb_writehandler(lin_page)= &exception_handler;
+		tlb_write(lin_page)=0;
 		break;
 	case ACMAP_EE:
-		paging.tlb.readhandler[lin_page]= &exception_handler;
-		paging.tlb.writehandler[lin_page]= &exception_handler;
-		paging.tlb.read[lin_page]=0;
-		paging.tlb.write[lin_page]=0;
+		tlb_readhandler(lin_page)= &exception_handler;
+		tlb_writehandler(lin_page)= &exception_handler;
+		tlb_read(lin_page)=0;
+		tlb_write(lin_page)=0;
 		break;
 }
 
@@ -955,6 +1029,9 @@ static void PAGING_LinkPageNew(Bitu lin_page, Bitu phys_page, Bitu linkmode, boo
 		break;
 	}
 	paging.links.entries[paging.links.used++]=lin_page; // "master table"
+#if !defined(USE_FULL_TLB)
+	paging.tlb_stats.links[lin_page >> TLB_BANK_SHIFT]++;
+#endif
 }
 
 void PAGING_LinkPage(Bitu lin_page,Bitu phys_page) {
@@ -968,15 +1045,18 @@ void PAGING_LinkPage(Bitu lin_page,Bitu phys_page) {
 		PAGING_ClearTLB();
 	}
 
-	paging.tlb.phys_page[lin_page]=phys_page;
-	if (handler->getFlags() & PFLAG_READABLE) paging.tlb.read[lin_page]=handler->GetHostReadPt(phys_page)-lin_base;
-	else paging.tlb.read[lin_page]=0;
-	if (handler->getFlags() & PFLAG_WRITEABLE) paging.tlb.write[lin_page]=handler->GetHostWritePt(phys_page)-lin_base;
-	else paging.tlb.write[lin_page]=0;
+	tlb_phys_page(lin_page)=phys_page;
+	if (handler->getFlags() & PFLAG_READABLE) tlb_read(lin_page)=handler->GetHostReadPt(phys_page)-lin_base;
+	else tlb_read(lin_page)=0;
+	if (handler->getFlags() & PFLAG_WRITEABLE) tlb_write(lin_page)=handler->GetHostWritePt(phys_page)-lin_base;
+	else tlb_write(lin_page)=0;
 
 	paging.links.entries[paging.links.used++]=lin_page;
-	paging.tlb.readhandler[lin_page]=handler;
-	paging.tlb.writehandler[lin_page]=handler;
+#if !defined(USE_FULL_TLB)
+	paging.tlb_stats.links[lin_page >> TLB_BANK_SHIFT]++;
+#endif
+	tlb_readhandler(lin_page)=handler;
+	tlb_writehandler(lin_page)=handler;
 }
 
 // parameter is the new cpl mode
@@ -992,36 +1072,36 @@ void PAGING_SwitchCPL(bool isUser) {
 		// sv -> us: rw -> ee 
 		for(Bitu i = 0; i < paging.krw_links.used; i++) {
 			Bitu tlb_index = paging.krw_links.entries[i];
-			paging.tlb.readhandler[tlb_index] = &exception_handler;
-			paging.tlb.writehandler[tlb_index] = &exception_handler;
-			paging.tlb.read[tlb_index] = 0;
-			paging.tlb.write[tlb_index] = 0;
+			tlb_readhandler(tlb_index) = &exception_handler;
+			tlb_writehandler(tlb_index) = &exception_handler;
+			tlb_read(tlb_index) = 0;
+			tlb_write(tlb_index) = 0;
 		}
 	} else {
 		// us -> sv: ee -> rw
 		for(Bitu i = 0; i < paging.krw_links.used; i++) {
 			Bitu tlb_index = paging.krw_links.entries[i];
-			Bitu phys_page = paging.tlb.phys_page[tlb_index];
+			Bitu phys_page = tlb_phys_page(tlb_index);
 			Bitu lin_base = tlb_index << 12;
 			bool dirty = (phys_page & PHYSPAGE_DITRY)? true:false;
 			phys_page &= PHYSPAGE_ADDR;
 			PageHandler* handler = MEM_GetPageHandler(phys_page);
 			
 			// map read handler
-			paging.tlb.readhandler[tlb_index] = handler;
+			tlb_readhandler(tlb_index) = handler;
 			if (handler->getFlags()&PFLAG_READABLE)
-				paging.tlb.read[tlb_index] = handler->GetHostReadPt(phys_page)-lin_base;
-			else paging.tlb.read[tlb_index] = 0;
+				tlb_read(tlb_index) = handler->GetHostReadPt(phys_page)-lin_base;
+			else tlb_read(tlb_index) = 0;
 			
 			// map write handler
 			if (dirty) {
-				paging.tlb.writehandler[tlb_index] = handler;
+				tlb_writehandler(tlb_index) = handler;
 				if (handler->getFlags()&PFLAG_WRITEABLE)
-					paging.tlb.write[tlb_index] = handler->GetHostWritePt(phys_page)-lin_base;
-				else paging.tlb.write[tlb_index] = 0;
+					tlb_write(tlb_index) = handler->GetHostWritePt(phys_page)-lin_base;
+				else tlb_write(tlb_index) = 0;
 			} else {
-				paging.tlb.writehandler[tlb_index] = &foiling_handler;
-				paging.tlb.write[tlb_index] = 0;
+				tlb_writehandler(tlb_index) = &foiling_handler;
+				tlb_write(tlb_index) = 0;
 			}
 		}
 	}
@@ -1033,21 +1113,21 @@ void PAGING_SwitchCPL(bool isUser) {
 			// sv -> us: re -> ee 
 			for(Bitu i = 0; i < paging.kr_links.used; i++) {
 				Bitu tlb_index = paging.kr_links.entries[i];
-				paging.tlb.readhandler[tlb_index] = &exception_handler;
-				paging.tlb.read[tlb_index] = 0;
+				tlb_readhandler(tlb_index) = &exception_handler;
+				tlb_read(tlb_index) = 0;
 			}
 		} else {
 			// us -> sv: ee -> re
 			for(Bitu i = 0; i < paging.kr_links.used; i++) {
 				Bitu tlb_index = paging.kr_links.entries[i];
 				Bitu lin_base = tlb_index << 12;
-				Bitu phys_page = paging.tlb.phys_page[tlb_index] & PHYSPAGE_ADDR;
+				Bitu phys_page = tlb_phys_page(tlb_index) & PHYSPAGE_ADDR;
 				PageHandler* handler = MEM_GetPageHandler(phys_page);
 
-				paging.tlb.readhandler[tlb_index] = handler;
+				tlb_readhandler(tlb_index) = handler;
 				if (handler->getFlags()&PFLAG_READABLE)
-					paging.tlb.read[tlb_index] = handler->GetHostReadPt(phys_page)-lin_base;
-				else paging.tlb.read[tlb_index] = 0;
+					tlb_read(tlb_index) = handler->GetHostReadPt(phys_page)-lin_base;
+				else tlb_read(tlb_index) = 0;
 			}
 		}
 	} else { // WP=0
@@ -1056,137 +1136,33 @@ void PAGING_SwitchCPL(bool isUser) {
 			// sv -> us: rw -> re 
 			for(Bitu i = 0; i < paging.ur_links.used; i++) {
 				Bitu tlb_index = paging.ur_links.entries[i];
-				paging.tlb.writehandler[tlb_index] = &exception_handler;
-				paging.tlb.write[tlb_index] = 0;
+				tlb_writehandler(tlb_index) = &exception_handler;
+				tlb_write(tlb_index) = 0;
 			}
 		} else {
 			// us -> sv: re -> rw
 			for(Bitu i = 0; i < paging.ur_links.used; i++) {
 				Bitu tlb_index = paging.ur_links.entries[i];
-				Bitu phys_page = paging.tlb.phys_page[tlb_index];
+				Bitu phys_page = tlb_phys_page(tlb_index);
 				bool dirty = (phys_page & PHYSPAGE_DITRY)? true:false;
 				phys_page &= PHYSPAGE_ADDR;
 				PageHandler* handler = MEM_GetPageHandler(phys_page);
 
 				if (dirty) {
 					Bitu lin_base = tlb_index << 12;
-					paging.tlb.writehandler[tlb_index] = handler;
+					tlb_writehandler(tlb_index) = handler;
 					if (handler->getFlags()&PFLAG_WRITEABLE)
-						paging.tlb.write[tlb_index] = handler->GetHostWritePt(phys_page)-lin_base;
-					else paging.tlb.write[tlb_index] = 0;
+						tlb_write(tlb_index) = handler->GetHostWritePt(phys_page)-lin_base;
+					else tlb_write(tlb_index) = 0;
 				} else {
-					paging.tlb.writehandler[tlb_index] = &foiling_handler;
-					paging.tlb.write[tlb_index] = 0;
+					tlb_writehandler(tlb_index) = &foiling_handler;
+					tlb_write(tlb_index) = 0;
 				}
 			}
 		}
 	}
 }
 
-#else
-
-static INLINE void InitTLBInt(tlb_entry *bank) {
- 	for (Bitu i=0;i<TLB_SIZE;i++) {
-		bank[i].read=0;
-		bank[i].write=0;
-		bank[i].readhandler=&init_page_handler;
-		bank[i].writehandler=&init_page_handler;
- 	}
-}
-
-void PAGING_InitTLBBank(tlb_entry **bank) {
-	*bank = (tlb_entry *)malloc(sizeof(tlb_entry)*TLB_SIZE);
-	if(!*bank) E_Exit("Out of Memory");
-	InitTLBInt(*bank);
-}
-
-void PAGING_InitTLB(void) {
-	InitTLBInt(paging.tlbh);
- 	paging.links.used=0;
-}
-
-void PAGING_ClearTLB(void) {
-	Bit32u * entries=&paging.links.entries[0];
-	for (;paging.links.used>0;paging.links.used--) {
-		Bitu page=*entries++;
-		tlb_entry *entry = get_tlb_entry(page<<12);
-		entry->read=0;
-		entry->write=0;
-		entry->readhandler=&init_page_handler;
-		entry->writehandler=&init_page_handler;
-	}
-	paging.links.used=0;
-}
-
-void PAGING_UnlinkPages(Bitu lin_page,Bitu pages) {
-	for (;pages>0;pages--) {
-		tlb_entry *entry = get_tlb_entry(lin_page<<12);
-		entry->read=0;
-		entry->write=0;
-		entry->readhandler=&init_page_handler;
-		entry->writehandler=&init_page_handler;
-		lin_page++;
-	}
-}
-
-void PAGING_MapPage(Bitu lin_page,Bitu phys_page) {
-	if (lin_page<LINK_START) {
-		paging.firstmb[lin_page]=phys_page;
-		paging.tlbh[lin_page].read=0;
-		paging.tlbh[lin_page].write=0;
-		paging.tlbh[lin_page].readhandler=&init_page_handler;
-		paging.tlbh[lin_page].writehandler=&init_page_handler;
-	} else {
-		PAGING_LinkPage(lin_page,phys_page);
-	}
-}
-
-void PAGING_LinkPage(Bitu lin_page,Bitu phys_page) {
-	PageHandler * handler=MEM_GetPageHandler(phys_page);
-	Bitu lin_base=lin_page << 12;
-	if (lin_page>=(TLB_SIZE*(TLB_BANKS+1)) || phys_page>=(TLB_SIZE*(TLB_BANKS+1))) 
-		E_Exit("Illegal page");
-
-	if (paging.links.used>=PAGING_LINKS) {
-		LOG(LOG_PAGING,LOG_NORMAL)("Not enough paging links, resetting cache");
-		PAGING_ClearTLB();
-	}
-
-	tlb_entry *entry = get_tlb_entry(lin_base);
-	entry->phys_page=phys_page;
-	if (handler->getFlags() & PFLAG_READABLE) entry->read=handler->GetHostReadPt(phys_page)-lin_base;
-	else entry->read=0;
-	if (handler->getFlags() & PFLAG_WRITEABLE) entry->write=handler->GetHostWritePt(phys_page)-lin_base;
-	else entry->write=0;
-
- 	paging.links.entries[paging.links.used++]=lin_page;
-	entry->readhandler=handler;
-	entry->writehandler=handler;
-}
-
-void PAGING_LinkPage_ReadOnly(Bitu lin_page,Bitu phys_page) {
-	PageHandler * handler=MEM_GetPageHandler(phys_page);
-	Bitu lin_base=lin_page << 12;
-	if (lin_page>=(TLB_SIZE*(TLB_BANKS+1)) || phys_page>=(TLB_SIZE*(TLB_BANKS+1))) 
-		E_Exit("Illegal page");
-
-	if (paging.links.used>=PAGING_LINKS) {
-		LOG(LOG_PAGING,LOG_NORMAL)("Not enough paging links, resetting cache");
-		PAGING_ClearTLB();
-	}
-
-	tlb_entry *entry = get_tlb_entry(lin_base);
-	entry->phys_page=phys_page;
-	if (handler->getFlags() & PFLAG_READABLE) entry->read=handler->GetHostReadPt(phys_page)-lin_base;
-	else entry->read=0;
-	entry->write=0;
-
- 	paging.links.entries[paging.links.used++]=lin_page;
-	entry->readhandler=handler;
-	entry->writehandler=&init_page_handler_userro;
-}
-
-#endif
 
 
 void PAGING_SetDirBase(Bitu cr3) {
@@ -1239,5 +1215,8 @@ void PAGING_Init() {
 	PAGING_InitTLB();
 	for (i=0;i<LINK_START;i++) paging.firstmb[i]=i;
 	pf_queue.used=0;
+#if !defined(USE_FULL_TLB)
+	AddExitFunction(AddExitFunctionFuncPair(PAGING_ShutDown));
+#endif
 }
 
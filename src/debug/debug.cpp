@@ -122,6 +122,7 @@ static Segment oldsegs[6];
 static Bitu oldflags,oldcpucpl;
 DBGBlock dbg;
 extern Bitu cycle_count;
+void DOS_LogIsoSectorCache(void);
 static bool debugging = false;
 static bool check_rescroll = false;
 
@@ -1263,6 +1264,15 @@ bool ParseCommand(char* str) {
 
 	if (command == "CPU") {LogCPUInfo(); return true;}
 
+#if (C_DYNAMIC_X86)
+	if (command == "DYNHOT") { // List the most executed dynamic core blocks
+		CPU_Core_Dyn_X86_LogHotBlocks(found[0] ? GetHexValue(found,found) : 0x10);
+		return true;
+	}
+#endif
+
+	if (command == "ISOCACHE") {DOS_LogIsoSectorCache(); return true;}
+
 	if (command == "INTVEC") {
 		if (found[0] != 0) {
 			OutputVecTable(found);
@@ -1358,6 +1368,10 @@ bool ParseCommand(char* str) {
 		DEBUG_ShowMsg("LDT                       - Lists descriptors of the LDT.\n");
 		DEBUG_ShowMsg("IDT                       - Lists descriptors of the IDT.\n");
 		DEBUG_ShowMsg("PAGING [page]             - Display content of page table.\n");
+#if (C_DYNAMIC_X86)
+		DEBUG_ShowMsg("DYNHOT [num]              - List most executed dynamic core blocks.\n");
+#endif
+		DEBUG_ShowMsg("ISOCACHE                  - Show sector cache counters of CD images.\n");
 		DEBUG_ShowMsg("EXTEND                    - Toggle additional info.\n");
 		DEBUG_ShowMsg("TIMERIRQ                  - Run the system timer.\n");
 
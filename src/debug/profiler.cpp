@@ -0,0 +1,204 @@
+/*
+ *  Copyright (C) 2002-2015  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+	Sampling profiler for the guest
+
+	On every PIC tick the current CS:EIP, CPL and mode are stored in a ring
+	buffer. A dump adds up the samples in the ring and writes them in the
+	folded stack format of flamegraph.pl, one line per program, mode, symbol
+	and address with the number of samples at the end.
+
+	Symbols come from a linker MAP file. Its seg:off addresses are taken as
+	relative to the load segment (PSP+10h, the PSP for a .COM file) of the
+	program that was running in real mode, in protected mode the offset is
+	taken as a flat address.
+*/
+
+#include <string.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "dosbox.h"
+#include "control.h"
+#include "setup.h"
+#include "cpu.h"
+#include "regs.h"
+#include "timer.h"
+#include "mapper.h"
+#include "hardware.h"
+#include "dos_inc.h"
+
+extern const char* RunningProgram;
+extern bool dos_kernel_disabled;
+
+enum {
+	PROF_REAL,PROF_V86,PROF_PM16,PROF_PM32
+};
+
+static const char * prof_modes[]={"real","v86","pm16","pm32"};
+
+struct ProfSample {
+	Bit32u eip;
+	Bit16u cs;
+	Bit16u psp;				//Current PSP in real mode, 0 otherwise
+	Bit16u program;			//Index into prof.programs
+	Bit8u mode;
+	Bit8u cpl;
+};
+
+static struct {
+	bool active;
+	std::vector<ProfSample> ring;
+	Bitu pos;
+	Bit64u total;
+	std::vector<std::string> programs;
+	Bit16u program;
+	std::map<Bit32u,std::string> real_symbols;		//By offset in the load image
+	std::map<Bit32u,std::string> flat_symbols;		//By offset
+} prof;
+
+static void PROFILER_Sample(void) {
+	ProfSample & sample=prof.ring[prof.pos];
+	if (++prof.pos>=prof.ring.size()) prof.pos=0;
+	prof.total++;
+
+	if (prof.programs[prof.program]!=RunningProgram) {
+		Bitu i;
+		for (i=0;i<prof.programs.size();i++)
+			if (prof.programs[i]==RunningProgram) break;
+		if (i==prof.programs.size()) {
+			if (i>=0xffff) i=0;
+			else prof.programs.push_back(RunningProgram);
+		}
+		prof.program=(Bit16u)i;
+	}
+
+	sample.eip=reg_eip;
+	sample.cs=SegValue(cs);
+	sample.cpl=(Bit8u)cpu.cpl;
+	sample.program=prof.program;
+	sample.psp=0;
+	if (!cpu.pmode) {
+		sample.mode=PROF_REAL;
+		/* Only in real mode DOS memory can be read without a chance of a page fault */
+		if (!dos_kernel_disabled) sample.psp=dos.psp();
+	} else if (GETFLAG(VM)) sample.mode=PROF_V86;
+	else sample.mode=cpu.code.big ? PROF_PM32 : PROF_PM16;
+}
+
+/* Lines of the form "ssss:oooo[oooo] name" as written by most DOS linkers */
+static void PROFILER_LoadMap(const char * filename) {
+	FILE * f=fopen(filename,"rt");
+	if (!f) {
+		LOG_MSG("PROFILER:Can't open map file %s",filename);
+		return;
+	}
+	char line[512];
+	while (fgets(line,sizeof(line),f)) {
+		unsigned int seg,off;char name[256];
+		const char * p=line;
+		while (*p==' ' || *p=='\t') p++;
+		if (!isxdigit((unsigned char)*p)) continue;
+		if (sscanf(p,"%x:%x %255s",&seg,&off,name)!=3) continue;
+		if (!(isalpha((unsigned char)name[0]) || name[0]=='_' || name[0]=='@' || name[0]=='$')) continue;
+		prof.real_symbols[((seg&0xffff)<<4)+(off&0xfffff)]=name;
+		prof.flat_symbols[off]=name;
+	}
+	fclose(f);
+	LOG_MSG("PROFILER:Loaded %d symbols from %s",(int)prof.flat_symbols.size(),filename);
+}
+
+static const char * PROFILER_Symbol(const std::map<Bit32u,std::string> & symbols,Bit32u addr) {
+	std::map<Bit32u,std::string>::const_iterator it=symbols.upper_bound(addr);
+	if (it==symbols.begin()) return NULL;
+	--it;
+	return it->second.c_str();
+}
+
+static void PROFILER_Dump(void) {
+	if (!prof.active) return;
+	FILE * f=OpenCaptureFile("Profile",".folded");
+	if (!f) return;
+
+	Bitu count=(prof.total<prof.ring.size()) ? (Bitu)prof.total : prof.ring.size();
+	std::map<std::string,Bitu> folded;
+	char frame[512];
+	for (Bitu i=0;i<count;i++) {
+		const ProfSample & sample=prof.ring[i];
+		const char * symbol=NULL;
+		if (sample.mode==PROF_REAL) {
+			if (sample.psp) {
+				/* A .COM file runs with CS=PSP and is linked at 0000:0100 */
+				Bit32u base=(sample.cs==sample.psp) ? sample.psp : (Bit32u)sample.psp+0x10;
+				Bit32u addr=((Bit32u)sample.cs<<4)+(sample.eip&0xffff);
+				if (addr>=(base<<4) && addr<0xA0000) symbol=PROFILER_Symbol(prof.real_symbols,addr-(base<<4));
+			}
+		} else if (sample.mode!=PROF_V86) symbol=PROFILER_Symbol(prof.flat_symbols,sample.eip);
+		snprintf(frame,sizeof(frame),"%s;%s cpl%d;%s%s%04X:%08X",
+			prof.programs[sample.program].c_str(),prof_modes[sample.mode],sample.cpl,
+			symbol ? symbol : "",symbol ? ";" : "",sample.cs,sample.eip);
+		folded[frame]++;
+	}
+	for (std::map<std::string,Bitu>::iterator it=folded.begin();it!=folded.end();++it)
+		fprintf(f,"%s %u\n",it->first.c_str(),(unsigned int)it->second);
+	fclose(f);
+	LOG_MSG("PROFILER:Wrote %u of %u samples",(unsigned int)count,(unsigned int)prof.total);
+}
+
+static void PROFILER_DumpEvent(bool pressed) {
+	if (!pressed) return;
+	PROFILER_Dump();
+}
+
+static void PROFILER_ShutDown(Section * sec) {
+	if (!prof.active) return;
+	PROFILER_Dump();
+	TIMER_DelTickHandler(PROFILER_Sample);
+	prof.active=false;
+	prof.ring.clear();
+	prof.real_symbols.clear();
+	prof.flat_symbols.clear();
+}
+
+void PROFILER_Init() {
+	Section_prop * section=static_cast<Section_prop *>(control->GetSection("debug"));
+	assert(section != NULL);
+
+	MAPPER_AddHandler(PROFILER_DumpEvent,MK_f6,MMOD1|MMOD2,"profdump","Prof Dump");
+	if (!section->Get_bool("profiler")) return;
+
+	LOG(LOG_MISC,LOG_DEBUG)("Initializing guest profiler");
+	Bits samples=section->Get_int("profiler samples");
+	prof.ring.resize(samples>0 ? (Bitu)samples : 1);
+	prof.pos=0;
+	prof.total=0;
+	prof.programs.clear();
+	prof.programs.push_back(RunningProgram);
+	prof.program=0;
+
+	Prop_path * map=section->Get_path("profiler map");
+	if (map && !map->realpath.empty()) PROFILER_LoadMap(map->realpath.c_str());
+
+	TIMER_AddTickHandler(PROFILER_Sample);
+	prof.active=true;
+	AddExitFunction(AddExitFunctionFuncPair(PROFILER_ShutDown));
+}
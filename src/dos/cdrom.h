@@ -154,6 +154,69 @@ private:
 	private:
 		BinaryFile();
 		std::ifstream *file;
+		SDL_mutex *mutex;			// The CD audio thread reads the same file
+	};
+
+	/* CD image compressed into hunks by MAME's chdman (CHD version 5). The
+	   tracks are seen one after the other, each with its own sector size,
+	   so they can be read like the bin file of a cue sheet. */
+	class CHDFile : public TrackFile {
+	public:
+		struct CHDTrack {
+			int number;
+			int frames;				// Including a pregap that is in the file
+			int pregap;
+			bool pregapInFile;
+			int sectorSize;			// Bytes of each frame that are stored
+			bool mode2;
+			bool audio;
+			int offset;				// Where the track starts in the stream
+			Bit32u firstFrame;		// Frame number in the CHD
+		};
+
+		CHDFile(const char *filename, bool &error);
+		~CHDFile();
+		bool read(Bit8u *buffer, int seek, int count);
+		int getLength();
+
+		std::vector<CHDTrack> chdTracks;
+	private:
+		struct MapEntry {
+			Bit8u type;
+			Bit32u length;
+			Bit64u offset;
+			Bit16u crc;
+		};
+		struct CachedHunk {
+			Bit32u number;
+			Bit64u lastUse;
+			std::vector<Bit8u> data;
+		};
+
+		CHDFile();
+		static bool TrackBefore(const CHDTrack &a, const CHDTrack &b);
+		bool ReadMap(void);
+		bool ReadMetadata(void);
+		bool ReadFile(Bit64u offset, void *buffer, Bit32u size);
+		bool DecodeHunk(Bit32u hunk, const Bit8u *src, Bit8u *dest, int depth);
+		Bit8u *GetHunk(Bit32u hunk);
+
+		FILE *file;
+		Bit32u compressors[4];
+		Bit64u logicalBytes;
+		Bit64u mapOffset;
+		Bit64u metaOffset;
+		Bit32u hunkBytes;
+		Bit32u unitBytes;
+		Bit32u hunkCount;
+		int length;
+		std::vector<MapEntry> map;
+		std::vector<CachedHunk> cache;
+		Bit64u cacheClock;
+		Bit32u lastMiss;
+		std::vector<Bit8u> compressed;
+		std::vector<Bit8u> scratch;
+		SDL_mutex *mutex;
 	};
 
 	struct Track {
@@ -195,6 +258,8 @@ static	CDROM_Interface_Image* images[26];
 private:
 	// player
 static	void	CDAudioCallBack(Bitu len);
+static	int	CDAudioThread(void *data);
+static	bool	CDAudioThreadReady(void);
 	int	GetTrack(int sector);
 
 static  struct imagePlayer {
@@ -205,6 +270,9 @@ static  struct imagePlayer {
 		int     bufLen;
 		int     currFrame;	
 		int     targetFrame;
+		int     readFrame;		// Next sector for the audio thread
+		bool    readEnded;
+		Bit32u  generation;		// Changes whenever the sectors in the ring become useless
 		bool    isPlaying;
 		bool    isPaused;
 		bool    ctrlUsed;
@@ -213,6 +281,7 @@ static  struct imagePlayer {
 	
 	void 	ClearTracks();
 	bool	LoadIsoFile(char *filename);
+	bool	LoadChdFile(char *filename);
 	bool	CanReadPVD(TrackFile *file, int sectorSize, bool mode2);
 	// cue sheet processing
 	bool	LoadCueSheet(char *cuefile);
@@ -363,6 +432,9 @@ private:
 		int     bufLen;
 		int     currFrame;	
 		int     targetFrame;
+		int     readFrame;		// Next sector for the audio thread
+		bool    readEnded;
+		Bit32u  generation;		// Changes whenever the sectors in the ring become useless
 		bool    isPlaying;
 		bool    isPaused;
 		bool    ctrlUsed;
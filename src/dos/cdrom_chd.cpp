@@ -0,0 +1,898 @@
+/*
+ *  Copyright (C) 2002-2015  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+	CHD compressed CD images
+
+	A CHD file holds the CD as frames of 2352 bytes of sector data followed
+	by 96 bytes of subcode, grouped into hunks that are compressed one by
+	one. A map gives the codec, position and CRC of every hunk, metadata
+	entries describe the tracks. Only version 5 files without a parent are
+	read. Uncompressed hunks can always be read, the codecs chdman createcd
+	uses by default need zlib for the subcode: "cdzl" and "zlib" are
+	inflated, the audio of "cdfl" hunks goes through the small FLAC decoder
+	below, and "cdlz" and "lzma" are decoded with liblzma when it is found
+	by configure.
+
+	Decompressed hunks are kept in a small LRU cache. When the hunks are
+	missed in order the compressed data of the next few is read along with
+	the current one and decompressed ahead.
+*/
+
+#include <algorithm>
+#include <cstdio>
+#include "cdrom.h"
+#if (C_ZLIB)
+#include <zlib.h>
+#if (C_LZMA)
+#include <lzma.h>
+#endif
+#endif
+
+#define CHD_FRAME_SIZE		2448
+#define CHD_SECTOR_DATA		2352
+#define CHD_SUBCODE_DATA	96
+#define CHD_TRACK_PADDING	4
+
+#define CHD_CACHE_HUNKS		32
+#define CHD_READAHEAD		4
+
+#define CHD_TAG(a,b,c,d)	(((Bit32u)(a) << 24) | ((Bit32u)(b) << 16) | ((Bit32u)(c) << 8) | (Bit32u)(d))
+#define CHD_CODEC_ZLIB		CHD_TAG('z','l','i','b')
+#define CHD_CODEC_CD_ZLIB	CHD_TAG('c','d','z','l')
+#define CHD_CODEC_LZMA		CHD_TAG('l','z','m','a')
+#define CHD_CODEC_CD_LZMA	CHD_TAG('c','d','l','z')
+#define CHD_CODEC_CD_FLAC	CHD_TAG('c','d','f','l')
+#define CHD_META_TRACK		CHD_TAG('C','H','T','R')
+#define CHD_META_TRACK2		CHD_TAG('C','H','T','2')
+
+/* Hunk types in the map, 0 to 3 select one of the four codecs */
+enum {
+	CHD_NONE=4,CHD_SELF,CHD_PARENT,CHD_RLE_SMALL,CHD_RLE_LARGE,
+	CHD_SELF_0,CHD_SELF_1,CHD_PARENT_SELF,CHD_PARENT_0,CHD_PARENT_1,
+	CHD_ZERO=0xff			/* Hunk of an uncompressed file that isn't stored */
+};
+
+static inline Bit32u CHD_Read16(const Bit8u *p) { return ((Bit32u)p[0] << 8) | p[1]; }
+static inline Bit32u CHD_Read24(const Bit8u *p) { return ((Bit32u)p[0] << 16) | ((Bit32u)p[1] << 8) | p[2]; }
+static inline Bit32u CHD_Read32(const Bit8u *p) { return ((Bit32u)p[0] << 24) | CHD_Read24(p + 1); }
+static inline Bit64u CHD_Read48(const Bit8u *p) { return ((Bit64u)CHD_Read16(p) << 32) | CHD_Read32(p + 2); }
+static inline Bit64u CHD_Read64(const Bit8u *p) { return ((Bit64u)CHD_Read32(p) << 32) | CHD_Read32(p + 4); }
+
+/* CRC-16-CCITT as used for the map and the hunks */
+static Bit16u CHD_CRC16(Bit16u crc, const Bit8u *data, Bitu size) {
+	static Bit16u table[256];
+	static bool table_ready = false;
+	if (!table_ready) {
+		for (Bitu i = 0; i < 256; i++) {
+			Bit16u value = (Bit16u)(i << 8);
+			for (int bit = 0; bit < 8; bit++)
+				value = (value & 0x8000) ? (Bit16u)((value << 1) ^ 0x1021) : (Bit16u)(value << 1);
+			table[i] = value;
+		}
+		table_ready = true;
+	}
+	for (Bitu i = 0; i < size; i++)
+		crc = (Bit16u)((crc << 8) ^ table[(crc >> 8) ^ data[i]]);
+	return crc;
+}
+
+/* Reads bits from the most significant end */
+class CHDBitReader {
+public:
+	CHDBitReader(const Bit8u *data, Bitu size) : data(data), size(size), offset(0), buffer(0), bits(0) {}
+	Bit32u Peek(int count) {
+		if (count == 0) return 0;
+		if (count > bits) {
+			while (bits <= 24) {
+				if (offset < size) buffer |= (Bit32u)data[offset] << (24 - bits);
+				offset++;
+				bits += 8;
+			}
+		}
+		return buffer >> (32 - count);
+	}
+	void Remove(int count) {
+		buffer = (count >= 32) ? 0 : (buffer << count);
+		bits -= count;
+	}
+	Bit32u Read(int count) {
+		Bit32u value = Peek(count);
+		Remove(count);
+		return value;
+	}
+	/* Skips to the next byte */
+	void Align(void) {
+		Remove(bits % 8);
+	}
+	/* Bytes used so far, counting a partly read one */
+	Bitu Position(void) const {
+		return offset - (Bitu)(bits / 8);
+	}
+	bool Overflow(void) const {
+		return Position() > size;
+	}
+private:
+	const Bit8u *data;
+	Bitu size,offset;
+	Bit32u buffer;
+	int bits;
+};
+
+/* Canonical Huffman code for the 16 hunk types of the map, up to 8 bits */
+class CHDMapHuffman {
+public:
+	bool Import(CHDBitReader &reader) {
+		int node = 0;
+		while (node < 16) {
+			int nodebits = (int)reader.Read(4);
+			if (nodebits != 1) {
+				numbits[node++] = (Bit8u)nodebits;
+				continue;
+			}
+			/* 1 escapes either a 1 or a run of the value that follows */
+			nodebits = (int)reader.Read(4);
+			if (nodebits == 1) {
+				numbits[node++] = 1;
+				continue;
+			}
+			int repeat = (int)reader.Read(4) + 3;
+			while (repeat--) {
+				if (node >= 16) return false;
+				numbits[node++] = (Bit8u)nodebits;
+			}
+		}
+		/* Codes are handed out starting with the longest */
+		Bit32u histogram[33] = { 0 };
+		for (int i = 0; i < 16; i++) {
+			if (numbits[i] > 8) return false;
+			histogram[numbits[i]]++;
+		}
+		Bit32u start = 0;
+		for (int length = 32; length > 0; length--) {
+			Bit32u next = (start + histogram[length]) >> 1;
+			if (length != 1 && next * 2 != start + histogram[length]) return false;
+			histogram[length] = start;
+			start = next;
+		}
+		memset(lookup, 0, sizeof(lookup));
+		for (int i = 0; i < 16; i++) {
+			if (numbits[i] == 0) continue;
+			Bit32u code = histogram[numbits[i]]++;
+			int shift = 8 - numbits[i];
+			for (Bit32u j = code << shift; j < ((code + 1) << shift); j++)
+				lookup[j] = (Bit16u)((i << 5) | numbits[i]);
+		}
+		return !reader.Overflow();
+	}
+	Bit8u Decode(CHDBitReader &reader) {
+		Bit16u entry = lookup[reader.Peek(8)];
+		reader.Remove(entry & 0x1f);
+		return (Bit8u)(entry >> 5);
+	}
+private:
+	Bit8u numbits[16];
+	Bit16u lookup[256];
+};
+
+#if (C_ZLIB)
+/* Sync header and the P and Q parity of a mode 1 or mode 2 form 1 sector,
+   which chdman leaves out when they can be computed again */
+static const Bit8u chd_sync_header[12] = { 0x00,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0x00 };
+
+static void CHD_ECCBlock(const Bit8u *src, Bit32u major_count, Bit32u minor_count, Bit32u major_mult, Bit32u minor_inc, Bit8u *dest) {
+	static Bit8u ecc_f[256],ecc_b[256];
+	static bool tables_ready = false;
+	if (!tables_ready) {
+		for (Bitu i = 0; i < 256; i++) {
+			Bitu j = (i << 1) ^ ((i & 0x80) ? 0x11d : 0);
+			ecc_f[i] = (Bit8u)j;
+			ecc_b[i ^ j] = (Bit8u)i;
+		}
+		tables_ready = true;
+	}
+	Bit32u size = major_count * minor_count;
+	for (Bit32u major = 0; major < major_count; major++) {
+		Bit32u index = (major >> 1) * major_mult + (major & 1);
+		Bit8u ecc_a = 0,ecc_b_value = 0;
+		for (Bit32u minor = 0; minor < minor_count; minor++) {
+			Bit8u value = src[index];
+			index += minor_inc;
+			if (index >= size) index -= size;
+			ecc_a ^= value;
+			ecc_b_value ^= value;
+			ecc_a = ecc_f[ecc_a];
+		}
+		ecc_a = ecc_b[ecc_f[ecc_a] ^ ecc_b_value];
+		dest[major] = ecc_a;
+		dest[major + major_count] = ecc_a ^ ecc_b_value;
+	}
+}
+
+static void CHD_RestoreSector(Bit8u *sector) {
+	memcpy(sector, chd_sync_header, sizeof(chd_sync_header));
+	/* The address is left out of the parity of mode 2 sectors */
+	Bit8u address[4];
+	bool mode2 = sector[15] == 2;
+	if (mode2) {
+		memcpy(address, &sector[12], 4);
+		memset(&sector[12], 0, 4);
+	}
+	CHD_ECCBlock(&sector[0x0c], 86, 24, 2, 86, &sector[0x81c]);
+	CHD_ECCBlock(&sector[0x0c], 52, 43, 86, 88, &sector[0x8c8]);
+	if (mode2) memcpy(&sector[12], address, 4);
+}
+
+static bool CHD_Inflate(const Bit8u *src, Bit32u src_size, Bit8u *dest, Bit32u dest_size) {
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) return false;
+	stream.next_in = (Bytef*)src;
+	stream.avail_in = src_size;
+	stream.next_out = dest;
+	stream.avail_out = dest_size;
+	inflate(&stream, Z_FINISH);
+	bool complete = stream.total_out == dest_size;
+	inflateEnd(&stream);
+	return complete;
+}
+
+#if (C_LZMA)
+/* Raw LZMA with the properties chdman always uses and no end marker */
+static bool CHD_DecodeLZMA(const Bit8u *src, Bit32u src_size, Bit8u *dest, Bit32u dest_size) {
+	lzma_options_lzma options;
+	if (lzma_lzma_preset(&options, 9)) return false;
+	/* A window as large as the hunk holds every match */
+	options.dict_size = std::max(dest_size, (Bit32u)LZMA_DICT_SIZE_MIN);
+	lzma_filter filters[2] = { { LZMA_FILTER_LZMA1, &options }, { LZMA_VLI_UNKNOWN, NULL } };
+	lzma_stream stream = LZMA_STREAM_INIT;
+	if (lzma_raw_decoder(&stream, filters) != LZMA_OK) return false;
+	stream.next_in = src;
+	stream.avail_in = src_size;
+	stream.next_out = dest;
+	stream.avail_out = dest_size;
+	lzma_ret result = lzma_code(&stream, LZMA_RUN);
+	bool complete = (result == LZMA_OK || result == LZMA_STREAM_END) && stream.avail_out == 0;
+	lzma_end(&stream);
+	return complete;
+}
+#endif
+
+/* Just enough FLAC for the audio of "cdfl" hunks: 16 bit stereo frames
+   without the stream header, blocks of any size */
+class CHDFlacDecoder {
+public:
+	CHDFlacDecoder(const Bit8u *data, Bitu size) : reader(data, size) {}
+	/* Writes the samples as big endian pairs like the other codecs hold them */
+	bool Decode(Bit8u *dest, Bit32u samples) {
+		while (samples > 0) {
+			Bit32u blocksize;
+			if (!Frame(blocksize)) return false;
+			if (blocksize > samples) blocksize = samples;
+			for (Bit32u i = 0; i < blocksize; i++) {
+				for (int ch = 0; ch < 2; ch++) {
+					Bit32s sample = channel[ch][i];
+					*dest++ = (Bit8u)(sample >> 8);
+					*dest++ = (Bit8u)sample;
+				}
+			}
+			samples -= blocksize;
+		}
+		return true;
+	}
+	/* The subcode follows the last frame */
+	Bitu Position(void) const {
+		return reader.Position();
+	}
+private:
+	Bit32u ReadLong(int count) {
+		if (count <= 24) return reader.Read(count);
+		Bit32u high = reader.Read(count - 16);
+		return (high << 16) | reader.Read(16);
+	}
+	Bit32s ReadSigned(int count) {
+		if (count == 0) return 0;
+		Bit32u value = ReadLong(count);
+		if (count < 32 && (value & (1u << (count - 1)))) value |= ~0u << count;
+		return (Bit32s)value;
+	}
+	Bit32u ReadUnary(void) {
+		Bit32u count = 0;
+		while (reader.Peek(8) == 0) {
+			reader.Remove(8);
+			count += 8;
+			if (reader.Overflow()) return count;
+		}
+		while (reader.Read(1) == 0) count++;
+		return count;
+	}
+	bool Frame(Bit32u &blocksize) {
+		if (reader.Read(15) != 0x7ffc) return false;
+		reader.Read(1);
+		Bit32u size_code = reader.Read(4);
+		Bit32u rate_code = reader.Read(4);
+		Bit32u assignment = reader.Read(4);
+		Bit32u sample_code = reader.Read(3);
+		reader.Read(1);
+		/* Frame or sample number, coded like UTF-8 */
+		Bit32u first = reader.Read(8);
+		int extra = 0;
+		while (extra < 8 && (first & (0x80 >> extra))) extra++;
+		if (extra == 1 || extra == 8) return false;
+		if (extra) extra--;
+		while (extra--) reader.Read(8);
+		switch (size_code) {
+		case 0: return false;
+		case 1: blocksize = 192; break;
+		case 6: blocksize = reader.Read(8) + 1; break;
+		case 7: blocksize = reader.Read(16) + 1; break;
+		default: blocksize = (size_code < 6) ? (576u << (size_code - 2)) : (256u << (size_code - 8)); break;
+		}
+		if (rate_code == 12) reader.Read(8);
+		else if (rate_code == 13 || rate_code == 14) reader.Read(16);
+		else if (rate_code == 15) return false;
+		reader.Read(8);
+		/* The hunk CRC covers the samples, so the frame CRCs aren't checked */
+		if (sample_code != 0 && sample_code != 4) return false;
+		if (assignment != 1 && (assignment < 8 || assignment > 10)) return false;
+		for (int ch = 0; ch < 2; ch++) {
+			bool side = (assignment == 8 || assignment == 10) ? (ch == 1) : (assignment == 9 && ch == 0);
+			channel[ch].resize(blocksize);
+			if (!Subframe(&channel[ch][0], blocksize, side ? 17 : 16)) return false;
+		}
+		reader.Align();
+		reader.Read(16);
+		Bit32s *left = &channel[0][0],*right = &channel[1][0];
+		for (Bit32u i = 0; i < blocksize; i++) {
+			switch (assignment) {
+			case 8: right[i] = left[i] - right[i]; break;
+			case 9: left[i] += right[i]; break;
+			case 10: {
+				Bit32s mid = (left[i] << 1) | (right[i] & 1);
+				Bit32s side = right[i];
+				left[i] = (mid + side) >> 1;
+				right[i] = (mid - side) >> 1;
+				break;
+			}
+			}
+		}
+		return !reader.Overflow();
+	}
+	bool Subframe(Bit32s *out, Bit32u blocksize, int bps) {
+		if (reader.Read(1)) return false;
+		Bit32u type = reader.Read(6);
+		int wasted = 0;
+		if (reader.Read(1)) wasted = (int)ReadUnary() + 1;
+		bps -= wasted;
+		if (bps <= 0) return false;
+		if (type == 0) {
+			Bit32s value = ReadSigned(bps);
+			for (Bit32u i = 0; i < blocksize; i++) out[i] = value;
+		} else if (type == 1) {
+			for (Bit32u i = 0; i < blocksize; i++) out[i] = ReadSigned(bps);
+		} else if (type >= 8 && type <= 12) {
+			Bit32u order = type - 8;
+			if (order > blocksize) return false;
+			for (Bit32u i = 0; i < order; i++) out[i] = ReadSigned(bps);
+			if (!Residual(out, blocksize, order)) return false;
+			for (Bit32u i = order; i < blocksize; i++) {
+				switch (order) {
+				case 1: out[i] += out[i-1]; break;
+				case 2: out[i] += 2 * out[i-1] - out[i-2]; break;
+				case 3: out[i] += 3 * (out[i-1] - out[i-2]) + out[i-3]; break;
+				case 4: out[i] += 4 * (out[i-1] + out[i-3]) - 6 * out[i-2] - out[i-4]; break;
+				}
+			}
+		} else if (type >= 32) {
+			Bit32u order = (type & 31) + 1;
+			if (order > blocksize) return false;
+			for (Bit32u i = 0; i < order; i++) out[i] = ReadSigned(bps);
+			int precision = (int)reader.Read(4) + 1;
+			Bit32s shift = ReadSigned(5);
+			if (precision == 16 || shift < 0) return false;
+			Bit32s coefficients[32];
+			for (Bit32u i = 0; i < order; i++) coefficients[i] = ReadSigned(precision);
+			if (!Residual(out, blocksize, order)) return false;
+			for (Bit32u i = order; i < blocksize; i++) {
+				Bit64s sum = 0;
+				for (Bit32u j = 0; j < order; j++) sum += (Bit64s)coefficients[j] * out[i-1-j];
+				out[i] += (Bit32s)(sum >> shift);
+			}
+		} else {
+			return false;
+		}
+		if (wasted) {
+			for (Bit32u i = 0; i < blocksize; i++) out[i] <<= wasted;
+		}
+		return !reader.Overflow();
+	}
+	/* Rice coded differences to the prediction */
+	bool Residual(Bit32s *out, Bit32u blocksize, Bit32u order) {
+		Bit32u method = reader.Read(2);
+		if (method > 1) return false;
+		int parameter_bits = method ? 5 : 4;
+		Bit32u escape = method ? 31 : 15;
+		int partition_order = (int)reader.Read(4);
+		Bit32u partition_size = blocksize >> partition_order;
+		if ((partition_size << partition_order) != blocksize || partition_size < order) return false;
+		Bit32u i = order;
+		for (Bit32u partition = 0; partition < (1u << partition_order); partition++) {
+			Bit32u end = (partition + 1) * partition_size;
+			Bit32u parameter = reader.Read(parameter_bits);
+			if (parameter == escape) {
+				int bits = (int)reader.Read(5);
+				for (; i < end; i++) out[i] = ReadSigned(bits);
+			} else {
+				for (; i < end; i++) {
+					Bit32u value = (ReadUnary() << parameter) | ReadLong((int)parameter);
+					out[i] = (Bit32s)(value >> 1) ^ -(Bit32s)(value & 1);
+				}
+			}
+			if (reader.Overflow()) return false;
+		}
+		return true;
+	}
+
+	CHDBitReader reader;
+	std::vector<Bit32s> channel[2];
+};
+
+/* The sector data of all frames and their subcode are compressed apart, the
+   subcode always with deflate. The data of "cdzl" and "cdlz" hunks starts
+   with a bit per frame for the sectors whose sync header and parity were
+   left out, "cdfl" hunks only hold audio. */
+static bool CHD_DecodeCD(Bit32u codec, const Bit8u *src, Bit32u src_size, Bit8u *dest, Bit32u dest_size, std::vector<Bit8u> &scratch) {
+	Bit32u frames = dest_size / CHD_FRAME_SIZE;
+	scratch.resize(frames * CHD_FRAME_SIZE);
+	Bit8u *sectors = &scratch[0];
+	Bit8u *subcode = &scratch[frames * CHD_SECTOR_DATA];
+	Bit32u ecc_bytes = 0,subcode_start;
+	if (codec == CHD_CODEC_CD_FLAC) {
+		CHDFlacDecoder flac(src, src_size);
+		if (!flac.Decode(sectors, frames * CHD_SECTOR_DATA / 4)) return false;
+		subcode_start = (Bit32u)flac.Position();
+		if (subcode_start > src_size) return false;
+	} else {
+		ecc_bytes = (frames + 7) / 8;
+		Bit32u length_bytes = (dest_size < 65536) ? 2 : 3;
+		Bit32u header_bytes = ecc_bytes + length_bytes;
+		if (src_size < header_bytes) return false;
+		Bit32u base_size = CHD_Read16(&src[ecc_bytes]);
+		if (length_bytes > 2) base_size = (base_size << 8) | src[ecc_bytes + 2];
+		if (base_size > src_size - header_bytes) return false;
+		bool (*decode)(const Bit8u*,Bit32u,Bit8u*,Bit32u) = CHD_Inflate;
+#if (C_LZMA)
+		if (codec == CHD_CODEC_CD_LZMA) decode = CHD_DecodeLZMA;
+#endif
+		if (!decode(&src[header_bytes], base_size, sectors, frames * CHD_SECTOR_DATA)) return false;
+		subcode_start = header_bytes + base_size;
+	}
+	if (!CHD_Inflate(&src[subcode_start], src_size - subcode_start, subcode, frames * CHD_SUBCODE_DATA)) return false;
+
+	for (Bit32u frame = 0; frame < frames; frame++) {
+		Bit8u *out = &dest[frame * CHD_FRAME_SIZE];
+		memcpy(out, &sectors[frame * CHD_SECTOR_DATA], CHD_SECTOR_DATA);
+		memcpy(out + CHD_SECTOR_DATA, &subcode[frame * CHD_SUBCODE_DATA], CHD_SUBCODE_DATA);
+		if (frame < ecc_bytes * 8 && (src[frame / 8] & (1 << (frame % 8)))) CHD_RestoreSector(out);
+	}
+	return true;
+}
+#endif
+
+static bool CHD_CodecSupported(Bit32u codec) {
+	switch (codec) {
+#if (C_ZLIB)
+	case CHD_CODEC_ZLIB:
+	case CHD_CODEC_CD_ZLIB:
+	case CHD_CODEC_CD_FLAC:
+#if (C_LZMA)
+	case CHD_CODEC_LZMA:
+	case CHD_CODEC_CD_LZMA:
+#endif
+		return true;
+#endif
+	default:
+		return false;
+	}
+}
+
+static bool CHD_Decompress(Bit32u codec, const Bit8u *src, Bit32u src_size, Bit8u *dest, Bit32u dest_size, std::vector<Bit8u> &scratch) {
+#if (C_ZLIB)
+	if (codec == CHD_CODEC_ZLIB) return CHD_Inflate(src, src_size, dest, dest_size);
+#if (C_LZMA)
+	if (codec == CHD_CODEC_LZMA) return CHD_DecodeLZMA(src, src_size, dest, dest_size);
+#endif
+	if (CHD_CodecSupported(codec)) return CHD_DecodeCD(codec, src, src_size, dest, dest_size, scratch);
+#endif
+	return false;
+}
+
+CDROM_Interface_Image::CHDFile::CHDFile(const char *filename, bool &error) :
+	file(NULL), logicalBytes(0), mapOffset(0), metaOffset(0), hunkBytes(0), unitBytes(0), hunkCount(0),
+	length(0), cacheClock(0), lastMiss(0xfffffff0), mutex(NULL)
+{
+	error = true;
+	for (int i = 0; i < 4; i++) compressors[i] = 0;
+	file = fopen(filename, "rb");
+	if (file == NULL) return;
+
+	Bit8u header[124];
+	if (!ReadFile(0, header, sizeof(header)) || memcmp(header, "MComprHD", 8) != 0) return;
+	Bit32u version = CHD_Read32(&header[12]);
+	if (version != 5) {
+		LOG_MSG("CHD: %s is version %u, only version 5 is supported", filename, (unsigned int)version);
+		return;
+	}
+	for (int i = 0; i < 4; i++) compressors[i] = CHD_Read32(&header[16 + i * 4]);
+	logicalBytes = CHD_Read64(&header[32]);
+	mapOffset = CHD_Read64(&header[40]);
+	metaOffset = CHD_Read64(&header[48]);
+	hunkBytes = CHD_Read32(&header[56]);
+	unitBytes = CHD_Read32(&header[60]);
+	if (unitBytes != CHD_FRAME_SIZE || hunkBytes == 0 || (hunkBytes % unitBytes) != 0) {
+		LOG_MSG("CHD: %s is not a CD image", filename);
+		return;
+	}
+	hunkCount = (Bit32u)((logicalBytes + hunkBytes - 1) / hunkBytes);
+	if (!ReadMap() || !ReadMetadata()) {
+		LOG_MSG("CHD: Can't use %s", filename);
+		return;
+	}
+
+	cache.resize(CHD_CACHE_HUNKS);
+	for (size_t i = 0; i < cache.size(); i++) {
+		cache[i].number = 0xffffffff;
+		cache[i].lastUse = 0;
+	}
+	mutex = SDL_CreateMutex();
+	error = false;
+}
+
+CDROM_Interface_Image::CHDFile::~CHDFile()
+{
+	if (mutex) SDL_DestroyMutex(mutex);
+	if (file) fclose(file);
+}
+
+bool CDROM_Interface_Image::CHDFile::ReadFile(Bit64u offset, void *buffer, Bit32u size)
+{
+	if (size == 0) return true;
+	if (fseeko64(file, (off_t)offset, SEEK_SET) != 0) return false;
+	return fread(buffer, size, 1, file) == 1;
+}
+
+bool CDROM_Interface_Image::CHDFile::ReadMap(void)
+{
+	map.resize(hunkCount);
+
+	/* An uncompressed file only has the offsets, in hunks */
+	if (compressors[0] == 0) {
+		std::vector<Bit8u> raw(hunkCount * 4);
+		if (!raw.empty() && !ReadFile(mapOffset, &raw[0], (Bit32u)raw.size())) return false;
+		for (Bit32u hunk = 0; hunk < hunkCount; hunk++) {
+			Bit32u offset = CHD_Read32(&raw[hunk * 4]);
+			map[hunk].type = offset ? CHD_NONE : CHD_ZERO;
+			map[hunk].length = hunkBytes;
+			map[hunk].offset = (Bit64u)offset * hunkBytes;
+			map[hunk].crc = 0;
+		}
+		return true;
+	}
+
+	Bit8u header[16];
+	if (!ReadFile(mapOffset, header, sizeof(header))) return false;
+	Bit32u map_bytes = CHD_Read32(&header[0]);
+	Bit64u offset = CHD_Read48(&header[4]);
+	Bit16u map_crc = (Bit16u)CHD_Read16(&header[10]);
+	int length_bits = header[12];
+	int self_bits = header[13];
+	int parent_bits = header[14];
+	if (map_bytes == 0 || map_bytes > hunkCount * 16 + 1024) return false;
+	std::vector<Bit8u> packed(map_bytes);
+	if (!ReadFile(mapOffset + 16, &packed[0], map_bytes)) return false;
+
+	/* Types are Huffman coded with runs of the same type */
+	CHDBitReader reader(&packed[0], packed.size());
+	CHDMapHuffman huffman;
+	if (!huffman.Import(reader)) return false;
+	Bit8u last_type = 0;
+	int repeat = 0;
+	for (Bit32u hunk = 0; hunk < hunkCount; hunk++) {
+		if (repeat > 0) {
+			map[hunk].type = last_type;
+			repeat--;
+			continue;
+		}
+		Bit8u type = huffman.Decode(reader);
+		if (type == CHD_RLE_SMALL) {
+			map[hunk].type = last_type;
+			repeat = 2 + huffman.Decode(reader);
+		} else if (type == CHD_RLE_LARGE) {
+			map[hunk].type = last_type;
+			repeat = 2 + 16 + (huffman.Decode(reader) << 4);
+			repeat += huffman.Decode(reader);
+		} else map[hunk].type = last_type = type;
+	}
+
+	/* Then the length, offset and CRC each type needs */
+	Bit64u last_self = 0;
+	Bit16u crc = 0xffff;
+	for (Bit32u hunk = 0; hunk < hunkCount; hunk++) {
+		MapEntry &entry = map[hunk];
+		entry.offset = offset;
+		entry.length = 0;
+		entry.crc = 0;
+		switch (entry.type) {
+		case 0: case 1: case 2: case 3:
+			entry.length = reader.Read(length_bits);
+			offset += entry.length;
+			entry.crc = (Bit16u)reader.Read(16);
+			if (!CHD_CodecSupported(compressors[entry.type])) {
+				Bit32u codec = compressors[entry.type];
+				LOG_MSG("CHD: Codec %c%c%c%c is not supported by this build, convert the image with chdman createcd -c cdzl",
+					(char)(codec >> 24), (char)(codec >> 16), (char)(codec >> 8), (char)codec);
+				return false;
+			}
+			break;
+		case CHD_NONE:
+			entry.length = hunkBytes;
+			offset += hunkBytes;
+			entry.crc = (Bit16u)reader.Read(16);
+			break;
+		case CHD_SELF:
+			last_self = entry.offset = reader.Read(self_bits);
+			break;
+		case CHD_SELF_1:
+			last_self++;
+			/* fall through */
+		case CHD_SELF_0:
+			entry.type = CHD_SELF;
+			entry.offset = last_self;
+			break;
+		case CHD_PARENT:
+			reader.Read(parent_bits);
+			/* fall through */
+		case CHD_PARENT_SELF:
+		case CHD_PARENT_0:
+		case CHD_PARENT_1:
+			LOG_MSG("CHD: Images with a parent are not supported");
+			return false;
+		default:
+			return false;
+		}
+		if (entry.type == CHD_SELF && entry.offset >= hunk) return false;
+
+		Bit8u raw[12];
+		raw[0] = entry.type;
+		raw[1] = (Bit8u)(entry.length >> 16); raw[2] = (Bit8u)(entry.length >> 8); raw[3] = (Bit8u)entry.length;
+		for (int i = 0; i < 6; i++) raw[4 + i] = (Bit8u)(entry.offset >> (40 - i * 8));
+		raw[10] = (Bit8u)(entry.crc >> 8); raw[11] = (Bit8u)entry.crc;
+		crc = CHD_CRC16(crc, raw, sizeof(raw));
+	}
+	return !reader.Overflow() && crc == map_crc;
+}
+
+bool CDROM_Interface_Image::CHDFile::TrackBefore(const CHDTrack &a, const CHDTrack &b)
+{
+	return a.number < b.number;
+}
+
+bool CDROM_Interface_Image::CHDFile::ReadMetadata(void)
+{
+	Bit64u offset = metaOffset;
+	for (int entries = 0; offset != 0 && entries < 1000; entries++) {
+		Bit8u header[16];
+		if (!ReadFile(offset, header, sizeof(header))) return false;
+		Bit32u tag = CHD_Read32(&header[0]);
+		Bit32u size = CHD_Read24(&header[5]);
+		if (tag == CHD_META_TRACK || tag == CHD_META_TRACK2) {
+			std::vector<char> text(size + 1, 0);
+			if (!ReadFile(offset + 16, &text[0], size)) return false;
+			char type[32],subtype[32],pgtype[32];
+			CHDTrack track;
+			track.pregap = 0;
+			pgtype[0] = 0;
+			if (tag == CHD_META_TRACK2) {
+				if (sscanf(&text[0], "TRACK:%d TYPE:%31s SUBTYPE:%31s FRAMES:%d PREGAP:%d PGTYPE:%31s",
+					&track.number, type, subtype, &track.frames, &track.pregap, pgtype) < 4) return false;
+			} else if (sscanf(&text[0], "TRACK:%d TYPE:%31s SUBTYPE:%31s FRAMES:%d",
+				&track.number, type, subtype, &track.frames) != 4) return false;
+			track.pregapInFile = pgtype[0] == 'V';
+
+			std::string kind(type);
+			track.mode2 = false;
+			track.audio = false;
+			if (kind == "MODE1" || kind == "MODE2_FORM1") track.sectorSize = COOKED_SECTOR_SIZE;
+			else if (kind == "MODE1_RAW") track.sectorSize = RAW_SECTOR_SIZE;
+			else if (kind == "MODE2" || kind == "MODE2_FORM_MIX") {
+				track.sectorSize = 2336;
+				track.mode2 = true;
+			} else if (kind == "MODE2_FORM2") track.sectorSize = 2324;
+			else if (kind == "MODE2_RAW") {
+				track.sectorSize = RAW_SECTOR_SIZE;
+				track.mode2 = true;
+			} else if (kind == "AUDIO") {
+				track.sectorSize = RAW_SECTOR_SIZE;
+				track.audio = true;
+			} else {
+				LOG_MSG("CHD: Track type %s is not supported", type);
+				return false;
+			}
+			if (track.frames <= 0 || track.pregap < 0 || (track.pregapInFile && track.pregap > track.frames)) return false;
+			chdTracks.push_back(track);
+		}
+		offset = CHD_Read64(&header[8]);
+	}
+	if (chdTracks.empty()) return false;
+	std::sort(chdTracks.begin(), chdTracks.end(), TrackBefore);
+
+	/* Every track starts on a multiple of 4 frames */
+	Bit64u stream = 0;
+	Bit64u frame = 0;
+	for (size_t i = 0; i < chdTracks.size(); i++) {
+		CHDTrack &track = chdTracks[i];
+		if (track.number != (int)i + 1) return false;
+		track.offset = (int)stream;
+		track.firstFrame = (Bit32u)frame;
+		stream += (Bit64u)track.frames * track.sectorSize;
+		frame += (track.frames + CHD_TRACK_PADDING - 1) & ~(CHD_TRACK_PADDING - 1);
+	}
+	if (stream > 0x7fffffff || frame * unitBytes > (Bit64u)hunkCount * hunkBytes) return false;
+	length = (int)stream;
+	return true;
+}
+
+bool CDROM_Interface_Image::CHDFile::DecodeHunk(Bit32u hunk, const Bit8u *src, Bit8u *dest, int depth)
+{
+	const MapEntry &entry = map[hunk];
+	switch (entry.type) {
+	case CHD_ZERO:
+		memset(dest, 0, hunkBytes);
+		return true;
+	case CHD_SELF: {
+		/* Same data as an earlier hunk */
+		Bit32u other = (Bit32u)entry.offset;
+		if (depth > 4) return false;
+		for (size_t i = 0; i < cache.size(); i++) {
+			if (cache[i].number == other) {
+				memcpy(dest, &cache[i].data[0], hunkBytes);
+				return true;
+			}
+		}
+		return DecodeHunk(other, NULL, dest, depth + 1);
+	}
+	case 0: case 1: case 2: case 3: case CHD_NONE:
+		break;
+	default:
+		return false;
+	}
+
+	std::vector<Bit8u> own;
+	if (src == NULL) {
+		own.resize(entry.length);
+		if (own.empty() || !ReadFile(entry.offset, &own[0], entry.length)) return false;
+		src = &own[0];
+	}
+	Bit32u codec = (entry.type == CHD_NONE) ? CHD_TAG('n','o','n','e') : compressors[entry.type];
+	if (entry.type == CHD_NONE) {
+		memcpy(dest, src, hunkBytes);
+	} else if (!CHD_Decompress(codec, src, entry.length, dest, hunkBytes, scratch)) {
+		LOG_MSG("CHD: Hunk %u is damaged, codec %c%c%c%c could not decompress it",
+			(unsigned int)hunk, (char)(codec >> 24), (char)(codec >> 16), (char)(codec >> 8), (char)codec);
+		return false;
+	}
+	if (compressors[0] != 0 && CHD_CRC16(0xffff, dest, hunkBytes) != entry.crc) {
+		LOG_MSG("CHD: CRC error in hunk %u, codec %c%c%c%c",
+			(unsigned int)hunk, (char)(codec >> 24), (char)(codec >> 16), (char)(codec >> 8), (char)codec);
+		return false;
+	}
+	return true;
+}
+
+Bit8u *CDROM_Interface_Image::CHDFile::GetHunk(Bit32u hunk)
+{
+	if (hunk >= hunkCount) return NULL;
+	for (size_t i = 0; i < cache.size(); i++) {
+		if (cache[i].number == hunk) {
+			cache[i].lastUse = ++cacheClock;
+			return &cache[i].data[0];
+		}
+	}
+
+	/* Misses in order take the following hunks along if they are stored right behind */
+	Bit32u count = 1;
+	const MapEntry &first = map[hunk];
+	if (first.type <= CHD_NONE) {
+		Bit64u end = first.offset + first.length;
+		if (hunk == lastMiss + 1) {
+			while (count < CHD_READAHEAD && hunk + count < hunkCount) {
+				const MapEntry &next = map[hunk + count];
+				if (next.type > CHD_NONE || next.offset != end) break;
+				bool cached = false;
+				for (size_t i = 0; i < cache.size(); i++)
+					if (cache[i].number == hunk + count) cached = true;
+				if (cached) break;
+				end += next.length;
+				count++;
+			}
+		}
+		compressed.resize((size_t)(end - first.offset));
+		if (compressed.empty() || !ReadFile(first.offset, &compressed[0], (Bit32u)compressed.size())) return NULL;
+	}
+	lastMiss = hunk + count - 1;
+
+	Bit8u *result = NULL;
+	size_t position = 0;
+	for (Bit32u i = 0; i < count; i++) {
+		CachedHunk *victim = &cache[0];
+		for (size_t j = 1; j < cache.size(); j++)
+			if (cache[j].lastUse < victim->lastUse) victim = &cache[j];
+		victim->number = 0xffffffff;
+		victim->lastUse = ++cacheClock;
+		victim->data.resize(hunkBytes);
+		const MapEntry &entry = map[hunk + i];
+		if (!DecodeHunk(hunk + i, (entry.type <= CHD_NONE) ? &compressed[position] : NULL, &victim->data[0], 0)) break;
+		victim->number = hunk + i;
+		if (i == 0) result = &victim->data[0];
+		position += entry.length;
+	}
+	return result;
+}
+
+bool CDROM_Interface_Image::CHDFile::read(Bit8u *buffer, int seek, int count)
+{
+	if (seek < 0 || count < 0 || seek > length - count) return false;
+	SDL_mutexP(mutex);
+	bool success = true;
+	while (count > 0) {
+		size_t t = chdTracks.size();
+		while (t > 0 && chdTracks[t - 1].offset > seek) t--;
+		if (t == 0) {
+			success = false;
+			break;
+		}
+		const CHDTrack &track = chdTracks[t - 1];
+		int position = seek - track.offset;
+		int frame = position / track.sectorSize;
+		int within = position % track.sectorSize;
+		int chunk = track.sectorSize - within;
+		if (chunk > count) chunk = count;
+
+		Bit64u byte = (Bit64u)(track.firstFrame + frame) * unitBytes;
+		Bit8u *data = GetHunk((Bit32u)(byte / hunkBytes));
+		if (data == NULL) {
+			success = false;
+			break;
+		}
+		data += byte % hunkBytes;
+		if (track.audio) {
+			/* Audio samples are stored big endian */
+			for (int i = 0; i < chunk; i++) buffer[i] = data[(within + i) ^ 1];
+		} else memcpy(buffer, data + within, chunk);
+		buffer += chunk;
+		seek += chunk;
+		count -= chunk;
+	}
+	SDL_mutexV(mutex);
+	return success;
+}
+
+int CDROM_Interface_Image::CHDFile::getLength()
+{
+	return length;
+}
@@ -30,6 +30,7 @@
 #include "support.h"
 #include "control.h"
 #include "setup.h"
+#include "lockfree_ring.h"
 
 #if !defined(WIN32)
 #include <libgen.h>
@@ -46,33 +47,56 @@ CDROM_Interface_Image::BinaryFile::BinaryFile(const char *filename, bool &error)
 {
 	file = new ifstream(filename, ios::in | ios::binary);
 	error = (file == NULL) || (file->fail());
+	mutex = SDL_CreateMutex();
 }
 
 CDROM_Interface_Image::BinaryFile::~BinaryFile()
 {
 	delete file;
+	SDL_DestroyMutex(mutex);
 }
 
 bool CDROM_Interface_Image::BinaryFile::read(Bit8u *buffer, int seek, int count)
 {
+	SDL_mutexP(mutex);
+	file->clear();
 	file->seekg(seek, ios::beg);
 	file->read((char*)buffer, count);
-	return !(file->fail());
+	bool success = !(file->fail());
+	SDL_mutexV(mutex);
+	return success;
 }
 
 int CDROM_Interface_Image::BinaryFile::getLength()
 {
+	SDL_mutexP(mutex);
+	file->clear();
 	file->seekg(0, ios::end);
 	int length = (int)file->tellg();
-	if (file->fail()) return -1;
+	if (file->fail()) length = -1;
+	SDL_mutexV(mutex);
 	return length;
 }
 
+/* The audio thread reads the sectors to play into this ring, the mixer
+   callback only copies them out. 32 sectors are about 400ms of audio. */
+struct CDAudioSector {
+	Bit32u generation;			// player.generation when it was read
+	bool end;					// Nothing more to play
+	Bit8u data[RAW_SECTOR_SIZE];
+};
+
+static LockFreeRing<CDAudioSector,32> cdaudio_ring;
+static RingSignal cdaudio_work;				// Audio thread waits for room or something to play
+static RingSignal cdaudio_progress;			// Mixer callback waits for a sector
+static SDL_Thread *cdaudio_thread = NULL;
+static std::atomic<bool> cdaudio_stop(false);
+
 // initialize static members
 int CDROM_Interface_Image::refCount = 0;
 CDROM_Interface_Image* CDROM_Interface_Image::images[26] = {NULL};
 CDROM_Interface_Image::imagePlayer CDROM_Interface_Image::player = {
-	NULL, NULL, NULL, {0}, 0, 0, 0, false, false, false, {0} };
+	NULL, NULL, NULL, {0}, 0, 0, 0, 0, true, 0, false, false, false, {0} };
 
 	
 CDROM_Interface_Image::CDROM_Interface_Image(Bit8u subUnit)
@@ -80,9 +104,15 @@ CDROM_Interface_Image::CDROM_Interface_Image(Bit8u subUnit)
 	images[subUnit] = this;
 	if (refCount == 0) {
 		player.mutex = SDL_CreateMutex();
+		player.readEnded = true;
 		if (player.channel == NULL)
 			player.channel = MIXER_AddChannel(&CDAudioCallBack, 44100, "CDAUDIO");
 		player.channel->Enable(true);
+		cdaudio_ring.Reset();
+		cdaudio_work.Open();
+		cdaudio_progress.Open();
+		cdaudio_stop.store(false);
+		cdaudio_thread = SDL_CreateThread(CDAudioThread, NULL);
 	}
 	refCount++;
 }
@@ -90,9 +120,24 @@ CDROM_Interface_Image::CDROM_Interface_Image(Bit8u subUnit)
 CDROM_Interface_Image::~CDROM_Interface_Image()
 {
 	refCount--;
-	if (player.cd == this) player.cd = NULL;
+	SDL_mutexP(player.mutex);
+	if (player.cd == this) {
+		player.cd = NULL;
+		player.isPlaying = false;
+		player.readEnded = true;
+		player.generation++;
+	}
+	SDL_mutexV(player.mutex);
 	ClearTracks();
 	if (refCount == 0) {
+		if (cdaudio_thread) {
+			cdaudio_stop.store(true);
+			cdaudio_work.Notify();
+			SDL_WaitThread(cdaudio_thread, NULL);
+			cdaudio_thread = NULL;
+		}
+		cdaudio_work.Close();
+		cdaudio_progress.Close();
 		SDL_DestroyMutex(player.mutex);
 		if (player.channel) {
 			player.channel->Enable(false);
@@ -108,6 +153,7 @@ void CDROM_Interface_Image::InitNewMedia()
 
 bool CDROM_Interface_Image::SetDevice(char* path, int forceCD)
 {
+	if (LoadChdFile(path)) return true;
 	if (LoadCueSheet(path)) return true;
 	if (LoadIsoFile(path)) return true;
 	
@@ -179,6 +225,10 @@ bool CDROM_Interface_Image::PlayAudioSector(unsigned long start,unsigned long le
 	player.cd = this;
 	player.currFrame = start;
 	player.targetFrame = start + len;
+	// whatever the audio thread read ahead is for the old position
+	player.readFrame = start;
+	player.generation++;
+	player.bufLen = 0;
 	int track = GetTrack(start) - 1;
 	if(track >= 0 && tracks[track].attr == 0x40) {
 		LOG(LOG_MISC,LOG_WARN)("Game tries to play the data track. Not doing this");
@@ -188,20 +238,28 @@ bool CDROM_Interface_Image::PlayAudioSector(unsigned long start,unsigned long le
 		//Real drives either fail or succeed as well
 	} else player.isPlaying = true;
 	player.isPaused = false;
+	player.readEnded = !player.isPlaying;
 	SDL_mutexV(player.mutex);
+	cdaudio_work.Notify();
 	return true;
 }
 
 bool CDROM_Interface_Image::PauseAudio(bool resume)
 {
+	// the position does not change, so the ring stays filled for the resume
 	player.isPaused = !resume;
 	return true;
 }
 
 bool CDROM_Interface_Image::StopAudio(void)
 {
+	SDL_mutexP(player.mutex);
 	player.isPlaying = false;
 	player.isPaused = false;
+	player.readEnded = true;
+	player.generation++;
+	player.bufLen = 0;
+	SDL_mutexV(player.mutex);
 	return true;
 }
 
@@ -217,11 +275,7 @@ bool CDROM_Interface_Image::ReadSectors(PhysPt buffer, bool raw, unsigned long s
 	Bitu buflen = num * sectorSize;
 	Bit8u* buf = new Bit8u[buflen];
 	
-	bool success = true; //Gobliiins reads 0 sectors
-	for(unsigned long i = 0; i < num; i++) {
-		success = ReadSector(&buf[i * sectorSize], raw, sector + i);
-		if (!success) break;
-	}
+	bool success = ReadSectorsHost(buf, raw, sector, num);
 
 	MEM_BlockWrite(buffer, buf, buflen);
 	delete[] buf;
@@ -233,6 +287,15 @@ bool CDROM_Interface_Image::ReadSectorsHost(void *buffer, bool raw, unsigned lon
 {
 	int sectorSize = raw ? RAW_SECTOR_SIZE : COOKED_SECTOR_SIZE;
 	bool success = true; //Gobliiins reads 0 sectors
+
+	// cooked sectors stored back to back in one track are read in one go
+	int track = GetTrack(sector) - 1;
+	if (num > 1 && track >= 0 && tracks[track].sectorSize == sectorSize && (raw || !tracks[track].mode2) &&
+		sector + num <= (unsigned long)(tracks[track].start + tracks[track].length)) {
+		int seek = tracks[track].skip + (sector - tracks[track].start) * sectorSize;
+		return tracks[track].file->read((Bit8u*)buffer, seek, num * sectorSize);
+	}
+
 	for(unsigned long i = 0; i < num; i++) {
 		success = ReadSector((Bit8u*)buffer + (i * sectorSize), raw, sector + i);
 		if (!success) break;
@@ -301,14 +364,23 @@ void CDROM_Interface_Image::CDAudioCallBack(Bitu len)
 		return;
 	}
 	
-	SDL_mutexP(player.mutex);
+	// the audio thread is waited for only when it fell behind
 	while (player.bufLen < (Bits)len) {
-		bool success;
-		if (player.targetFrame > player.currFrame)
-			success = player.cd->ReadSector(&player.buffer[player.bufLen], true, player.currFrame);
-		else success = false;
+		CDAudioSector *sector = cdaudio_ring.ReadSlot();
+		if (sector == NULL) {
+			cdaudio_progress.Prepare();
+			if (cdaudio_ring.ReadSlot()) cdaudio_progress.Cancel();
+			else cdaudio_progress.Wait();
+			continue;
+		}
+		if (sector->generation != player.generation) {
+			cdaudio_ring.Pop();
+			cdaudio_work.Notify();
+			continue;
+		}
 		
-		if (success) {
+		if (!sector->end) {
+			memcpy(&player.buffer[player.bufLen], sector->data, RAW_SECTOR_SIZE);
 			player.currFrame++;
 			player.bufLen += RAW_SECTOR_SIZE;
 		} else {
@@ -316,8 +388,9 @@ void CDROM_Interface_Image::CDAudioCallBack(Bitu len)
 			player.bufLen = len;
 			player.isPlaying = false;
 		}
+		cdaudio_ring.Pop();
+		cdaudio_work.Notify();
 	}
-	SDL_mutexV(player.mutex);
 	if (player.ctrlUsed) {
 		Bit16s sample0,sample1;
 		Bit16s * samples=(Bit16s *)&player.buffer;
@@ -343,6 +416,43 @@ void CDROM_Interface_Image::CDAudioCallBack(Bitu len)
 	player.bufLen -= len;
 }
 
+bool CDROM_Interface_Image::CDAudioThreadReady(void)
+{
+	SDL_mutexP(player.mutex);
+	bool ready = player.cd != NULL && !player.readEnded;
+	SDL_mutexV(player.mutex);
+	return ready && cdaudio_ring.WriteSlot() != NULL;
+}
+
+int CDROM_Interface_Image::CDAudioThread(void* /*data*/)
+{
+	while (!cdaudio_stop.load()) {
+		if (!CDAudioThreadReady()) {
+			cdaudio_work.Prepare();
+			if (CDAudioThreadReady() || cdaudio_stop.load()) cdaudio_work.Cancel();
+			else cdaudio_work.Wait();
+			continue;
+		}
+		// the sector is read with the player locked, so it can't change under the read
+		CDAudioSector *sector = cdaudio_ring.WriteSlot();
+		SDL_mutexP(player.mutex);
+		if (player.cd == NULL || player.readEnded) {
+			SDL_mutexV(player.mutex);
+			continue;
+		}
+		sector->generation = player.generation;
+		bool success = player.readFrame < player.targetFrame &&
+			player.cd->ReadSector(sector->data, true, player.readFrame);
+		sector->end = !success;
+		if (success) player.readFrame++;
+		else player.readEnded = true;
+		SDL_mutexV(player.mutex);
+		cdaudio_ring.Push();
+		cdaudio_progress.Notify();
+	}
+	return 0;
+}
+
 bool CDROM_Interface_Image::LoadIsoFile(char* filename)
 {
 	tracks.clear();
@@ -387,6 +497,55 @@ bool CDROM_Interface_Image::LoadIsoFile(char* filename)
 	return true;
 }
 
+bool CDROM_Interface_Image::LoadChdFile(char* filename)
+{
+	tracks.clear();
+
+	char magic[8];
+	FILE *f = fopen(filename, "rb");
+	if (f == NULL) return false;
+	bool chd = fread(magic, sizeof(magic), 1, f) == 1 && !memcmp(magic, "MComprHD", 8);
+	fclose(f);
+	if (!chd) return false;
+
+	bool error;
+	CHDFile *file = new CHDFile(filename, error);
+	if (error) {
+		delete file;
+		return false;
+	}
+
+	// all tracks read from the one file, a pregap that is not stored moves the track on
+	Track track = {0, 0, 0, 0, 0, 0, false, NULL};
+	int lba = 0;
+	for (size_t i = 0; i < file->chdTracks.size(); i++) {
+		const CHDFile::CHDTrack &chdTrack = file->chdTracks[i];
+		int inFile = chdTrack.pregapInFile ? chdTrack.pregap : 0;
+		if (i > 0 && !chdTrack.pregapInFile) lba += chdTrack.pregap;
+		track.number = chdTrack.number;
+		track.attr = chdTrack.audio ? 0 : 0x40;
+		track.start = lba + inFile;
+		track.length = chdTrack.frames - inFile;
+		track.skip = chdTrack.offset + inFile * chdTrack.sectorSize;
+		track.sectorSize = chdTrack.sectorSize;
+		track.mode2 = chdTrack.mode2;
+		track.file = file;
+		tracks.push_back(track);
+		lba = track.start + track.length;
+	}
+
+	// leadout track
+	track.number = (int)tracks.size() + 1;
+	track.attr = 0;
+	track.start = lba;
+	track.length = 0;
+	track.skip = 0;
+	track.file = NULL;
+	tracks.push_back(track);
+
+	return true;
+}
+
 bool CDROM_Interface_Image::CanReadPVD(TrackFile *file, int sectorSize, bool mode2)
 {
 	Bit8u pvd[COOKED_SECTOR_SIZE];
@@ -27,6 +27,7 @@
 #include "callback.h"
 #include "regs.h"
 #include "dos_inc.h"
+#include "drives.h"
 #include "setup.h"
 #include "support.h"
 #include "parport.h"
@@ -577,7 +578,8 @@ static Bitu DOS_21Handler(void) {
 //TODO Find out the values for when reg_al!=0
 //TODO Hope this doesn't do anything special
 	case 0x0d:		/* Disk Reset */
-//Sure let's reset a virtual disk
+		/* Write back the FATs of mounted images */
+		fatDrive::flushAll();
 		break;	
 	case 0x0e:		/* Select Default Drive */
 		DOS_SetDefaultDrive(reg_dl);
@@ -2168,6 +2170,13 @@ void DOS_OnReset(Section* /*sec*/) {
     DOS_GetMemory_reinit();
 }
 
+/* Pending FAT writes go out before a reset or a guest OS takes over the disks.
+   The delayed flush may not survive a reset, and would clobber what the guest
+   OS writes after booting */
+void DOS_FlushFAT(Section* /*sec*/) {
+	fatDrive::flushAll();
+}
+
 void DOS_Startup(Section* sec) {
 	if (test == NULL) {
         DOS_GetMemory_reinit();
@@ -2180,7 +2189,10 @@ void DOS_Init() {
 	LOG(LOG_MISC,LOG_DEBUG)("Initializing DOS kernel (DOS_Init)");
 
 	AddExitFunction(AddExitFunctionFuncPair(DOS_ShutDown),false);
+	AddVMEventFunction(VM_EVENT_RESET,AddVMEventFunctionFuncPair(DOS_FlushFAT));
 	AddVMEventFunction(VM_EVENT_RESET,AddVMEventFunctionFuncPair(DOS_OnReset));
+	AddVMEventFunction(VM_EVENT_DOS_EXIT_BEGIN,AddVMEventFunctionFuncPair(DOS_FlushFAT));
+	AddVMEventFunction(VM_EVENT_DOS_EXIT_REBOOT_BEGIN,AddVMEventFunctionFuncPair(DOS_FlushFAT));
 	AddVMEventFunction(VM_EVENT_DOS_EXIT_KERNEL,AddVMEventFunctionFuncPair(DOS_ShutDown));
 	AddVMEventFunction(VM_EVENT_DOS_EXIT_REBOOT_KERNEL,AddVMEventFunctionFuncPair(DOS_ShutDown));
 	AddVMEventFunction(VM_EVENT_DOS_SURPRISE_REBOOT,AddVMEventFunctionFuncPair(DOS_OnReset));
@@ -476,6 +476,7 @@ bool DOS_FlushFile(Bit16u entry) {
 		return false;
 	};
 	LOG(LOG_DOSMISC,LOG_NORMAL)("FFlush used.");
+	Files[handle]->Flush();
 	return true;
 }
 
@@ -21,6 +21,7 @@
 #include "callback.h"
 #include "mem.h"
 #include "regs.h"
+#include "cpu.h"
 #include "dos_inc.h"
 #include <list>
 
@@ -288,7 +289,10 @@ static bool DOS_MultiplexFunctions(void) {
 		}
 		else return false;
 	case 0x1680:	/*  RELEASE CURRENT VIRTUAL MACHINE TIME-SLICE */
-		//TODO Maybe do some idling but could screw up other systems :)
+		if (CPU_IdleSkip) {
+			CPU_Idle();
+			reg_al=0x00;	/* call supported */
+		}
 		return true; //So no warning in the debugger anymore
 	case 0x1689:	/*  Kernel IDLE CALL */
 	case 0x168f:	/*  Close awareness crap */
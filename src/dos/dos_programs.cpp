@@ -39,6 +39,7 @@
 #include "dma.h"
 #include "bios_disk.h"
 #include "qcow2_disk.h"
+#include "cow_disk.h"
 #include "setup.h"
 #include "control.h"
 #include <time.h>
@@ -714,6 +715,9 @@ public:
 			return;
 		}
 
+		/* The guest OS reads the disk directly from here on */
+		fatDrive::flushAll();
+
 		bootSector bootarea;
 		imageDiskList[drive-65]->Read_Sector(0,0,1,(Bit8u *)&bootarea);
 
@@ -1967,6 +1971,16 @@ public:
 	virtual Bit8u Write_AbsoluteSector(Bit32u sectnum, void * data) {
 		return 0x05; /* fail, read only */
 	}
+	virtual Bit8u Read_Sectors(Bit32u sectnum, Bit32u count, void * data) {
+		for (Bit32u i=0;i < count;i++) {
+			if (Read_AbsoluteSector(sectnum+i,(unsigned char*)data+(i*512)) != 0x00)
+				return 0x05;
+		}
+		return 0x00;
+	}
+	virtual Bit8u Write_Sectors(Bit32u sectnum, Bit32u count, void * data) {
+		return 0x05; /* fail, read only */
+	}
 	imageDiskElToritoFloppy(unsigned char new_CDROM_drive,unsigned long new_cdrom_sector_offset,unsigned char floppy_emu_type) : imageDisk(NULL,NULL,0,false) {
 		diskimg = NULL;
 		sector_size = 512;
@@ -2264,6 +2278,7 @@ public:
 			int reserved_cylinders=0;
 			std::string reservecyl;
 			std::string str_size;
+			std::string cowfile;
 			mediaid=0xF8;
 
 			/* DOSBox-X: to please certain 32-bit drivers like Windows 3.1 WDCTRL, or to emulate older h/w configurations,
@@ -2276,6 +2291,9 @@ public:
 			/* DOSBox-X: we allow "-ide" to allow controlling which IDE controller and slot to attach the hard disk/CD-ROM to */
 			cmd->FindString("-ide",ideattach,true);
 
+			/* DOSBox-X: "-cow" leaves the image alone and keeps all writes in a delta file */
+			cmd->FindString("-cow",cowfile,true);
+
 			if (ideattach == "auto") {
 				if (type == "floppy") {
 				}
@@ -2402,6 +2420,11 @@ public:
 					temp_line = paths[0];
 			}
 
+			if (!cowfile.empty() && (fstype == "iso" || el_torito != "" || paths.size() != 1)) {
+				WriteOut(MSG_Get("PROGRAM_IMGMOUNT_COW_SINGLE"));
+				return;
+			}
+
 			if(fstype=="fat") {
 				if (el_torito != "") {
 					WriteOut("El Torito bootable CD: -fs fat mounting not supported\n"); /* <- NTS: Someday!! */
@@ -2410,7 +2433,7 @@ public:
 
 				if (imgsizedetect) {
 					bool yet_detected = false;
-					FILE * diskfile = fopen64(temp_line.c_str(), "rb+");
+					FILE * diskfile = fopen64(temp_line.c_str(), cowfile.empty() ? "rb+" : "rb");
 					if(!diskfile) {
 						WriteOut(MSG_Get("PROGRAM_IMGMOUNT_INVALID_IMAGE"));
 						return;
@@ -2534,7 +2557,8 @@ public:
 				std::vector<DOS_Drive*>::size_type ct;
 				
 				for (i = 0; i < paths.size(); i++) {
-					DOS_Drive* newDrive = new fatDrive(paths[i].c_str(),sizes[0],sizes[1],sizes[2],sizes[3],0);
+					DOS_Drive* newDrive = new fatDrive(paths[i].c_str(),sizes[0],sizes[1],sizes[2],sizes[3],0,
+						cowfile.empty() ? NULL : cowfile.c_str());
 					imgDisks.push_back(newDrive);
 					if(!(dynamic_cast<fatDrive*>(newDrive))->created_successfully) {
 						WriteOut(MSG_Get("PROGRAM_IMGMOUNT_CANT_CREATE"));
@@ -2665,12 +2689,25 @@ public:
 				/* auto-fill: sector size */
 				if (sizes[0] == 0) sizes[0] = 512;
 
-				FILE *newDisk = fopen64(temp_line.c_str(), "rb+");
+				FILE *newDisk = fopen64(temp_line.c_str(), cowfile.empty() ? "rb+" : "rb");
 
 				QCow2Image::QCow2Header qcow2_header = QCow2Image::read_header(newDisk);
 				
 				Bit64u sectors;
-				if (qcow2_header.magic == QCow2Image::magic && (qcow2_header.version == 2 || qcow2_header.version == 3)){
+				if (!cowfile.empty()) {
+					fseeko64(newDisk,0L, SEEK_END);
+					sectors = (Bit64u)ftello64(newDisk) / (Bit64u)sizes[0];
+					imagesize = (Bit32u)(sectors / 2); /* orig. code wants it in KBs */
+					setbuf(newDisk,NULL);
+					imageDiskCOW *cowDisk = new imageDiskCOW(newDisk, cowfile.c_str(), (Bit8u *)temp_line.c_str(), imagesize, (imagesize > 2880));
+					if (!cowDisk->created_successfully) {
+						delete cowDisk;
+						WriteOut(MSG_Get("PROGRAM_IMGMOUNT_CANT_CREATE"));
+						return;
+					}
+					newImage = cowDisk;
+				}
+				else if (qcow2_header.magic == QCow2Image::magic && (qcow2_header.version == 2 || qcow2_header.version == 3)){
 					Bit32u cluster_size = 1 << qcow2_header.cluster_bits;
 					if ((sizes[0] < 512) || ((cluster_size % sizes[0]) != 0)){
 						WriteOut("Sector size must be larger than 512 bytes and evenly divide the image cluster size of %lu bytes.\n", cluster_size);
@@ -3194,6 +3231,7 @@ void DOS_SetupPrograms(void) {
 	MSG_Add("PROGRAM_IMGMOUNT_MOUNT","To mount directories, use the \033[34;1mMOUNT\033[0m command, not the \033[34;1mIMGMOUNT\033[0m command.\n");
 	MSG_Add("PROGRAM_IMGMOUNT_ALREADY_MOUNTED","Drive already mounted at that letter.\n");
 	MSG_Add("PROGRAM_IMGMOUNT_CANT_CREATE","Can't create drive from file.\n");
+	MSG_Add("PROGRAM_IMGMOUNT_COW_SINGLE","A delta file (-cow) can only be used with a single floppy or hard disk image.\n");
 	MSG_Add("PROGRAM_IMGMOUNT_MOUNT_NUMBER","Drive number %d mounted as %s\n");
 	MSG_Add("PROGRAM_IMGMOUNT_NON_LOCAL_DRIVE", "The image must be on a host or local drive.\n");
 	MSG_Add("PROGRAM_IMGMOUNT_MULTIPLE_NON_CUEISO_FILES", "Using multiple files is only supported for cue/iso images.\n");
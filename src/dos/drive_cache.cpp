@@ -26,6 +26,17 @@
 #include <vector>
 #include <iterator>
 #include <algorithm>
+#include <string>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#if defined (LINUX)
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <fcntl.h>
+#endif
 
 #if defined (WIN32)   /* Win 32 */
 #define WIN32_LEAN_AND_MEAN        // Exclude rarely-used stuff from 
@@ -40,6 +51,153 @@
 
 int fileInfoCounter = 0;
 
+/* Directory index
+
+   Reading a host directory with many entries and making up the 8.3 names
+   for it is slow, so the result is kept in an index file from one session
+   to the next. A directory is taken from the index when its modification
+   time is still the same as when it was read. Sizes and times of the files
+   are not kept, a file can change without the directory changing.
+
+   Index file layout, little endian:
+     "DBXDIRX1"
+   then per directory
+     Bit32u path length, path
+     Bit64u modification time, seconds
+     Bit32u modification time, nanoseconds
+     Bit32u number of entries
+   followed by the entries
+     Bit16u name length, name
+     Bit8u  short name length, short name
+     Bit32u short name number
+     Bit8u  1 for a directory */
+
+#define DIRINDEX_MAGIC			"DBXDIRX2"
+#define DIRINDEX_MIN_ENTRIES	64
+
+std::string dirindex_file;
+bool dirindex_watch = true;
+
+struct DirIndexEntry {
+	std::string	orgname;
+	std::string	shortname;
+	Bit32u		shortNr;
+	bool		isDir;
+};
+
+struct DirIndexDir {
+	Bit64u		mtime;
+	Bit32u		mtime_ns;
+	std::vector<DirIndexEntry>	entries;
+};
+
+static struct {
+	bool		loaded;
+	bool		dirty;
+	std::map<std::string,DirIndexDir>	dirs;
+} dirindex = { false, false };
+
+static bool DirIndex_Stamp(const char* path, Bit64u& mtime, Bit32u& mtime_ns) {
+	struct stat st;
+	if (stat(path,&st)!=0 || !S_ISDIR(st.st_mode)) return false;
+	mtime = (Bit64u)st.st_mtime;
+#if defined (LINUX)
+	mtime_ns = (Bit32u)st.st_mtim.tv_nsec;
+#else
+	mtime_ns = 0;
+#endif
+	return true;
+}
+
+static Bit32u DirIndex_Get(const std::vector<Bit8u>& buf, size_t& pos, int len) {
+	Bit32u v = 0;
+	for (int i=0; i<len; i++) v |= (Bit32u)buf[pos+i] << (i*8);
+	pos += len;
+	return v;
+}
+
+static void DirIndex_Put(std::vector<Bit8u>& buf, Bit64u v, int len) {
+	for (int i=0; i<len; i++) buf.push_back((Bit8u)(v >> (i*8)));
+}
+
+static void DirIndex_Load(void) {
+	dirindex.loaded = true;
+	FILE* f = fopen(dirindex_file.c_str(),"rb");
+	if (!f) return;
+	std::vector<Bit8u> buf;
+	Bit8u block[65536];
+	size_t got;
+	while ((got = fread(block,1,sizeof(block),f))>0) buf.insert(buf.end(),block,block+got);
+	fclose(f);
+
+	if (buf.size()<8 || memcmp(&buf[0],DIRINDEX_MAGIC,8)!=0) {
+		LOG_MSG("DIRCACHE: %s is not a directory index",dirindex_file.c_str());
+		return;
+	}
+	size_t pos = 8;
+	while (pos<buf.size()) {
+		if (buf.size()-pos<4) goto bad;
+		Bit32u len = DirIndex_Get(buf,pos,4);
+		if (len>=CROSS_LEN || buf.size()-pos<len+16) goto bad;
+		std::string path((const char*)&buf[pos],len); pos += len;
+		DirIndexDir& dir = dirindex.dirs[path];
+		dir.mtime = DirIndex_Get(buf,pos,4);
+		dir.mtime |= (Bit64u)DirIndex_Get(buf,pos,4) << 32;
+		dir.mtime_ns = DirIndex_Get(buf,pos,4);
+		Bit32u count = DirIndex_Get(buf,pos,4);
+		dir.entries.resize(count);
+		for (Bit32u i=0; i<count; i++) {
+			DirIndexEntry& entry = dir.entries[i];
+			if (buf.size()-pos<2) goto bad;
+			len = DirIndex_Get(buf,pos,2);
+			if (len==0 || len>=CROSS_LEN || buf.size()-pos<len+1) goto bad;
+			entry.orgname.assign((const char*)&buf[pos],len); pos += len;
+			len = DirIndex_Get(buf,pos,1);
+			if (len==0 || len>DOS_NAMELENGTH || buf.size()-pos<len+5) goto bad;
+			entry.shortname.assign((const char*)&buf[pos],len); pos += len;
+			entry.shortNr = DirIndex_Get(buf,pos,4);
+			entry.isDir = DirIndex_Get(buf,pos,1)!=0;
+		}
+	}
+	LOG(LOG_DOSMISC,LOG_NORMAL)("DIRCACHE: Loaded %d directories from %s",(int)dirindex.dirs.size(),dirindex_file.c_str());
+	return;
+bad:
+	LOG_MSG("DIRCACHE: Directory index %s is damaged, ignoring it",dirindex_file.c_str());
+	dirindex.dirs.clear();
+}
+
+void DOS_SaveDirectoryIndex(void) {
+	if (!dirindex.dirty || dirindex_file.empty()) return;
+	dirindex.dirty = false;
+
+	std::vector<Bit8u> buf(DIRINDEX_MAGIC,DIRINDEX_MAGIC+8);
+	for (std::map<std::string,DirIndexDir>::const_iterator it=dirindex.dirs.begin(); it!=dirindex.dirs.end(); ++it) {
+		const DirIndexDir& dir = it->second;
+		DirIndex_Put(buf,it->first.size(),4);
+		buf.insert(buf.end(),it->first.begin(),it->first.end());
+		DirIndex_Put(buf,dir.mtime,8);
+		DirIndex_Put(buf,dir.mtime_ns,4);
+		DirIndex_Put(buf,dir.entries.size(),4);
+		for (size_t i=0; i<dir.entries.size(); i++) {
+			const DirIndexEntry& entry = dir.entries[i];
+			DirIndex_Put(buf,entry.orgname.size(),2);
+			buf.insert(buf.end(),entry.orgname.begin(),entry.orgname.end());
+			DirIndex_Put(buf,entry.shortname.size(),1);
+			buf.insert(buf.end(),entry.shortname.begin(),entry.shortname.end());
+			DirIndex_Put(buf,entry.shortNr,4);
+			DirIndex_Put(buf,entry.isDir ? 1 : 0,1);
+		}
+	}
+
+	FILE* f = fopen(dirindex_file.c_str(),"wb");
+	if (!f || fwrite(&buf[0],buf.size(),1,f)!=1) {
+		LOG_MSG("DIRCACHE: Can't write directory index %s",dirindex_file.c_str());
+		if (f) fclose(f);
+		return;
+	}
+	fclose(f);
+}
+
 bool SortByName(DOS_Drive_Cache::CFileInfo* const &a, DOS_Drive_Cache::CFileInfo* const &b) {
 	return strcmp(a->shortname,b->shortname)<0;
 }
@@ -69,6 +227,7 @@ DOS_Drive_Cache::DOS_Drive_Cache(void) {
 	for (Bit32u i=0; i<MAX_OPENDIRS; i++) { dirSearch[i] = 0; dirFindFirst[i] = 0; };
 	SetDirSort(DIRALPHABETICAL);
 	updatelabel = true;
+	watchFd = -1;
 }
 
 DOS_Drive_Cache::DOS_Drive_Cache(const char* path, DOS_Drive *drive) {
@@ -77,6 +236,7 @@ DOS_Drive_Cache::DOS_Drive_Cache(const char* path, DOS_Drive *drive) {
 	srchNr			= 0;
 	label[0]		= 0;
 	nextFreeFindFirst	= 0;
+	watchFd			= -1;
 	for (Bit32u i=0; i<MAX_OPENDIRS; i++) { dirSearch[i] = 0; dirFindFirst[i] = 0; };
 	SetDirSort(DIRALPHABETICAL);
 	SetBaseDir(path,drive);
@@ -86,6 +246,9 @@ DOS_Drive_Cache::DOS_Drive_Cache(const char* path, DOS_Drive *drive) {
 DOS_Drive_Cache::~DOS_Drive_Cache(void) {
 	Clear();
 	for (Bit32u i=0; i<MAX_OPENDIRS; i++) { DeleteFileInfo(dirFindFirst[i]); dirFindFirst[i]=0; };
+#if defined (LINUX)
+	if (watchFd>=0) close(watchFd);
+#endif
 }
 
 void DOS_Drive_Cache::Clear(void) {
@@ -213,17 +376,8 @@ void DOS_Drive_Cache::AddEntry(const char* path, bool checkExists) {
 			if (GetLongName(dir,file)>=0) return;
 		}
 
+		// New entries go at the end, open searches are not affected
 		CreateEntry(dir,file,false);
-
-		Bits index = GetLongName(dir,file);
-		if (index>=0) {
-			Bit32u i;
-			// Check if there are any open search dir that are affected by this...
-			if (dir) for (i=0; i<MAX_OPENDIRS; i++) {
-				if ((dirSearch[i]==dir) && ((Bit32u)index<=dirSearch[i]->nextEntry)) 
-					dirSearch[i]->nextEntry++;
-			}
-		}
 		//		LOG_DEBUG("DIR: Added Entry %s",path);
 	} else {
 //		LOG_DEBUG("DIR: Error: Failed to add %s",path);	
@@ -266,6 +420,10 @@ void DOS_Drive_Cache::CacheOut(const char* path, bool ignoreLastDir) {
 	}
 
 //	LOG_DEBUG("DIR: Caching out %s : dir %s",expand,dir->orgname);
+	CacheOutDir(dir);
+}
+
+void DOS_Drive_Cache::CacheOutDir(CFileInfo* dir) {
 //	clear cache first?
 	for (Bit32u i=0; i<MAX_OPENDIRS; i++) {
 		dirSearch[i] = 0; //free[i] = true;    
@@ -277,7 +435,7 @@ void DOS_Drive_Cache::CacheOut(const char* path, bool ignoreLastDir) {
 	}
 	// clear lists
 	dir->fileList.clear();
-	dir->longNameList.clear();
+	dir->ClearLookup();
 	save_dir = 0;
 }
 
@@ -291,82 +449,12 @@ bool DOS_Drive_Cache::GetShortName(const char* fullname, char* shortname) {
 	char expand[CROSS_LEN] = {0};
 	CFileInfo* curDir = FindDirInfo(fullname,expand);
 
-	std::vector<CFileInfo*>::size_type filelist_size = curDir->longNameList.size();
-	if (GCC_UNLIKELY(filelist_size<=0)) return false;
-
-	Bits low		= 0;
-	Bits high		= (Bits)(filelist_size-1);
-	Bits mid, res;
-
-	while (low<=high) {
-		mid = (low+high)/2;
-		res = strcmp(fullname,curDir->longNameList[mid]->orgname);
-		if (res>0)	low  = mid+1; else
-		if (res<0)	high = mid-1; 
-		else {
-			strcpy(shortname,curDir->longNameList[mid]->shortname);
-			return true;
-		};
-	}
-	return false;
-}
-
-int DOS_Drive_Cache::CompareShortname(const char* compareName, const char* shortName) {
-	char const* cpos = strchr(shortName,'~');
-	if (cpos) {
-/* the following code is replaced as it's not safe when char* is 64 bits */
-/*		Bits compareCount1	= (int)cpos - (int)shortName;
-		char* endPos		= strchr(cpos,'.');
-		Bitu numberSize		= endPos ? int(endPos)-int(cpos) : strlen(cpos);
-		
-		char* lpos			= strchr(compareName,'.');
-		Bits compareCount2	= lpos ? int(lpos)-int(compareName) : strlen(compareName);
-		if (compareCount2>8) compareCount2 = 8;
-
-		compareCount2 -= numberSize;
-		if (compareCount2>compareCount1) compareCount1 = compareCount2;
-*/
-		size_t compareCount1 = strcspn(shortName,"~");
-		size_t numberSize    = strcspn(cpos,".");
-		size_t compareCount2 = strcspn(compareName,".");
-		if(compareCount2 > 8) compareCount2 = 8;
-		/* We want 
-		 * compareCount2 -= numberSize;
-		 * if (compareCount2>compareCount1) compareCount1 = compareCount2;
-		 * but to prevent negative numbers: 
-		 */
-		if(compareCount2 > compareCount1 + numberSize)
-			compareCount1 = compareCount2 - numberSize;
-		return strncmp(compareName,shortName,compareCount1);
-	}
-	return strcmp(compareName,shortName);
-}
-
-Bitu DOS_Drive_Cache::CreateShortNameID(CFileInfo* curDir, const char* name) {
-	std::vector<CFileInfo*>::size_type filelist_size = curDir->longNameList.size();
-	if (GCC_UNLIKELY(filelist_size<=0)) return 1;	// shortener IDs start with 1
-
-	Bitu foundNr	= 0;	
-	Bits low		= 0;
-	Bits high		= (Bits)(filelist_size-1);
-	Bits mid, res;
-
-	while (low<=high) {
-		mid = (low+high)/2;
-		res = CompareShortname(name,curDir->longNameList[mid]->shortname);
-		
-		if (res>0)	low  = mid+1; else
-		if (res<0)	high = mid-1; 
-		else {
-			// any more same x chars in next entries ?	
-			do {
-				foundNr = curDir->longNameList[mid]->shortNr;
-				mid++;
-			} while((Bitu)mid<curDir->longNameList.size() && (CompareShortname(name,curDir->longNameList[mid]->shortname)==0));
-			break;
-		};
-	}
-	return foundNr+1;
+	const char* name = strrchr(fullname,CROSS_FILESPLIT);
+	name = name ? name+1 : fullname;
+	std::unordered_map<std::string,Bitu>::const_iterator it = curDir->longNames.find(name);
+	if (it==curDir->longNames.end()) return false;
+	strcpy(shortname,curDir->fileList[it->second]->shortname);
+	return true;
 }
 
 bool DOS_Drive_Cache::RemoveTrailingDot(char* shortname) {
@@ -442,18 +530,11 @@ Bits DOS_Drive_Cache::GetLongName(CFileInfo* curDir, char* shortName) {
 	// Remove dot, if no extension...
 	RemoveTrailingDot(shortName);
 	// Search long name and return array number of element
-	Bits low	= 0;
-	Bits high	= (Bits)(filelist_size-1);
-	Bits mid,res;
-	while (low<=high) {
-		mid = (low+high)/2;
-		res = strcmp(shortName,curDir->fileList[mid]->shortname);
-		if (res>0)	low  = mid+1; else
-		if (res<0)	high = mid-1; else
-		{	// Found
-			strcpy(shortName,curDir->fileList[mid]->orgname);
-			return mid;
-		};
+	std::unordered_map<std::string,Bitu>::const_iterator it = curDir->shortNames.find(shortName);
+	if (it!=curDir->shortNames.end()) {
+		// Found
+		strcpy(shortName,curDir->fileList[it->second]->orgname);
+		return (Bits)it->second;
 	}
 #ifdef WINE_DRIVE_SUPPORT
 	if (strlen(shortName) < 8 || shortName[4] != '~' || shortName[5] == '.' || shortName[6] == '.' || shortName[7] == '.') return -1; // not available
@@ -461,7 +542,7 @@ Bits DOS_Drive_Cache::GetLongName(CFileInfo* curDir, char* shortName) {
 	// The above test is rather strict as the following loop can be really slow if filelist_size is large.
 	char buff[CROSS_LEN];
 	for (Bitu i = 0; i < filelist_size; i++) {
-		res = wine_hash_short_file_name(curDir->fileList[i]->orgname,buff);
+		Bits res = wine_hash_short_file_name(curDir->fileList[i]->orgname,buff);
 		buff[res] = 0;
 		if (!strcmp(shortName,buff)) {	
 			// Found
@@ -522,51 +603,36 @@ void DOS_Drive_Cache::CreateShortName(CFileInfo* curDir, CFileInfo* info) {
 	}
 
 	if (createShort) {
-		// Create number
-		char buffer[8];
-		info->shortNr = CreateShortNameID(curDir,tmpName);
-		sprintf(buffer,"%d",(int)info->shortNr);
-		// Copy first letters
-		Bits tocopy = 0;
-		size_t buflen = strlen(buffer);
-		if (len+buflen+1>8)	tocopy = (Bits)(8 - buflen - 1);
-		else				tocopy = len;
-		safe_strncpy(info->shortname,tmpName,tocopy+1);
-		// Copy number
-		strcat(info->shortname,"~");
-		strcat(info->shortname,buffer);
-		// Add (and cut) Extension, if available
-		if (pos) {
-			// Step to last extension...
-			pos = strrchr(tmpName, '.');
-			// add extension
-			strncat(info->shortname,pos,4);
-			info->shortname[DOS_NAMELENGTH] = 0;
-		}
-
-		// keep list sorted for CreateShortNameID to work correctly
-		if (curDir->longNameList.size()>0) {
-			if (!(strcmp(info->shortname,curDir->longNameList.back()->shortname)<0)) {
-				// append at end of list
-				curDir->longNameList.push_back(info);
-			} else {
-				// look for position where to insert this element
-				bool found=false;
-				std::vector<CFileInfo*>::iterator it;
-				for (it=curDir->longNameList.begin(); it!=curDir->longNameList.end(); ++it) {
-					if (strcmp(info->shortname,(*it)->shortname)<0) {
-						found = true;
-						break;
-					}
-				}
-				// Put it in longname list...
-				if (found) curDir->longNameList.insert(it,info);
-				else curDir->longNameList.push_back(info);
+		// Continue after the last number given to a name starting the same way,
+		// skipping numbers that a shorter start already took
+		char start[9];
+		safe_strncpy(start,tmpName,(len<8 ? len : 8)+1);
+		Bitu& lastNr = curDir->aliasNumbers[start];
+		for (info->shortNr = lastNr+1;; info->shortNr++) {
+			// Create number
+			char buffer[8];
+			sprintf(buffer,"%d",(int)info->shortNr);
+			// Copy first letters
+			Bits tocopy = 0;
+			size_t buflen = strlen(buffer);
+			if (len+buflen+1>8)	tocopy = (Bits)(8 - buflen - 1);
+			else				tocopy = len;
+			safe_strncpy(info->shortname,tmpName,tocopy+1);
+			// Copy number
+			strcat(info->shortname,"~");
+			strcat(info->shortname,buffer);
+			// Add (and cut) Extension, if available
+			if (pos) {
+				// Step to last extension...
+				const char* ext = strrchr(tmpName, '.');
+				// add extension
+				strncat(info->shortname,ext,4);
+				info->shortname[DOS_NAMELENGTH] = 0;
 			}
-		} else {
-			// empty file list, append
-			curDir->longNameList.push_back(info);
+			RemoveTrailingDot(info->shortname);
+			if (curDir->shortNames.find(info->shortname)==curDir->shortNames.end()) break;
 		}
+		lastNr = info->shortNr;
 	} else {
 		strcpy(info->shortname,tmpName);
 	}
@@ -584,13 +650,16 @@ DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::FindDirInfo(const char* path, char*
 	CFileInfo*	curDir = dirBase;
 	Bit16u		id;
 
+//	LOG_DEBUG("DIR: Find %s",path);
+
+	// Pick up changes made to the host directories behind our back
+	PollWatches();
+
 	if (save_dir && (strcmp(path,save_path)==0)) {
 		strcpy(expandedPath,save_expanded);
 		return save_dir;
 	};
 
-//	LOG_DEBUG("DIR: Find %s",path);
-
 	// Remove base dir path
 	start += strlen(basePath);
 	strcpy(expandedPath,basePath);
@@ -703,30 +772,14 @@ void DOS_Drive_Cache::CreateEntry(CFileInfo* dir, const char* name, bool is_dire
 	// Check for long filenames...
 	CreateShortName(dir, info);		
 
-	bool found = false;
-
-	// keep list sorted (so GetLongName works correctly, used by CreateShortName in this routine)
-	if (dir->fileList.size()>0) {
-		if (!(strcmp(info->shortname,dir->fileList.back()->shortname)<0)) {
-			// append at end of list
-			dir->fileList.push_back(info);
-		} else {
-			// look for position where to insert this element
-			std::vector<CFileInfo*>::iterator it;
-			for (it=dir->fileList.begin(); it!=dir->fileList.end(); ++it) {
-				if (strcmp(info->shortname,(*it)->shortname)<0) {
-					found = true;
-					break;
-				}
-			}
-			// Put file in lists
-			if (found) dir->fileList.insert(it,info);
-			else dir->fileList.push_back(info);
-		}
-	} else {
-		// empty file list, append
-		dir->fileList.push_back(info);
-	}
+	AppendEntry(dir, info);
+}
+
+void DOS_Drive_Cache::AppendEntry(CFileInfo* dir, CFileInfo* info) {
+	Bitu index = dir->fileList.size();
+	dir->fileList.push_back(info);
+	dir->shortNames.insert(std::make_pair(std::string(info->shortname),index));
+	dir->longNames.insert(std::make_pair(std::string(info->orgname),index));
 }
 
 void DOS_Drive_Cache::CopyEntry(CFileInfo* dir, CFileInfo* from) {
@@ -745,27 +798,36 @@ bool DOS_Drive_Cache::ReadDir(Bit16u id, char* &result) {
 	if (id>MAX_OPENDIRS) return false;
 
 	if (!IsCachedIn(dirSearch[id])) {
-		// Try to open directory
-		void* dirp = drive->opendir(dirPath);
-		if (!dirp) {
-			if (dirSearch[id]) {
-				dirSearch[id]->id = MAX_OPENDIRS;
-				dirSearch[id] = 0;
+		// Watch before reading, so nothing that changes in between is missed
+		WatchDir(dirSearch[id], dirPath);
+		// The time is taken before reading too, a change while reading makes it stale
+		Bit64u mtime = 0; Bit32u mtime_ns = 0;
+		bool stamped = !dirindex_file.empty() && DirIndex_Stamp(dirPath, mtime, mtime_ns);
+		if (!stamped || !LoadFromIndex(dirSearch[id], dirPath, mtime, mtime_ns)) {
+			// Try to open directory
+			void* dirp = drive->opendir(dirPath);
+			if (!dirp) {
+				if (dirSearch[id]) {
+					dirSearch[id]->id = MAX_OPENDIRS;
+					dirSearch[id] = 0;
+				}
+				return false;
 			}
-			return false;
-		}
-		// Read complete directory
-		char dir_name[CROSS_LEN];
-		bool is_directory;
-		if (drive->read_directory_first(dirp, dir_name, is_directory)) {
-			CreateEntry(dirSearch[id], dir_name, is_directory);
-			while (drive->read_directory_next(dirp, dir_name, is_directory)) {
+			// Read complete directory
+			char dir_name[CROSS_LEN];
+			bool is_directory;
+			if (drive->read_directory_first(dirp, dir_name, is_directory)) {
 				CreateEntry(dirSearch[id], dir_name, is_directory);
+				while (drive->read_directory_next(dirp, dir_name, is_directory)) {
+					CreateEntry(dirSearch[id], dir_name, is_directory);
+				}
 			}
-		}
 
-		// close dir
-		drive->closedir(dirp);
+			// close dir
+			drive->closedir(dirp);
+
+			if (stamped) StoreInIndex(dirSearch[id], dirPath, mtime, mtime_ns);
+		}
 
 		// Info
 /*		if (!dirp) {
@@ -839,8 +901,7 @@ bool DOS_Drive_Cache::FindFirst(char* path, Bit16u& id) {
 	}
 	// Now re-sort the fileList accordingly to output
 	switch (sortDirType) {
-		case ALPHABETICAL		: break;
-//		case ALPHABETICAL		: std::sort(dirFindFirst[dirFindFirstID]->fileList.begin(), dirFindFirst[dirFindFirstID]->fileList.end(), SortByName);		break;
+		case ALPHABETICAL		: std::sort(dirFindFirst[dirFindFirstID]->fileList.begin(), dirFindFirst[dirFindFirstID]->fileList.end(), SortByName);		break;
 		case DIRALPHABETICAL	: std::sort(dirFindFirst[dirFindFirstID]->fileList.begin(), dirFindFirst[dirFindFirstID]->fileList.end(), SortByDirName);		break;
 		case ALPHABETICALREV	: std::sort(dirFindFirst[dirFindFirstID]->fileList.begin(), dirFindFirst[dirFindFirstID]->fileList.end(), SortByNameRev);		break;
 		case DIRALPHABETICALREV	: std::sort(dirFindFirst[dirFindFirstID]->fileList.begin(), dirFindFirst[dirFindFirstID]->fileList.end(), SortByDirNameRev);	break;
@@ -875,6 +936,13 @@ void DOS_Drive_Cache::ClearFileInfo(CFileInfo *dir) {
 		dirSearch[dir->id] = 0;
 		dir->id = MAX_OPENDIRS;
 	}
+#if defined (LINUX)
+	if (dir->watch >= 0) {
+		inotify_rm_watch(watchFd, dir->watch);
+		watches.erase(dir->watch);
+		dir->watch = -1;
+	}
+#endif
 }
 
 void DOS_Drive_Cache::DeleteFileInfo(CFileInfo *dir) {
@@ -882,3 +950,108 @@ void DOS_Drive_Cache::DeleteFileInfo(CFileInfo *dir) {
 		ClearFileInfo(dir);
 	delete dir;
 }
+
+bool DOS_Drive_Cache::LoadFromIndex(CFileInfo* dir, const char* path, Bit64u mtime, Bit32u mtime_ns) {
+	if (!dirindex.loaded) DirIndex_Load();
+	std::map<std::string,DirIndexDir>::const_iterator it = dirindex.dirs.find(path);
+	if (it==dirindex.dirs.end() || it->second.mtime!=mtime || it->second.mtime_ns!=mtime_ns) return false;
+
+	const DirIndexDir& index = it->second;
+	dir->fileList.reserve(index.entries.size());
+	for (size_t i=0; i<index.entries.size(); i++) {
+		const DirIndexEntry& entry = index.entries[i];
+		CFileInfo* info = new CFileInfo;
+		strcpy(info->orgname, entry.orgname.c_str());
+		strcpy(info->shortname, entry.shortname.c_str());
+		info->shortNr = entry.shortNr;
+		info->isDir = entry.isDir;
+		AppendEntry(dir, info);
+	}
+	return true;
+}
+
+void DOS_Drive_Cache::StoreInIndex(CFileInfo* dir, const char* path, Bit64u mtime, Bit32u mtime_ns) {
+	if (dir->fileList.size()<DIRINDEX_MIN_ENTRIES) return;
+	// Changes within the same tick of the clock would not show in the time
+	if ((Bit64u)time(NULL) < mtime+2) return;
+	if (!dirindex.loaded) DirIndex_Load();
+
+	DirIndexDir& index = dirindex.dirs[path];
+	index.mtime = mtime;
+	index.mtime_ns = mtime_ns;
+	index.entries.resize(dir->fileList.size());
+	for (size_t i=0; i<dir->fileList.size(); i++) {
+		DirIndexEntry& entry = index.entries[i];
+		entry.orgname = dir->fileList[i]->orgname;
+		entry.shortname = dir->fileList[i]->shortname;
+		entry.shortNr = (Bit32u)dir->fileList[i]->shortNr;
+		entry.isDir = dir->fileList[i]->isDir;
+	}
+	dirindex.dirty = true;
+}
+
+void DOS_Drive_Cache::WatchDir(CFileInfo* dir, const char* path) {
+#if defined (LINUX)
+	if (!dirindex_watch || dir->watch>=0) return;
+	if (watchFd == -1) {
+		watchFd = inotify_init();
+		if (watchFd < 0) {
+			LOG(LOG_DOSMISC,LOG_WARN)("DIRCACHE: Can't watch host directories for changes");
+			watchFd = -2;
+			return;
+		}
+		fcntl(watchFd, F_SETFL, fcntl(watchFd, F_GETFL) | O_NONBLOCK);
+		fcntl(watchFd, F_SETFD, FD_CLOEXEC);
+	}
+	if (watchFd < 0) return;
+	int wd = inotify_add_watch(watchFd, path, IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO|IN_ONLYDIR);
+	if (wd < 0) return;
+	// The same host directory seen through another path has the same watch
+	std::map<int,CFileInfo*>::iterator it = watches.find(wd);
+	if (it != watches.end()) return;
+	watches[wd] = dir;
+	dir->watch = wd;
+#endif
+}
+
+void DOS_Drive_Cache::PollWatches(void) {
+#if defined (LINUX)
+	if (watchFd < 0) return;
+	union {
+		struct inotify_event	event;
+		char			raw[4096];
+	} buf;
+	ssize_t len;
+	while ((len = read(watchFd, buf.raw, sizeof(buf.raw))) > 0) {
+		for (ssize_t pos = 0; pos < len; ) {
+			const struct inotify_event* event = (const struct inotify_event*)(buf.raw + pos);
+			pos += (ssize_t)(sizeof(struct inotify_event) + event->len);
+
+			if (event->mask & IN_Q_OVERFLOW) {
+				// Events were lost, forget everything below the base directory
+				if (dirBase) CacheOutDir(dirBase);
+				continue;
+			}
+			std::map<int,CFileInfo*>::iterator it = watches.find(event->wd);
+			if (it == watches.end()) continue;
+			CFileInfo* dir = it->second;
+			if (event->mask & IN_IGNORED) {
+				watches.erase(it);
+				dir->watch = -1;
+				continue;
+			}
+			if (!event->len || !IsCachedIn(dir)) continue;
+
+			bool known = dir->longNames.find(event->name) != dir->longNames.end();
+			if (event->mask & (IN_DELETE|IN_MOVED_FROM)) {
+				// Short names may depend on it, read the directory again when needed
+				if (known) CacheOutDir(dir);
+			} else if (event->mask & (IN_CREATE|IN_MOVED_TO)) {
+				if (known || strlen(event->name) >= CROSS_LEN) continue;
+				CreateEntry(dir, event->name, (event->mask & IN_ISDIR) != 0);
+				save_dir = 0;
+			}
+		}
+	}
+#endif
+}
@@ -21,6 +21,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <vector>
 #include "dosbox.h"
 #include "dos_inc.h"
 #include "drives.h"
@@ -29,6 +30,8 @@
 #include "bios.h"
 #include "bios_disk.h"
 #include "qcow2_disk.h"
+#include "cow_disk.h"
+#include "pic.h"
 
 #define IMGTYPE_FLOPPY 0
 #define IMGTYPE_ISO    1
@@ -47,6 +50,7 @@ public:
 	bool Close();
 	Bit16u GetInformation(void);
 	bool UpdateDateTimeFromHost(void);   
+	void Flush(void);
 	Bit32u GetSeekPos(void);
 public:
 	Bit32u firstCluster;
@@ -62,6 +66,21 @@ public:
 	bool loadedSector;
 	fatDrive *myDrive;
 private:
+	/* A run of clusters that follow each other on disk */
+	struct Extent {
+		Bit32u fileClust;		/* Index of the first cluster in the file */
+		Bit32u firstClust;
+		Bit32u count;
+	};
+	bool MapClusters(Bit32u clusters);
+	Bit32u GetSector(Bit32u logicalSector, Bit32u *run);
+	Bit32u LastCluster(void);
+
+	std::vector<Extent> extents;	/* Cluster chain from firstCluster, built as far as needed */
+	Bit32u mappedClusters;
+	Bit32u mappedFirstCluster;
+	Bit32u mappedEpoch;
+
 	enum { NONE,READ,WRITE } last_action;
 	Bit16u info;
 };
@@ -94,6 +113,9 @@ fatFile::fatFile(const char* /*name*/, Bit32u startCluster, Bit32u fileLen, fatD
 	loadedSector = false;
 	curSectOff = 0;
 	seekpos = 0;
+	mappedClusters = 0;
+	mappedFirstCluster = 0;
+	mappedEpoch = 0;
 	memset(&sectorBuffer[0], 0, sizeof(sectorBuffer));
 	
 	if(filelength > 0) {
@@ -103,6 +125,66 @@ fatFile::fatFile(const char* /*name*/, Bit32u startCluster, Bit32u fileLen, fatD
 	}
 }
 
+/* Make sure the first clusters of the chain are in the extent list, false if
+   the chain is shorter. Chains only grow while a file is open unless one is
+   freed, which resets the list. */
+bool fatFile::MapClusters(Bit32u clusters) {
+	if (mappedFirstCluster != firstCluster || mappedEpoch != myDrive->chainEpoch) {
+		extents.clear();
+		mappedClusters = 0;
+		mappedFirstCluster = firstCluster;
+		mappedEpoch = myDrive->chainEpoch;
+	}
+	if (clusters <= mappedClusters) return true;
+
+	Bit32u clust;
+	if (mappedClusters == 0) {
+		if (firstCluster < 2) return false;
+		clust = firstCluster;
+	} else {
+		clust = myDrive->getNextCluster(LastCluster());
+		if (clust == 0) return false;
+	}
+	while (true) {
+		if (!extents.empty() && extents.back().firstClust + extents.back().count == clust) {
+			extents.back().count++;
+		} else {
+			Extent ext;
+			ext.fileClust = mappedClusters;
+			ext.firstClust = clust;
+			ext.count = 1;
+			extents.push_back(ext);
+		}
+		if (++mappedClusters >= clusters) return true;
+		clust = myDrive->getNextCluster(clust);
+		if (clust == 0) return false;
+	}
+}
+
+Bit32u fatFile::LastCluster(void) {
+	if (extents.empty()) return firstCluster;
+	return extents.back().firstClust + extents.back().count - 1;
+}
+
+/* Absolute sector of a sector in the file, 0 past the end of the chain. run
+   gets the number of sectors from there on that are contiguous on disk. */
+Bit32u fatFile::GetSector(Bit32u logicalSector, Bit32u *run) {
+	Bit32u spc = myDrive->bootbuffer.sectorspercluster;
+	Bit32u clustIndex = logicalSector / spc;
+	Bit32u sectClust = logicalSector % spc;
+	if (!MapClusters(clustIndex + 1)) return 0;
+
+	size_t lo = 0, hi = extents.size();
+	while (hi - lo > 1) {
+		size_t mid = (lo + hi) / 2;
+		if (extents[mid].fileClust <= clustIndex) lo = mid;
+		else hi = mid;
+	}
+	const Extent &ext = extents[lo];
+	if (run) *run = (ext.fileClust + ext.count - clustIndex) * spc - sectClust;
+	return myDrive->getClustFirstSect(ext.firstClust + (clustIndex - ext.fileClust)) + sectClust;
+}
+
 bool fatFile::Read(Bit8u * data, Bit16u *size) {
 	if ((this->flags & 0xf) == OPEN_WRITE) {	// check if file opened in write-only mode
 		DOS_SetError(DOSERR_ACCESS_DENIED);
@@ -114,8 +196,9 @@ bool fatFile::Read(Bit8u * data, Bit16u *size) {
 		return true;
 	}
 
+	Bit32u sectsize = myDrive->getSectorSize();
 	if (!loadedSector) {
-		currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
+		currentSector = GetSector(seekpos / sectsize, NULL);
 		if(currentSector == 0) {
 			/* EOC reached before EOF */
 			*size = 0;
@@ -128,29 +211,42 @@ bool fatFile::Read(Bit8u * data, Bit16u *size) {
 	}
 
 	sizedec = *size;
+	if (sizedec > filelength - seekpos) sizedec = (Bit16u)(filelength - seekpos);
 	sizecount = 0;
 	while(sizedec != 0) {
-		if(seekpos >= filelength) {
-			*size = sizecount;
-			return true; 
+		Bit32u avail = sectsize - curSectOff;
+		if (avail > sizedec) avail = sizedec;
+		memcpy(&data[sizecount], &sectorBuffer[curSectOff], avail);
+		sizecount += (Bit16u)avail;
+		sizedec -= (Bit16u)avail;
+		seekpos += avail;
+		curSectOff += avail;
+		if (curSectOff < sectsize) break;
+
+		/* Whole sectors go straight to the caller, a run at a time */
+		while (sizedec >= sectsize) {
+			Bit32u run;
+			Bit32u sect = GetSector(seekpos / sectsize, &run);
+			if (sect == 0) break;
+			if (run > sizedec / sectsize) run = sizedec / sectsize;
+			myDrive->loadedDisk->Read_Sectors(sect, run, &data[sizecount]);
+			sizecount += (Bit16u)(run * sectsize);
+			sizedec -= (Bit16u)(run * sectsize);
+			seekpos += run * sectsize;
 		}
-		data[sizecount++] = sectorBuffer[curSectOff++];
-		seekpos++;
-		if(curSectOff >= myDrive->getSectorSize()) {
-			currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
-			if(currentSector == 0) {
-				/* EOC reached before EOF */
-				//LOG_MSG("EOC reached before EOF, seekpos %d, filelen %d", seekpos, filelength);
-				*size = sizecount;
-				loadedSector = false;
-				return true;
-			}
-			curSectOff = 0;
-			myDrive->loadedDisk->Read_AbsoluteSector(currentSector, sectorBuffer);
-			loadedSector = true;
-			//LOG_MSG("Reading absolute sector at %d for seekpos %d", currentSector, seekpos);
+
+		currentSector = GetSector(seekpos / sectsize, NULL);
+		if(currentSector == 0) {
+			/* EOC reached before EOF */
+			//LOG_MSG("EOC reached before EOF, seekpos %d, filelen %d", seekpos, filelength);
+			*size = sizecount;
+			loadedSector = false;
+			return true;
 		}
-		--sizedec;
+		curSectOff = 0;
+		myDrive->loadedDisk->Read_AbsoluteSector(currentSector, sectorBuffer);
+		loadedSector = true;
+		//LOG_MSG("Reading absolute sector at %d for seekpos %d", currentSector, seekpos);
 	}
 	*size =sizecount;
 	return true;
@@ -175,18 +271,18 @@ bool fatFile::Write(Bit8u * data, Bit16u *size) {
 			if(filelength == 0) {
 				firstCluster = myDrive->getFirstFreeClust();
 				myDrive->allocateCluster(firstCluster, 0);
-				currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
+				currentSector = GetSector(seekpos / myDrive->getSectorSize(), NULL);
 				myDrive->loadedDisk->Read_AbsoluteSector(currentSector, sectorBuffer);
 				loadedSector = true;
 			}
 			filelength = seekpos+1;
 			if (!loadedSector) {
-				currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
+				currentSector = GetSector(seekpos / myDrive->getSectorSize(), NULL);
 				if(currentSector == 0) {
 					/* EOC reached before EOF - try to increase file allocation */
-					myDrive->appendCluster(firstCluster);
+					myDrive->appendCluster(LastCluster());
 					/* Try getting sector again */
-					currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
+					currentSector = GetSector(seekpos / myDrive->getSectorSize(), NULL);
 					if(currentSector == 0) {
 						/* No can do. lets give up and go home.  We must be out of room */
 						goto finalizeWrite;
@@ -203,12 +299,12 @@ bool fatFile::Write(Bit8u * data, Bit16u *size) {
 		if(curSectOff >= myDrive->getSectorSize()) {
 			if(loadedSector) myDrive->loadedDisk->Write_AbsoluteSector(currentSector, sectorBuffer);
 
-			currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
+			currentSector = GetSector(seekpos / myDrive->getSectorSize(), NULL);
 			if(currentSector == 0) {
 				/* EOC reached before EOF - try to increase file allocation */
-				myDrive->appendCluster(firstCluster);
+				myDrive->appendCluster(LastCluster());
 				/* Try getting sector again */
-				currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
+				currentSector = GetSector(seekpos / myDrive->getSectorSize(), NULL);
 				if(currentSector == 0) {
 					/* No can do. lets give up and go home.  We must be out of room */
 					loadedSector = false;
@@ -254,7 +350,7 @@ bool fatFile::Seek(Bit32u *pos, Bit32u type) {
 	if((Bit32u)seekto > filelength) seekto = (Bit32s)filelength;
 	if(seekto<0) seekto = 0;
 	seekpos = (Bit32u)seekto;
-	currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
+	currentSector = GetSector(seekpos / myDrive->getSectorSize(), NULL);
 	if (currentSector == 0) {
 		/* not within file size, thus no sector is available */
 		loadedSector = false;
@@ -269,6 +365,7 @@ bool fatFile::Seek(Bit32u *pos, Bit32u type) {
 bool fatFile::Close() {
 	/* Flush buffer */
 	if (loadedSector) myDrive->loadedDisk->Write_AbsoluteSector(currentSector, sectorBuffer);
+	myDrive->flushFat();
 
 	return false;
 }
@@ -281,6 +378,10 @@ bool fatFile::UpdateDateTimeFromHost(void) {
 	return true;
 }
 
+void fatFile::Flush(void) {
+	myDrive->flushFat();
+}
+
 Bit32u fatFile::GetSeekPos() {
 	return seekpos;
 }
@@ -289,37 +390,26 @@ Bit32u fatDrive::getClustFirstSect(Bit32u clustNum) {
 	return ((clustNum - 2) * bootbuffer.sectorspercluster) + firstDataSector;
 }
 
-Bit32u fatDrive::getClusterValue(Bit32u clustNum) {
-	Bit32u fatoffset=0;
-	Bit32u fatsectnum;
-	Bit32u fatentoff;
-	Bit32u clustValue=0;
-
+static Bit32u fatEntryOffset(Bit8u fattype, Bit32u clustNum) {
 	switch(fattype) {
 		case FAT12:
-			fatoffset = clustNum + (clustNum / 2);
-			break;
+			return clustNum + (clustNum / 2);
 		case FAT16:
-			fatoffset = clustNum * 2;
-			break;
-		case FAT32:
-			fatoffset = clustNum * 4;
-			break;
-	}
-	fatsectnum = bootbuffer.reservedsectors + (fatoffset / bootbuffer.bytespersector) + partSectOff;
-	fatentoff = fatoffset % bootbuffer.bytespersector;
-
-	if(curFatSect != fatsectnum) {
-		/* Load two sectors at once for FAT12 */
-		loadedDisk->Read_AbsoluteSector(fatsectnum, &fatSectBuffer[0]);
-		if (fattype==FAT12)
-			loadedDisk->Read_AbsoluteSector(fatsectnum+1, &fatSectBuffer[512]);
-		curFatSect = fatsectnum;
+			return clustNum * 2;
+		default:
+			return clustNum * 4;
 	}
+}
+
+Bit32u fatDrive::getClusterValue(Bit32u clustNum) {
+	Bit32u fatoffset = fatEntryOffset(fattype, clustNum);
+	Bit32u clustValue=0;
+
+	if(fatoffset + 4 > fatCache.size()) return 0;
 
 	switch(fattype) {
 		case FAT12:
-			clustValue = *((Bit16u *)&fatSectBuffer[fatentoff]);
+			clustValue = host_readw(&fatCache[fatoffset]);
 			if(clustNum & 0x1) {
 				clustValue >>= 4;
 			} else {
@@ -327,46 +417,30 @@ Bit32u fatDrive::getClusterValue(Bit32u clustNum) {
 			}
 			break;
 		case FAT16:
-			clustValue = *((Bit16u *)&fatSectBuffer[fatentoff]);
+			clustValue = host_readw(&fatCache[fatoffset]);
 			break;
 		case FAT32:
-			clustValue = *((Bit32u *)&fatSectBuffer[fatentoff]);
+			clustValue = host_readd(&fatCache[fatoffset]);
 			break;
 	}
 
 	return clustValue;
 }
 
+static std::vector<fatDrive*> fatDirtyDrives;
+
+static void FAT_FlushEvent(Bitu /*val*/) {
+	fatDrive::flushAll();
+}
+
 void fatDrive::setClusterValue(Bit32u clustNum, Bit32u clustValue) {
-	Bit32u fatoffset=0;
-	Bit32u fatsectnum;
-	Bit32u fatentoff;
+	Bit32u fatoffset = fatEntryOffset(fattype, clustNum);
 
-	switch(fattype) {
-		case FAT12:
-			fatoffset = clustNum + (clustNum / 2);
-			break;
-		case FAT16:
-			fatoffset = clustNum * 2;
-			break;
-		case FAT32:
-			fatoffset = clustNum * 4;
-			break;
-	}
-	fatsectnum = bootbuffer.reservedsectors + (fatoffset / bootbuffer.bytespersector) + partSectOff;
-	fatentoff = fatoffset % bootbuffer.bytespersector;
-
-	if(curFatSect != fatsectnum) {
-		/* Load two sectors at once for FAT12 */
-		loadedDisk->Read_AbsoluteSector(fatsectnum, &fatSectBuffer[0]);
-		if (fattype==FAT12)
-			loadedDisk->Read_AbsoluteSector(fatsectnum+1, &fatSectBuffer[512]);
-		curFatSect = fatsectnum;
-	}
+	if(fatoffset + 4 > fatCache.size()) return;
 
 	switch(fattype) {
 		case FAT12: {
-			Bit16u tmpValue = *((Bit16u *)&fatSectBuffer[fatentoff]);
+			Bit16u tmpValue = host_readw(&fatCache[fatoffset]);
 			if(clustNum & 0x1) {
 				clustValue &= 0xfff;
 				clustValue <<= 4;
@@ -378,25 +452,117 @@ void fatDrive::setClusterValue(Bit32u clustNum, Bit32u clustValue) {
 				tmpValue &= 0xf000;
 				tmpValue |= (Bit16u)clustValue;
 			}
-			*((Bit16u *)&fatSectBuffer[fatentoff]) = tmpValue;
+			host_writew(&fatCache[fatoffset], tmpValue);
 			break;
 			}
 		case FAT16:
-			*((Bit16u *)&fatSectBuffer[fatentoff]) = (Bit16u)clustValue;
+			host_writew(&fatCache[fatoffset], (Bit16u)clustValue);
 			break;
 		case FAT32:
-			*((Bit32u *)&fatSectBuffer[fatentoff]) = clustValue;
+			host_writed(&fatCache[fatoffset], clustValue);
 			break;
 	}
-	for(int fc=0;fc<bootbuffer.fatcopies;fc++) {
-		loadedDisk->Write_AbsoluteSector(fatsectnum + (fc * bootbuffer.sectorsperfat), &fatSectBuffer[0]);
-		if (fattype==FAT12) {
-			if (fatentoff>=511)
-				loadedDisk->Write_AbsoluteSector(fatsectnum+1+(fc * bootbuffer.sectorsperfat), &fatSectBuffer[512]);
+	setClusterFree(clustNum, clustValue == 0);
+
+	/* A FAT12 entry can straddle two sectors */
+	Bit32u bps = bootbuffer.bytespersector;
+	fatDirty[fatoffset / bps] = true;
+	if (fattype == FAT12) fatDirty[(fatoffset + 1) / bps] = true;
+	if (!fatDirtyAny) {
+		fatDirtyAny = true;
+		fatDirtyDrives.push_back(this);
+		/* Written back a second later unless a close or commit comes first */
+		PIC_RemoveEvents(FAT_FlushEvent);
+		PIC_AddEvent(FAT_FlushEvent, 1000.0);
+	}
+}
+
+void fatDrive::setClusterFree(Bit32u clustNum, bool isFree) {
+	if (clustNum < 2 || clustNum - 2 >= CountOfClusters) return;
+	Bit32u idx = clustNum - 2;
+	Bit32u bit = 1u << (idx & 31);
+	Bit32u &word = freeMap[idx >> 5];
+	if (isFree == ((word & bit) != 0)) return;
+	if (isFree) {
+		word |= bit;
+		freeCount++;
+		if ((idx >> 5) < freeHint) freeHint = idx >> 5;
+	} else {
+		word &= ~bit;
+		freeCount--;
+	}
+}
+
+void fatDrive::loadFat(void) {
+	Bit32u bps = bootbuffer.bytespersector;
+	Bit32u fatsize = (Bit32u)bootbuffer.sectorsperfat * bps;
+	/* Room to read a whole entry at the end of the table */
+	fatCache.assign(fatsize + 4, 0);
+	fatDirty.assign(bootbuffer.sectorsperfat + 1, false);
+	fatDirtyAny = false;
+	if (bootbuffer.sectorsperfat)
+		loadedDisk->Read_Sectors(bootbuffer.reservedsectors + partSectOff, bootbuffer.sectorsperfat, &fatCache[0]);
+
+	freeMap.assign((CountOfClusters + 31) / 32, 0);
+	freeCount = 0;
+	freeHint = 0;
+	for (Bit32u i = 0; i < CountOfClusters; i++) {
+		if (!getClusterValue(i + 2)) {
+			freeMap[i >> 5] |= 1u << (i & 31);
+			freeCount++;
+		}
+	}
+}
+
+void fatDrive::flushFat(void) {
+	if (!fatDirtyAny) return;
+	Bit32u bps = bootbuffer.bytespersector;
+	for (Bit32u i = 0; i < bootbuffer.sectorsperfat; i++) {
+		if (!fatDirty[i]) continue;
+		/* Runs of dirty sectors are written at once */
+		Bit32u count = 1;
+		while (i + count < bootbuffer.sectorsperfat && fatDirty[i + count]) count++;
+		for(int fc=0;fc<bootbuffer.fatcopies;fc++)
+			loadedDisk->Write_Sectors(bootbuffer.reservedsectors + partSectOff + i + (fc * bootbuffer.sectorsperfat), count, &fatCache[i * bps]);
+		for (Bit32u j = 0; j < count; j++) fatDirty[i + j] = false;
+		i += count - 1;
+	}
+	fatDirtyAny = false;
+	for (size_t i = 0; i < fatDirtyDrives.size(); i++) {
+		if (fatDirtyDrives[i] == this) {
+			fatDirtyDrives.erase(fatDirtyDrives.begin() + i);
+			break;
 		}
 	}
 }
 
+void fatDrive::flushAll(void) {
+	while (!fatDirtyDrives.empty()) fatDirtyDrives.back()->flushFat();
+}
+
+/* Sectors the guest reads or writes through INT 13h, the IDE or the floppy
+   controller bypass the FAT in memory.
+   Before that the FAT of the drives on the disk is written back, after a write
+   into the FAT it is read again */
+void fatDrive::beforeDiskIO(imageDisk *disk) {
+	for (size_t i = fatDirtyDrives.size(); i-- > 0;) {
+		if (fatDirtyDrives[i]->loadedDisk == disk) fatDirtyDrives[i]->flushFat();
+	}
+}
+
+void fatDrive::afterDiskWrite(imageDisk *disk, Bit32u sectnum, Bit32u count) {
+	for (int i = 0; i < DOS_DRIVES; i++) {
+		fatDrive *drive = dynamic_cast<fatDrive*>(Drives[i]);
+		if (drive == NULL || drive->loadedDisk != disk) continue;
+		Bit32u fatStart = drive->bootbuffer.reservedsectors + drive->partSectOff;
+		Bit32u fatEnd = fatStart + (Bit32u)drive->bootbuffer.sectorsperfat * drive->bootbuffer.fatcopies;
+		if (sectnum >= fatEnd || sectnum + count <= fatStart) continue;
+		drive->loadFat();
+		/* Mapped cluster chains may have changed as well */
+		drive->chainEpoch++;
+	}
+}
+
 bool fatDrive::getEntryName(const char *fullname, char *entname) {
 	char dirtoken[DOS_PATHLENGTH];
 
@@ -545,10 +711,29 @@ Bit32u fatDrive::getAbsoluteSectFromChain(Bit32u startClustNum, Bit32u logicalSe
 	return (getClustFirstSect(currentClust) + sectClust);
 }
 
+/* Next cluster in a chain, 0 at its end */
+Bit32u fatDrive::getNextCluster(Bit32u clustNum) {
+	Bit32u testvalue = getClusterValue(clustNum);
+	if (testvalue < 2) return 0;
+	switch(fattype) {
+		case FAT12:
+			if(testvalue >= 0xff8) return 0;
+			break;
+		case FAT16:
+			if(testvalue >= 0xfff8) return 0;
+			break;
+		case FAT32:
+			if(testvalue >= 0xfffffff8) return 0;
+			break;
+	}
+	return testvalue;
+}
+
 void fatDrive::deleteClustChain(Bit32u startCluster) {
 	Bit32u testvalue;
 	Bit32u currentClust = startCluster;
 	bool isEOF = false;
+	chainEpoch++;
 	while(!isEOF) {
 		testvalue = getClusterValue(currentClust);
 		if(testvalue == 0) {
@@ -636,13 +821,19 @@ bool fatDrive::allocateCluster(Bit32u useCluster, Bit32u prevCluster) {
 
 fatDrive::~fatDrive() {
 	if (loadedDisk) {
+		flushFat();
 		loadedDisk->Release();
 		loadedDisk = NULL;
 	}
 }
 
-fatDrive::fatDrive(const char *sysFilename, Bit32u bytesector, Bit32u cylsector, Bit32u headscyl, Bit32u cylinders, Bit32u startSector) {
+fatDrive::fatDrive(const char *sysFilename, Bit32u bytesector, Bit32u cylsector, Bit32u headscyl, Bit32u cylinders, Bit32u startSector, const char *cowFilename) {
+	loadedDisk = NULL;
 	created_successfully = true;
+	fatDirtyAny = false;
+	freeCount = 0;
+	freeHint = 0;
+	chainEpoch = 0;
 	FILE *diskfile;
 	Bit32u filesize;
 	struct partTable mbrData;
@@ -653,7 +844,8 @@ fatDrive::fatDrive(const char *sysFilename, Bit32u bytesector, Bit32u cylsector,
 		imgDTA    = new DOS_DTA(imgDTAPtr);
 	}
 
-	diskfile = fopen64(sysFilename, "rb+");
+	/* With a delta file the image itself is never written to */
+	diskfile = fopen64(sysFilename, cowFilename ? "rb" : "rb+");
 	if(!diskfile) {created_successfully = false;return;}
 
     // all disk I/O is in sector-sized blocks.
@@ -664,7 +856,18 @@ fatDrive::fatDrive(const char *sysFilename, Bit32u bytesector, Bit32u cylsector,
 	
 	QCow2Image::QCow2Header qcow2_header = QCow2Image::read_header(diskfile);
 	
-	if (qcow2_header.magic == QCow2Image::magic && (qcow2_header.version == 2 || qcow2_header.version == 3)){
+	if (cowFilename != NULL) {
+		fseeko64(diskfile, 0L, SEEK_END);
+		filesize = (Bit32u)(ftello64(diskfile) / 1024L);
+		imageDiskCOW *cowDisk = new imageDiskCOW(diskfile, cowFilename, (Bit8u *)sysFilename, filesize, (filesize > 2880));
+		if (!cowDisk->created_successfully) {
+			delete cowDisk;
+			created_successfully = false;
+			return;
+		}
+		loadedDisk = cowDisk;
+	}
+	else if (qcow2_header.magic == QCow2Image::magic && (qcow2_header.version == 2 || qcow2_header.version == 3)){
 		Bit32u cluster_size = 1 << qcow2_header.cluster_bits;
 		if ((bytesector < 512) || ((cluster_size % bytesector) != 0)){
 			created_successfully = false;
@@ -801,8 +1004,7 @@ fatDrive::fatDrive(const char *sysFilename, Bit32u bytesector, Bit32u cylsector,
 	/* There is no cluster 0, this means we are in the root directory */
 	cwdDirCluster = 0;
 
-	memset(fatSectBuffer,0,1024);
-	curFatSect = 0xffffffff;
+	loadFat();
 
 	strcpy(info, "fatDrive ");
 	strcat(info, sysFilename);
@@ -810,8 +1012,7 @@ fatDrive::fatDrive(const char *sysFilename, Bit32u bytesector, Bit32u cylsector,
 
 bool fatDrive::AllocationInfo(Bit16u *_bytes_sector, Bit8u *_sectors_cluster, Bit16u *_total_clusters, Bit16u *_free_clusters) {
 	Bit32u hs, cy, sect,sectsize;
-	Bit32u countFree = 0;
-	Bit32u i;
+	Bit32u countFree = freeCount;
 	
 	loadedDisk->Get_Geometry(&hs, &cy, &sect, &sectsize);
 	*_bytes_sector = (Bit16u)sectsize;
@@ -821,7 +1022,6 @@ bool fatDrive::AllocationInfo(Bit16u *_bytes_sector, Bit8u *_sectors_cluster, Bi
 		// maybe some special handling needed for fat32
 		*_total_clusters = 65535;
 	}
-	for(i=0;i<CountOfClusters;i++) if(!getClusterValue(i+2)) countFree++;
 	if (countFree<65536) *_free_clusters = (Bit16u)countFree;
 	else {
 		// maybe some special handling needed for fat32
@@ -832,9 +1032,15 @@ bool fatDrive::AllocationInfo(Bit16u *_bytes_sector, Bit8u *_sectors_cluster, Bi
 }
 
 Bit32u fatDrive::getFirstFreeClust(void) {
-	Bit32u i;
-	for(i=0;i<CountOfClusters;i++) {
-		if(!getClusterValue(i+2)) return (i+2);
+	for(;freeHint<freeMap.size();freeHint++) {
+		Bit32u word = freeMap[freeHint];
+		if (!word) continue;
+		Bit32u bit = 0;
+		while (!(word & 1)) {
+			word >>= 1;
+			bit++;
+		}
+		return (freeHint << 5) + bit + 2;
 	}
 
 	/* No free cluster found */
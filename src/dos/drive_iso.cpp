@@ -22,6 +22,7 @@
 #include "cdrom.h"
 #include "dosbox.h"
 #include "dos_system.h"
+#include "dos_inc.h"
 #include "support.h"
 #include "drives.h"
 
@@ -41,8 +42,6 @@ public:
 	Bit32u GetSeekPos(void);
 private:
 	isoDrive *drive;
-	Bit8u buffer[ISO_FRAMESIZE];
-	int cachedSector;
 	Bit32u fileBegin;
 	Bit32u filePos;
 	Bit32u fileEnd;
@@ -57,7 +56,6 @@ isoFile::isoFile(isoDrive *drive, const char *name, FileStat_Block *stat, Bit32u
 	fileBegin = offset;
 	filePos = fileBegin;
 	fileEnd = fileBegin + stat->size;
-	cachedSector = -1;
 	open = true;
 	this->name = NULL;
 	SetName(name);
@@ -68,35 +66,20 @@ bool isoFile::Read(Bit8u *data, Bit16u *size) {
 		*size = (Bit16u)(fileEnd - filePos);
 	
 	Bit16u nowSize = 0;
-	int sector = filePos / ISO_FRAMESIZE;
-	Bit16u sectorPos = (Bit16u)(filePos % ISO_FRAMESIZE);
-	
-	if (sector != cachedSector) {
-		if (drive->readSector(buffer, sector)) cachedSector = sector;
-		else { *size = 0; cachedSector = -1; }
-	}
 	while (nowSize < *size) {
+		// sectors come from the sector cache of the drive, shared with directory lookups
+		Bit8u *buffer;
+		if (!drive->ReadCachedSector(&buffer, filePos / ISO_FRAMESIZE)) break;
+		Bit16u sectorPos = (Bit16u)(filePos % ISO_FRAMESIZE);
 		Bit16u remSector = ISO_FRAMESIZE - sectorPos;
 		Bit16u remSize = *size - nowSize;
-		if(remSector < remSize) {
-			memcpy(&data[nowSize], &buffer[sectorPos], remSector);
-			nowSize += remSector;
-			sectorPos = 0;
-			sector++;
-			cachedSector++;
-			if (!drive->readSector(buffer, sector)) {
-				*size = nowSize;
-				cachedSector = -1;
-			}
-		} else {
-			memcpy(&data[nowSize], &buffer[sectorPos], remSize);
-			nowSize += remSize;
-		}
-			
+		if (remSector > remSize) remSector = remSize;
+		memcpy(&data[nowSize], &buffer[sectorPos], remSector);
+		nowSize += remSector;
+		filePos += remSector;
 	}
 	
 	*size = nowSize;
-	filePos += *size;
 	return true;
 }
 
@@ -147,6 +130,9 @@ bool MSCDEX_GetVolumeName(Bit8u subUnit, char* name);
 
 bool CDROM_Interface_Image::images_init = false;
 
+int iso_sector_cache_size = 256;
+int iso_read_ahead = 32;
+
 isoDrive::isoDrive(char driveLetter, const char *fileName, Bit8u mediaid, int &error) {
 	size_t i;
 
@@ -159,7 +145,10 @@ isoDrive::isoDrive(char driveLetter, const char *fileName, Bit8u mediaid, int &e
 	subUnit = 0;
 	nextFreeDirIterator = 0;
 	memset(dirIterators, 0, sizeof(dirIterators));
-	memset(sectorHashEntries, 0, sizeof(sectorHashEntries));
+	memset(&cacheStats, 0, sizeof(cacheStats));
+	sectorCache.resize(iso_sector_cache_size > 16 ? iso_sector_cache_size : 16);
+	sectorCacheData.resize(sectorCache.size() * ISO_FRAMESIZE);
+	FlushSectorCache();
 	memset(&rootEntry, 0, sizeof(isoDirEntry));
 	
 	safe_strncpy(this->fileName, fileName, CROSS_LEN);
@@ -209,6 +198,7 @@ int isoDrive::UpdateMscdex(char driveLetter, const char* path, Bit8u& subUnit) {
 
 void isoDrive::Activate(void) {
 	UpdateMscdex(driveLetter, fileName, subUnit);
+	FlushSectorCache();
 }
 
 bool isoDrive::FileOpen(DOS_File **file, const char *name, Bit32u flags) {
@@ -456,24 +446,98 @@ void isoDrive::FreeDirIterator(const int dirIterator) {
 	}
 }
 
+void isoDrive::FlushSectorCache(void) {
+	sectorCacheIndex.clear();
+	int count = (int)sectorCache.size();
+	for (int i = 0; i < count; i++) {
+		sectorCache[i].valid = false;
+		sectorCache[i].prev = i - 1;
+		sectorCache[i].next = (i + 1 < count) ? i + 1 : -1;
+	}
+	sectorCacheFirst = 0;
+	sectorCacheLast = count - 1;
+	nextSequentialSector = 0xffffffff;
+	readAheadSectors = 0;
+}
+
+// move an entry to the front of the LRU list
+void isoDrive::UseSectorCacheEntry(int entry) {
+	SectorCacheEntry& ce = sectorCache[entry];
+	if (entry == sectorCacheFirst) return;
+	sectorCache[ce.prev].next = ce.next;
+	if (ce.next >= 0) sectorCache[ce.next].prev = ce.prev;
+	else sectorCacheLast = ce.prev;
+	ce.prev = -1;
+	ce.next = sectorCacheFirst;
+	sectorCache[sectorCacheFirst].prev = entry;
+	sectorCacheFirst = entry;
+}
+
 bool isoDrive::ReadCachedSector(Bit8u** buffer, const Bit32u sector) {
-	// get hash table entry
-	int pos = sector % ISO_MAX_HASH_TABLE_SIZE;
-	SectorHashEntry& he = sectorHashEntries[pos];
-	
-	// check if the entry is valid and contains the correct sector
-	if (!he.valid || he.sector != sector) {
-		if (!CDROM_Interface_Image::images[subUnit]->ReadSector(he.data, false, sector)) {
-			return false;
+	std::map<Bit32u,int>::iterator it = sectorCacheIndex.find(sector);
+	if (it != sectorCacheIndex.end()) {
+		cacheStats.hits++;
+		UseSectorCacheEntry(it->second);
+		*buffer = &sectorCacheData[it->second * ISO_FRAMESIZE];
+		return true;
+	}
+	cacheStats.misses++;
+
+	// a miss right behind the last read reads ahead, twice as far each time
+	Bitu count = 1;
+	if (sector == nextSequentialSector && iso_read_ahead > 0) {
+		readAheadSectors = readAheadSectors ? readAheadSectors * 2 : 4;
+		if (readAheadSectors > (Bitu)iso_read_ahead) readAheadSectors = (Bitu)iso_read_ahead;
+		if (readAheadSectors > sectorCache.size() / 2) readAheadSectors = sectorCache.size() / 2;
+		count += readAheadSectors;
+	} else readAheadSectors = 0;
+	for (Bitu i = 1; i < count; i++) {
+		if (sectorCacheIndex.find(sector + (Bit32u)i) != sectorCacheIndex.end()) {
+			count = i;
+			break;
 		}
-		he.valid = true;
-		he.sector = sector;
+	}
+
+	readAheadBuffer.resize(count * ISO_FRAMESIZE);
+	CDROM_Interface_Image* cdrom = CDROM_Interface_Image::images[subUnit];
+	if (!cdrom->ReadSectorsHost(&readAheadBuffer[0], false, sector, count)) {
+		// the read ahead may run past the end of the track
+		count = 1;
+		if (!cdrom->ReadSectorsHost(&readAheadBuffer[0], false, sector, 1)) return false;
+	}
+	cacheStats.readAhead += count - 1;
+	nextSequentialSector = sector + (Bit32u)count;
+
+	// the sector asked for is added last so it is the most recently used
+	for (Bitu i = count; i-- > 0;) {
+		int entry = sectorCacheLast;
+		SectorCacheEntry& ce = sectorCache[entry];
+		if (ce.valid) sectorCacheIndex.erase(ce.sector);
+		ce.valid = true;
+		ce.sector = sector + (Bit32u)i;
+		sectorCacheIndex[ce.sector] = entry;
+		memcpy(&sectorCacheData[entry * ISO_FRAMESIZE], &readAheadBuffer[i * ISO_FRAMESIZE], ISO_FRAMESIZE);
+		UseSectorCacheEntry(entry);
 	}
 	
-	*buffer = he.data;
+	*buffer = &sectorCacheData[sectorCacheFirst * ISO_FRAMESIZE];
 	return true;
 }
 
+#if C_DEBUG
+/* Show the sector cache counters of the mounted CD images in the debugger */
+void DOS_LogIsoSectorCache(void) {
+	DEBUG_ShowMsg("Drive  Sectors        Hits      Misses  Read ahead\n");
+	for (int i = 0; i < DOS_DRIVES; i++) {
+		if (!Drives[i] || strncmp(Drives[i]->GetInfo(), "isoDrive ", 9)) continue;
+		isoDrive* drive = static_cast<isoDrive*>(Drives[i]);
+		DEBUG_ShowMsg("%c:   %8u %11llu %11llu %11llu\n", 'A' + i, (unsigned int)drive->SectorCacheSize(),
+			(unsigned long long)drive->cacheStats.hits, (unsigned long long)drive->cacheStats.misses,
+			(unsigned long long)drive->cacheStats.readAhead);
+	}
+}
+#endif
+
 inline bool isoDrive :: readSector(Bit8u *buffer, Bit32u sector) {
 	return CDROM_Interface_Image::images[subUnit]->ReadSector(buffer, false, sector);
 }
@@ -572,6 +636,7 @@ bool isoDrive :: lookup(isoDirEntry *de, const char *path) {
 void IDE_ATAPI_MediaChangeNotify(unsigned char drive_index);
 
 void isoDrive :: MediaChange() {
+	FlushSectorCache();
 	IDE_ATAPI_MediaChangeNotify(toupper(driveLetter) - 'A'); /* ewwww */
 }
 
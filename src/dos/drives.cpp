@@ -235,6 +235,12 @@ int DriveManager::UnmountDrive(int drive) {
 
 bool drivemanager_init = false;
 bool int13_extensions_enable = true;
+extern int iso_sector_cache_size;
+extern int iso_read_ahead;
+extern std::string dirindex_file;
+extern bool dirindex_watch;
+
+void DOS_SaveDirectoryIndex(void);
 
 void DriveManager::Init(Section* s) {
 	Section_prop * section=static_cast<Section_prop *>(s);
@@ -242,6 +248,11 @@ void DriveManager::Init(Section* s) {
 	drivemanager_init = true;
 
 	int13_extensions_enable = section->Get_bool("int 13 extensions");
+	iso_sector_cache_size = section->Get_int("iso sector cache");
+	iso_read_ahead = section->Get_int("iso read ahead");
+	Prop_path* pp = section->Get_path("directory index");
+	dirindex_file = (pp && !pp->realpath.empty()) ? pp->realpath : "";
+	dirindex_watch = section->Get_bool("watch host directories");
 	
 	// setup driveInfos structure
 	currentDrive = 0;
@@ -260,9 +271,15 @@ void DRIVES_Startup(Section *s) {
 	}
 }
 
+static void DRIVES_ShutDown(Section* /*sec*/) {
+	DOS_SaveDirectoryIndex();
+}
+
 void DRIVES_Init() {
 	LOG(LOG_MISC,LOG_DEBUG)("Initializing OOS drives");
 
+	AddExitFunction(AddExitFunctionFuncPair(DRIVES_ShutDown));
+
 	// TODO: DOS kernel exit, reset, guest booting handler
 }
 
@@ -20,6 +20,7 @@
 #ifndef _DRIVES_H__
 #define _DRIVES_H__
 
+#include <map>
 #include <vector>
 #include <sys/types.h>
 #include "dos_system.h"
@@ -190,7 +191,7 @@ struct partTable {
 class imageDisk;
 class fatDrive : public DOS_Drive {
 public:
-	fatDrive(const char * sysFilename, Bit32u bytesector, Bit32u cylsector, Bit32u headscyl, Bit32u cylinders, Bit32u startSector);
+	fatDrive(const char * sysFilename, Bit32u bytesector, Bit32u cylsector, Bit32u headscyl, Bit32u cylinders, Bit32u startSector, const char * cowFilename = NULL);
 	virtual ~fatDrive();
 	virtual bool FileOpen(DOS_File * * file,const char * name,Bit32u flags);
 	virtual bool FileCreate(DOS_File * * file,const char * name,Bit16u attributes);
@@ -217,11 +218,18 @@ public:
 	Bit32u appendCluster(Bit32u startCluster);
 	void deleteClustChain(Bit32u startCluster);
 	Bit32u getFirstFreeClust(void);
+	Bit32u getNextCluster(Bit32u clustNum);
+	void flushFat(void);
+	static void flushAll(void);
+	static void beforeDiskIO(imageDisk *disk);
+	static void afterDiskWrite(imageDisk *disk, Bit32u sectnum, Bit32u count);
 	bool directoryBrowse(Bit32u dirClustNumber, direntry *useEntry, Bit32s entNum, Bit32s start=0);
 	bool directoryChange(Bit32u dirClustNumber, direntry *useEntry, Bit32s entNum);
 	imageDisk *loadedDisk;
 	bool created_successfully;
+	Bit32u chainEpoch;		/* Changes when a cluster chain is freed */
 private:
+	friend class fatFile;
 	Bit32u getClusterValue(Bit32u clustNum);
 	void setClusterValue(Bit32u clustNum, Bit32u clustValue);
 	Bit32u getClustFirstSect(Bit32u clustNum);
@@ -254,8 +262,16 @@ private:
 	Bit32u cwdDirCluster;
 	Bit32u dirPosition; /* Position in directory search */
 
-	Bit8u fatSectBuffer[1024];
-	Bit32u curFatSect;
+	/* The FAT is kept in memory, changed sectors are written to all copies on a flush */
+	std::vector<Bit8u> fatCache;
+	std::vector<bool> fatDirty;
+	bool fatDirtyAny;
+	/* Bit per cluster that is set while the cluster is free */
+	std::vector<Bit32u> freeMap;
+	Bit32u freeCount;
+	Bit32u freeHint;		/* No free cluster in the words below this one */
+	void loadFat(void);
+	void setClusterFree(Bit32u clustNum, bool isFree);
 };
 
 
@@ -375,7 +391,6 @@ struct isoDirEntry {
 #define IS_ASSOC(fileFlags)	(fileFlags & ISO_ASSOCIATED)
 #define IS_DIR(fileFlags)	(fileFlags & ISO_DIRECTORY)
 #define IS_HIDDEN(fileFlags)	(fileFlags & ISO_HIDDEN)
-#define ISO_MAX_HASH_TABLE_SIZE 	100
 
 class isoDrive : public DOS_Drive {
 public:
@@ -401,8 +416,16 @@ public:
 	virtual bool isRemovable(void);
 	virtual Bits UnMount(void);
 	bool readSector(Bit8u *buffer, Bit32u sector);
+	bool ReadCachedSector(Bit8u** buffer, const Bit32u sector);
 	virtual char const* GetLabel(void) {return discLabel;};
 	virtual void Activate(void);
+
+	struct SectorCacheStats {
+		Bit64u hits;
+		Bit64u misses;
+		Bit64u readAhead;			// Sectors read before they were asked for
+	} cacheStats;
+	Bitu SectorCacheSize(void) const { return sectorCache.size(); }
 private:
 	int  readDirEntry(isoDirEntry *de, Bit8u *data);
 	bool loadImage();
@@ -412,7 +435,8 @@ private:
 	int  GetDirIterator(const isoDirEntry* de);
 	bool GetNextDirEntry(const int dirIterator, isoDirEntry* de);
 	void FreeDirIterator(const int dirIterator);
-	bool ReadCachedSector(Bit8u** buffer, const Bit32u sector);
+	void FlushSectorCache(void);
+	void UseSectorCacheEntry(int entry);
 	
 	struct DirIterator {
 		bool valid;
@@ -424,11 +448,19 @@ private:
 	
 	int nextFreeDirIterator;
 	
-	struct SectorHashEntry {
-		bool valid;
+	/* Sectors of files and directories, least recently used ones are replaced */
+	struct SectorCacheEntry {
 		Bit32u sector;
-		Bit8u data[ISO_FRAMESIZE];
-	} sectorHashEntries[ISO_MAX_HASH_TABLE_SIZE];
+		bool valid;
+		int prev,next;				// Most recently used first
+	};
+	std::vector<SectorCacheEntry> sectorCache;
+	std::vector<Bit8u> sectorCacheData;
+	std::map<Bit32u,int> sectorCacheIndex;
+	int sectorCacheFirst,sectorCacheLast;
+	Bit32u nextSequentialSector;	// Sector after the last one read from the image
+	Bitu readAheadSectors;			// Grows while the reads stay sequential
+	std::vector<Bit8u> readAheadBuffer;
 
 	bool iso;
 	bool dataCD;
@@ -182,6 +182,7 @@ bool				ignore_opcode_63 = true;
 bool				mainline_compatible_mapping = true;
 bool				mainline_compatible_bios_mapping = true;
 int				dynamic_core_cache_block_size = 32;
+int				dynamic_core_hot_threshold = 4096;
 Bitu				VGA_BIOS_Size_override = 0;
 Bitu				VGA_BIOS_SEG = 0xC000;
 Bitu				VGA_BIOS_SEG_END = 0xC800;
@@ -843,6 +844,7 @@ void DOSBOX_SetupConfigSections(void) {
 	const char* cyclest[] = { "auto","fixed","max","%u",0 };
 	const char* mputypes[] = { "intelligent", "uart", "none", 0 };
 	const char* vsyncmode[] = { "off", "on" ,"force", "host", 0 };
+	const char* writetracking[] = { "auto", "full", "off", 0 };
 	const char* captureformats[] = { "default", "avi-zmbv", "mpegts-h264", 0 };
 	const char* blocksizes[] = {"1024", "2048", "4096", "8192", "512", "256", 0};
     const char* capturechromaformats[] = { "auto", "4:4:4", "4:2:2", "4:2:0", 0};
@@ -905,8 +907,11 @@ void DOSBOX_SetupConfigSections(void) {
 		0 };
 
 	const char* cores[] = { "auto",
-#if (C_DYNAMIC_X86)
+#if (C_DYNAMIC_X86) || (C_DYNREC)
 		"dynamic",
+#endif
+#if (C_DYNREC)
+		"dynamic_rec",
 #endif
 		"normal", "full", "simple", 0 };
 
@@ -1349,6 +1354,13 @@ void DOSBOX_SetupConfigSections(void) {
 	Pbool->Set_help("This setting affects the VGA Line Compare register. Set to false (default value) to emulate most VGA behavior\n"
 			"Set to true for the value to latch once at the start of the frame.");
 
+	Pstring = secprop->Add_string("vga write tracking",Property::Changeable::OnlyAtStart,"auto");
+	Pstring->Set_values(writetracking);
+	Pstring->Set_help("Keep track of which parts of video memory the guest writes to, lines that were not written to since the last frame are not drawn again.\n"
+			"auto: Track the writes that go through the emulated VGA memory logic anyway. Direct mapped modes, and every mode once the linear framebuffer is written to, are drawn every frame.\n"
+			"full: Also trap writes to direct mapped modes and the linear framebuffer. Static SVGA screens get cheaper, writes to video memory slower.\n"
+			"off: Draw every line every frame.");
+
 	Pbool = secprop->Add_bool("ignore vblank wraparound",Property::Changeable::Always,false);
 	Pbool->Set_help("DOSBox-X can handle active display properly if games or demos reprogram vertical blanking to end in the active picture area.\n"
 			"If the wraparound handling prevents the game from displaying properly, set this to false. Out of bounds vblank values will be ignored.\n");
@@ -1380,6 +1392,22 @@ void DOSBOX_SetupConfigSections(void) {
 	Pbool = secprop->Add_bool("char9",Property::Changeable::Always,true);
 	Pbool->Set_help("Allow 9-pixel wide text mode fonts.");
 
+	Pbool = secprop->Add_bool("scaler thread",Property::Changeable::Always,false);
+	Pbool->Set_help("Run the scaler on its own thread. The emulated video card hands over each line and goes\n"
+			"on while the line is scaled, the frame is shown once all its lines are done.");
+
+	Pint = secprop->Add_int("scaler bands",Property::Changeable::Always,0);
+	Pint->SetMinMax(0,16);
+	Pint->Set_help("Scale each frame in this many horizontal bands at the same time, one thread per band.\n"
+			"The changed lines of a frame are collected and scaled once the frame is complete, bands\n"
+			"without changes are skipped. Helps the expensive scalers like hq3x at high resolutions.\n"
+			"0 scales line by line while the frame is drawn. Takes precedence over scaler thread.");
+
+	Pbool = secprop->Add_bool("frame queue",Property::Changeable::Always,false);
+	Pbool->Set_help("Scale into frames of its own and hand finished frames over to the output without locking.\n"
+			"The output shows the newest one whenever it gets to it and counts the frames it skipped,\n"
+			"only the changed lines are copied to the output. Doesn't apply to 8 bit output.");
+
 	/* NTS: In the original code borrowed from yhkong, this was named "multiscan". All it really does is disable
 	 *      the doublescan down-rezzing DOSBox normally does with 320x240 graphics so that you get the full rendition of what a VGA output would emit. */
 	Pbool = secprop->Add_bool("doublescan",Property::Changeable::Always,true);
@@ -1417,6 +1445,7 @@ void DOSBOX_SetupConfigSections(void) {
 	Pstring = secprop->Add_string("core",Property::Changeable::WhenIdle,"auto");
 	Pstring->Set_values(cores);
 	Pstring->Set_help("CPU Core used in emulation. auto will switch to dynamic if available and appropriate.\n"
+			"dynamic_rec selects the portable recompiling core.\n"
 			"WARNING: Do not use dynamic or auto setting core with Windows 95 or other preemptive\n"
 			"multitasking OSes with protected mode paging, you should use the normal core instead.");
 
@@ -1472,6 +1501,20 @@ void DOSBOX_SetupConfigSections(void) {
 			"also causes problems with 32-bit protected mode DOS games and reduces the performance\n"
 			"of the dynamic core.\n");
 
+	Pint = secprop->Add_int("dynamic core hot threshold",Property::Changeable::Always,4096);
+	Pint->SetMinMax(0,0x7fffffff);
+	Pint->Set_help("number of executions after which a block of the dynamic core is translated again\n"
+			"with the segment bases it uses taken as constants and without restoring flags that are\n"
+			"overwritten before they are read. Executions reached through linked blocks count too.\n"
+			"0 disables retranslation.\n"
+			"The execution counts can be listed with the DYNHOT debugger command.");
+
+	Pstring = secprop->Add_string("dynamic core tier hint cache",Property::Changeable::OnlyAtStart,"");
+	Pstring->Set_help("file that keeps which blocks of the dynamic core became hot, keyed by the contents of the\n"
+			"code pages. No translated code is kept, every block is still translated on its first run.\n"
+			"If set, blocks that were hot in an earlier run get their hot translation on their next run\n"
+			"instead of after the hot threshold. Empty disables it.");
+
 	Pstring = secprop->Add_string("cputype",Property::Changeable::Always,"auto");
 	Pstring->Set_values(cputype_values);
 	Pstring->Set_help("CPU Type used in emulation. auto emulates a 486 which tolerates Pentium instructions.");
@@ -1508,6 +1551,12 @@ void DOSBOX_SetupConfigSections(void) {
 			"MS-DOS and Windows 3.1 exception handlers. For preemptive multitasking OSes like Windows 95, set this option to true.\n"
 			"This option is not compatible with the dynamic core.");
 
+	Pbool = secprop->Add_bool("idle skip",Property::Changeable::Always,false);
+	Pbool->Set_help("When the guest waits for a key in the BIOS or releases its time slice (INT 2Fh AX=1680h),\n"
+			"skip ahead to the next timer or interrupt event like HLT does instead of running out the\n"
+			"remaining cycles, so the host can sleep while the guest is idle. Leave it off for runs\n"
+			"that must execute every cycle to be reproducible.");
+
 	Pbool = secprop->Add_bool("ignore opcode 63",Property::Changeable::Always,true);
 	Pbool->Set_help("When debugging, do not report illegal opcode 0x63.\n"
 			"Enable this option to ignore spurious errors while debugging from within Windows 3.1/9x/ME");
@@ -1663,6 +1712,18 @@ void DOSBOX_SetupConfigSections(void) {
 
 	secprop=control->AddSection_prop("debug",&Null_Init);
 
+	Pbool = secprop->Add_bool("profiler",Property::Changeable::OnlyAtStart,false);
+	Pbool->Set_help("Sample the guest CS:EIP on every timer tick. The samples are written to the capture folder\n"
+			"in the folded stack format of flamegraph.pl at exit or with the \"profdump\" mapper event.");
+
+	Pint = secprop->Add_int("profiler samples",Property::Changeable::OnlyAtStart,65536);
+	Pint->SetMinMax(1,16*1024*1024);
+	Pint->Set_help("Number of samples the profiler keeps, older samples are overwritten.");
+
+	Pstring = secprop->Add_path("profiler map",Property::Changeable::OnlyAtStart,"");
+	Pstring->Set_help("Linker MAP file to name the sampled addresses with. In real mode its segments are taken as\n"
+			"relative to the load segment of the running program, in protected mode offsets as flat addresses.");
+
 	secprop=control->AddSection_prop("sblaster",&Null_Init,true);//done
 	
 	Pstring = secprop->Add_string("sbtype",Property::Changeable::WhenIdle,"sb16");
@@ -1784,6 +1845,10 @@ void DOSBOX_SetupConfigSections(void) {
 	Pint->Set_values(oplrates);
 	Pint->Set_help("Sample rate of OPL music emulation. Use 49716 for highest quality (set the mixer rate accordingly).");
 
+	Pbool = secprop->Add_bool("oplthread",Property::Changeable::WhenIdle,false);
+	Pbool->Set_help("Generate the OPL music on its own thread. The music is the same, but reaches the mixer one\n"
+			"millisecond later.");
+
 	Phex = secprop->Add_hex("hardwarebase",Property::Changeable::WhenIdle,0x220);
 	Phex->Set_help("base address of the real hardware soundblaster:\n"\
 		"210,220,230,240,250,260,280");
@@ -2280,6 +2345,26 @@ void DOSBOX_SetupConfigSections(void) {
 	Pbool = secprop->Add_bool("int 13 extensions",Property::Changeable::WhenIdle,true);
 	Pbool->Set_help("Enable INT 13h extensions (functions 0x40-0x48). You will need this enabled if the virtual hard drive image is 8.4GB or larger.");
 
+	Pint = secprop->Add_int("iso sector cache",Property::Changeable::WhenIdle,256);
+	Pint->SetMinMax(16,65536);
+	Pint->Set_help("Number of 2048 byte sectors each mounted CD image keeps in memory for file reads and\n"
+			"directory lookups. The least recently used sectors are replaced. The ISOCACHE debugger\n"
+			"command shows how often the cache was hit.");
+
+	Pint = secprop->Add_int("iso read ahead",Property::Changeable::WhenIdle,32);
+	Pint->SetMinMax(0,1024);
+	Pint->Set_help("Largest number of sectors read ahead from a CD image when it is read sequentially. The\n"
+			"read ahead starts small and doubles while the reads stay sequential. 0 disables read ahead.");
+
+	Pstring = secprop->Add_path("directory index",Property::Changeable::OnlyAtStart,"");
+	Pstring->Set_help("File to keep the directory listings of large host directories in, with the 8.3 names made\n"
+			"up for them. The next session takes a directory from it as long as the directory was not changed\n"
+			"on the host, instead of reading it again. Empty to not keep an index.");
+
+	Pbool = secprop->Add_bool("watch host directories",Property::Changeable::OnlyAtStart,true);
+	Pbool->Set_help("Notice files that are added or removed in mounted host directories while DOSBox-X runs,\n"
+			"so they show up without a RESCAN. Only available on Linux.");
+
 	Pbool = secprop->Add_bool("biosps2",Property::Changeable::OnlyAtStart,true);
 	Pbool->Set_help("Emulate BIOS INT 15h PS/2 mouse services\n"
 		"Note that some OS's like Microsoft Windows neither use INT 33h nor\n"
@@ -20,6 +20,7 @@
 #include <sys/types.h>
 #include <assert.h>
 #include <math.h>
+#include <vector>
 
 #include "dosbox.h"
 #include "video.h"
@@ -30,6 +31,7 @@
 #include "cross.h"
 #include "hardware.h"
 #include "support.h"
+#include "lockfree_ring.h"
 
 #include "render_scalers.h"
 #if defined(__SSE__)
@@ -39,9 +41,355 @@
 
 Render_t render;
 ScalerLineHandler_t RENDER_DrawLine;
+static ScalerLineHandler_t render_line;		//Current step of the scaling chain
+
+/* Scaling on its own thread: RENDER_DrawLine copies the lines into a ring and
+   the thread runs them through the scaling chain. Everything the chain uses
+   belongs to the thread until the ring is drained again, which happens at the
+   end of a frame and before anything about the output changes. */
+#define RENDER_RING_LINES 64
+
+struct RenderLine {
+	bool empty;
+	Bit8u data[SCALER_MAXWIDTH*4];
+};
+
+static struct {
+	bool enabled;
+	bool wanted;					//Setting, applied at the start of a frame
+	SDL_Thread * thread;
+	std::atomic<bool> stop;
+	LockFreeRing<RenderLine,RENDER_RING_LINES> lines;
+	RingSignal work;				//Thread waits for lines
+	RingSignal progress;			//Emulation waits for room or a drained ring
+	Bitu queued;
+	std::atomic<Bitu> done;
+} render_thread;
 
 void RENDER_CallBack( GFX_CallBackFunctions_t function );
 
+/* Next step of the chain from inside the chain, can be on the scaling thread */
+static INLINE void RENDER_SetChain(ScalerLineHandler_t handler) {
+	render_line = handler;
+	if (!render_thread.enabled) RENDER_DrawLine = handler;
+}
+
+static void RENDER_EmptyLineHandler(const void * src);
+
+static void RENDER_QueueLine(const void * s) {
+	RenderLine * line;
+	while (!(line = render_thread.lines.WriteSlot())) {
+		render_thread.progress.Prepare();
+		if (render_thread.lines.WriteSlot()) render_thread.progress.Cancel();
+		else render_thread.progress.Wait();
+	}
+	line->empty = (s == NULL);
+	if (s) memcpy(line->data,s,render.scale.cachePitch);
+	render_thread.lines.Push();
+	render_thread.queued++;
+	render_thread.work.Notify();
+}
+
+static int RENDER_ThreadProc(void *) {
+	for (;;) {
+		RenderLine * line = render_thread.lines.ReadSlot();
+		if (!line) {
+			if (render_thread.stop.load()) break;
+			render_thread.work.Prepare();
+			if (render_thread.lines.ReadSlot() || render_thread.stop.load()) render_thread.work.Cancel();
+			else render_thread.work.Wait();
+			continue;
+		}
+		render_line(line->empty ? NULL : line->data);
+		render_thread.lines.Pop();
+		render_thread.done.store(render_thread.done.load()+1);
+		render_thread.progress.Notify();
+	}
+	return 0;
+}
+
+/* Wait until the scaling thread has handled all queued lines */
+static void RENDER_ThreadDrain(void) {
+	if (!render_thread.enabled) return;
+	while (render_thread.done.load() != render_thread.queued) {
+		render_thread.progress.Prepare();
+		if (render_thread.done.load() == render_thread.queued) render_thread.progress.Cancel();
+		else render_thread.progress.Wait();
+	}
+}
+
+static void RENDER_ThreadStop(void) {
+	if (!render_thread.enabled) return;
+	RENDER_ThreadDrain();
+	render_thread.stop.store(true);
+	render_thread.work.Notify();
+	SDL_WaitThread(render_thread.thread, NULL);
+	render_thread.thread = NULL;
+	render_thread.enabled = false;
+	RENDER_DrawLine = render_line;
+}
+
+static void RENDER_ThreadApply(void) {
+	if (render_thread.wanted == render_thread.enabled) return;
+	if (!render_thread.wanted) {
+		RENDER_ThreadStop();
+		return;
+	}
+	render_thread.work.Open();
+	render_thread.progress.Open();
+	render_thread.lines.Reset();
+	render_thread.queued = 0;
+	render_thread.done.store(0);
+	render_thread.stop.store(false);
+	render_thread.thread = SDL_CreateThread(RENDER_ThreadProc, NULL);
+	if (!render_thread.thread) {
+		LOG_MSG("RENDER:Can't start the scaler thread");
+		render_thread.wanted = false;
+		return;
+	}
+	render_thread.enabled = true;
+}
+
+/* Frame queue: the scalers draw into one of three frames that belong to
+   RENDER instead of into the output. A finished frame is published without
+   locking, the output takes the newest one whenever it gets to it and counts
+   the ones it never saw. Each frame carries the frame number every line last
+   changed in, so the output copies the lines that changed since the frame it
+   showed last, those of skipped frames included. */
+#define RENDER_QUEUE_FRAMES 3
+
+struct RenderFrame {
+	std::vector<Bit8u> data;
+	std::vector<Bitu> lineSerial;	//Number of the frame each line last changed in
+	Bitu serial;					//Number of the frame it holds
+};
+
+static struct {
+	bool enabled;
+	bool wanted;					//Setting, applied at the start of a frame
+	bool applied;
+	RenderFrame frame[RENDER_QUEUE_FRAMES];
+	LockFreeTriple buffers;
+	Bitu width, height, lineBytes, pitch;
+	/* Scaler side */
+	bool writing;
+	Bitu latest;					//Frame published last
+	Bitu serial;
+	std::vector<Bitu> lineSerial;
+	std::vector<Bit8u> drawn;		//Lines drawn into the back frame since it was published
+	/* Output side */
+	Bitu shownSerial;				//0 when the output has to be drawn again
+	bool retry;						//The front frame couldn't be shown yet
+	std::vector<Bit16u> changed;
+	Bitu shown, skipped;
+} render_queue;
+
+/* Outside of frames only, a frame that wasn't shown yet is thrown away */
+static void RENDER_QueueSetup(void) {
+	render_queue.enabled = render_queue.wanted && render.scale.outMode != scalerMode8 &&
+		!render.headless && render_queue.width && render_queue.height;
+	render_queue.buffers.Reset();
+	render_queue.writing = false;
+	render_queue.latest = render_queue.buffers.Front();
+	render_queue.serial = 0;
+	render_queue.shownSerial = 0;
+	render_queue.retry = false;
+	Bitu lines = render_queue.enabled ? render_queue.height : 0;
+	render_queue.pitch = (render_queue.lineBytes + 15) & ~15;
+	for (Bitu i=0;i<RENDER_QUEUE_FRAMES;i++) {
+		RenderFrame & frame = render_queue.frame[i];
+		frame.data.assign(lines * render_queue.pitch, 0);
+		frame.lineSerial.assign(lines, 0);
+		frame.serial = 0;
+	}
+	render_queue.lineSerial.assign(lines, 0);
+	render_queue.drawn.assign(lines, 0);
+	render_queue.changed.resize(lines + 2);
+}
+
+static bool RENDER_OutputStart(Bit8u * & pixels, Bitu & pitch) {
+	if (!render_queue.enabled) return GFX_StartUpdate(pixels, pitch);
+	RenderFrame & back = render_queue.frame[render_queue.buffers.Back()];
+	if (!render_queue.writing) {
+		/* Catch up with the lines that changed since this frame was drawn,
+		   the output only reads the frame published last */
+		const RenderFrame & latest = render_queue.frame[render_queue.latest];
+		for (Bitu y=0;y<render_queue.height;y++) {
+			if (render_queue.lineSerial[y] > back.serial)
+				memcpy(&back.data[y * render_queue.pitch], &latest.data[y * render_queue.pitch], render_queue.lineBytes);
+		}
+		back.serial = render_queue.serial;
+		render_queue.writing = true;
+	}
+	pixels = &back.data[0];
+	pitch = render_queue.pitch;
+	return true;
+}
+
+static void RENDER_QueueApply(void) {
+	if (render_queue.wanted == render_queue.applied) return;
+	render_queue.applied = render_queue.wanted;
+	RENDER_QueueSetup();
+	render.scale.clearCache = true;
+}
+
+static void RENDER_OutputEnd(const Bit16u * changedLines, Bitu changedIndex, bool abort) {
+	if (!render_queue.enabled) {
+		GFX_EndUpdate(abort ? NULL : changedLines);
+		return;
+	}
+	for (Bitu y=0, index=0;index<=changedIndex && y<render_queue.height;index++) {
+		Bitu count = changedLines[index];
+		if (count > render_queue.height - y) count = render_queue.height - y;
+		if (index & 1) memset(&render_queue.drawn[y], 1, count);
+		y += count;
+	}
+	/* What was drawn stays in the frame, it goes out with the next one */
+	if (abort) return;
+	render_queue.serial++;
+	for (Bitu y=0;y<render_queue.height;y++) {
+		if (render_queue.drawn[y]) render_queue.lineSerial[y] = render_queue.serial;
+	}
+	render_queue.drawn.assign(render_queue.height, 0);
+	Bitu b = render_queue.buffers.Back();
+	RenderFrame & back = render_queue.frame[b];
+	back.lineSerial = render_queue.lineSerial;
+	back.serial = render_queue.serial;
+	render_queue.latest = b;
+	render_queue.writing = false;
+	render_queue.buffers.Publish();
+}
+
+/* Output side: show the newest finished frame */
+void RENDER_PresentFrame(void) {
+	if (!render_queue.enabled) return;
+	if (!render_queue.buffers.Take() && !render_queue.retry) return;
+	const RenderFrame & front = render_queue.frame[render_queue.buffers.Front()];
+	Bit8u * pixels;
+	Bitu pitch;
+	/* The next frame still brings every line changed since the last one shown */
+	render_queue.retry = !GFX_StartUpdate(pixels, pitch);
+	if (render_queue.retry) return;
+	Bitu index = 0;
+	render_queue.changed[0] = 0;
+	for (Bitu y=0;y<render_queue.height;y++) {
+		Bitu dirty = front.lineSerial[y] > render_queue.shownSerial;
+		if (dirty) memcpy(pixels + y * pitch, &front.data[y * render_queue.pitch], render_queue.lineBytes);
+		if ((index & 1) != dirty) render_queue.changed[++index] = 0;
+		render_queue.changed[index]++;
+	}
+	GFX_EndUpdate(&render_queue.changed[0]);
+	if (front.serial > render_queue.shownSerial + 1)
+		render_queue.skipped += front.serial - render_queue.shownSerial - 1;
+	render_queue.shownSerial = front.serial;
+	render_queue.shown++;
+}
+
+/* Scaling in bands: while the frame is drawn its changed lines are only
+   collected. At the end of the frame it is cut into horizontal bands that are
+   scaled at the same time, the first one on the emulation thread and the
+   others each on a thread of their own. Bands without changes are skipped. */
+struct RenderBand {
+	ScalerLines_t lines;
+	Bitu first, last;				//Lines of the band, complex scalers start at 1
+	Bitu outLines;
+	bool changed;
+	SDL_Thread * thread;
+	SDL_sem * start;
+	Bit16u changedLines[SCALER_MAXHEIGHT];
+	scalerWriteCache_t writeCache;
+};
+
+static struct {
+	Bitu count;						//0 when frames are scaled line by line
+	Bitu wanted;					//Setting, applied at the start of a frame
+	RenderBand * band;
+	SDL_sem * done;
+	bool stop;
+	bool collecting;
+	bool copyAll;					//Not only the lines that differ from the cache
+	ScalerLineHandler_t handler;
+	Bitu line;
+	std::vector<Bit8u> frame;
+	std::vector<Bit8u> changed;		//The line is in frame and has to be scaled
+} render_bands;
+
+static void RENDER_BandRun(RenderBand * band) {
+	scalerLines = &band->lines;
+	if (!band->changed) {
+		band->changedLines[0] = (Bit16u)band->outLines;
+#if RENDER_USE_ADVANCED_SCALERS>1
+	} else if (render.scale.complexHandler) {
+		while (band->lines.outLine < band->last)
+			render.scale.complexHandler();
+#endif
+	} else {
+		for (Bitu i=band->first;i<band->last;i++)
+			render_bands.handler(render_bands.changed[i] ? &render_bands.frame[i*render.scale.cachePitch] : NULL);
+	}
+}
+
+static int RENDER_BandThread(void * data) {
+	RenderBand * band = (RenderBand *)data;
+	for (;;) {
+		SDL_SemWait(band->start);
+		if (render_bands.stop) break;
+		RENDER_BandRun(band);
+		SDL_SemPost(render_bands.done);
+	}
+	return 0;
+}
+
+static void RENDER_BandsStop(void) {
+	if (!render_bands.band) return;
+	render_bands.stop = true;
+	for (Bitu b=1;b<render_bands.count;b++) {
+		SDL_SemPost(render_bands.band[b].start);
+		SDL_WaitThread(render_bands.band[b].thread, NULL);
+		SDL_DestroySemaphore(render_bands.band[b].start);
+	}
+	SDL_DestroySemaphore(render_bands.done);
+	delete[] render_bands.band;
+	render_bands.band = NULL;
+	render_bands.count = 0;
+}
+
+static void RENDER_BandsApply(void) {
+	if (render_bands.wanted == render_bands.count) return;
+	RENDER_BandsStop();
+	if (!render_bands.wanted) return;
+	render_bands.band = new RenderBand[render_bands.wanted];
+	render_bands.done = SDL_CreateSemaphore(0);
+	render_bands.stop = false;
+	Bitu count;
+	for (count=0;count<render_bands.wanted;count++) {
+		RenderBand & band = render_bands.band[count];
+		band.lines.changedLines = band.changedLines;
+		band.lines.writeCache = &band.writeCache;
+		band.thread = NULL;
+		band.start = NULL;
+		if (!count) continue;
+		band.start = SDL_CreateSemaphore(0);
+		band.thread = SDL_CreateThread(RENDER_BandThread, &band);
+		if (!band.thread) {
+			LOG_MSG("RENDER:Can't start more than %d scaler band threads",(int)count-1);
+			SDL_DestroySemaphore(band.start);
+			render_bands.wanted = count;
+			break;
+		}
+	}
+	render_bands.count = count;
+}
+
+/* Set the chain from the emulation, outside of frames nothing is queued */
+static void RENDER_SetLines(ScalerLineHandler_t handler) {
+	render_bands.collecting = false;
+	render_line = handler;
+	if (!render_thread.enabled) RENDER_DrawLine = handler;
+	else if (handler == RENDER_EmptyLineHandler) RENDER_DrawLine = RENDER_EmptyLineHandler;
+	else RENDER_DrawLine = RENDER_QueueLine;
+}
+
 static void Check_Palette(void) {
 	/* Clean up any previous changed palette data */
 	if (render.pal.changed) {
@@ -120,7 +468,7 @@ static void RENDER_EmptyLineHandler(const void * src) {
 static void RENDER_StartLineHandler(const void * s) {
 	if (s) {
 		const Bitu *src = (Bitu*)s;
-		Bitu *cache = (Bitu*)(render.scale.cacheRead);
+		Bitu *cache = (Bitu*)(scalerLines->cacheRead);
 		Bits count = render.src.start;
 #if defined(__SSE__)
 		if(sse2_available) {
@@ -145,31 +493,32 @@ static void RENDER_StartLineHandler(const void * s) {
 		}
 	}
 /* cacheHit */
-	render.scale.cacheRead += render.scale.cachePitch;
-	Scaler_ChangedLines[0] += Scaler_Aspect[ render.scale.inLine ];
-	render.scale.inLine++;
-	render.scale.outLine++;
+	scalerLines->cacheRead += render.scale.cachePitch;
+	Scaler_ChangedLines[0] += Scaler_Aspect[ scalerLines->inLine ];
+	scalerLines->inLine++;
+	scalerLines->outLine++;
 	return;
 cacheMiss:
-	if (!GFX_StartUpdate( render.scale.outWrite, render.scale.outPitch )) {
-		RENDER_DrawLine = RENDER_EmptyLineHandler;
+	/* With the scaling thread the update was already started by RENDER_StartUpdate */
+	if (!render_thread.enabled && !RENDER_OutputStart( scalerLines->outWrite, render.scale.outPitch )) {
+		RENDER_SetChain( RENDER_EmptyLineHandler );
 		return;
 	}
-	render.scale.outWrite += render.scale.outPitch * Scaler_ChangedLines[0];
-	RENDER_DrawLine = render.scale.lineHandler;
-	RENDER_DrawLine( s );
+	scalerLines->outWrite += render.scale.outPitch * Scaler_ChangedLines[0];
+	RENDER_SetChain( render.scale.lineHandler );
+	render_line( s );
 }
 
 static void RENDER_FinishLineHandler(const void * s) {
 	if (s) {
 		const Bitu *src = (Bitu*)s;
-		Bitu *cache = (Bitu*)(render.scale.cacheRead);
+		Bitu *cache = (Bitu*)(scalerLines->cacheRead);
 		for (Bits x=render.src.start;x>0;) {
 			cache[0] = src[0];
 			x--; src++; cache++;
 		}
 	}
-	render.scale.cacheRead += render.scale.cachePitch;
+	scalerLines->cacheRead += render.scale.cachePitch;
 }
 
 
@@ -177,18 +526,137 @@ static void RENDER_ClearCacheHandler(const void * src) {
 	Bitu x, width;
 	Bit32u *srcLine, *cacheLine;
 	srcLine = (Bit32u *)src;
-	cacheLine = (Bit32u *)render.scale.cacheRead;
+	cacheLine = (Bit32u *)scalerLines->cacheRead;
 	width = render.scale.cachePitch / 4;
 	for (x=0;x<width;x++)
 		cacheLine[x] = ~srcLine[x];
 	render.scale.lineHandler( src );
 }
 
+static void RENDER_BandLineHandler(const void * s) {
+	Bitu line = render_bands.line++;
+	if (!s || line >= render.scale.inHeight) return;
+	Bitu pitch = render.scale.cachePitch;
+	if (!render_bands.copyAll && !memcmp(s, (Bit8u*)&scalerSourceCache + line*pitch, pitch)) return;
+	memcpy(&render_bands.frame[line*pitch], s, pitch);
+	render_bands.changed[line] = 1;
+}
+
+/* Collect the lines of this frame, render_line is what they'll be scaled with */
+static void RENDER_BandsStart(void) {
+	Bitu lines = render.scale.inHeight;
+	render_bands.copyAll = (render_line != RENDER_StartLineHandler);
+	render_bands.handler = render_bands.copyAll ? render_line : render.scale.lineHandler;
+	if (render_bands.frame.size() < lines*render.scale.cachePitch)
+		render_bands.frame.resize(lines*render.scale.cachePitch);
+	render_bands.changed.assign(lines, 0);
+	render_bands.line = 0;
+	render_bands.collecting = true;
+	RENDER_DrawLine = RENDER_BandLineHandler;
+}
+
+static void RENDER_BandsAddLines(Bitu changed, Bitu count) {
+	if (!count) return;
+	if ((scalerMainLines.changedIndex & 1) == changed) {
+		Scaler_ChangedLines[scalerMainLines.changedIndex] += count;
+	} else {
+		Scaler_ChangedLines[++scalerMainLines.changedIndex] = count;
+	}
+}
+
+#if RENDER_USE_ADVANCED_SCALERS>1
+static void RENDER_BandsNoComplex(void) {
+}
+#endif
+
+static void RENDER_BandsFinish(bool abort) {
+	Bitu lines = render.scale.inHeight;
+	Bitu i, b;
+	for (i=0;i<lines && !render_bands.changed[i];i++) {}
+	if (i == lines) return;
+	if (abort || !RENDER_OutputStart( scalerMainLines.outWrite, render.scale.outPitch )) {
+		/* The palette change or cache clear of this frame still has to happen */
+		if (render_bands.copyAll) render.scale.clearCache = true;
+		return;
+	}
+	Bitu first = 0;
+#if RENDER_USE_ADVANCED_SCALERS>1
+	if (render.scale.complexHandler) {
+		/* Complex scalers go through the lines once to see what changed, only the
+		   scaling itself depends on the neighbouring lines and is done in bands */
+		ScalerComplexHandler_t complexHandler = render.scale.complexHandler;
+		render.scale.complexHandler = RENDER_BandsNoComplex;
+		for (i=0;i<lines;i++)
+			render_bands.handler(render_bands.changed[i] ? &render_bands.frame[i*render.scale.cachePitch] : NULL);
+		render.scale.complexHandler = complexHandler;
+		first = 1;
+	}
+#endif
+	Bitu count = render_bands.count;
+	if ((lines - first) < count * 2) count = 1;
+
+	Bitu line = first, out = 0;
+	for (b=0;b<count;b++) {
+		RenderBand * band = &render_bands.band[b];
+		band->first = line;
+		band->last = first + ((lines - first) * (b + 1)) / count;
+		band->lines.outWrite = scalerMainLines.outWrite + out * render.scale.outPitch;
+		band->lines.cacheRead = (Bit8u*)&scalerSourceCache + line * render.scale.cachePitch;
+		band->lines.inLine = line;
+		band->lines.outLine = line;
+		band->lines.changedIndex = 0;
+		band->changedLines[0] = 0;
+		band->changed = false;
+		band->outLines = 0;
+		for (;line<band->last;line++) {
+			band->outLines += Scaler_Aspect[line];
+#if RENDER_USE_ADVANCED_SCALERS>1
+			if (first) band->changed |= scalerChangeCache[line][0] != 0;
+			else
+#endif
+			band->changed |= render_bands.changed[line] != 0;
+		}
+#if RENDER_USE_ADVANCED_SCALERS>1
+		/* The last line of a complex scaler comes along with the one before it */
+		if (first && b == count - 1) {
+			band->outLines += Scaler_Aspect[lines];
+			band->changed |= scalerChangeCache[lines][0] != 0;
+		}
+#endif
+		out += band->outLines;
+	}
+
+	Bitu started = 0;
+	for (b=1;b<count;b++) {
+		if (render_bands.band[b].changed) {
+			SDL_SemPost(render_bands.band[b].start);
+			started++;
+		} else {
+			RENDER_BandRun(&render_bands.band[b]);
+		}
+	}
+	RENDER_BandRun(&render_bands.band[0]);
+	scalerLines = &scalerMainLines;
+	while (started--) SDL_SemWait(render_bands.done);
+
+	scalerMainLines.changedIndex = 0;
+	Scaler_ChangedLines[0] = 0;
+	for (b=0;b<count;b++) {
+		RenderBand * band = &render_bands.band[b];
+		for (i=0;i<=band->lines.changedIndex;i++)
+			RENDER_BandsAddLines(i & 1, band->changedLines[i]);
+	}
+}
+
 extern void GFX_SetTitle(Bit32s cycles,Bits frameskip,Bits timing,bool paused);
 
 bool RENDER_StartUpdate(void) {
 	if (GCC_UNLIKELY(render.updating))
 		return false;
+	RENDER_ThreadDrain();
+	RENDER_ThreadApply();
+	RENDER_BandsApply();
+	RENDER_QueueApply();
 	if (GCC_UNLIKELY(!render.active))
 		return false;
 	if (GCC_UNLIKELY(render.frameskip.count<render.frameskip.max)) {
@@ -199,44 +667,61 @@ bool RENDER_StartUpdate(void) {
 	if (render.scale.inMode == scalerMode8) {
 		Check_Palette();
 	}
-	render.scale.inLine = 0;
-	render.scale.outLine = 0;
-	render.scale.cacheRead = (Bit8u*)&scalerSourceCache;
-	render.scale.outWrite = 0;
+	scalerMainLines.inLine = 0;
+	scalerMainLines.outLine = 0;
+	scalerMainLines.cacheRead = (Bit8u*)&scalerSourceCache;
+	scalerMainLines.outWrite = 0;
 	render.scale.outPitch = 0;
 	Scaler_ChangedLines[0] = 0;
-	Scaler_ChangedLineIndex = 0;
+	scalerMainLines.changedIndex = 0;
+	if (render.headless) {
+		/* Without an output the frame is only drawn when it's going to be captured,
+		   the capture code takes the source lines from the cache */
+		if (!(CaptureState & (CAPTURE_IMAGE|CAPTURE_VIDEO)))
+			return false;
+		RENDER_SetLines(RENDER_FinishLineHandler);
+		render.fullFrame = true;
+		render.updating = true;
+		return true;
+	}
 	/* Clearing the cache will first process the line to make sure it's never the same */
 	if (GCC_UNLIKELY( render.scale.clearCache) ) {
 //		LOG_MSG("Clearing cache");
 		//Will always have to update the screen with this one anyway, so let's update already
-		if (GCC_UNLIKELY(!GFX_StartUpdate( render.scale.outWrite, render.scale.outPitch )))
+		if (!render_bands.count && GCC_UNLIKELY(!RENDER_OutputStart( scalerMainLines.outWrite, render.scale.outPitch )))
 			return false;
 		render.fullFrame = true;
 		render.scale.clearCache = false;
-		RENDER_DrawLine = RENDER_ClearCacheHandler;
+		RENDER_SetLines(RENDER_ClearCacheHandler);
 	} else {
 		if (render.pal.changed) {
 			/* Assume pal changes always do a full screen update anyway */
-			if (GCC_UNLIKELY(!GFX_StartUpdate( render.scale.outWrite, render.scale.outPitch )))
+			if (!render_bands.count && GCC_UNLIKELY(!RENDER_OutputStart( scalerMainLines.outWrite, render.scale.outPitch )))
 				return false;
-			RENDER_DrawLine = render.scale.linePalHandler;
+			RENDER_SetLines(render.scale.linePalHandler);
 			render.fullFrame = true;
 		} else {
-			RENDER_DrawLine = RENDER_StartLineHandler;
+			/* The scaling thread can't start the update itself once a line changed */
+			if (render_thread.enabled && GCC_UNLIKELY(!RENDER_OutputStart( scalerMainLines.outWrite, render.scale.outPitch )))
+				return false;
+			RENDER_SetLines(RENDER_StartLineHandler);
 			if (GCC_UNLIKELY(CaptureState & (CAPTURE_IMAGE|CAPTURE_VIDEO))) 
 				render.fullFrame = true;
 			else
 				render.fullFrame = false;
 		}
 	}
+	/* The update is started once it's known whether anything changed */
+	if (render_bands.count) RENDER_BandsStart();
 	render.updating = true;
 	return true;
 }
 
 static void RENDER_Halt( void ) {
-	RENDER_DrawLine = RENDER_EmptyLineHandler;
+	RENDER_ThreadDrain();
+	RENDER_SetLines(RENDER_EmptyLineHandler);
 	GFX_EndUpdate( 0 );
+	RENDER_QueueSetup();
 	render.updating=false;
 	render.active=false;
 }
@@ -248,7 +733,9 @@ void PauseDOSBox(bool pressed);
 void RENDER_EndUpdate( bool abort ) {
 	if (GCC_UNLIKELY(!render.updating))
 		return;
-	RENDER_DrawLine = RENDER_EmptyLineHandler;
+	RENDER_ThreadDrain();
+	if (render_bands.collecting) RENDER_BandsFinish(abort);
+	RENDER_SetLines(RENDER_EmptyLineHandler);
 	if (GCC_UNLIKELY(CaptureState & (CAPTURE_IMAGE|CAPTURE_VIDEO))) {
 		Bitu pitch, flags;
 		flags = 0;
@@ -263,8 +750,8 @@ void RENDER_EndUpdate( bool abort ) {
 		CAPTURE_AddImage( render.src.width, render.src.height, render.src.bpp, pitch,
 			flags, fps, (Bit8u *)&scalerSourceCache, (Bit8u*)&render.pal.rgb );
 	}
-	if ( render.scale.outWrite ) {
-		GFX_EndUpdate( abort? NULL : Scaler_ChangedLines );
+	if ( scalerMainLines.outWrite ) {
+		RENDER_OutputEnd( Scaler_ChangedLines, scalerMainLines.changedIndex, abort );
 		render.frameskip.hadSkip[render.frameskip.index] = 0;
 	} else {
 #if 0
@@ -311,6 +798,8 @@ static Bitu MakeAspectTable(Bitu skip,Bitu height,double scaley,Bitu miny) {
 
 
 static void RENDER_Reset( void ) {
+	RENDER_ThreadDrain();
+
 	Bitu width=render.src.width;
 	Bitu height=render.src.height;
 	bool dblw=render.src.dblw;
@@ -530,6 +1019,7 @@ forcenormal:
 	}
 /* Setup the scaler variables */
 	gfx_flags=GFX_SetSize(width,height,gfx_flags,gfx_scalew,gfx_scaleh,&RENDER_CallBack);
+	render.headless = (gfx_flags & GFX_HEADLESS) != 0;
 	if (gfx_flags & GFX_CAN_8)
 		render.scale.outMode = scalerMode8;
 	else if (gfx_flags & GFX_CAN_15)
@@ -540,6 +1030,10 @@ forcenormal:
 		render.scale.outMode = scalerMode32;
 	else 
 		E_Exit("Failed to create a rendering output");
+	render_queue.width = width;
+	render_queue.height = height;
+	render_queue.lineBytes = width * (render.scale.outMode == scalerMode32 ? 4 : 2);
+	RENDER_QueueSetup();
 	ScalerLineBlock_t *lineBlock;
 	if (gfx_flags & GFX_HARDWARE) {
 #if RENDER_USE_ADVANCED_SCALERS>1
@@ -607,8 +1101,8 @@ forcenormal:
 	render.pal.changed = false;
 	memset(render.pal.modified, 0, sizeof(render.pal.modified));
 	//Finish this frame using a copy only handler
-	RENDER_DrawLine = RENDER_FinishLineHandler;
-	render.scale.outWrite = 0;
+	RENDER_SetLines(RENDER_FinishLineHandler);
+	scalerMainLines.outWrite = 0;
 	/* Signal the next frame to first reinit the cache */
 	render.scale.clearCache = true;
 	render.active=true;
@@ -622,6 +1116,7 @@ void RENDER_CallBack( GFX_CallBackFunctions_t function ) {
 		render.scale.clearCache = true;
 		return;
 	} else if ( function == GFX_CallBackReset) {
+		RENDER_ThreadDrain();
 		GFX_EndUpdate( 0 );	
 		RENDER_Reset();
 	} else {
@@ -710,6 +1205,17 @@ void RENDER_SetForceUpdate(bool f) {
 	render.forceUpdate = f;
 }
 
+static void RENDER_ShutDown(Section *sec) {
+	RENDER_BandsStop();
+	RENDER_ThreadStop();
+	render_thread.work.Close();
+	render_thread.progress.Close();
+	if (render_queue.wanted)
+		LOG_MSG("RENDER:Frame queue showed %u frames, skipped %u",
+			(unsigned int)render_queue.shown,(unsigned int)render_queue.skipped);
+	render_queue.enabled = false;
+}
+
 void RENDER_Init() {
 	Section_prop * section=static_cast<Section_prop *>(control->GetSection("render"));
 
@@ -725,8 +1231,8 @@ void RENDER_Init() {
 	bool scalerforced = render.scale.forced;
 	scalerOperation_t scaleOp = render.scale.op;
 
-    render.scale.cacheRead = NULL;
-    render.scale.outWrite = NULL;
+    scalerMainLines.cacheRead = NULL;
+    scalerMainLines.outWrite = NULL;
 
 	render.pal.first=0;
 	render.pal.last=255;
@@ -786,6 +1292,9 @@ void RENDER_Init() {
 
 
 	render.autofit=section->Get_bool("autofit");
+	render_bands.wanted=section->Get_int("scaler bands");
+	render_thread.wanted=section->Get_bool("scaler thread") && !render_bands.wanted;
+	render_queue.wanted=section->Get_bool("frame queue");
 
 
 	//If something changed that needs a ReInit
@@ -795,7 +1304,10 @@ void RENDER_Init() {
 				   render.scale.forced))
 		RENDER_CallBack( GFX_CallBackReset );
 
-	if(!running) render.updating=true;
+	if(!running) {
+		render.updating=true;
+		AddExitFunction(AddExitFunctionFuncPair(RENDER_ShutDown));
+	}
 	running = true;
 
 	MAPPER_AddHandler(DecreaseFrameSkip,MK_f7,MMOD1,"decfskip","Dec Fskip");
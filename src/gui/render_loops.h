@@ -24,27 +24,27 @@ static void conc3d(SCALERNAME,SBPP,R)(void) {
     (void)conc3d(SCALERNAME,SBPP,R);
 #endif
 //Skip the first one for multiline input scalers
-	if (!render.scale.outLine) {
-		render.scale.outLine++;
+	if (!scalerLines->outLine) {
+		scalerLines->outLine++;
 		return;
 	}
 lastagain:
-	if (!CC[render.scale.outLine][0]) {
+	if (!CC[scalerLines->outLine][0]) {
 #if defined(SCALERLINEAR) 
 		Bitu scaleLines = SCALERHEIGHT;
 #else
-		Bitu scaleLines = Scaler_Aspect[ render.scale.outLine ];
+		Bitu scaleLines = Scaler_Aspect[ scalerLines->outLine ];
 #endif
 		ScalerAddLines( 0, scaleLines );
-		if (++render.scale.outLine == render.scale.inHeight)
+		if (++scalerLines->outLine == render.scale.inHeight)
 			goto lastagain;
 		return;
 	}
 	/* Clear the complete line marker */
-	CC[render.scale.outLine][0] = 0;
-	const PTYPE * fc = &FC[render.scale.outLine][1];
-	PTYPE * line0=(PTYPE *)(render.scale.outWrite);
-	Bit8u * changed = &CC[render.scale.outLine][1];
+	CC[scalerLines->outLine][0] = 0;
+	const PTYPE * fc = &FC[scalerLines->outLine][1];
+	PTYPE * line0=(PTYPE *)(scalerLines->outWrite);
+	Bit8u * changed = &CC[scalerLines->outLine][1];
 	Bitu b;
 	for (b=0;b<render.scale.blocks;b++) {
 #if (SCALERHEIGHT > 1) 
@@ -140,15 +140,15 @@ lastagain:
 #if defined(SCALERLINEAR) 
 	Bitu scaleLines = SCALERHEIGHT;
 #else
-	Bitu scaleLines = Scaler_Aspect[ render.scale.outLine ];
+	Bitu scaleLines = Scaler_Aspect[ scalerLines->outLine ];
 	if ( ((Bits)(scaleLines - SCALERHEIGHT)) > 0 ) {
-		BituMove( render.scale.outWrite + render.scale.outPitch * SCALERHEIGHT,
-			render.scale.outWrite + render.scale.outPitch * (SCALERHEIGHT-1),
+		BituMove( scalerLines->outWrite + render.scale.outPitch * SCALERHEIGHT,
+			scalerLines->outWrite + render.scale.outPitch * (SCALERHEIGHT-1),
 			render.src.width * SCALERWIDTH * PSIZE);
 	}
 #endif
 	ScalerAddLines( 1, scaleLines );
-	if (++render.scale.outLine == render.scale.inHeight)
+	if (++scalerLines->outLine == render.scale.inHeight)
 		goto lastagain;
 }
 
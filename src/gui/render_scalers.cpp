@@ -27,13 +27,10 @@
 
 Bit8u Scaler_Aspect[SCALER_MAXHEIGHT];
 Bit16u Scaler_ChangedLines[SCALER_MAXHEIGHT];
-Bitu Scaler_ChangedLineIndex;
 
-static union {
-	Bit32u b32 [4][SCALER_MAXWIDTH*3];
-	Bit16u b16 [4][SCALER_MAXWIDTH*3];
-	Bit8u b8 [4][SCALER_MAXWIDTH*3];
-} scalerWriteCache;
+static scalerWriteCache_t scalerWriteCache;
+ScalerLines_t scalerMainLines = { 0, 0, 0, 0, Scaler_ChangedLines, 0, &scalerWriteCache };
+SCALER_THREAD_LOCAL ScalerLines_t *scalerLines = &scalerMainLines;
 //scalerFrameCache_t scalerFrameCache;
 scalerSourceCache_t scalerSourceCache;
 #if RENDER_USE_ADVANCED_SCALERS>1
@@ -62,12 +59,13 @@ static INLINE void BituMove( void *_dst, const void * _src, Bitu size) {
 }
 
 static INLINE void ScalerAddLines( Bitu changed, Bitu count ) {
-	if ((Scaler_ChangedLineIndex & 1) == changed ) {
-		Scaler_ChangedLines[Scaler_ChangedLineIndex] += count;
+	ScalerLines_t *lines = scalerLines;
+	if ((lines->changedIndex & 1) == changed ) {
+		lines->changedLines[lines->changedIndex] += count;
 	} else {
-		Scaler_ChangedLines[++Scaler_ChangedLineIndex] = count;
+		lines->changedLines[++lines->changedIndex] = count;
 	}
-	render.scale.outWrite += render.scale.outPitch * count;
+	lines->outWrite += render.scale.outPitch * count;
 }
 
 
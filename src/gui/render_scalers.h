@@ -64,7 +64,6 @@ typedef void (*ScalerComplexHandler_t)(void);
 
 extern Bit8u Scaler_Aspect[];
 extern Bit8u diff_table[];
-extern Bitu Scaler_ChangedLineIndex;
 extern Bit16u Scaler_ChangedLines[];
 #if RENDER_USE_ADVANCED_SCALERS>1
 /* Not entirely happy about those +2's since they make a non power of 2, with muls instead of shift */
@@ -81,6 +80,30 @@ typedef union {
 	Bit8u b8	[SCALER_MAXHEIGHT] [SCALER_MAXWIDTH];
 } scalerSourceCache_t;
 extern scalerSourceCache_t scalerSourceCache;
+typedef union {
+	Bit32u b32 [4][SCALER_MAXWIDTH*3];
+	Bit16u b16 [4][SCALER_MAXWIDTH*3];
+	Bit8u b8 [4][SCALER_MAXWIDTH*3];
+} scalerWriteCache_t;
+
+/* Where a scaler is in the frame. When a frame is scaled in bands every band
+   has its own, scalerLines points at the one of the thread running the scaler */
+typedef struct {
+	Bit8u *outWrite;
+	Bit8u *cacheRead;
+	Bitu inLine, outLine;
+	Bit16u *changedLines;
+	Bitu changedIndex;
+	scalerWriteCache_t *writeCache;
+} ScalerLines_t;
+
+#if defined(_MSC_VER)
+#define SCALER_THREAD_LOCAL __declspec(thread)
+#else
+#define SCALER_THREAD_LOCAL __thread
+#endif
+extern ScalerLines_t scalerMainLines;
+extern SCALER_THREAD_LOCAL ScalerLines_t *scalerLines;
 #if RENDER_USE_ADVANCED_SCALERS>1
 extern scalerChangeCache_t scalerChangeCache;
 #endif
@@ -27,11 +27,11 @@ static void conc4d(SCALERNAME,SBPP,DBPP,R)(const void *s) {
 
 #ifdef RENDER_NULL_INPUT
 	if (!s) {
-		render.scale.cacheRead += render.scale.cachePitch;
+		scalerLines->cacheRead += render.scale.cachePitch;
 #if defined(SCALERLINEAR) 
 		Bitu skipLines = SCALERHEIGHT;
 #else
-		Bitu skipLines = Scaler_Aspect[ render.scale.outLine++ ];
+		Bitu skipLines = Scaler_Aspect[ scalerLines->outLine++ ];
 #endif
 		ScalerAddLines( 0, skipLines );
 		return;
@@ -40,9 +40,9 @@ static void conc4d(SCALERNAME,SBPP,DBPP,R)(const void *s) {
 	/* Clear the complete line marker */
 	Bitu hadChange = 0;
 	const SRCTYPE *src = (SRCTYPE*)s;
-	SRCTYPE *cache = (SRCTYPE*)(render.scale.cacheRead);
-	render.scale.cacheRead += render.scale.cachePitch;
-	PTYPE * line0=(PTYPE *)(render.scale.outWrite);
+	SRCTYPE *cache = (SRCTYPE*)(scalerLines->cacheRead);
+	scalerLines->cacheRead += render.scale.cachePitch;
+	PTYPE * line0=(PTYPE *)(scalerLines->outWrite);
 #if (SBPP == 9)
 	for (Bits x=render.src.width;x>0;) {
 		if (*(Bit32u const*)src == *(Bit32u*)cache && !(
@@ -143,10 +143,10 @@ static void conc4d(SCALERNAME,SBPP,DBPP,R)(const void *s) {
 #if defined(SCALERLINEAR) 
 	Bitu scaleLines = SCALERHEIGHT;
 #else
-	Bitu scaleLines = Scaler_Aspect[ render.scale.outLine++ ];
+	Bitu scaleLines = Scaler_Aspect[ scalerLines->outLine++ ];
 	if ( scaleLines - SCALERHEIGHT && hadChange ) {
-		BituMove( render.scale.outWrite + render.scale.outPitch * SCALERHEIGHT,
-			render.scale.outWrite + render.scale.outPitch * (SCALERHEIGHT-1),
+		BituMove( scalerLines->outWrite + render.scale.outPitch * SCALERHEIGHT,
+			scalerLines->outWrite + render.scale.outPitch * (SCALERHEIGHT-1),
 			render.src.width * SCALERWIDTH * PSIZE);
 	}
 #endif
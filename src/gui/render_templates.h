@@ -19,7 +19,7 @@
 #if DBPP == 8
 #define PSIZE 1
 #define PTYPE Bit8u
-#define WC scalerWriteCache.b8
+#define WC scalerLines->writeCache->b8
 //#define FC scalerFrameCache.b8
 #define FC (*(scalerFrameCache_t*)(&scalerSourceCache.b32[400][0])).b8
 #define redMask		0
@@ -34,7 +34,7 @@
 #elif DBPP == 15 || DBPP == 16
 #define PSIZE 2
 #define PTYPE Bit16u
-#define WC scalerWriteCache.b16
+#define WC scalerLines->writeCache->b16
 //#define FC scalerFrameCache.b16
 #define FC (*(scalerFrameCache_t*)(&scalerSourceCache.b32[400][0])).b16
 #if DBPP == 15
@@ -61,7 +61,7 @@
 #elif DBPP == 32
 #define PSIZE 4
 #define PTYPE Bit32u
-#define WC scalerWriteCache.b32
+#define WC scalerLines->writeCache->b32
 //#define FC scalerFrameCache.b32
 #define FC (*(scalerFrameCache_t*)(&scalerSourceCache.b32[400][0])).b32
 #define redMask		0xff0000
@@ -158,16 +158,16 @@ static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 
 #ifdef RENDER_NULL_INPUT
 	if (!s) {
-		render.scale.cacheRead += render.scale.cachePitch;
-		render.scale.inLine++;
+		scalerLines->cacheRead += render.scale.cachePitch;
+		scalerLines->inLine++;
 		render.scale.complexHandler();
 		return;
 	}
 #endif
 	const SRCTYPE * src = (SRCTYPE*)s;
-	PTYPE *fc= &FC[render.scale.inLine+1][1];
-	SRCTYPE *sc = (SRCTYPE*)(render.scale.cacheRead);
-	render.scale.cacheRead += render.scale.cachePitch;
+	PTYPE *fc= &FC[scalerLines->inLine+1][1];
+	SRCTYPE *sc = (SRCTYPE*)(scalerLines->cacheRead);
+	scalerLines->cacheRead += render.scale.cachePitch;
 	Bitu b;
 	bool hadChange = false;
 	/* This should also copy the surrounding pixels but it looks nice enough without */
@@ -187,15 +187,15 @@ static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 				} while (x<SCALER_BLOCKSIZE);
 				hadChange = true;
 				/* Change the surrounding blocks */
-				CC[render.scale.inLine+0][1+b-1] |= SCALE_RIGHT;
-				CC[render.scale.inLine+0][1+b+0] |= SCALE_FULL;
-				CC[render.scale.inLine+0][1+b+1] |= SCALE_LEFT;
-				CC[render.scale.inLine+1][1+b-1] |= SCALE_RIGHT;
-				CC[render.scale.inLine+1][1+b+0] |= SCALE_FULL;
-				CC[render.scale.inLine+1][1+b+1] |= SCALE_LEFT;
-				CC[render.scale.inLine+2][1+b-1] |= SCALE_RIGHT;
-				CC[render.scale.inLine+2][1+b+0] |= SCALE_FULL;
-				CC[render.scale.inLine+2][1+b+1] |= SCALE_LEFT;
+				CC[scalerLines->inLine+0][1+b-1] |= SCALE_RIGHT;
+				CC[scalerLines->inLine+0][1+b+0] |= SCALE_FULL;
+				CC[scalerLines->inLine+0][1+b+1] |= SCALE_LEFT;
+				CC[scalerLines->inLine+1][1+b-1] |= SCALE_RIGHT;
+				CC[scalerLines->inLine+1][1+b+0] |= SCALE_FULL;
+				CC[scalerLines->inLine+1][1+b+1] |= SCALE_LEFT;
+				CC[scalerLines->inLine+2][1+b-1] |= SCALE_RIGHT;
+				CC[scalerLines->inLine+2][1+b+0] |= SCALE_FULL;
+				CC[scalerLines->inLine+2][1+b+1] |= SCALE_LEFT;
 				continue;
 			}
 		}
@@ -204,11 +204,11 @@ static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 		src += SCALER_BLOCKSIZE;
 	}
 	if (hadChange) {
-		CC[render.scale.inLine+0][0] = 1;
-		CC[render.scale.inLine+1][0] = 1;
-		CC[render.scale.inLine+2][0] = 1;
+		CC[scalerLines->inLine+0][0] = 1;
+		CC[scalerLines->inLine+1][0] = 1;
+		CC[scalerLines->inLine+2][0] = 1;
 	}
-	render.scale.inLine++;
+	scalerLines->inLine++;
 	render.scale.complexHandler();
 }
 #endif
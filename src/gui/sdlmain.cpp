@@ -117,6 +117,9 @@ void SHELL_Init(void);
 #if C_DYNAMIC_X86
 void CPU_Core_Dyn_X86_Shutdown(void);
 #endif
+#if C_DYNREC
+void CPU_Core_Dynrec_Shutdown(void);
+#endif
 
 #if C_OPENGL
 #include "SDL_opengl.h"
@@ -168,7 +171,8 @@ enum SCREEN_TYPES {
 	SCREEN_SURFACE_DDRAW,
 	SCREEN_OVERLAY,
 	SCREEN_OPENGL,
-	SCREEN_DIRECT3D
+	SCREEN_DIRECT3D,
+	SCREEN_HEADLESS
 };
 
 enum PRIORITY_LEVELS {
@@ -643,6 +647,11 @@ check_gotbpp:
 		    flags&=~(GFX_CAN_8|GFX_CAN_15|GFX_CAN_16);
 		break;
 #endif
+	case SCREEN_HEADLESS:
+		/* Nothing is drawn, so no scaling either */
+		flags|=GFX_SCALING;
+		if (flags & GFX_CAN_32) flags&=~(GFX_CAN_8|GFX_CAN_15|GFX_CAN_16);
+		break;
 	default:
 		goto check_surface;
 		break;
@@ -1248,6 +1257,14 @@ dosurface:
 		break;
 	    }
 #endif
+	case SCREEN_HEADLESS:
+		sdl.desktop.type=SCREEN_HEADLESS;
+		if (flags & GFX_CAN_8) retFlags=GFX_CAN_8;
+		if (flags & GFX_CAN_15) retFlags=GFX_CAN_15;
+		if (flags & GFX_CAN_16) retFlags=GFX_CAN_16;
+		if (flags & GFX_CAN_32) retFlags=GFX_CAN_32;
+		retFlags |= GFX_SCALING | GFX_HEADLESS;
+		break;
 	default:
 		goto dosurface;
 		break;
@@ -2151,6 +2168,7 @@ Bitu GFX_GetRGB(Bit8u red,Bit8u green,Bit8u blue) {
 	switch (sdl.desktop.type) {
 	case SCREEN_SURFACE:
 	case SCREEN_SURFACE_DDRAW:
+	case SCREEN_HEADLESS:
 		return SDL_MapRGB(sdl.surface->format,red,green,blue);
 	case SCREEN_OVERLAY:
 		{
@@ -2428,6 +2446,8 @@ static void GUI_StartUp() {
 		LOG_MSG("SDL:Direct3D activated");
 #endif
 #endif
+	} else if (output == "headless") {
+		sdl.desktop.want_type=SCREEN_HEADLESS;
 	} else if (output == "openglhq") {
 		char *oldvideo = getenv("SDL_VIDEODRIVER");
 
@@ -2452,8 +2472,9 @@ static void GUI_StartUp() {
 //	sdl.overscan_color=section->Get_int("overscancolor");
 
 	sdl.overlay=0;
-	/* Initialize screen for first time */
-	sdl.surface=SDL_SetVideoMode(640,400,0,SDL_RESIZABLE);
+	/* Initialize screen for first time. Headless output never shows it, it only
+	   keeps it for the pixel format of the 32 bpp frames. */
+	sdl.surface=SDL_SetVideoMode(640,400,sdl.desktop.want_type==SCREEN_HEADLESS?32:0,SDL_RESIZABLE);
 	if (sdl.surface == NULL) E_Exit("Could not initialize video: %s",SDL_GetError());
 	sdl.desktop.bpp=sdl.surface->format->BitsPerPixel;
 	if (sdl.desktop.bpp==24) {
@@ -3352,6 +3373,8 @@ void GFX_Events() {
 			MAPPER_CheckEvent(&event);
 		}
 	}
+	/* Video output has to stay on this thread, frames from the queue are shown here */
+	RENDER_PresentFrame();
 	// start emendelson from dbDOS
 	// Disabled multiple characters per dispatch b/c occasionally
 	// keystrokes get lost in the spew. (Prob b/c of DI usage on Win32, sadly..)
@@ -3672,7 +3695,7 @@ void SDL_SetupConfigSection() {
 	                  "  (output=surface does not!)");
 
 	const char* outputs[] = {
-		"surface", "overlay",
+		"surface", "overlay", "headless",
 #if C_OPENGL
 		"opengl", "openglnb", "openglhq",
 #endif
@@ -3688,7 +3711,9 @@ void SDL_SetupConfigSection() {
 #else
 		Pstring = sdl_sec->Add_string("output",Property::Changeable::Always,"surface");
 #endif
-	Pstring->Set_help("What video system to use for output.");
+	Pstring->Set_help("What video system to use for output.\n"
+		"  headless shows nothing and needs no display, frames are only drawn for screenshots and\n"
+		"  video capture. Without a capture going on the emulated video card isn't drawn at all.");
 	Pstring->Set_values(outputs);
 
 	Pbool = sdl_sec->Add_bool("autolock",Property::Changeable::Always,true);
@@ -4252,6 +4277,7 @@ void Init_PS2_Port_92h();
 void Init_A20_Gate();
 void HARDWARE_Init();
 void CAPTURE_Init();
+void PROFILER_Init();
 void ROMBIOS_Init();
 void CALLBACK_Init();
 void Init_DMA();
@@ -4556,6 +4582,15 @@ int main(int argc, char* argv[]) {
 		LOG(LOG_GUI,LOG_DEBUG)("SDL 1.2.14 hack: SDL_DISABLE_LOCK_KEYS=1");
 #endif
 
+		/* hack: Headless output never opens a window, so it doesn't need a display either */
+		{
+			Section_prop *sec = static_cast<Section_prop *>(control->GetSection("sdl"));
+			if (!strcmp(sec->Get_string("output"),"headless") && getenv("SDL_VIDEODRIVER") == NULL) {
+				putenv(const_cast<char*>("SDL_VIDEODRIVER=dummy"));
+				LOG(LOG_GUI,LOG_DEBUG)("Headless output: setting SDL_VIDEODRIVER=dummy");
+			}
+		}
+
 #ifdef WIN32
 		/* hack: Encourage SDL to use windib if not otherwise specified */
 		if (getenv("SDL_VIDEODRIVER") == NULL) {
@@ -4788,6 +4823,7 @@ int main(int argc, char* argv[]) {
 #if C_FPU
 		FPU_Init();
 #endif
+		PROFILER_Init();
 		VGA_Init();
 		ISAPNP_Cfg_Init();
 		FDC_Primary_Init();
@@ -5058,6 +5094,9 @@ fresh_boot:
 	CALLBACK_Shutdown();
 #if C_DYNAMIC_X86
 	CPU_Core_Dyn_X86_Shutdown();
+#endif
+#if C_DYNREC
+	CPU_Core_Dynrec_Shutdown();
 #endif
 	FreeBIOSDiskList();
 	MAPPER_Shutdown();
@@ -17,6 +17,7 @@
  */
 
 
+#include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
@@ -28,6 +29,7 @@
 #include "mem.h"
 #include "dbopl.h"
 #include "nukedopl.h"
+#include "lockfree_ring.h"
 
 bool adlib_force_timer_overflow_on_polling = false;
 
@@ -51,6 +53,18 @@ namespace OPL2 {
 				chan->AddSamples_m16( todo, buf );
 			}
 		}
+		virtual void Render( Bitu samples, Bit32s* buffer ) {
+			Bit16s buf[1024];
+			while( samples > 0 ) {
+				Bitu todo = samples > 1024 ? 1024 : samples;
+				samples -= todo;
+				adlib_getsample(buf, todo);
+				for ( Bitu i = 0; i < todo; i++ ) {
+					*buffer++ = buf[i];
+					*buffer++ = buf[i];
+				}
+			}
+		}
 
 		virtual void Init( Bitu rate ) {
 			adlib_init(rate);
@@ -82,6 +96,16 @@ namespace OPL3 {
 				chan->AddSamples_s16( todo, buf );
 			}
 		}
+		virtual void Render( Bitu samples, Bit32s* buffer ) {
+			Bit16s buf[1024*2];
+			while( samples > 0 ) {
+				Bitu todo = samples > 1024 ? 1024 : samples;
+				samples -= todo;
+				adlib_getsample(buf, todo);
+				for ( Bitu i = 0; i < todo * 2; i++ )
+					*buffer++ = buf[i];
+			}
+		}
 
 		virtual void Init( Bitu rate ) {
 			adlib_init(rate);
@@ -115,6 +139,16 @@ namespace NukedOPL {
 				chan->AddSamples_s16( todo, buf );
 			}
 		}
+		virtual void Render( Bitu samples, Bit32s* buffer ) {
+			Bit16s buf[1024*2];
+			while( samples > 0 ) {
+				Bitu todo = samples > 1024 ? 1024 : samples;
+				samples -= todo;
+				OPL3_GenerateStream(&chip, buf, todo);
+				for ( Bitu i = 0; i < todo * 2; i++ )
+					*buffer++ = buf[i];
+			}
+		}
 		virtual void Init( Bitu rate ) {
 			OPL3_Reset(&chip, rate);
 		}
@@ -124,6 +158,154 @@ namespace NukedOPL {
 }
 
 
+namespace Adlib {
+
+/* Runs a handler that can Render() on its own thread. Register writes and
+   requests for samples are queued in the order the mixer sees them, so the
+   samples that come back are the same as without the thread. They are handed
+   to the mixer one millisecond late, which gives the thread that much time to
+   keep up without the emulation waiting on it. */
+class ThreadedHandler : public Handler {
+	enum { RENDER_SAMPLES = 0xffffffff, RENDER_MAX = 1024, OUTPUT_MAX = 8192 };
+	struct Command {
+		Bit32u reg;					//RENDER_SAMPLES to generate val samples
+		Bit32u val;
+	};
+	struct Frame {
+		Bit32s left,right;
+	};
+	Handler* handler;
+	SDL_Thread* thread;
+	LockFreeRing<Command,4096> commands;
+	LockFreeRing<Frame,OUTPUT_MAX> output;
+	RingSignal work;				//Thread waits for commands
+	RingSignal progress;			//Emulation waits for room or samples
+	std::atomic<bool> stop;
+	bool opl3;
+
+	void Queue( Bit32u reg, Bit32u val ) {
+		Command* cmd;
+		while ( !(cmd = commands.WriteSlot()) ) {
+			progress.Prepare();
+			if ( commands.WriteSlot() ) progress.Cancel();
+			else progress.Wait();
+		}
+		cmd->reg = reg;
+		cmd->val = val;
+		commands.Push();
+		work.Notify();
+	}
+
+	void Run() {
+		Bit32s buffer[RENDER_MAX*2];
+		for (;;) {
+			Command* cmd = commands.ReadSlot();
+			if ( !cmd ) {
+				if ( stop.load() ) break;
+				work.Prepare();
+				if ( commands.ReadSlot() || stop.load() ) work.Cancel();
+				else work.Wait();
+				continue;
+			}
+			if ( cmd->reg == RENDER_SAMPLES ) {
+				Bitu samples = cmd->val;
+				handler->Render( samples, buffer );
+				for ( Bitu i = 0; i < samples; i++ ) {
+					//Can't be full, the emulation takes the samples right after asking for them
+					//so the ring never holds more than the silence and one request, see Init
+					Frame* frame = output.WriteSlot();
+					assert( frame );
+					frame->left = buffer[i*2];
+					frame->right = buffer[i*2+1];
+					output.Push();
+				}
+			} else {
+				handler->WriteReg( cmd->reg, (Bit8u)cmd->val );
+			}
+			commands.Pop();
+			progress.Notify();
+		}
+	}
+
+	static int ThreadProc( void* data ) {
+		static_cast<ThreadedHandler*>(data)->Run();
+		return 0;
+	}
+public:
+	ThreadedHandler( Handler* _handler ) : handler(_handler), thread(0), stop(false), opl3(false) {
+	}
+	virtual Bit32u WriteAddr( Bit32u port, Bit8u val ) {
+		//Same as the handlers that can render, but without looking at the chip the thread owns
+		switch ( port & 3 ) {
+		case 0:
+			return val;
+		case 2:
+			if ( opl3 || (val == 0x05) )
+				return 0x100 | val;
+			else 
+				return val;
+		}
+		return 0;
+	}
+	virtual void WriteReg( Bit32u reg, Bit8u val ) {
+		if ( reg == 0x105 )
+			opl3 = (val & 1) != 0;
+		Queue( reg, val );
+	}
+	virtual void Generate( MixerChannel* chan, Bitu samples ) {
+		Bit32s buffer[RENDER_MAX*2];
+		while ( samples > 0 ) {
+			Bitu todo = samples > RENDER_MAX ? RENDER_MAX : samples;
+			samples -= todo;
+			Render( todo, buffer );
+			chan->AddSamples_s32( todo, buffer );
+		}
+	}
+	virtual void Render( Bitu samples, Bit32s* buffer ) {
+		while ( samples > 0 ) {
+			Bitu todo = samples > RENDER_MAX ? RENDER_MAX : samples;
+			samples -= todo;
+			Queue( RENDER_SAMPLES, (Bit32u)todo );
+			for ( Bitu i = 0; i < todo; i++ ) {
+				Frame* frame;
+				while ( !(frame = output.ReadSlot()) ) {
+					progress.Prepare();
+					if ( output.ReadSlot() ) progress.Cancel();
+					else progress.Wait();
+				}
+				*buffer++ = frame->left;
+				*buffer++ = frame->right;
+				output.Pop();
+			}
+		}
+	}
+	virtual void Init( Bitu rate ) {
+		handler->Init( rate );
+		//One millisecond of silence to start with, with room for the largest request behind it
+		assert( rate / 1000 + 1 + RENDER_MAX <= OUTPUT_MAX );
+		for ( Bitu i = 0; i < rate / 1000 + 1; i++ ) {
+			Frame* frame = output.WriteSlot();
+			frame->left = frame->right = 0;
+			output.Push();
+		}
+		work.Open();
+		progress.Open();
+		thread = SDL_CreateThread( ThreadProc, this );
+	}
+	~ThreadedHandler() {
+		if ( thread ) {
+			stop.store( true );
+			work.Notify();
+			SDL_WaitThread( thread, NULL );
+		}
+		work.Close();
+		progress.Close();
+		delete handler;
+	}
+};
+
+}
+
 #define RAW_SIZE 1024
 
 
@@ -731,6 +913,9 @@ Module::Module( Section* configuration ) : Module_base(configuration) {
 	} else {
 		handler = new DBOPL::Handler();
 	}
+	//Once wrapped only the thread touches the emulator, so the compat globals are fine too
+	if (section->Get_bool("oplthread"))
+		handler = new ThreadedHandler( handler );
 	handler->Init( rate );
 	bool single = false;
 	switch ( oplmode ) {
@@ -108,6 +108,8 @@ public:
 	virtual void WriteReg( Bit32u addr, Bit8u val ) = 0;
 	//Generate a certain amount of samples
 	virtual void Generate( MixerChannel* chan, Bitu samples ) = 0;
+	//Generate stereo samples into a buffer, for handlers that can run on their own thread
+	virtual void Render( Bitu samples, Bit32s* buffer ) = 0;
 	//Initialize at a specific sample rate and mode
 	virtual void Init( Bitu rate ) = 0;
 
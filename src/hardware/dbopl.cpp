@@ -1493,6 +1493,24 @@ void Handler::WriteReg( Bit32u addr, Bit8u val ) {
 	chip.WriteReg( addr, val );
 }
 
+void Handler::Render( Bitu samples, Bit32s* buffer ) {
+	Bit32s mono[ 512 ];
+	while ( samples > 0 ) {
+		Bitu todo = samples > 512 ? 512 : samples;
+		samples -= todo;
+		if ( !chip.opl3Active ) {
+			chip.GenerateBlock2( todo, mono );
+			for ( Bitu i = 0; i < todo; i++ ) {
+				*buffer++ = mono[i];
+				*buffer++ = mono[i];
+			}
+		} else {
+			chip.GenerateBlock3( todo, buffer );
+			buffer += todo * 2;
+		}
+	}
+}
+
 void Handler::Generate( MixerChannel* chan, Bitu samples ) {
 	Bit32s buffer[ 512 * 2 ];
 	if ( GCC_UNLIKELY(samples > 512) )
@@ -250,6 +250,7 @@ struct Handler : public Adlib::Handler {
 	virtual Bit32u WriteAddr( Bit32u port, Bit8u val );
 	virtual void WriteReg( Bit32u addr, Bit8u val );
 	virtual void Generate( MixerChannel* chan, Bitu samples );
+	virtual void Render( Bitu samples, Bit32s* buffer );
 	virtual void Init( Bitu rate );
 };
 
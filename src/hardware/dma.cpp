@@ -52,6 +52,12 @@ static void UpdateEMSMapping(void) {
 	}
 }
 
+/* Copying a page at a time is the same as going byte by byte when the address
+   wraps at a power of two of at least a page */
+static INLINE bool DMA_WrapKeepsPages(Bit32u dma_wrap) {
+	return dma_wrap >= 0xfff && ((dma_wrap + 1) & dma_wrap) == 0;
+}
+
 /* read a block from physical memory */
 static void DMA_BlockRead(PhysPt spage,PhysPt offset,void * data,Bitu size,Bit8u dma16,const Bit32u DMA16_ADDRMASK) {
 	Bit8u * write=(Bit8u *) data;
@@ -59,14 +65,18 @@ static void DMA_BlockRead(PhysPt spage,PhysPt offset,void * data,Bitu size,Bit8u
 	size <<= dma16;
 	offset <<= dma16;
 	Bit32u dma_wrap = (((0xffff<<dma16)+dma16)&DMA16_ADDRMASK) | dma_wrapping;
-	for ( ; size ; size--, offset++) {
+	bool spans = DMA_WrapKeepsPages(dma_wrap);
+	while (size) {
 		offset &= dma_wrap;
 		Bitu page = highpart_addr_page+(offset >> 12);
 		/* care for EMS pageframe etc. */
 		if (page < EMM_PAGEFRAME4K) page = paging.firstmb[page];
 		else if (page < EMM_PAGEFRAME4K+0x10) page = ems_board_mapping[page];
 		else if (page < LINK_START) page = paging.firstmb[page];
-		*write++=phys_readb(page*4096 + (offset & 4095));
+		Bitu span = spans ? 4096 - (offset & 4095) : 1;
+		if (span > size) span = size;
+		memcpy(write, MemBase + page*4096 + (offset & 4095), span);
+		write += span; offset += span; size -= span;
 	}
 }
 
@@ -123,7 +133,8 @@ static void DMA_BlockWrite(PhysPt spage,PhysPt offset,void * data,Bitu size,Bit8
 	size <<= dma16;
 	offset <<= dma16;
 	Bit32u dma_wrap = (((0xffff<<dma16)+dma16)&DMA16_ADDRMASK) | dma_wrapping;
-	for ( ; size ; size--, offset++) {
+	bool spans = DMA_WrapKeepsPages(dma_wrap);
+	while (size) {
 		if (offset>(dma_wrapping<<dma16)) {
 			LOG_MSG("DMA segbound wrapping (write): %x:%x size %x [%x] wrap %x",(int)spage,(int)offset,(int)size,dma16,(int)dma_wrapping);
 		}
@@ -133,7 +144,10 @@ static void DMA_BlockWrite(PhysPt spage,PhysPt offset,void * data,Bitu size,Bit8
 		if (page < EMM_PAGEFRAME4K) page = paging.firstmb[page];
 		else if (page < EMM_PAGEFRAME4K+0x10) page = ems_board_mapping[page];
 		else if (page < LINK_START) page = paging.firstmb[page];
-		phys_writeb(page*4096 + (offset & 4095), *read++);
+		Bitu span = spans ? 4096 - (offset & 4095) : 1;
+		if (span > size) span = size;
+		memcpy(MemBase + page*4096 + (offset & 4095), read, span);
+		read += span; offset += span; size -= span;
 	}
 }
 
@@ -20,6 +20,7 @@
 #include "control.h"
 #include "callback.h"
 #include "bios_disk.h"
+#include "../src/dos/drives.h"
 
 #ifdef _MSC_VER
 # define MIN(a,b) ((a) < (b) ? (a) : (b))
@@ -691,11 +692,13 @@ void FloppyController::on_fdc_in_command() {
 					if (dma->Read(512,sector) != 512) break;
 
 					/* write sector */
+					fatDrive::beforeDiskIO(image);
 					Bit8u err = image->Write_Sector(in_cmd[3]/*head*/,in_cmd[2]/*cylinder*/,in_cmd[4]/*sector*/,sector);
 					if (err != 0x00) {
 						fail = true;
 						break;
 					}
+					fatDrive::afterDiskWrite(image,image->Get_AbsoluteSector(in_cmd[3],in_cmd[2],in_cmd[4]),1);
 
 					/* if we're at the last sector of the track according to program, then stop */
 					if (in_cmd[4] == in_cmd[6]) break;
@@ -765,6 +768,7 @@ void FloppyController::on_fdc_in_command() {
 					}
 
 					/* read sector */
+					fatDrive::beforeDiskIO(image);
 					Bit8u err = image->Read_Sector(in_cmd[3]/*head*/,in_cmd[2]/*cylinder*/,in_cmd[4]/*sector*/,sector);
 					if (err != 0x00) {
 						fail = true;
@@ -22,6 +22,7 @@
 #include "callback.h"
 #include "bios_disk.h"
 #include "../src/dos/cdrom.h"
+#include "../src/dos/drives.h"
 
 #ifdef _MSC_VER
 # define MIN(a,b) ((a) < (b) ? (a) : (b))
@@ -177,6 +178,9 @@ public:
 	Bitu phys_heads,phys_sects,phys_cyls;
 	unsigned char sector[512*128];
 	Bitu sector_i,sector_total;
+	/* READ SECTOR reads the rest of the transfer into sector[] in one go */
+	uint32_t readahead_first;
+	Bitu readahead_count;
 };
 
 enum {
@@ -2015,6 +2019,8 @@ void IDEATADevice::generate_identify_device() {
 IDEATADevice::IDEATADevice(IDEController *c,unsigned char bios_disk_index) : IDEDevice(c) {
 	this->bios_disk_index = bios_disk_index;
 	sector_i = sector_total = 0;
+	readahead_first = 0;
+	readahead_count = 0;
 
 	headshr = 0;
 	type = IDE_TYPE_HDD;
@@ -2669,12 +2675,14 @@ static void IDE_DelayedCommand(Bitu idx/*which IDE controller*/) {
 						(ata->lba[0] - 1);
 				}
 
+				fatDrive::beforeDiskIO(disk);
 				if (disk->Write_AbsoluteSector(sectorn, ata->sector) != 0) {
 					LOG_MSG("Failed to write sector\n");
 					ata->abort_error();
 					dev->controller->raise_irq();
 					return;
 				}
+				fatDrive::afterDiskWrite(disk, sectorn, 1);
 
 				/* NTS: the way this command works is that the drive writes ONE sector, then fires the IRQ
 				        and lets the host read it, then reads another sector, fires the IRQ, etc. One
@@ -2751,11 +2759,22 @@ static void IDE_DelayedCommand(Bitu idx/*which IDE controller*/) {
 						(ata->lba[0] - 1);
 				}
 
-				if (disk->Read_AbsoluteSector(sectorn, ata->sector) != 0) {
-					LOG_MSG("ATA read failed\n");
-					ata->abort_error();
-					dev->controller->raise_irq();
-					return;
+				if (ata->readahead_count == 0 || sectorn < ata->readahead_first ||
+					(sectorn - ata->readahead_first) >= ata->readahead_count) {
+					/* read as much of the transfer as fits, or just this sector if that fails
+					   because the transfer runs off the end of the disk */
+					ata->readahead_first = sectorn;
+					ata->readahead_count = MIN((Bitu)sectcount,(Bitu)(sizeof(ata->sector)/512));
+					fatDrive::beforeDiskIO(disk);
+					if (ata->readahead_count > 1 && disk->Read_Sectors(sectorn, ata->readahead_count, ata->sector) != 0)
+						ata->readahead_count = 1;
+					if (ata->readahead_count == 1 && disk->Read_AbsoluteSector(sectorn, ata->sector) != 0) {
+						ata->readahead_count = 0;
+						LOG_MSG("ATA read failed\n");
+						ata->abort_error();
+						dev->controller->raise_irq();
+						return;
+					}
 				}
 
 				/* NTS: the way this command works is that the drive reads ONE sector, then fires the IRQ
@@ -2765,7 +2784,7 @@ static void IDE_DelayedCommand(Bitu idx/*which IDE controller*/) {
 				/* NTS: The sector advance + count decrement is done in the I/O completion function */
 				dev->state = IDE_DEV_DATA_READ;
 				dev->status = IDE_STATUS_DRQ|IDE_STATUS_DRIVE_READY|IDE_STATUS_DRIVE_SEEK_COMPLETE;
-				ata->prepare_read(0,512);
+				ata->prepare_read((sectorn - ata->readahead_first)*512,(sectorn - ata->readahead_first + 1)*512);
 				dev->controller->raise_irq();
 				break;
 
@@ -2815,6 +2834,7 @@ static void IDE_DelayedCommand(Bitu idx/*which IDE controller*/) {
 						(ata->lba[0] - 1);
 				}
 
+				fatDrive::beforeDiskIO(disk);
 				if (disk->Read_AbsoluteSector(sectorn, ata->sector) != 0) {
 					LOG_MSG("ATA read failed\n");
 					ata->abort_error();
@@ -2894,14 +2914,12 @@ static void IDE_DelayedCommand(Bitu idx/*which IDE controller*/) {
 				if ((512*ata->multiple_sector_count) > sizeof(ata->sector))
 					E_Exit("SECTOR OVERFLOW");
 
-				for (unsigned int cc=0;cc < MIN((Bitu)ata->multiple_sector_count,(Bitu)sectcount);cc++) {
-					/* it would be great if the disk object had a "read multiple sectors" member function */
-					if (disk->Read_AbsoluteSector(sectorn+cc, ata->sector+(cc*512)) != 0) {
-						LOG_MSG("ATA read failed\n");
-						ata->abort_error();
-						dev->controller->raise_irq();
-						return;
-					}
+				fatDrive::beforeDiskIO(disk);
+				if (disk->Read_Sectors(sectorn, MIN((Bitu)ata->multiple_sector_count,(Bitu)sectcount), ata->sector) != 0) {
+					LOG_MSG("ATA read failed\n");
+					ata->abort_error();
+					dev->controller->raise_irq();
+					return;
 				}
 
 				/* NTS: the way this command works is that the drive reads ONE sector, then fires the IRQ
@@ -2960,15 +2978,14 @@ static void IDE_DelayedCommand(Bitu idx/*which IDE controller*/) {
 						(ata->lba[0] - 1);
 				}
 
-				for (unsigned int cc=0;cc < MIN((Bitu)ata->multiple_sector_count,(Bitu)sectcount);cc++) {
-					/* it would be great if the disk object had a "write multiple sectors" member function */
-					if (disk->Write_AbsoluteSector(sectorn+cc, ata->sector+(cc*512)) != 0) {
-						LOG_MSG("Failed to write sector\n");
-						ata->abort_error();
-						dev->controller->raise_irq();
-						return;
-					}
+				fatDrive::beforeDiskIO(disk);
+				if (disk->Write_Sectors(sectorn, MIN((Bitu)ata->multiple_sector_count,(Bitu)sectcount), ata->sector) != 0) {
+					LOG_MSG("Failed to write sector\n");
+					ata->abort_error();
+					dev->controller->raise_irq();
+					return;
 				}
+				fatDrive::afterDiskWrite(disk, sectorn, (Bit32u)MIN((Bitu)ata->multiple_sector_count,(Bitu)sectcount));
 
 				for (unsigned int cc=0;cc < MIN((Bitu)ata->multiple_sector_count,(Bitu)sectcount);cc++) {
 					if ((ata->count&0xFF) == 1) {
@@ -3289,6 +3306,8 @@ void IDEATADevice::writecommand(uint8_t cmd) {
 	if (!command_interruption_ok(cmd))
 		return;
 
+	readahead_count = 0;
+
 	if (!faked_command) {
 		if (drivehead_is_lba(drivehead)) {
 			uint64_t n;
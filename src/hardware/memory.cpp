@@ -692,45 +692,58 @@ void mem_strcpy(PhysPt dest,PhysPt src) {
 	mem_writeb_inline(dest,0);
 }
 
+/* Block transfers go a page at a time. Once the first byte went through the
+   handler the page is linked, and if it turned out to be plain memory the rest
+   of it is copied straight from the host pointer in the TLB */
 void mem_memcpy(PhysPt dest,PhysPt src,Bitu size) {
-	while (size--) mem_writeb_inline(dest++,mem_readb_inline(src++));
+	while (size) {
+		Bitu span=mem_span_size(src);
+		if (span>mem_span_size(dest)) span=mem_span_size(dest);
+		if (span>size) span=size;
+		HostPt read=mem_span_read(src);
+		HostPt write=mem_span_write(dest);
+		if (!read || !write) {
+			mem_writeb_inline(dest++,mem_readb_inline(src++));
+			size--;
+			continue;
+		}
+		if (write>read && write<read+span) {
+			/* Overlapping forward copy repeats the data like a byte loop does */
+			for (Bitu i=0;i<span;i++) write[i]=read[i];
+		} else memmove(write,read,span);
+		dest+=span;src+=span;size-=span;
+	}
 }
 
 void MEM_BlockRead(PhysPt pt,void * data,Bitu size) {
 	Bit8u * write=reinterpret_cast<Bit8u *>(data);
-	while (size--) {
-		*write++=mem_readb_inline(pt++);
+	while (size) {
+		Bitu span=mem_span_size(pt);
+		if (span>size) span=size;
+		HostPt read=mem_span_read(pt);
+		if (!read) {
+			*write++=mem_readb_inline(pt++);
+			size--;
+			continue;
+		}
+		memcpy(write,read,span);
+		write+=span;pt+=span;size-=span;
 	}
 }
 
 void MEM_BlockWrite(PhysPt pt,void const * const data,Bitu size) {
 	Bit8u const * read = reinterpret_cast<Bit8u const * const>(data);
-	if (size==0)
-		return;
-
-	if ((pt >> 12) == ((pt+size-1)>>12)) { // Always same TLB entry
-		HostPt tlb_addr=get_tlb_write(pt);
-		if (!tlb_addr) {
-			Bit8u val = *read++;
-			get_tlb_writehandler(pt)->writeb(pt,val);
-			tlb_addr=get_tlb_write(pt);
-			pt++; size--;
-			if (!tlb_addr) {
-				// Slow path
-				while (size--) {
-					mem_writeb_inline(pt++,*read++);
-				}
-				return;
-			}
+	while (size) {
+		Bitu span=mem_span_size(pt);
+		if (span>size) span=size;
+		HostPt write=mem_span_write(pt);
+		if (!write) {
+			mem_writeb_inline(pt++,*read++);
+			size--;
+			continue;
 		}
-		// Fast path
-		memcpy(tlb_addr+pt, read, size);
-	}
-	else {
-		const Bitu current = (((pt>>12)+1)<<12) - pt;
-		Bitu remainder = size - current;
-		MEM_BlockWrite(pt, data, current);
-		MEM_BlockWrite(pt+current, reinterpret_cast<Bit8u const * const>(data)+current, remainder);
+		memcpy(write,read,span);
+		read+=span;pt+=span;size-=span;
 	}
 }
 
@@ -25,7 +25,10 @@
 #include "setup.h"
 #include "control.h"
 
-#define PIC_QUEUESIZE 512
+#include <map>
+#include <vector>
+
+#define PIC_QUEUEGROW 256
 
 struct PIC_Controller {
 	Bitu icw_words;
@@ -177,17 +180,26 @@ void PIC_Controller::start_irq(Bit8u val){
 	}
 }
 
+/* Scheduled events are kept in a binary min-heap ordered on the time they are
+   due, a sequence number keeps events that are due at the same time in the
+   order they were added. Every handler also chains its pending events so they
+   can be removed without going through the whole queue. */
 struct PICEntry {
-	float index;
+	double index;					//Due time in ms, counted like PIC_Ticks
+	Bit64u order;
 	Bitu value;
 	PIC_EventHandler pic_event;
-	PICEntry * next;
+	Bitu heap_pos;
+	PICEntry * hprev, * hnext;		//Events of the same handler
+	PICEntry * next;				//Free list
 };
 
 static struct {
-	PICEntry entries[PIC_QUEUESIZE];
+	std::vector<PICEntry *> heap;
+	std::vector<PICEntry *> blocks;
+	std::map<PIC_EventHandler,PICEntry *> handlers;
 	PICEntry * free_entry;
-	PICEntry * next_entry;
+	Bit64u order;
 } pic_queue;
 
 static void write_command(Bitu port,Bitu val,Bitu iolen) {
@@ -466,31 +478,92 @@ void PIC_SetIRQMask(Bitu irq, bool masked) {
 	pic->set_imr(newmask);
 }
 
-static void AddEntry(PICEntry * entry) {
-	PICEntry * find_entry=pic_queue.next_entry;
-	if (GCC_UNLIKELY(find_entry ==0)) {
-		entry->next=0;
-		pic_queue.next_entry=entry;
-	} else if (find_entry->index>entry->index) {
-		pic_queue.next_entry=entry;
-		entry->next=find_entry;
-	} else while (find_entry) {
-		if (find_entry->next) {
-			/* See if the next index comes later than this one */
-			if (find_entry->next->index > entry->index) {
-				entry->next=find_entry->next;
-				find_entry->next=entry;
-				break;
-			} else {
-				find_entry=find_entry->next;
-			}
-		} else {
-			entry->next=find_entry->next;
-			find_entry->next=entry;
-			break;
-		}
+static void PIC_QueueGrow(void) {
+	PICEntry * block=new PICEntry[PIC_QUEUEGROW];
+	for (Bitu i=0;i<PIC_QUEUEGROW;i++) {
+		block[i].pic_event=0;
+		block[i].next=(i+1<PIC_QUEUEGROW) ? &block[i+1] : pic_queue.free_entry;
 	}
-	Bits cycles=PIC_MakeCycles(pic_queue.next_entry->index-PIC_TickIndex());
+	pic_queue.free_entry=&block[0];
+	pic_queue.blocks.push_back(block);
+}
+
+static INLINE bool PIC_EntryBefore(PICEntry * a,PICEntry * b) {
+	if (a->index!=b->index) return a->index<b->index;
+	return a->order<b->order;
+}
+
+static INLINE void PIC_HeapSet(Bitu pos,PICEntry * entry) {
+	pic_queue.heap[pos]=entry;
+	entry->heap_pos=pos;
+}
+
+static void PIC_HeapUp(Bitu pos) {
+	PICEntry * entry=pic_queue.heap[pos];
+	while (pos>0) {
+		Bitu parent=(pos-1)>>1;
+		if (!PIC_EntryBefore(entry,pic_queue.heap[parent])) break;
+		PIC_HeapSet(pos,pic_queue.heap[parent]);
+		pos=parent;
+	}
+	PIC_HeapSet(pos,entry);
+}
+
+static void PIC_HeapDown(Bitu pos) {
+	Bitu size=pic_queue.heap.size();
+	PICEntry * entry=pic_queue.heap[pos];
+	for (;;) {
+		Bitu child=pos*2+1;
+		if (child>=size) break;
+		if (child+1<size && PIC_EntryBefore(pic_queue.heap[child+1],pic_queue.heap[child])) child++;
+		if (!PIC_EntryBefore(pic_queue.heap[child],entry)) break;
+		PIC_HeapSet(pos,pic_queue.heap[child]);
+		pos=child;
+	}
+	PIC_HeapSet(pos,entry);
+}
+
+/* Take an event out of the heap and its handler chain and free it */
+static void PIC_FreeEntry(PICEntry * entry) {
+	Bitu pos=entry->heap_pos;
+	PICEntry * last=pic_queue.heap.back();
+	pic_queue.heap.pop_back();
+	if (last!=entry) {
+		PIC_HeapSet(pos,last);
+		if (pos>0 && PIC_EntryBefore(last,pic_queue.heap[(pos-1)>>1])) PIC_HeapUp(pos);
+		else PIC_HeapDown(pos);
+	}
+
+	if (entry->hnext) entry->hnext->hprev=entry->hprev;
+	if (entry->hprev) entry->hprev->hnext=entry->hnext;
+	else pic_queue.handlers[entry->pic_event]=entry->hnext;
+
+	entry->pic_event=0;
+	entry->next=pic_queue.free_entry;
+	pic_queue.free_entry=entry;
+}
+
+static INLINE PICEntry * PIC_NextEntry(void) {
+	return pic_queue.heap.empty() ? 0 : pic_queue.heap[0];
+}
+
+/* Time until the first event is due, in the same unit as PIC_TickIndex() */
+static INLINE double PIC_NextIndex(void) {
+	return pic_queue.heap[0]->index-(double)PIC_Ticks;
+}
+
+static void AddEntry(PICEntry * entry) {
+	entry->order=pic_queue.order++;
+	pic_queue.heap.push_back(entry);
+	PIC_HeapUp(pic_queue.heap.size()-1);
+
+	PICEntry * & first=pic_queue.handlers[entry->pic_event];
+	entry->hprev=0;
+	entry->hnext=first;
+	if (first) first->hprev=entry;
+	first=entry;
+
+	Bits cycles=PIC_MakeCycles(PIC_NextIndex()-PIC_TickIndex());
 	if (cycles<CPU_Cycles) {
 		CPU_CycleLeft+=CPU_Cycles;
 		CPU_Cycles=0;
@@ -498,16 +571,13 @@ static void AddEntry(PICEntry * entry) {
 }
 
 static bool InEventService = false;
-static float srv_lag = 0;
+static double srv_lag = 0;
 
-void PIC_AddEvent(PIC_EventHandler handler,float delay,Bitu val) {
-	if (GCC_UNLIKELY(!pic_queue.free_entry)) {
-		LOG(LOG_PIC,LOG_ERROR)("Event queue full");
-		return;
-	}
+void PIC_AddEvent(PIC_EventHandler handler,double delay,Bitu val) {
+	if (GCC_UNLIKELY(!pic_queue.free_entry)) PIC_QueueGrow();
 	PICEntry * entry=pic_queue.free_entry;
 	if(InEventService) entry->index = delay + srv_lag;
-	else entry->index = delay + PIC_TickIndex();
+	else entry->index = delay + PIC_FullIndex();
 
 	entry->pic_event=handler;
 	entry->value=val;
@@ -516,53 +586,20 @@ void PIC_AddEvent(PIC_EventHandler handler,float delay,Bitu val) {
 }
 
 void PIC_RemoveSpecificEvents(PIC_EventHandler handler, Bitu val) {
-	PICEntry * entry=pic_queue.next_entry;
-	PICEntry * prev_entry;
-	prev_entry = 0;
+	std::map<PIC_EventHandler,PICEntry *>::iterator it=pic_queue.handlers.find(handler);
+	if (it==pic_queue.handlers.end()) return;
+	PICEntry * entry=it->second;
 	while (entry) {
-		if (GCC_UNLIKELY((entry->pic_event == handler)) && (entry->value == val)) {
-			if (prev_entry) {
-				prev_entry->next=entry->next;
-				entry->next=pic_queue.free_entry;
-				pic_queue.free_entry=entry;
-				entry=prev_entry->next;
-				continue;
-			} else {
-				pic_queue.next_entry=entry->next;
-				entry->next=pic_queue.free_entry;
-				pic_queue.free_entry=entry;
-				entry=pic_queue.next_entry;
-				continue;
-			}
-		}
-		prev_entry=entry;
-		entry=entry->next;
-	}	
+		PICEntry * next=entry->hnext;
+		if (entry->value == val) PIC_FreeEntry(entry);
+		entry=next;
+	}
 }
 
 void PIC_RemoveEvents(PIC_EventHandler handler) {
-	PICEntry * entry=pic_queue.next_entry;
-	PICEntry * prev_entry;
-	prev_entry=0;
-	while (entry) {
-		if (GCC_UNLIKELY(entry->pic_event==handler)) {
-			if (prev_entry) {
-				prev_entry->next=entry->next;
-				entry->next=pic_queue.free_entry;
-				pic_queue.free_entry=entry;
-				entry=prev_entry->next;
-				continue;
-			} else {
-				pic_queue.next_entry=entry->next;
-				entry->next=pic_queue.free_entry;
-				pic_queue.free_entry=entry;
-				entry=pic_queue.next_entry;
-				continue;
-			}
-		}
-		prev_entry=entry;
-		entry=entry->next;
-	}	
+	std::map<PIC_EventHandler,PICEntry *>::iterator it=pic_queue.handlers.find(handler);
+	if (it==pic_queue.handlers.end()) return;
+	while (it->second) PIC_FreeEntry(it->second);
 }
 
 extern ClockDomain clockdom_DOSBox_cycles;
@@ -579,22 +616,21 @@ bool PIC_RunQueue(void) {
 		/* Check the queue for an entry */
 		Bits index_nd=PIC_TickIndexND();
 		InEventService = true;
-		while (pic_queue.next_entry && (pic_queue.next_entry->index*CPU_CycleMax<=index_nd)) {
-			PICEntry * entry=pic_queue.next_entry;
-			pic_queue.next_entry=entry->next;
+		while (PIC_NextEntry() && (PIC_NextIndex()*CPU_CycleMax<=index_nd)) {
+			PICEntry * entry=PIC_NextEntry();
+			PIC_EventHandler handler=entry->pic_event;
+			Bitu value=entry->value;
 
 			srv_lag = entry->index;
-			(entry->pic_event)(entry->value); // call the event handler
-
-			/* Put the entry in the free list */
-			entry->next=pic_queue.free_entry;
-			pic_queue.free_entry=entry;
+			/* Put the entry in the free list before calling the handler, it may add or remove events */
+			PIC_FreeEntry(entry);
+			handler(value); // call the event handler
 		}
 		InEventService = false;
 
 		/* Check when to set the new cycle end */
-		if (pic_queue.next_entry) {
-			Bits cycles=(Bits)(pic_queue.next_entry->index*CPU_CycleMax-index_nd);
+		if (PIC_NextEntry()) {
+			Bits cycles=(Bits)(PIC_NextIndex()*CPU_CycleMax-index_nd);
 			if (GCC_UNLIKELY(!cycles)) cycles=1;
 			if (cycles<CPU_CycleLeft) {
 				CPU_Cycles=cycles;
@@ -677,12 +713,7 @@ void TIMER_AddTick(void) {
 	CPU_CycleLeft += CPU_CycleMax + CPU_Cycles;
 	CPU_Cycles = 0;
 
-	/* Go through the list of scheduled events and lower their index with 1000 */
-	PICEntry * entry=pic_queue.next_entry;
-	while (entry) {
-		entry->index -= 1.0;
-		entry=entry->next;
-	}
+	/* Scheduled events are due at a time counted like PIC_Ticks so nothing to adjust there */
 
 	/* Call our list of ticker handlers */
 	TickerBlock * ticker=firstticker;
@@ -723,6 +754,10 @@ void PIC_Reset(Section *sec) {
     PIC_irq_delay = section->Get_int("irq delay");
     if (PIC_irq_delay < 0) PIC_irq_delay = 2; /* default */
 
+	/* Keep pending events due at the same time from now on */
+	for (i=0;i<pic_queue.heap.size();i++)
+		pic_queue.heap[i]->index-=(double)PIC_Ticks;
+
 	/* Setup pic0 and pic1 with initial values like DOS has normally */
 	PIC_Ticks=0;
 	PIC_IRQCheck=0;
@@ -780,6 +815,12 @@ void PIC_Reset(Section *sec) {
 }
 
 void PIC_Destroy(Section* sec) {
+	pic_queue.heap.clear();
+	pic_queue.handlers.clear();
+	for (Bitu i=0;i<pic_queue.blocks.size();i++)
+		delete[] pic_queue.blocks[i];
+	pic_queue.blocks.clear();
+	pic_queue.free_entry=0;
 }
 
 void PIC_EnterPC98_Phase1(Section* sec) {
@@ -799,20 +840,12 @@ void PIC_EnterPC98_Phase2(Section* sec) {
 }
 
 void Init_PIC() {
-	Bitu i;
-
 	LOG(LOG_MISC,LOG_DEBUG)("Init_PIC()");
 
 	/* Initialize the pic queue */
-	for (i=0;i<PIC_QUEUESIZE-1;i++) {
-		pic_queue.entries[i].next=&pic_queue.entries[i+1];
-
-		// savestate compatibility
-		pic_queue.entries[i].pic_event = 0;
-	}
-	pic_queue.entries[PIC_QUEUESIZE-1].next=0;
-	pic_queue.free_entry=&pic_queue.entries[0];
-	pic_queue.next_entry=0;
+	pic_queue.free_entry=0;
+	pic_queue.order=0;
+	PIC_QueueGrow();
 
 	AddExitFunction(AddExitFunctionFuncPair(PIC_Destroy));
 	AddVMEventFunction(VM_EVENT_RESET,AddVMEventFunctionFuncPair(PIC_Reset));
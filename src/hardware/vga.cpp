@@ -477,6 +477,9 @@ void VGA_Reset(Section*) {
 	enable_page_flip_debugging_marker = section->Get_bool("page flip debug line");
 	enable_vretrace_poll_debugging_marker = section->Get_bool("vertical retrace poll debug line");
 	vga_double_buffered_line_compare = section->Get_bool("double-buffered line compare");
+	str = section->Get_string("vga write tracking");
+	vga.changes.enabled = (str != "off");
+	vga.changes.trap_direct = (str == "full");
 	hack_lfb_yadjust = section->Get_int("vesa lfb base scanline adjust");
 	allow_vesa_lowres_modes = section->Get_bool("allow low resolution vesa modes");
 	vesa12_modes_32bpp = section->Get_bool("vesa vbe 1.2 modes are 32bpp");
@@ -665,6 +668,7 @@ void VGA_UnsetupAttr(void);
 void VGA_UnsetupDAC(void);
 void VGA_UnsetupGFX(void);
 void VGA_UnsetupSEQ(void);
+void VGA_Selftest_Lines(void);
 
 #define gfx(blah) vga.gfx.blah
 #define seq(blah) vga.seq.blah
@@ -774,6 +778,8 @@ void VGA_Init() {
 		}
 	}
 
+	if (control->opt_debug) VGA_Selftest_Lines();
+
 	AddVMEventFunction(VM_EVENT_RESET,AddVMEventFunctionFuncPair(VGA_Reset));
 	AddVMEventFunction(VM_EVENT_ENTER_PC98_MODE,AddVMEventFunctionFuncPair(VGA_OnEnterPC98));
 }
@@ -111,6 +111,7 @@ void write_p3c0(Bitu /*port*/,Bitu val,Bitu iolen) {
 		return;
 	} else {
 		vga.internal.attrindex=false;
+		VGA_InvalidateChanges();
 		switch (attr(index)) {
 			/* Palette */
 		case 0x00:		case 0x01:		case 0x02:		case 0x03:
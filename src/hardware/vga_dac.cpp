@@ -64,6 +64,7 @@ static void VGA_DAC_SendColor( Bitu index, Bitu src ) {
 		vga.dac.xlat16[index] = ((((blue&0x3f)>>1)<<GFX_Bshift)) | ((green&0x3f)<<GFX_Gshift) | (((red&0x3f)>>1)<<GFX_Rshift) | GFX_Amask;
 
 	RENDER_SetPal( index, (red << 2) | ( red >> 4 ), (green << 2) | ( green >> 4 ), (blue << 2) | ( blue >> 4 ) );
+	VGA_InvalidateChanges();
 }
 
 void VGA_DAC_UpdateColor( Bitu index ) {
@@ -20,6 +20,7 @@
 #include <string.h>
 #include <math.h>
 #include <stdio.h>
+#include <vector>
 #include "dosbox.h"
 #if defined (WIN32)
 #include <d3d9.h>
@@ -35,6 +36,9 @@
 #include "timer.h"
 #include "config.h"
 #include "control.h"
+#if defined(__SSE__)
+#include <emmintrin.h>
+#endif
 
 //#undef C_DEBUG
 //#define C_DEBUG 1
@@ -54,6 +58,9 @@ extern unsigned int vga_display_start_hretrace;
 extern float hretrace_fx_avg_weight;
 extern bool ignore_vblank_wraparound;
 extern bool vga_double_buffered_line_compare;
+#if defined(__SSE__)
+extern bool sse2_available;
+#endif
 
 void memxor(void *_d,unsigned int byte,size_t count) {
 	unsigned char *d = (unsigned char*)_d;
@@ -298,7 +305,29 @@ static Bit8u * VGA_Draw_Linear_Line_24_to_32(Bitu vidstart, Bitu /*line*/) {
 	 *          extra byte), then overwrites the extra byte with 0xFF to
 	 *          produce a valid RGBA 8:8:8:8 value with the original pixel's
 	 *          RGB plus alpha channel value of 0xFF. */
-	for (i=0;i < vga.draw.width;i++)
+	i = 0;
+#if defined(__SSE__)
+	if (sse2_available) {
+		/* Four pixels at a time. Shifting the 16 bytes left by n bytes puts
+		 * pixel n at the start of dword n, the masks keep its RGB bytes. The
+		 * loads must stay below the end of video memory. */
+		const Bit8u *src = vga.draw.linear_base + offset;
+		Bitu avail = vga.draw.linear_mask + 1 - offset;
+		const __m128i m0 = _mm_set_epi32(0,0,0,0x00FFFFFF);
+		const __m128i m1 = _mm_set_epi32(0,0,0x00FFFFFF,0);
+		const __m128i m2 = _mm_set_epi32(0,0x00FFFFFF,0,0);
+		const __m128i m3 = _mm_set_epi32(0x00FFFFFF,0,0,0);
+		const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+		for (;(i+4) <= vga.draw.width && (i*3+16) <= avail;i += 4) {
+			__m128i v = _mm_loadu_si128((const __m128i*)(src+(i*3)));
+			__m128i p = _mm_or_si128(_mm_and_si128(v,m0),_mm_and_si128(_mm_slli_si128(v,1),m1));
+			p = _mm_or_si128(p,_mm_and_si128(_mm_slli_si128(v,2),m2));
+			p = _mm_or_si128(p,_mm_and_si128(_mm_slli_si128(v,3),m3));
+			_mm_storeu_si128((__m128i*)(TempLine+(i*4)),_mm_or_si128(p,alpha));
+		}
+	}
+#endif
+	for (;i < vga.draw.width;i++)
 		((uint32_t*)TempLine)[i] = *((uint32_t*)(vga.draw.linear_base+offset+(i*3))) | 0xFF000000;
 
 	return TempLine;
@@ -390,10 +419,31 @@ static Bit8u * VGA_Draw_Xlat32_VGA_CRTC_bmode_Line(Bitu vidstart, Bitu /*line*/)
 	return TempLine + (poff * 4);
 }
 
+/* No SSE2 path here: SSE2 has no gather, and loading 16 indexes at once only to look them
+ * up one by one and store the results 4 at a time measured 15-30% slower than this loop
+ * for 640 and 1280 pixel lines. */
 static Bit8u * VGA_Draw_Xlat32_Linear_Line(Bitu vidstart, Bitu /*line*/) {
 	Bit32u* temps = (Bit32u*) TempLine;
+	Bitu count = vga.draw.line_length>>2;
+	Bitu offset = vidstart & vga.draw.linear_mask;
 
-	for(Bitu i = 0; i < (vga.draw.line_length>>2); i++)
+	if (GCC_LIKELY((offset + count) <= (vga.draw.linear_mask + 1))) {
+		/* the usual case, the line does not wrap around */
+		const Bit8u *src = &vga.draw.linear_base[offset];
+		const Bit32u *xlat = vga.dac.xlat32;
+		Bitu i = 0;
+		for(; (i + 4) <= count; i += 4) {
+			temps[i+0]=xlat[src[i+0]];
+			temps[i+1]=xlat[src[i+1]];
+			temps[i+2]=xlat[src[i+2]];
+			temps[i+3]=xlat[src[i+3]];
+		}
+		for(; i < count; i++)
+			temps[i]=xlat[src[i]];
+		return TempLine;
+	}
+
+	for(Bitu i = 0; i < count; i++)
 		temps[i]=vga.dac.xlat32[vga.draw.linear_base[(vidstart+i)&vga.draw.linear_mask]];
 
 	return TempLine;
@@ -404,8 +454,31 @@ extern Bit32u Expand16Table[4][16];
 static Bit8u * VGA_Draw_VGA_Planar_Xlat32_Line(Bitu vidstart, Bitu /*line*/) {
 	Bit32u* temps = (Bit32u*) TempLine;
 	Bit32u t1,t2,tmp;
+	Bitu end = (vga.draw.line_length>>2)+vga.draw.panning;
+	Bitu i = 0;
 
-	for (Bitu i = 0; i < ((vga.draw.line_length>>2)+vga.draw.panning); i += 8) {
+#if defined(__SSE__)
+	if (sse2_available) {
+		/* Four latches (32 pixels) at a time. The sign bits of the 16 bytes are
+		 * one pixel of each latch, plane n of latch l in bit 4*l+n, doubling
+		 * every byte moves on to the next pixel. */
+		const Bit32u *xlat = vga.dac.xlat32;
+		for (; (i + 32) <= end && ((vidstart & vga.draw.linear_mask) + 16) <= (vga.draw.linear_mask + 1); i += 32) {
+			__m128i v = _mm_loadu_si128((const __m128i*)(&vga.draw.linear_base[ vidstart & vga.draw.linear_mask ]));
+			vidstart += 16;
+			for (Bitu x = 0; x < 8; x++) {
+				unsigned int m = (unsigned int)_mm_movemask_epi8(v);
+				temps[i+x]    = xlat[m & 0xF];
+				temps[i+x+8]  = xlat[(m >> 4) & 0xF];
+				temps[i+x+16] = xlat[(m >> 8) & 0xF];
+				temps[i+x+24] = xlat[(m >> 12) & 0xF];
+				v = _mm_add_epi8(v,v);
+			}
+		}
+	}
+#endif
+
+	for (; i < end; i += 8) {
 		t1 = t2 = *((Bit32u*)(&vga.draw.linear_base[ vidstart & vga.draw.linear_mask ]));
 		t1 = (t1 >> 4) & 0x0f0f0f0f;
 		t2 &= 0x0f0f0f0f;
@@ -811,6 +884,21 @@ skip_cursor:
 	return TempLine;
 }
 
+#if defined(__SSE__)
+// eight pixels of a font byte, bit 7 is the leftmost one
+static INLINE void VGA_TEXT_Xlat32_Draw8_SSE2(Bit32u* draw, Bitu font, Bit32u fg, Bit32u bg) {
+	const __m128i bits_lo = _mm_set_epi32(0x10,0x20,0x40,0x80);
+	const __m128i bits_hi = _mm_set_epi32(0x01,0x02,0x04,0x08);
+	__m128i f = _mm_set1_epi32((int)font);
+	__m128i vfg = _mm_set1_epi32((int)fg);
+	__m128i vbg = _mm_set1_epi32((int)bg);
+	__m128i sel = _mm_cmpeq_epi32(_mm_and_si128(f,bits_lo),bits_lo);
+	_mm_storeu_si128((__m128i*)draw,_mm_or_si128(_mm_and_si128(sel,vfg),_mm_andnot_si128(sel,vbg)));
+	sel = _mm_cmpeq_epi32(_mm_and_si128(f,bits_hi),bits_hi);
+	_mm_storeu_si128((__m128i*)(draw+4),_mm_or_si128(_mm_and_si128(sel,vfg),_mm_andnot_si128(sel,vbg)));
+}
+#endif
+
 // combined 8/9-dot wide text mode 16bpp line drawing function
 static Bit8u* VGA_TEXT_Xlat32_Draw_Line(Bitu vidstart, Bitu line) {
 	// keep it aligned:
@@ -845,11 +933,26 @@ static Bit8u* VGA_TEXT_Xlat32_Draw_Line(Bitu vidstart, Bitu line) {
 			// extend to the 9th pixel if needed
 			if ((font&0x2) && (vga.attr.mode_control&0x04) &&
 				(chr>=0xc0) && (chr<=0xdf)) font |= 1;
+#if defined(__SSE__)
+			if (sse2_available) {
+				VGA_TEXT_Xlat32_Draw8_SSE2(draw,(font>>1)&0xff,vga.dac.xlat32[foreground],vga.dac.xlat32[background]);
+				draw[8] = vga.dac.xlat32[(font&0x1)? foreground:background];
+				draw += 9;
+				continue;
+			}
+#endif
 			for (Bitu n = 0; n < 9; n++) {
 				*draw++ = vga.dac.xlat32[(font&0x100)? foreground:background];
 				font <<= 1;
 			}
 		} else {
+#if defined(__SSE__)
+			if (sse2_available) {
+				VGA_TEXT_Xlat32_Draw8_SSE2(draw,font,vga.dac.xlat32[foreground],vga.dac.xlat32[background]);
+				draw += 8;
+				continue;
+			}
+#endif
 			for (Bitu n = 0; n < 8; n++) {
 				*draw++ = vga.dac.xlat32[(font&0x80)? foreground:background];
 				font <<= 1;
@@ -874,6 +977,97 @@ static Bit8u* VGA_TEXT_Xlat32_Draw_Line(Bitu vidstart, Bitu line) {
 	return TempLine+(16*4);
 }
 
+static Bit32u VGA_SelftestRandom(Bit32u &seed) {
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return seed;
+}
+
+#if defined(__SSE__)
+// draw one line with and without SSE2, false if they differ
+static bool VGA_SelftestLine(VGA_Line_Handler handler,Bitu vidstart,Bitu line,Bitu pixels) {
+	std::vector<Bit32u> plain(pixels);
+	sse2_available = true;
+	memcpy(&plain[0],handler(vidstart,line),pixels*4);
+	sse2_available = false;
+	bool same = memcmp(&plain[0],handler(vidstart,line),pixels*4) == 0;
+	sse2_available = true;
+	return same;
+}
+#endif
+
+// test routine to make sure the faster line converters draw the same as the plain
+// ones, on random video memory, palette and panning. Runs with -debug only.
+void VGA_Selftest_Lines(void) {
+	static const Bitu mask = 0xFFFF;
+	std::vector<Bit8u> mem(mask + 1 + 4096);
+	std::vector<Bit8u> font(2 * 256 * 32);
+	VGA_Type *saved = new VGA_Type(vga);
+	Bit32u seed = 0x1234567;
+	const char *failed = NULL;
+
+	for (size_t i = 0;i < mem.size();i++) mem[i] = (Bit8u)VGA_SelftestRandom(seed);
+	for (size_t i = 0;i < font.size();i++) font[i] = (Bit8u)VGA_SelftestRandom(seed);
+	for (Bitu i = 0;i < 256;i++) vga.dac.xlat32[i] = VGA_SelftestRandom(seed);
+	vga.draw.linear_base = vga.mem.linear = &mem[0];
+	vga.draw.linear_mask = mask;
+	vga.draw.planar_mask = mask >> 2;
+	vga.draw.font_tables[0] = &font[0];
+	vga.draw.font_tables[1] = &font[256 * 32];
+	vga.draw.cursor.enabled = false;
+
+	for (Bitu t = 0;t < 64 && failed == NULL;t++) {
+		Bitu vidstart = VGA_SelftestRandom(seed) & mask;
+
+		// 8bpp: the unrolled loop for lines that don't wrap against a lookup per pixel,
+		// every other line ends past the top of video memory
+		vga.draw.line_length = ((VGA_SelftestRandom(seed) % SCALER_MAXWIDTH) + 1) * 4;
+		Bitu count = vga.draw.line_length >> 2;
+		Bitu start = (t & 1) ? (mask + 1 - (VGA_SelftestRandom(seed) % count)) & mask : vidstart;
+		const Bit32u *line = (const Bit32u*)VGA_Draw_Xlat32_Linear_Line(start,0);
+		for (Bitu i = 0;i < count;i++) {
+			if (line[i] != vga.dac.xlat32[mem[(start + i) & mask]]) {
+				failed = "8bpp";
+				break;
+			}
+		}
+
+#if defined(__SSE__)
+		if (!sse2_available) continue;
+
+		vga.draw.panning = VGA_SelftestRandom(seed) & 7;
+		vga.draw.line_length = ((VGA_SelftestRandom(seed) % (SCALER_MAXWIDTH / 8 - 1)) + 1) * 32;
+		if (!VGA_SelftestLine(VGA_Draw_VGA_Planar_Xlat32_Line,vidstart,0,
+			((vga.draw.line_length >> 2) + vga.draw.panning + 7) & ~7))
+			failed = "planar";
+
+		vga.draw.width = (VGA_SelftestRandom(seed) % SCALER_MAXWIDTH) + 1;
+		if (!VGA_SelftestLine(VGA_Draw_Linear_Line_24_to_32,vidstart,0,vga.draw.width))
+			failed = "24bpp";
+
+		vga.draw.blocks = (VGA_SelftestRandom(seed) % (SCALER_MAXWIDTH / 9)) + 1;
+		vga.draw.panning = VGA_SelftestRandom(seed) % 9;
+		vga.draw.char9dot = (t & 1) != 0;
+		vga.draw.blinking = (t >> 1) & 1;
+		vga.draw.blink = ((t >> 2) & 1) != 0;
+		vga.config.addr_shift = (t >> 3) & 1;
+		vga.attr.mode_control = (Bit8u)VGA_SelftestRandom(seed);
+		vga.crtc.underline_location = (Bit8u)VGA_SelftestRandom(seed);
+		if (!VGA_SelftestLine(VGA_TEXT_Xlat32_Draw_Line,vidstart,VGA_SelftestRandom(seed) & 31,
+			vga.draw.blocks * (vga.draw.char9dot ? 9 : 8) - vga.draw.panning))
+			failed = vga.draw.char9dot ? "9 dot text" : "8 dot text";
+#endif
+	}
+
+	vga = *saved;
+	delete saved;
+	if (failed != NULL)
+		LOG(LOG_VGA,LOG_WARN)("VGA line selftest fail: %s lines differ from the plain ones",failed);
+	else
+		LOG(LOG_VGA,LOG_DEBUG)("VGA line selftest passed");
+}
+
 unsigned int pc98_map_charfont(Bit16u chr,unsigned char line,unsigned char righthalf/*if fullwidth*/) {
     unsigned int index;
 
@@ -1009,6 +1203,132 @@ static Bit8u* VGA_PC98_Xlat32_Draw_Line(Bitu vidstart, Bitu line) {
 	return TempLine;
 }
 
+/* Lines whose video memory wasn't written to since they were last drawn go to
+   the renderer as NULL, it still has them from the frame before. A line is only
+   left out if it was drawn from the same address with the same state, which
+   anything but video memory changes through vga.changes.generation. */
+struct VGA_ChangesLine {
+	Bitu address, line;
+	Bit32u frame, generation;
+};
+
+/* The state of a frame that doesn't come from registers */
+struct VGA_ChangesKey {
+	VGA_Line_Handler drawline;
+	Bitu linear_mask, line_length, blocks, panning, bpp;
+	Bitu cursor_address, cursor_count;
+	bool blink;
+};
+
+static std::vector<VGA_ChangesLine> changes_lines;
+static VGA_ChangesKey changes_key;
+static struct {
+	Bitu span;			/* Bytes of video memory a line reads, 0 if lines can't be left out */
+	Bitu mask;
+	bool planar;		/* Addresses count in units of four bytes */
+	Bitu cursor;		/* Start of the hardware cursor pattern, it counts as part of every line */
+	bool has_cursor;
+} changes_draw;
+
+static bool VGA_ChangesClean(Bitu start,Bitu len,Bitu mask,Bit32u frame) {
+	const Bit32u *map = vga.changes.map;
+	while (len) {
+		start &= mask;
+		Bitu chunk = mask - start + 1;
+		if (chunk == 0 || chunk > len) chunk = len;
+		Bitu end = (start + chunk - 1) >> VGA_CHANGE_SHIFT;
+		/* Memory the map doesn't cover is never clean */
+		if (end >= vga.changes.blocks) return false;
+		for (Bitu b = start >> VGA_CHANGE_SHIFT;b <= end;b++)
+			if ((Bit32s)(map[b] - frame) >= 0) return false;
+		start += chunk;
+		len -= chunk;
+	}
+	return true;
+}
+
+/* Find out how lines of this frame read video memory */
+static void VGA_ChangesStartFrame(void) {
+	vga.changes.frame++;
+	changes_draw.span = 0;
+	changes_draw.has_cursor = false;
+	if (!vga.changes.active || vga.changes.map == NULL) {
+		VGA_InvalidateChanges();
+		return;
+	}
+
+	VGA_ChangesKey key;
+	memset(&key,0,sizeof(key));
+	key.drawline = VGA_DrawLine;
+	key.linear_mask = vga.draw.linear_mask;
+	key.line_length = vga.draw.line_length;
+	key.blocks = vga.draw.blocks;
+	key.panning = vga.draw.panning;
+	key.bpp = vga.draw.bpp;
+	if (vga.mode == M_TEXT) {
+		key.cursor_address = vga.draw.cursor.address;
+		key.cursor_count = vga.draw.cursor.count & 0x8;
+		key.blink = vga.draw.blink;
+	}
+	if (memcmp(&key,&changes_key,sizeof(key)) != 0) {
+		changes_key = key;
+		VGA_InvalidateChanges();
+	}
+	if (changes_lines.size() < vga.draw.lines_total) {
+		VGA_ChangesLine unused = { 0, 0, 0, vga.changes.generation };
+		changes_lines.resize(vga.draw.lines_total,unused);
+		VGA_InvalidateChanges();
+	}
+
+	changes_draw.mask = vga.draw.linear_mask;
+	changes_draw.planar = false;
+	if (VGA_DrawLine == VGA_Draw_Linear_Line || VGA_DrawLine == VGA_Draw_Linear_Line_24_to_32 ||
+		VGA_DrawLine == VGA_Draw_LIN16_Line_HWMouse || VGA_DrawLine == VGA_Draw_LIN32_Line_HWMouse ||
+		VGA_DrawLine == VGA_Draw_VGA_Line_HWMouse || VGA_DrawLine == VGA_Draw_LIN16_Line_2x) {
+		changes_draw.span = vga.draw.line_length;
+	} else if (VGA_DrawLine == VGA_Draw_Xlat32_Linear_Line || VGA_DrawLine == VGA_Draw_VGA_Line_Xlat32_HWMouse) {
+		changes_draw.span = vga.draw.line_length >> 2;
+	} else if (VGA_DrawLine == VGA_Draw_Xlat32_VGA_CRTC_bmode_Line) {
+		/* The retrace effects move the lines around on their own */
+		if (!vga_enable_hretrace_effects)
+			changes_draw.span = ((vga.draw.line_length >> 4) + 1) << (2 + vga.config.addr_shift);
+	} else if (VGA_DrawLine == VGA_Draw_VGA_Planar_Xlat32_Line) {
+		/* 8 pixels in 4 bytes, the SSE2 version reads 16 bytes at a time */
+		changes_draw.span = (((vga.draw.line_length >> 2) + vga.draw.panning) >> 1) + 16;
+	} else if (VGA_DrawLine == VGA_TEXT_Xlat32_Draw_Line) {
+		changes_draw.span = (vga.draw.blocks + 1) << (2 + vga.config.addr_shift);
+		changes_draw.mask = (vga.draw.planar_mask << 2) | 3;
+		changes_draw.planar = true;
+	}
+	if (VGA_DrawLine == VGA_Draw_LIN16_Line_HWMouse || VGA_DrawLine == VGA_Draw_LIN32_Line_HWMouse ||
+		VGA_DrawLine == VGA_Draw_VGA_Line_HWMouse || VGA_DrawLine == VGA_Draw_VGA_Line_Xlat32_HWMouse) {
+		changes_draw.cursor = ((Bitu)vga.s3.hgc.startaddr) << 10;
+		changes_draw.has_cursor = true;
+	}
+	if ((changes_draw.mask >> VGA_CHANGE_SHIFT) >= vga.changes.blocks ||
+		(changes_draw.has_cursor && ((changes_draw.cursor + 1023) >> VGA_CHANGE_SHIFT) >= vga.changes.blocks))
+		changes_draw.span = 0;
+	if (!changes_draw.span) VGA_InvalidateChanges();
+}
+
+/* True if the renderer can keep what it has for the line drawn from vidstart */
+static bool VGA_ChangesSkipLine(Bitu vidstart,Bitu line) {
+	if (!changes_draw.span || vga.draw.lines_done >= changes_lines.size()) return false;
+	VGA_ChangesLine & last = changes_lines[vga.draw.lines_done];
+	bool skip = !render.fullFrame && last.generation == vga.changes.generation &&
+		last.address == vidstart && last.line == line;
+	if (skip) {
+		Bitu start = changes_draw.planar ? (vidstart << 2) : vidstart;
+		skip = VGA_ChangesClean(start,changes_draw.span,changes_draw.mask,last.frame) &&
+			(!changes_draw.has_cursor || VGA_ChangesClean(changes_draw.cursor,1024,vga.vmemwrap - 1,last.frame));
+	}
+	last.address = vidstart;
+	last.line = line;
+	last.frame = vga.changes.frame;
+	last.generation = vga.changes.generation;
+	return skip;
+}
+
 static void VGA_ProcessSplit() {
 	vga.draw.has_split = true;
 	if (vga.attr.mode_control&0x20) {
@@ -1150,16 +1470,22 @@ static void VGA_DrawSingleLine(Bitu /*blah*/) {
 			memxor_greendotted_16bpp((uint16_t*)TempLine,(vga.draw.width>>1)*(vga.draw.bpp>>3),vga.draw.lines_done);
 			vga_3da_polled = false;
 		}
+		VGA_InvalidateChanges();
 		RENDER_DrawLine(TempLine);
+	} else if (!vga_page_flip_occurred && !vga_3da_polled &&
+		VGA_ChangesSkipLine(vga.draw.address, vga.draw.address_line)) {
+		RENDER_DrawLine(NULL);
 	} else {
 		Bit8u * data=VGA_DrawLine( vga.draw.address, vga.draw.address_line );
 		if (vga_page_flip_occurred) {
 			memxor(data,0xFF,vga.draw.width*(vga.draw.bpp>>3));
 			vga_page_flip_occurred = false;
+			VGA_InvalidateChanges();
 		}
 		if (vga_3da_polled) {
 			memxor_greendotted_16bpp((uint16_t*)TempLine,(vga.draw.width>>1)*(vga.draw.bpp>>3),vga.draw.lines_done);
 			vga_3da_polled = false;
+			VGA_InvalidateChanges();
 		}
 		RENDER_DrawLine(data);
 	}
@@ -1198,6 +1524,7 @@ static void VGA_DrawSingleLine(Bitu /*blah*/) {
 static void VGA_DrawEGASingleLine(Bitu /*blah*/) {
 	if (GCC_UNLIKELY(vga.attr.disabled)) {
 		memset(TempLine, 0, sizeof(TempLine));
+		VGA_InvalidateChanges();
 		RENDER_DrawLine(TempLine);
 	} else {
 		Bitu address = vga.draw.address;
@@ -1214,8 +1541,12 @@ static void VGA_DrawEGASingleLine(Bitu /*blah*/) {
 					break;
 			}
 		}
-		Bit8u * data=VGA_DrawLine(address, vga.draw.address_line );	
-		RENDER_DrawLine(data);
+		if (VGA_ChangesSkipLine(address, vga.draw.address_line)) {
+			RENDER_DrawLine(NULL);
+		} else {
+			Bit8u * data=VGA_DrawLine(address, vga.draw.address_line );	
+			RENDER_DrawLine(data);
+		}
 	}
 
 	vga.draw.address_line++;
@@ -1246,6 +1577,7 @@ void VGA_SetBlinking(Bitu enabled) {
 		vga.tandy.mode_control&=~0x20;
 	}
 	for (Bitu i=0;i<8;i++) TXT_BG_Table[i+8]=(b+i) | ((b+i) << 8)| ((b+i) <<16) | ((b+i) << 24);
+	VGA_InvalidateChanges();
 }
 
 static void VGA_VertInterrupt(Bitu /*val*/) {
@@ -1559,6 +1891,8 @@ static void VGA_VerticalTimer(Bitu /*val*/) {
 		}
 	}
 
+	VGA_ChangesStartFrame();
+
 	// add the draw event
 	switch (vga.draw.mode) {
 	case LINE:
@@ -1702,6 +2036,7 @@ void VGA_SetupDrawing(Bitu /*val*/) {
 		PIC_RemoveEvents(VGA_DisplayStartLatch);
 		return;
 	}
+	VGA_InvalidateChanges();
 	// user choosable special trick support
 	// multiscan -- zooming effects - only makes sense if linewise is enabled
 	// linewise -- scan display line by line instead of 4 blocks
@@ -218,6 +218,7 @@ public:
 		ModeOperation(val);
 		/* Update video memory and the pixel buffer */
 		vga.mem.linear[start] = val;
+		VGA_MarkChanged(start);
 	}
 public:	
 	VGA_ChainedEGA_Handler() : PageHandler(PFLAG_NOCODE) {}
@@ -287,6 +288,7 @@ public:
 		pixels.d&=vga.config.full_not_map_mask;
 		pixels.d|=(data & vga.config.full_map_mask);
 		((Bit32u*)vga.mem.linear)[start]=pixels.d;
+		VGA_MarkChanged(start<<2);
 	}
 public:	
 	VGA_UnchainedEGA_Handler() : VGA_UnchainedRead_Handler(PFLAG_NOCODE) {}
@@ -342,6 +344,7 @@ public:
 		pixels.d = ModeOperation(val);
 		/* Update video memory and the pixel buffer */
 		hostWrite<Bit8u>( &vga.mem.linear[((addr&~3)<<2)+(addr&3)], pixels.b[addr&3] );
+		VGA_MarkChanged(((addr&~3)<<2)+(addr&3));
 	}
 	Bitu readb(PhysPt addr ) {
 		VGAMEM_USEC_read_delay();
@@ -409,6 +412,7 @@ public:
 	static INLINE void writeHandler(PhysPt addr, Bitu val) {
 		// No need to check for compatible chains here, this one is only enabled if that bit is set
 		hostWrite<Size>( &vga.mem.linear[((addr&0xFFFC)<<2)+(addr&3)], val );
+		VGA_MarkChanged(((addr&0xFFFC)<<2)+(addr&3));
 	}
 	Bitu readb(PhysPt addr ) {
 		VGAMEM_USEC_read_delay();
@@ -491,6 +495,7 @@ public:
 	static INLINE void writeHandler(PhysPt addr, Bitu val) {
 		// No need to check for compatible chains here, this one is only enabled if that bit is set
 		hostWrite<Size>( &vga.mem.linear[addr], val );
+		VGA_MarkChanged(addr);
 	}
 	Bitu readb(PhysPt addr ) {
 		VGAMEM_USEC_read_delay();
@@ -574,6 +579,7 @@ public:
 		pixels.d = ModeOperation(val);
 		/* Update video memory and the pixel buffer */
 		hostWrite<Bit8u>( &vga.mem.linear[addr], pixels.b[addr&3] );
+		VGA_MarkChanged(addr);
 	}
 	Bitu readb(PhysPt addr ) {
 		VGAMEM_USEC_read_delay();
@@ -672,6 +678,7 @@ public:
 				if (vga.seq.map_mask & 0x4) { /* bitplane 2: font RAM */
 					pixels.b[2] = data >> 16;
 					vga.draw.font[memaddr] = data >> 16;
+					VGA_InvalidateChanges();
 				}
 			}
 		}
@@ -681,6 +688,7 @@ public:
 		}
 
 		((Bit32u*)vga.mem.linear)[memaddr]=pixels.d;
+		VGA_MarkChanged(memaddr<<2);
 	}
 public:
 	VGA_UnchainedVGA_Handler() : VGA_UnchainedRead_Handler(PFLAG_NOCODE) {}
@@ -848,10 +856,12 @@ public:
 			if (vga.seq.map_mask & 0x4) { /* bitplane 2: font RAM */
 				pixels.b[2] = val;
 				vga.draw.font[memaddr] = val;
+				VGA_InvalidateChanges();
 			}
 		}
 
 		((Bit32u*)vga.mem.linear)[memaddr]=pixels.d;
+		VGA_MarkChanged(memaddr<<2);
 	}
 };
 
@@ -866,6 +876,24 @@ public:
  		phys_page-=vgapages.base;
 		return &vga.mem.linear[CHECKED3(vga.svga.bank_write_full+phys_page*4096)];
 	}
+	/* Only called when the writes are trapped for the change tracking */
+	void writeb(PhysPt addr,Bitu val) {
+		HostPt w = GetHostWritePt(PAGING_GetPhysicalAddress(addr) >> 12) + (addr & 0xfff);
+		host_writeb(w,(Bit8u)val);
+		VGA_MarkChanged((Bitu)(w - vga.mem.linear));
+	}
+	void writew(PhysPt addr,Bitu val) {
+		HostPt w = GetHostWritePt(PAGING_GetPhysicalAddress(addr) >> 12) + (addr & 0xfff);
+		host_writew(w,(Bit16u)val);
+		VGA_MarkChanged((Bitu)(w - vga.mem.linear));
+		VGA_MarkChanged((Bitu)(w - vga.mem.linear) + 1);
+	}
+	void writed(PhysPt addr,Bitu val) {
+		HostPt w = GetHostWritePt(PAGING_GetPhysicalAddress(addr) >> 12) + (addr & 0xfff);
+		host_writed(w,(Bit32u)val);
+		VGA_MarkChanged((Bitu)(w - vga.mem.linear));
+		VGA_MarkChanged((Bitu)(w - vga.mem.linear) + 3);
+	}
 };
 
 class VGA_Slow_CGA_Handler : public PageHandler {
@@ -940,6 +968,8 @@ public:
 	}
 };
 
+static void VGA_LFBWritten(void);
+
 class VGA_LFB_Handler : public PageHandler {
 public:
 	VGA_LFB_Handler() : PageHandler(PFLAG_READABLE|PFLAG_WRITEABLE|PFLAG_NOCODE) {}
@@ -951,6 +981,27 @@ public:
 	HostPt GetHostWritePt( Bitu phys_page ) {
 		return GetHostReadPt( phys_page );
 	}
+	/* Only called when the writes are trapped for the change tracking */
+	void writeb(PhysPt addr,Bitu val) {
+		HostPt w = GetHostWritePt(PAGING_GetPhysicalAddress(addr) >> 12) + (addr & 0xfff);
+		host_writeb(w,(Bit8u)val);
+		VGA_MarkChanged((Bitu)(w - vga.mem.linear));
+		VGA_LFBWritten();
+	}
+	void writew(PhysPt addr,Bitu val) {
+		HostPt w = GetHostWritePt(PAGING_GetPhysicalAddress(addr) >> 12) + (addr & 0xfff);
+		host_writew(w,(Bit16u)val);
+		VGA_MarkChanged((Bitu)(w - vga.mem.linear));
+		VGA_MarkChanged((Bitu)(w - vga.mem.linear) + 1);
+		VGA_LFBWritten();
+	}
+	void writed(PhysPt addr,Bitu val) {
+		HostPt w = GetHostWritePt(PAGING_GetPhysicalAddress(addr) >> 12) + (addr & 0xfff);
+		host_writed(w,(Bit32u)val);
+		VGA_MarkChanged((Bitu)(w - vga.mem.linear));
+		VGA_MarkChanged((Bitu)(w - vga.mem.linear) + 3);
+		VGA_LFBWritten();
+	}
 };
 
 extern void XGA_Write(Bitu port, Bitu val, Bitu len);
@@ -1255,6 +1306,29 @@ static struct vg {
 	VGA_Empty_Handler			empty;
 } vgaph;
 
+static bool vgaph_marks_changes = false;	/* The handlers mapped at A0000-BFFFF mark what they write */
+static bool vgaph_lfb_direct = false;	/* The LFB was written to in this mode and is mapped directly */
+static VGAModes vgaph_lfb_mode = M_ERROR;
+
+/* Lines can only be skipped while every write to video memory ends up in the map */
+static void VGA_UpdateChanges(void) {
+	bool active = vga.changes.enabled && vgaph_marks_changes &&
+		(vga.lfb.handler == NULL || !(vgaph.lfb.getFlags() & PFLAG_WRITEABLE));
+	/* Writes that weren't marked until now could have gone anywhere */
+	if (active && !vga.changes.active) VGA_InvalidateChanges();
+	vga.changes.active = active;
+}
+
+/* Unless all writes are trapped only the first write to the LFB is, a program
+   that draws through the LFB gets it mapped directly until the next mode set */
+static void VGA_LFBWritten(void) {
+	if (vga.changes.trap_direct) return;
+	vgaph_lfb_direct = true;
+	vgaph.lfb.setFlags(PFLAG_READABLE|PFLAG_WRITEABLE|PFLAG_NOCODE);
+	VGA_UpdateChanges();
+	PAGING_ClearTLB();
+}
+
 void VGA_ChangedBank(void) {
 	VGA_SetupHandlers();
 }
@@ -1268,6 +1342,17 @@ void VGA_SetupHandlers(void) {
 	vga.svga.bank_read_full = vga.svga.bank_read*vga.svga.bank_size;
 	vga.svga.bank_write_full = vga.svga.bank_write*vga.svga.bank_size;
 
+	/* To keep track of changes writes to the direct mapped memory and the LFB have to be trapped */
+	Bitu direct_write = (vga.changes.trap_direct && IS_EGAVGA_ARCH) ? 0 : PFLAG_WRITEABLE;
+	vgaph.map.setFlags(PFLAG_READABLE|PFLAG_NOCODE|direct_write);
+	if (vga.mode != vgaph_lfb_mode) {
+		vgaph_lfb_mode = vga.mode;
+		vgaph_lfb_direct = false;
+	}
+	bool lfb_trap = vga.changes.enabled && IS_EGAVGA_ARCH && (vga.changes.trap_direct || !vgaph_lfb_direct);
+	vgaph.lfb.setFlags(PFLAG_READABLE|PFLAG_NOCODE|(lfb_trap ? 0 : PFLAG_WRITEABLE));
+	vgaph_marks_changes = false;
+
 	PageHandler *newHandler;
 	switch (machine) {
 	case MCH_CGA:
@@ -1335,6 +1420,7 @@ void VGA_SetupHandlers(void) {
 	switch (vga.mode) {
 	case M_ERROR:
 	default:
+		VGA_UpdateChanges();
 		return;
 	case M_LIN4:
 		newHandler = &vgaph.lin4;
@@ -1395,6 +1481,7 @@ void VGA_SetupHandlers(void) {
 		newHandler = &vgaph.map;
 		break;
 	}
+	vgaph_marks_changes = IS_EGAVGA_ARCH && newHandler != &vgaph.pc98 && (newHandler != &vgaph.map || !direct_write);
 	switch ((vga.gfx.miscellaneous >> 2) & 3) {
 	case 0:
 		vgapages.base = VGA_PAGE_A0;
@@ -1446,6 +1533,7 @@ void VGA_SetupHandlers(void) {
 	if(svgaCard == SVGA_S3Trio && (vga.s3.ext_mem_ctrl & 0x10))
 		MEM_SetPageHandler(VGA_PAGE_A0, 16, &vgaph.mmio);
 range_done:
+	VGA_UpdateChanges();
 	PAGING_ClearTLB();
 }
 
@@ -1486,6 +1574,7 @@ void VGA_StartUpdateLFB(void) {
 		vga.lfb.handler = &vgaph.lfb;
 		MEM_SetLFB(vga.s3.la_window << 4 ,vga.vmemsize/4096, vga.lfb.handler, &vgaph.mmio);
 	}
+	VGA_UpdateChanges();
 }
 
 static bool VGA_Memory_ShutDown_init = false;
@@ -1496,6 +1585,11 @@ static void VGA_Memory_ShutDown(Section * /*sec*/) {
 		vga.mem.linear_orgptr = NULL;
 		vga.mem.linear = NULL;
 	}
+	if (vga.changes.map != NULL) {
+		delete[] vga.changes.map;
+		vga.changes.map = NULL;
+		vga.changes.blocks = 0;
+	}
 }
 
 void VGA_SetupMemory() {
@@ -1510,6 +1604,11 @@ void VGA_SetupMemory() {
         vga.mem.linear=(Bit8u*)(((uintptr_t)vga.mem.linear_orgptr + 16-1) & ~(16-1));
         vga.vmemsize_alloced = vga.vmemsize;
 
+        vga.changes.blocks = ((vga.vmemsize+32) >> VGA_CHANGE_SHIFT) + 1;
+        vga.changes.map = new Bit32u[vga.changes.blocks];
+        memset(vga.changes.map,0,vga.changes.blocks*sizeof(Bit32u));
+        VGA_InvalidateChanges();
+
         /* HACK. try to avoid stale pointers */
 	    vga.draw.linear_base = vga.mem.linear;
         vga.tandy.draw_base = vga.mem.linear;
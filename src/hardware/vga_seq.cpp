@@ -82,6 +82,8 @@ void VGA_Screenstate(bool enabled);
 
 void write_p3c5(Bitu /*port*/,Bitu val,Bitu iolen) {
 //	LOG_MSG("SEQ WRITE reg %X val %X",seq(index),val);
+	/* The map mask changes all the time while drawing and doesn't show */
+	if (seq(index) != 2) VGA_InvalidateChanges();
 	switch(seq(index)) {
 	case 0:		/* Reset */
 		if((seq(reset)^val)&0x3) VGA_SequReset((val&0x3)!=0x3);
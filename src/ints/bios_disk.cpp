@@ -16,6 +16,9 @@
  *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
  */
 
+#include <string.h>
+#include <errno.h>
+#include <vector>
 #include "dosbox.h"
 #include "callback.h"
 #include "bios.h"
@@ -26,6 +29,14 @@
 #include "../dos/drives.h"
 #include "mapper.h"
 
+#if !defined(WIN32)
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 #define MAX_DISK_IMAGES 4
 
 extern bool int13_extensions_enable;
@@ -204,63 +215,129 @@ void swapInNextCD(bool pressed) {
 
 
 Bit8u imageDisk::Read_Sector(Bit32u head,Bit32u cylinder,Bit32u sector,void * data) {
-	Bit32u sectnum;
+	return Read_AbsoluteSector(Get_AbsoluteSector(head,cylinder,sector), data);
+}
 
-	sectnum = ( (cylinder * heads + head) * sectors ) + sector - 1L;
+Bit8u imageDisk::Read_AbsoluteSector(Bit32u sectnum, void * data) {
+	return Read_Sectors(sectnum, 1, data);
+}
 
-	return Read_AbsoluteSector(sectnum, data);
+Bit8u imageDisk::Write_Sector(Bit32u head,Bit32u cylinder,Bit32u sector,void * data) {
+	return Write_AbsoluteSector(Get_AbsoluteSector(head,cylinder,sector), data);
 }
 
-Bit8u imageDisk::Read_AbsoluteSector(Bit32u sectnum, void * data) {
-	Bit64u bytenum,res;
-	int got;
+Bit8u imageDisk::Write_AbsoluteSector(Bit32u sectnum, void *data) {
+	return Write_Sectors(sectnum, 1, data);
+}
+
+/* Map raw images into memory. Everything that isn't covered by the mapping,
+   like a write that grows the file, goes through pread/pwrite, and through
+   stdio where those don't exist. */
+void imageDisk::Setup_IO(void) {
+	io_ready = true;
+#if !defined(WIN32)
+	if (diskimg == NULL) return;
+	int fd = fileno(diskimg);
+	struct stat st;
+	if (fstat(fd,&st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) return;
+	/* Too big for the address space of a 32-bit host */
+	if ((Bit64u)(size_t)st.st_size != (Bit64u)st.st_size) return;
+	int flags = fcntl(fd,F_GETFL);
+	bool writable = (flags != -1) && ((flags & O_ACCMODE) == O_RDWR);
+	void *p = mmap(NULL,(size_t)st.st_size,PROT_READ|(writable ? PROT_WRITE : 0),MAP_SHARED,fd,0);
+	if (p == MAP_FAILED) {
+		LOG_MSG("mmap() failed for disk image %s, using file I/O\n",diskname.c_str());
+		return;
+	}
+	mapped = (Bit8u*)p;
+	mapped_size = (Bit64u)st.st_size;
+	mapped_writable = writable;
+#endif
+}
 
-	bytenum = (Bit64u)sectnum * (Bit64u)sector_size;
+Bit8u imageDisk::Read_Sectors(Bit32u sectnum, Bit32u count, void * data) {
+	Bit64u bytenum = (Bit64u)sectnum * (Bit64u)sector_size;
+	Bit64u len = (Bit64u)count * (Bit64u)sector_size;
 
-	//LOG_MSG("Reading sectors %ld at bytenum %I64d", sectnum, bytenum);
+	if (!io_ready) Setup_IO();
+	if (mapped != NULL && bytenum + len <= mapped_size) {
+		memcpy(data, mapped + bytenum, (size_t)len);
+		return 0x00;
+	}
+	if (diskimg == NULL) return 0x05;
+
+#if !defined(WIN32)
+	int fd = fileno(diskimg);
+	Bit8u *p = (Bit8u*)data;
+	while (len > 0) {
+		ssize_t got = pread(fd, p, (size_t)len, (off_t)bytenum);
+		if (got < 0 && errno == EINTR) continue;
+		if (got <= 0) {
+			LOG_MSG("pread() failed in Read_Sectors for sector %lu. Want=%llu\n",
+				(unsigned long)sectnum,(unsigned long long)len);
+			return 0x05;
+		}
+		p += got;
+		bytenum += (Bit64u)got;
+		len -= (Bit64u)got;
+	}
+	return 0x00;
+#else
+	Bit64u res;
+	size_t got;
 
 	fseeko64(diskimg,bytenum,SEEK_SET);
 	res = ftello64(diskimg);
 	if (res != bytenum) {
-		LOG_MSG("fseek() failed in Read_AbsoluteSector for sector %lu. Want=%llu Got=%llu\n",
+		LOG_MSG("fseek() failed in Read_Sectors for sector %lu. Want=%llu Got=%llu\n",
 			(unsigned long)sectnum,(unsigned long long)bytenum,(unsigned long long)res);
 		return 0x05;
 	}
 
-	got = fread(data, 1, sector_size, diskimg);
-	if ((unsigned int)got != sector_size) {
-		LOG_MSG("fread() failed in Read_AbsoluteSector for sector %lu. Want=%u got=%d\n",
-			(unsigned long)sectnum,(unsigned int)sector_size,(unsigned int)got);
+	got = fread(data, 1, (size_t)len, diskimg);
+	if ((Bit64u)got != len) {
+		LOG_MSG("fread() failed in Read_Sectors for sector %lu. Want=%llu got=%llu\n",
+			(unsigned long)sectnum,(unsigned long long)len,(unsigned long long)got);
 		return 0x05;
 	}
 
 	return 0x00;
+#endif
 }
 
-Bit8u imageDisk::Write_Sector(Bit32u head,Bit32u cylinder,Bit32u sector,void * data) {
-	Bit32u sectnum;
-
-	sectnum = ( (cylinder * heads + head) * sectors ) + sector - 1L;
-
-	return Write_AbsoluteSector(sectnum, data);
-}
-
-
-Bit8u imageDisk::Write_AbsoluteSector(Bit32u sectnum, void *data) {
-	Bit64u bytenum;
-
-	bytenum = (Bit64u)sectnum * sector_size;
-
-	//LOG_MSG("Writing sectors to %ld at bytenum %d", sectnum, bytenum);
+Bit8u imageDisk::Write_Sectors(Bit32u sectnum, Bit32u count, void * data) {
+	Bit64u bytenum = (Bit64u)sectnum * (Bit64u)sector_size;
+	Bit64u len = (Bit64u)count * (Bit64u)sector_size;
 
+	if (!io_ready) Setup_IO();
+	if (mapped != NULL && bytenum + len <= mapped_size) {
+		if (!mapped_writable) return 0x05;
+		memcpy(mapped + bytenum, data, (size_t)len);
+		return 0x00;
+	}
+	if (diskimg == NULL) return 0x05;
+
+#if !defined(WIN32)
+	int fd = fileno(diskimg);
+	const Bit8u *p = (const Bit8u*)data;
+	while (len > 0) {
+		ssize_t put = pwrite(fd, p, (size_t)len, (off_t)bytenum);
+		if (put < 0 && errno == EINTR) continue;
+		if (put <= 0) return 0x05;
+		p += put;
+		bytenum += (Bit64u)put;
+		len -= (Bit64u)put;
+	}
+	return 0x00;
+#else
 	fseeko64(diskimg,bytenum,SEEK_SET);
 	if ((Bit64u)ftello64(diskimg) != bytenum)
-		LOG_MSG("WARNING: fseek() failed in Read_AbsoluteSector for sector %lu\n",(unsigned long)sectnum);
+		LOG_MSG("WARNING: fseek() failed in Write_Sectors for sector %lu\n",(unsigned long)sectnum);
 
-	size_t ret=fwrite(data, sector_size, 1, diskimg);
+	size_t ret=fwrite(data, (size_t)len, 1, diskimg);
 
 	return ((ret>0)?0x00:0x05);
-
+#endif
 }
 
 void imageDisk::Set_Reserved_Cylinders(Bitu resCyl) {
@@ -272,6 +349,10 @@ Bit32u imageDisk::Get_Reserved_Cylinders() {
 }
 
 imageDisk::imageDisk(FILE *imgFile, Bit8u *imgName, Bit32u imgSizeK, bool isHardDisk) {
+	io_ready = false;
+	mapped = NULL;
+	mapped_size = 0;
+	mapped_writable = false;
 	heads = 0;
 	cylinders = 0;
 	sectors = 0;
@@ -313,6 +394,13 @@ imageDisk::imageDisk(FILE *imgFile, Bit8u *imgName, Bit32u imgSizeK, bool isHard
 	}
 }
 
+imageDisk::~imageDisk() {
+#if !defined(WIN32)
+	if (mapped != NULL) munmap(mapped,(size_t)mapped_size);
+#endif
+	if(diskimg != NULL) { fclose(diskimg); }
+}
+
 void imageDisk::Set_Geometry(Bit32u setHeads, Bit32u setCyl, Bit32u setSect, Bit32u setSectSize) {
 	Bitu bigdisk_shift = 0;
 	if(setCyl > 16384 ) LOG_MSG("This disk image is too big.");
@@ -414,11 +502,44 @@ void IDE_ResetDiskByBIOS(unsigned char disk);
 void IDE_EmuINT13DiskReadByBIOS(unsigned char disk,unsigned int cyl,unsigned int head,unsigned sect);
 void IDE_EmuINT13DiskReadByBIOS_LBA(unsigned char disk,uint64_t lba);
 
+/* Sector buffer to and from seg:off, wrapping at the end of the segment */
+static void INT13_WriteBuffer(Bit16u seg,Bit16u off,const Bit8u * data,Bitu size) {
+	while (size) {
+		Bitu chunk=0x10000-off;
+		if (chunk>size) chunk=size;
+		MEM_BlockWrite(PhysMake(seg,off),data,chunk);
+		data+=chunk;
+		size-=chunk;
+		off=(Bit16u)(off+chunk);
+	}
+}
+
+static void INT13_ReadBuffer(Bit16u seg,Bit16u off,Bit8u * data,Bitu size) {
+	while (size) {
+		Bitu chunk=0x10000-off;
+		if (chunk>size) chunk=size;
+		MEM_BlockRead(PhysMake(seg,off),data,chunk);
+		data+=chunk;
+		size-=chunk;
+		off=(Bit16u)(off+chunk);
+	}
+}
+
+/* Whole transfers go through this buffer */
+static std::vector<Bit8u> int13_buffer;
+
+static Bit8u * INT13_Buffer(Bitu size) {
+	if (int13_buffer.size()<size) int13_buffer.resize(size);
+	return &int13_buffer[0];
+}
+
 static Bitu INT13_DiskHandler(void) {
 	Bit16u segat, bufptr;
-	Bit8u sectbuf[512];
+	Bit8u *sectbuf;
+	Bitu  sectsize;
+	Bit32u sectnum;
 	Bitu  drivenum;
-	Bitu  i,t;
+	Bitu  i;
 	last_drive = reg_dl;
 	drivenum = GetDosDriveNumber(reg_dl);
 	bool any_images = false;
@@ -496,24 +617,23 @@ static Bitu INT13_DiskHandler(void) {
 
 		segat = SegValue(es);
 		bufptr = reg_bx;
-		for(i=0;i<reg_al;i++) {
-			last_status = imageDiskList[drivenum]->Read_Sector((Bit32u)reg_dh, (Bit32u)(reg_ch | ((reg_cl & 0xc0)<< 2)), (Bit32u)((reg_cl & 63)+i), sectbuf);
+		sectsize = imageDiskList[drivenum]->getSectSize();
+		sectbuf = INT13_Buffer(reg_al*sectsize);
+		fatDrive::beforeDiskIO(imageDiskList[drivenum]);
+		last_status = imageDiskList[drivenum]->Read_Sectors(imageDiskList[drivenum]->Get_AbsoluteSector((Bit32u)reg_dh, (Bit32u)(reg_ch | ((reg_cl & 0xc0)<< 2)), (Bit32u)(reg_cl & 63)), reg_al, sectbuf);
 
-			/* IDE emulation: simulate change of IDE state that would occur on a real machine after INT 13h */
+		/* IDE emulation: simulate change of IDE state that would occur on a real machine after INT 13h */
+		for(i=0;i<reg_al;i++)
 			IDE_EmuINT13DiskReadByBIOS(reg_dl, (Bit32u)(reg_ch | ((reg_cl & 0xc0)<< 2)), (Bit32u)reg_dh, (Bit32u)((reg_cl & 63)+i));
 
-			if((last_status != 0x00) || (killRead)) {
-				LOG_MSG("Error in disk read");
-				killRead = false;
-				reg_ah = 0x04;
-				CALLBACK_SCF(true);
-				return CBRET_NONE;
-			}
-			for(t=0;t<512;t++) {
-				real_writeb(segat,bufptr,sectbuf[t]);
-				bufptr++;
-			}
+		if((last_status != 0x00) || (killRead)) {
+			LOG_MSG("Error in disk read");
+			killRead = false;
+			reg_ah = 0x04;
+			CALLBACK_SCF(true);
+			return CBRET_NONE;
 		}
+		INT13_WriteBuffer(segat,bufptr,sectbuf,reg_al*sectsize);
 		reg_ah = 0x00;
 		CALLBACK_SCF(false);
 		break;
@@ -527,18 +647,18 @@ static Bitu INT13_DiskHandler(void) {
 
 
 		bufptr = reg_bx;
-		for(i=0;i<reg_al;i++) {
-			for(t=0;t<imageDiskList[drivenum]->getSectSize();t++) {
-				sectbuf[t] = real_readb(SegValue(es),bufptr);
-				bufptr++;
-			}
-
-			last_status = imageDiskList[drivenum]->Write_Sector((Bit32u)reg_dh, (Bit32u)(reg_ch | ((reg_cl & 0xc0) << 2)), (Bit32u)((reg_cl & 63) + i), &sectbuf[0]);
-			if(last_status != 0x00) {
-            CALLBACK_SCF(true);
-				return CBRET_NONE;
-			}
-        }
+		sectsize = imageDiskList[drivenum]->getSectSize();
+		sectbuf = INT13_Buffer(reg_al*sectsize);
+		INT13_ReadBuffer(SegValue(es),bufptr,sectbuf,reg_al*sectsize);
+
+		sectnum = imageDiskList[drivenum]->Get_AbsoluteSector((Bit32u)reg_dh, (Bit32u)(reg_ch | ((reg_cl & 0xc0) << 2)), (Bit32u)(reg_cl & 63));
+		fatDrive::beforeDiskIO(imageDiskList[drivenum]);
+		last_status = imageDiskList[drivenum]->Write_Sectors(sectnum, reg_al, sectbuf);
+		fatDrive::afterDiskWrite(imageDiskList[drivenum], sectnum, reg_al);
+		if(last_status != 0x00) {
+			CALLBACK_SCF(true);
+			return CBRET_NONE;
+		}
 		reg_ah = 0x00;
 		CALLBACK_SCF(false);
         break;
@@ -677,23 +797,22 @@ static Bitu INT13_DiskHandler(void) {
 
 		segat = dap.seg;
 		bufptr = dap.off;
-		for(i=0;i<dap.num;i++) {
-			last_status = imageDiskList[drivenum]->Read_AbsoluteSector(dap.sector+i, sectbuf);
+		sectsize = imageDiskList[drivenum]->getSectSize();
+		sectbuf = INT13_Buffer(dap.num*sectsize);
+		fatDrive::beforeDiskIO(imageDiskList[drivenum]);
+		last_status = imageDiskList[drivenum]->Read_Sectors(dap.sector, dap.num, sectbuf);
 
+		for(i=0;i<dap.num;i++)
 			IDE_EmuINT13DiskReadByBIOS_LBA(reg_dl,dap.sector+i);
 
-			if((last_status != 0x00) || (killRead)) {
-				LOG_MSG("Error in disk read");
-				killRead = false;
-				reg_ah = 0x04;
-				CALLBACK_SCF(true);
-				return CBRET_NONE;
-			}
-			for(t=0;t<512;t++) {
-				real_writeb(segat,bufptr,sectbuf[t]);
-				bufptr++;
-			}
+		if((last_status != 0x00) || (killRead)) {
+			LOG_MSG("Error in disk read");
+			killRead = false;
+			reg_ah = 0x04;
+			CALLBACK_SCF(true);
+			return CBRET_NONE;
 		}
+		INT13_WriteBuffer(segat,bufptr,sectbuf,dap.num*sectsize);
 		reg_ah = 0x00;
 		CALLBACK_SCF(false);
 		break;
@@ -707,17 +826,16 @@ static Bitu INT13_DiskHandler(void) {
 		/* Read Disk Address Packet */
 		readDAP(SegValue(ds),reg_si);
 		bufptr = dap.off;
-		for(i=0;i<dap.num;i++) {
-			for(t=0;t<imageDiskList[drivenum]->getSectSize();t++) {
-				sectbuf[t] = real_readb(dap.seg,bufptr);
-				bufptr++;
-			}
+		sectsize = imageDiskList[drivenum]->getSectSize();
+		sectbuf = INT13_Buffer(dap.num*sectsize);
+		INT13_ReadBuffer(dap.seg,bufptr,sectbuf,dap.num*sectsize);
 
-			last_status = imageDiskList[drivenum]->Write_AbsoluteSector(dap.sector+i, &sectbuf[0]);
-			if(last_status != 0x00) {
-				CALLBACK_SCF(true);
-				return CBRET_NONE;
-			}
+		fatDrive::beforeDiskIO(imageDiskList[drivenum]);
+		last_status = imageDiskList[drivenum]->Write_Sectors(dap.sector, dap.num, sectbuf);
+		fatDrive::afterDiskWrite(imageDiskList[drivenum], dap.sector, dap.num);
+		if(last_status != 0x00) {
+			CALLBACK_SCF(true);
+			return CBRET_NONE;
 		}
 		reg_ah = 0x00;
 		CALLBACK_SCF(false);
@@ -23,6 +23,7 @@
 #include "bios.h"
 #include "keyboard.h"
 #include "regs.h"
+#include "cpu.h"
 #include "inout.h"
 #include "dos_inc.h"
 #include "SDL.h"
@@ -977,6 +978,7 @@ Bitu INT16_Handler(void) {
 		} else {
 			/* enter small idle loop to allow for irqs to happen */
 			reg_ip+=1;
+			CPU_Idle();
 		}
 		break;
 	case 0x10: /* GET KEYSTROKE (enhanced keyboards only) */
@@ -992,6 +994,7 @@ Bitu INT16_Handler(void) {
 		} else {
 			/* enter small idle loop to allow for irqs to happen */
 			reg_ip+=1;
+			CPU_Idle();
 		}
 		break;
 	case 0x01: /* CHECK FOR KEYSTROKE */
@@ -0,0 +1,215 @@
+/*
+ *  Copyright (C) 2002-2015  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <string.h>
+#include <errno.h>
+#include "dosbox.h"
+#include "mem.h"
+#include "cow_disk.h"
+
+#if !defined(WIN32)
+#include <unistd.h>
+#endif
+
+#define COW_MAGIC		"DBXCOWD1"
+#define COW_VERSION		1
+#define COW_HEADER_SIZE	512
+#define COW_BLOCK_SIZE	4096
+
+imageDiskCOW::imageDiskCOW(FILE *baseFile, const char *deltaName, Bit8u *imgName, Bit32u imgSizeK, bool isHardDisk) :
+	imageDisk(baseFile, imgName, imgSizeK, isHardDisk), created_successfully(false), delta(NULL),
+	block_size(COW_BLOCK_SIZE), base_size(0), block_count(0), data_offset(0) {
+	if (baseFile == NULL) return;
+	fseeko64(baseFile, 0L, SEEK_END);
+	base_size = (Bit64u)ftello64(baseFile);
+	created_successfully = Open_Delta(deltaName);
+}
+
+imageDiskCOW::~imageDiskCOW() {
+	if (delta != NULL) fclose(delta);
+}
+
+/* Load the header and bitmap of an existing delta file, or start a new one */
+bool imageDiskCOW::Open_Delta(const char *deltaName) {
+	Bit8u header[COW_HEADER_SIZE];
+
+	delta = fopen64(deltaName, "rb+");
+	if (delta != NULL) {
+		setbuf(delta, NULL);
+		if (!Delta_Read(0, header, COW_HEADER_SIZE) || memcmp(header, COW_MAGIC, 8) != 0 ||
+			host_readd(&header[8]) != COW_VERSION) {
+			LOG_MSG("COW: %s is not a delta file",deltaName);
+			return false;
+		}
+		block_size = host_readd(&header[12]);
+		if (block_size < 512 || (block_size & (block_size - 1)) != 0) {
+			LOG_MSG("COW: %s has an invalid block size of %u",deltaName,(unsigned int)block_size);
+			return false;
+		}
+		if (host_readq(&header[16]) != base_size) {
+			LOG_MSG("COW: %s was made for an image of %llu bytes, not %llu",deltaName,
+				(unsigned long long)host_readq(&header[16]),(unsigned long long)base_size);
+			return false;
+		}
+		block_count = (base_size + block_size - 1) / block_size;
+		data_offset = host_readq(&header[24]);
+		if (data_offset < COW_HEADER_SIZE + (block_count + 7) / 8) return false;
+		bitmap.resize((size_t)((block_count + 7) / 8));
+		if (!bitmap.empty() && !Delta_Read(COW_HEADER_SIZE, &bitmap[0], bitmap.size())) return false;
+		return true;
+	}
+
+	delta = fopen64(deltaName, "wb+");
+	if (delta == NULL) {
+		LOG_MSG("COW: Can't create delta file %s",deltaName);
+		return false;
+	}
+	setbuf(delta, NULL);
+	block_count = (base_size + block_size - 1) / block_size;
+	data_offset = COW_HEADER_SIZE + (block_count + 7) / 8;
+	data_offset = (data_offset + block_size - 1) & ~((Bit64u)block_size - 1);
+	bitmap.assign((size_t)((block_count + 7) / 8), 0);
+
+	memset(header, 0, sizeof(header));
+	memcpy(header, COW_MAGIC, 8);
+	host_writed(&header[8], COW_VERSION);
+	host_writed(&header[12], block_size);
+	host_writeq(&header[16], base_size);
+	host_writeq(&header[24], data_offset);
+	strncpy((char*)&header[32], diskname.c_str(), COW_HEADER_SIZE - 32 - 1);
+	if (!Delta_Write(0, header, COW_HEADER_SIZE)) return false;
+	if (!bitmap.empty() && !Delta_Write(COW_HEADER_SIZE, &bitmap[0], bitmap.size())) return false;
+	return true;
+}
+
+bool imageDiskCOW::Delta_Read(Bit64u offset, void *data, Bit64u len) {
+#if !defined(WIN32)
+	int fd = fileno(delta);
+	Bit8u *p = (Bit8u*)data;
+	while (len > 0) {
+		ssize_t got = pread(fd, p, (size_t)len, (off_t)offset);
+		if (got < 0 && errno == EINTR) continue;
+		if (got <= 0) return false;
+		p += got;
+		offset += (Bit64u)got;
+		len -= (Bit64u)got;
+	}
+	return true;
+#else
+	if (fseeko64(delta, offset, SEEK_SET) != 0) return false;
+	return fread(data, (size_t)len, 1, delta) == 1;
+#endif
+}
+
+bool imageDiskCOW::Delta_Write(Bit64u offset, const void *data, Bit64u len) {
+#if !defined(WIN32)
+	int fd = fileno(delta);
+	const Bit8u *p = (const Bit8u*)data;
+	while (len > 0) {
+		ssize_t put = pwrite(fd, p, (size_t)len, (off_t)offset);
+		if (put < 0 && errno == EINTR) continue;
+		if (put <= 0) return false;
+		p += put;
+		offset += (Bit64u)put;
+		len -= (Bit64u)put;
+	}
+	return true;
+#else
+	if (fseeko64(delta, offset, SEEK_SET) != 0) return false;
+	return fwrite(data, (size_t)len, 1, delta) == 1;
+#endif
+}
+
+Bit8u imageDiskCOW::Read_Sectors(Bit32u sectnum, Bit32u count, void * data) {
+	if (delta == NULL || (block_size % sector_size) != 0) return 0x05;
+	Bit64u spb = block_size / sector_size;
+	Bit64u sect = sectnum;
+	Bit8u *p = (Bit8u*)data;
+
+	while (count > 0) {
+		/* the rest of this block and all following blocks that come from the same file */
+		Bit64u block = sect / spb;
+		bool dirty = block < block_count && Block_Dirty(block);
+		Bit64u run = spb - (sect % spb);
+		for (Bit64u b = block + 1; run < count && (b < block_count && Block_Dirty(b)) == dirty; b++)
+			run += spb;
+		if (run > count) run = count;
+
+		Bit64u len = run * sector_size;
+		if (dirty) {
+			if (!Delta_Read(data_offset + sect * sector_size, p, len)) {
+				LOG_MSG("COW: Read of sector %llu from delta file failed",(unsigned long long)sect);
+				return 0x05;
+			}
+		} else {
+			Bit8u ret = imageDisk::Read_Sectors((Bit32u)sect, (Bit32u)run, p);
+			if (ret != 0x00) return ret;
+		}
+		p += len;
+		sect += run;
+		count -= (Bit32u)run;
+	}
+	return 0x00;
+}
+
+Bit8u imageDiskCOW::Write_Sectors(Bit32u sectnum, Bit32u count, void * data) {
+	if (delta == NULL || (block_size % sector_size) != 0) return 0x05;
+	Bit64u spb = block_size / sector_size;
+	Bit64u sect = sectnum;
+	const Bit8u *p = (const Bit8u*)data;
+
+	while (count > 0) {
+		Bit64u block = sect / spb;
+		if (block >= block_count) return 0x05;	/* the delta can't grow past the base image */
+		Bit64u first = sect % spb;
+		Bit64u run = spb - first;
+
+		if (Block_Dirty(block)) {
+			for (Bit64u b = block + 1; run < count && b < block_count && Block_Dirty(b); b++)
+				run += spb;
+			if (run > count) run = count;
+			if (!Delta_Write(data_offset + sect * sector_size, p, run * sector_size)) return 0x05;
+		} else {
+			/* First write to the block, it goes into the delta file whole */
+			if (run > count) run = count;
+			const Bit8u *src = p;
+			if (run != spb) {
+				copy_buffer.resize(block_size);
+				Bit64u base_sectors = base_size / sector_size;
+				Bit64u base_first = block * spb;
+				Bit64u n = (base_first < base_sectors) ? base_sectors - base_first : 0;
+				if (n > spb) n = spb;
+				memset(&copy_buffer[0], 0, block_size);
+				if (n > 0) {
+					Bit8u ret = imageDisk::Read_Sectors((Bit32u)base_first, (Bit32u)n, &copy_buffer[0]);
+					if (ret != 0x00) return ret;
+				}
+				memcpy(&copy_buffer[(size_t)(first * sector_size)], p, (size_t)(run * sector_size));
+				src = &copy_buffer[0];
+			}
+			/* The block has to be in the file before the bitmap says so */
+			if (!Delta_Write(data_offset + block * block_size, src, block_size)) return 0x05;
+			bitmap[(size_t)(block >> 3)] |= (Bit8u)(1 << (block & 7));
+			if (!Delta_Write(COW_HEADER_SIZE + (block >> 3), &bitmap[(size_t)(block >> 3)], 1)) return 0x05;
+		}
+		p += run * sector_size;
+		sect += run;
+		count -= (Bit32u)run;
+	}
+	return 0x00;
+}
@@ -590,6 +590,7 @@ static void FinishSetMode(bool clearmem) {
 		case M_LIN32:
 			/* Hack we just access the memory directly */
 			memset(vga.mem.linear,0,vga.vmemsize);
+			VGA_InvalidateChanges();
 			break;
 		default:
 			break;
@@ -17,12 +17,26 @@
  */
 
 
+#include <string.h>
 #include "qcow2_disk.h"
+#include "pic.h"
+
+#if !defined(WIN32)
+#include <unistd.h>
+#endif
 
 
 using namespace std;
 
 
+//Images with tables that still have to be written back.
+	static std::vector<QCow2Image*> dirty_images;
+
+	static void QCow2_FlushEvent(Bitu /*val*/){
+		QCow2Image::flush_all();
+	}
+
+
 //Public constant.
 	const Bit32u QCow2Image::magic = 0x514649FB;
 
@@ -63,6 +77,17 @@ using namespace std;
 		l1_bits = header.cluster_bits + l2_bits;
 		refcount_bits = header.cluster_bits - 1;
 		refcount_mask = mask64(refcount_bits);
+		table_cache.resize(table_cache_size);
+		for (Bitu i = 0; i < table_cache_size; i++){
+			table_cache[i].offset = 0;
+			table_cache[i].last_use = 0;
+			table_cache[i].refcount_block = false;
+			table_cache[i].dirty = false;
+		}
+		table_cache_clock = 0;
+		l1_dirty = false;
+		metadata_dirty = false;
+		load_tables();
 		if (header.backing_file_offset != 0 && header.backing_file_size != 0){
 			char* backing_file_name = new char[header.backing_file_size + 1];
 			backing_file_name[header.backing_file_size] = 0;
@@ -100,6 +125,13 @@ using namespace std;
 
 //Public Destructor.
 	QCow2Image::~QCow2Image(){
+		flush_metadata();
+		for (size_t i = 0; i < dirty_images.size(); i++){
+			if (dirty_images[i] == this){
+				dirty_images.erase(dirty_images.begin() + i);
+				break;
+			}
+		}
 		if (backing_image != NULL){
 			fclose(backing_image->file);
 			delete backing_image;
@@ -109,93 +141,178 @@ using namespace std;
 
 //Public function to a read a sector.
 	Bit8u QCow2Image::read_sector(Bit32u sectnum, Bit8u* data){
-		const Bit64u address = (Bit64u)sectnum * sector_size;
-		if (address >= header.size){
-			return 0x05;
-		}
-		Bit64u l2_table_offset;
-		if (0 != read_l1_table(address, l2_table_offset)){
-			return 0x05;
-		}
-		if (0 == l2_table_offset){
-			return read_unallocated_sector(sectnum, data);
-		}
-		Bit64u data_cluster_offset;
-		if (0 != read_l2_table(l2_table_offset, address, data_cluster_offset)){
-			return 0x05;
-		}
-		if (0 == data_cluster_offset){
-			return read_unallocated_sector(sectnum, data);
-		}
-		return read_allocated_data(data_cluster_offset + (address & cluster_mask), data, sector_size);
+		return read_sectors(sectnum, 1, data);
 	}
 
 
 //Public function to a write a sector.
 	Bit8u QCow2Image::write_sector(Bit32u sectnum, Bit8u* data){
-		const Bit64u address = (Bit64u)sectnum * sector_size;
-		if (address >= header.size){
-			return 0x05;
-		}
-		Bit64u l2_table_offset;
-		if (0 != read_l1_table(address, l2_table_offset)){
+		return write_sectors(sectnum, 1, data);
+	}
+
+
+//Public function to read several sectors. Data clusters that follow each other in the image file are read at once.
+	Bit8u QCow2Image::read_sectors(Bit32u sectnum, Bit32u count, Bit8u* data){
+		Bit64u address = (Bit64u)sectnum * sector_size;
+		Bit64u remaining = (Bit64u)count * sector_size;
+		if (address >= header.size || remaining > header.size - address){
 			return 0x05;
 		}
-		if (0 == l2_table_offset){
-			if (0 != pad_file(l2_table_offset)){
+		while (remaining > 0){
+			Bit64u data_cluster_offset;
+			if (0 != lookup_cluster(address, data_cluster_offset)){
 				return 0x05;
 			}
-			if (0 != write_l1_table_entry(address, l2_table_offset)){
-				return 0x05;
+			const Bit64u file_offset = data_cluster_offset + (address & cluster_mask);
+			Bit64u length = cluster_size - (address & cluster_mask);
+			while (length < remaining){
+				Bit64u next_cluster_offset;
+				if (0 != lookup_cluster(address + length, next_cluster_offset)){
+					return 0x05;
+				}
+				if (0 == data_cluster_offset ? 0 != next_cluster_offset : next_cluster_offset != file_offset + length){
+					break;
+				}
+				length += cluster_size;
 			}
-			Bit8u* cluster_buffer = new Bit8u[cluster_size];
-			std::fill(cluster_buffer, cluster_buffer + cluster_size, 0);
-			if (0 != write_data(l2_table_offset, cluster_buffer, cluster_size)){
-				delete[] cluster_buffer;
-				return 0x05;
+			if (length > remaining){
+				length = remaining;
 			}
-			if (0 != update_reference_count(l2_table_offset, cluster_buffer)){
-				delete[] cluster_buffer;
+			if (0 == data_cluster_offset){
+				if (0 != read_unallocated_sectors((Bit32u)(address / sector_size), (Bit32u)(length / sector_size), data)){
+					return 0x05;
+				}
+			} else if (0 != read_allocated_data(file_offset, data, length)){
 				return 0x05;
 			}
-			delete[] cluster_buffer;
+			data += length;
+			address += length;
+			remaining -= length;
 		}
-		Bit64u data_cluster_offset;
-		if (0 != read_l2_table(l2_table_offset, address, data_cluster_offset)){
+		return 0;
+	}
+
+
+//Public function to write several sectors.
+	Bit8u QCow2Image::write_sectors(Bit32u sectnum, Bit32u count, Bit8u* data){
+		Bit64u address = (Bit64u)sectnum * sector_size;
+		Bit64u remaining = (Bit64u)count * sector_size;
+		if (address >= header.size || remaining > header.size - address){
 			return 0x05;
 		}
-		if (data_cluster_offset == 0){
-			if (0 != pad_file(data_cluster_offset)){
+		while (remaining > 0){
+			Bit64u length = cluster_size - (address & cluster_mask);
+			if (length > remaining){
+				length = remaining;
+			}
+			Bit64u l2_table_offset;
+			if (0 != read_l1_table(address, l2_table_offset)){
+				return 0x05;
+			}
+			if (0 == l2_table_offset){
+				Bit8u* l2_table;
+				cluster_buffer.assign(cluster_size, 0);
+				if (0 != allocate_cluster(l2_table_offset, &cluster_buffer[0])){
+					return 0x05;
+				}
+				if (0 != get_table(l2_table_offset, false, true, l2_table)){
+					return 0x05;
+				}
+				if (0 != write_l1_table_entry(address, l2_table_offset)){
+					return 0x05;
+				}
+			}
+			Bit64u data_cluster_offset;
+			if (0 != read_l2_table(l2_table_offset, address, data_cluster_offset)){
 				return 0x05;
 			}
-			if (0 != write_l2_table_entry(l2_table_offset, address, data_cluster_offset)){
+			if (0 == data_cluster_offset){
+				Bit8u* cluster_data = data;
+				if (length != cluster_size){
+					cluster_buffer.resize(cluster_size);
+					if (0 != read_unallocated_cluster(address/cluster_size, &cluster_buffer[0])){
+						return 0x05;
+					}
+					memcpy(&cluster_buffer[address & cluster_mask], data, length);
+					cluster_data = &cluster_buffer[0];
+				}
+				if (0 != allocate_cluster(data_cluster_offset, cluster_data)){
+					return 0x05;
+				}
+				if (0 != write_l2_table_entry(l2_table_offset, address, data_cluster_offset)){
+					return 0x05;
+				}
+			} else if (0 != write_data(data_cluster_offset + (address & cluster_mask), data, length)){
 				return 0x05;
 			}
-			Bit8u* cluster_buffer = new Bit8u[cluster_size];
-			if ( 0 != read_unallocated_cluster(address/cluster_size, cluster_buffer)){
-				delete[] cluster_buffer;
+			data += length;
+			address += length;
+			remaining -= length;
+		}
+		return 0;
+	}
+
+
+//Public function to write the cached tables back to the image file.
+	Bit8u QCow2Image::flush_metadata(){
+		if (!metadata_dirty){
+			return 0;
+		}
+		/* Refcount blocks go first so nothing on disk points at a cluster that isn't counted yet,
+		   then the L2 tables, and the L1 table last so it never points at an L2 table that isn't written yet.
+		   New clusters themselves are always written before any table refers to them. */
+		for (int pass = 0; pass < 2; pass++){
+			for (Bitu i = 0; i < table_cache.size(); i++){
+				CachedTable& entry = table_cache[i];
+				if (entry.dirty && entry.refcount_block == (pass == 0)){
+					if (0 != write_data(entry.offset, &entry.data[0], cluster_size)){
+						return 0x05;
+					}
+					entry.dirty = false;
+				}
+			}
+			if (0 != sync_file()){
 				return 0x05;
 			}
-			const Bit64u cluster_buffer_sector_offset = address & cluster_mask;
-			for (Bit64u i = 0; i < sector_size; i++){
-				cluster_buffer[cluster_buffer_sector_offset + i] = data[i];
+		}
+		if (l1_dirty && !l1_table.empty()){
+			std::vector<Bit64u> buffer(l1_table.size());
+			for (size_t i = 0; i < l1_table.size(); i++){
+				buffer[i] = host_read64(l1_table[i]);
 			}
-			if (0 != write_data(data_cluster_offset, cluster_buffer, cluster_size)){
-				delete[] cluster_buffer;
+			if (0 != write_data(header.l1_table_offset, (Bit8u*)&buffer[0], (Bit64u)buffer.size() << 3)){
 				return 0x05;
 			}
-			if (0 != update_reference_count(data_cluster_offset, cluster_buffer)){
-				delete[] cluster_buffer;
+			if (0 != sync_file()){
 				return 0x05;
 			}
-			delete[] cluster_buffer;
-			return 0;
 		}
-		return write_data(data_cluster_offset + (address & cluster_mask), data, sector_size);
+		l1_dirty = false;
+		metadata_dirty = false;
+		for (size_t i = 0; i < dirty_images.size(); i++){
+			if (dirty_images[i] == this){
+				dirty_images.erase(dirty_images.begin() + i);
+				break;
+			}
+		}
+		return 0;
+	}
+
+
+//Public function to write back the tables of all images.
+	void QCow2Image::flush_all(){
+		while (!dirty_images.empty()){
+			QCow2Image* image = dirty_images.back();
+			if (0 != image->flush_metadata()){
+				LOG_MSG("Failed to write QCow2 metadata");
+				dirty_images.pop_back();
+			}
+		}
 	}
 
 
 //Private constants.
+	const Bitu QCow2Image::table_cache_size = 32;
 	const Bit64u QCow2Image::copy_flag = 0x8000000000000000;
 	const Bit64u QCow2Image::empty_mask = 0xFFFFFFFFFFFFFFFF;
 	const Bit64u QCow2Image::table_entry_mask = 0x00FFFFFFFFFFFFFF;
@@ -250,6 +367,109 @@ using namespace std;
 	}
 
 
+//Write a new cluster at the end of the file and count a reference to it.
+	Bit8u QCow2Image::allocate_cluster(Bit64u& cluster_offset, Bit8u* data){
+		if (0 != pad_file(cluster_offset)){
+			return 0x05;
+		}
+		if (0 != write_data(cluster_offset, data, cluster_size)){
+			return 0x05;
+		}
+		return update_reference_count(cluster_offset);
+	}
+
+
+//Get an L2 table or refcount block from the cache, loading it if needed. A fresh table was just allocated and is all zeros.
+	Bit8u QCow2Image::get_table(Bit64u table_offset, bool refcount_block, bool fresh, Bit8u*& table){
+		CachedTable* victim = &table_cache[0];
+		for (Bitu i = 0; i < table_cache.size(); i++){
+			CachedTable& entry = table_cache[i];
+			if (entry.offset == table_offset && !entry.data.empty()){
+				entry.last_use = ++table_cache_clock;
+				table = &entry.data[0];
+				return 0;
+			}
+			if (entry.last_use < victim->last_use){
+				victim = &entry;
+			}
+		}
+		if (victim->dirty && 0 != flush_metadata()){
+			return 0x05;
+		}
+		victim->offset = 0;
+		victim->data.resize(cluster_size);
+		if (fresh){
+			std::fill(victim->data.begin(), victim->data.end(), 0);
+		} else if (0 != read_allocated_data(table_offset, &victim->data[0], cluster_size)){
+			victim->data.clear();
+			return 0x05;
+		}
+		victim->offset = table_offset;
+		victim->refcount_block = refcount_block;
+		victim->dirty = false;
+		victim->last_use = ++table_cache_clock;
+		table = &victim->data[0];
+		return 0;
+	}
+
+
+//Load the L1 table and the refcount table, which are small enough to be kept in memory.
+	void QCow2Image::load_tables(){
+		l1_table.resize(header.l1_size);
+		if (!l1_table.empty() && 0 != read_allocated_data(header.l1_table_offset, (Bit8u*)&l1_table[0], (Bit64u)l1_table.size() << 3)){
+			LOG_MSG("Failed to read QCow2 L1 table");
+			l1_table.clear();
+		}
+		for (size_t i = 0; i < l1_table.size(); i++){
+			l1_table[i] = host_read64(l1_table[i]);
+		}
+		refcount_table.resize((size_t)(((Bit64u)header.refcount_table_clusters << header.cluster_bits) >> 3));
+		if (!refcount_table.empty() && 0 != read_allocated_data(header.refcount_table_offset, (Bit8u*)&refcount_table[0], (Bit64u)refcount_table.size() << 3)){
+			LOG_MSG("Failed to read QCow2 refcount table");
+			refcount_table.clear();
+		}
+		for (size_t i = 0; i < refcount_table.size(); i++){
+			refcount_table[i] = host_read64(refcount_table[i]);
+		}
+	}
+
+
+//Get the offset of the data cluster for a given address, 0 if it isn't allocated.
+	Bit8u QCow2Image::lookup_cluster(Bit64u address, Bit64u& data_cluster_offset){
+		Bit64u l2_table_offset;
+		data_cluster_offset = 0;
+		if (0 != read_l1_table(address, l2_table_offset)){
+			return 0x05;
+		}
+		if (0 == l2_table_offset){
+			return 0;
+		}
+		return read_l2_table(l2_table_offset, address, data_cluster_offset);
+	}
+
+
+//Remember that a cached table, or the L1 table if NULL, has to be written back.
+	void QCow2Image::mark_dirty(Bit8u* table){
+		if (table == NULL){
+			l1_dirty = true;
+		} else {
+			for (Bitu i = 0; i < table_cache.size(); i++){
+				if (!table_cache[i].data.empty() && &table_cache[i].data[0] == table){
+					table_cache[i].dirty = true;
+					break;
+				}
+			}
+		}
+		if (!metadata_dirty){
+			metadata_dirty = true;
+			dirty_images.push_back(this);
+			/* Written back a second later, earlier when a dirty table has to leave the cache */
+			PIC_RemoveEvents(QCow2_FlushEvent);
+			PIC_AddEvent(QCow2_FlushEvent, 1000.0);
+		}
+	}
+
+
 //Pad a file with zeros if it doesn't end on a cluster boundary.
 	Bit8u QCow2Image::pad_file(Bit64u& new_file_length){
 		if (0 != fseeko64(file, 0, SEEK_END)){
@@ -309,32 +529,35 @@ using namespace std;
 
 //Read the L1 table to get the offset of the L2 table for a given address.
 	inline Bit8u QCow2Image::read_l1_table(Bit64u address, Bit64u& l2_table_offset){
-		const Bit64u l1_entry_offset = header.l1_table_offset + ((address >> l1_bits) << 3);
-		return read_table(l1_entry_offset, table_entry_mask, l2_table_offset);
+		const Bit64u l1_index = address >> l1_bits;
+		if (l1_index >= l1_table.size()){
+			return 0x05;
+		}
+		l2_table_offset = l1_table[(size_t)l1_index] & table_entry_mask;
+		return 0;
 	}
 
 
 //Read an L2 table to get the offset of the data cluster for a given address.
 	inline Bit8u QCow2Image::read_l2_table(Bit64u l2_table_offset, Bit64u address, Bit64u& data_cluster_offset){
-		const Bit64u l2_entry_offset = l2_table_offset + (((address >> header.cluster_bits) & l2_mask) << 3);
-		return read_table(l2_entry_offset, table_entry_mask, data_cluster_offset);
+		Bit8u* l2_table;
+		if (0 != get_table(l2_table_offset, false, false, l2_table)){
+			return 0x05;
+		}
+		Bit64u buffer;
+		memcpy(&buffer, l2_table + (((address >> header.cluster_bits) & l2_mask) << 3), sizeof buffer);
+		data_cluster_offset = host_read64(buffer) & table_entry_mask;
+		return 0;
 	}
 
 
 //Read the refcount table to get the offset of the refcount cluster for a given address.
 	inline Bit8u QCow2Image::read_refcount_table(Bit64u data_cluster_offset, Bit64u& refcount_cluster_offset){
-		const Bit64u refcount_entry_offset = header.refcount_table_offset + (((data_cluster_offset/cluster_size) >> refcount_bits) << 3);
-		return read_table(refcount_entry_offset, empty_mask, refcount_cluster_offset);
-	}
-
-
-//Read a table entry at the given offset.
-	inline Bit8u QCow2Image::read_table(Bit64u entry_offset, Bit64u entry_mask, Bit64u& entry_value){
-		Bit64u buffer;
-		if (0 != read_allocated_data(entry_offset, (Bit8u*)&buffer, sizeof buffer)){
+		const Bit64u refcount_index = (data_cluster_offset/cluster_size) >> refcount_bits;
+		if (refcount_index >= refcount_table.size()){
 			return 0x05;
 		}
-		entry_value = host_read64(buffer) & table_entry_mask;
+		refcount_cluster_offset = refcount_table[(size_t)refcount_index] & table_entry_mask;
 		return 0;
 	}
 
@@ -350,29 +573,46 @@ using namespace std;
 	}
 
 
-//Read a sector not currently allocated in the image file.
-	inline Bit8u QCow2Image::read_unallocated_sector(Bit32u sectnum, Bit8u* data){
+//Read sectors not currently allocated in the image file.
+	inline Bit8u QCow2Image::read_unallocated_sectors(Bit32u sectnum, Bit32u count, Bit8u* data){
 		if(backing_image == NULL){
-			std::fill(data, data+sector_size, 0);
+			std::fill(data, data+(Bit64u)count*sector_size, 0);
 			return 0;
 		}
-		return backing_image->read_sector(sectnum, data);
+		return backing_image->read_sectors(sectnum, count, data);
+	}
+
+
+//Make the writes so far durable before the next ones.
+	Bit8u QCow2Image::sync_file(){
+		if (0 != fflush(file)){
+			return 0x05;
+		}
+#if !defined(WIN32)
+		fsync(fileno(file));
+#endif
+		return 0;
 	}
 
-//Update the reference count for a cluster.
-	Bit8u QCow2Image::update_reference_count(Bit64u cluster_offset, Bit8u* cluster_buffer){
+
+//Update the reference count for a newly written cluster.
+	Bit8u QCow2Image::update_reference_count(Bit64u cluster_offset){
 		Bit64u refcount_cluster_offset;
 		if (0 != read_refcount_table(cluster_offset, refcount_cluster_offset)){
 			return 0x05;
 		}
 		if (0 == refcount_cluster_offset){
+			Bit8u* refcount_block;
 			refcount_cluster_offset = cluster_offset + cluster_size;
-			std::fill(cluster_buffer, cluster_buffer + cluster_size, 0);
-			if (0 != write_refcount_table_entry(cluster_offset, refcount_cluster_offset)){
+			std::vector<Bit8u> zero_cluster(cluster_size, 0);
+			if (0 != write_data(refcount_cluster_offset, &zero_cluster[0], cluster_size)){
 				return 0x05;
 			}
-			if (0 != write_data(refcount_cluster_offset, cluster_buffer, cluster_size)){
-			return 0x05;
+			if (0 != get_table(refcount_cluster_offset, true, true, refcount_block)){
+				return 0x05;
+			}
+			if (0 != write_refcount_table_entry(cluster_offset, refcount_cluster_offset)){
+				return 0x05;
 			}
 			if (0 != write_refcount(refcount_cluster_offset, refcount_cluster_offset, 0x1)){
 				return 0x05;
@@ -399,29 +639,50 @@ using namespace std;
 
 //Write an L2 table offset into the L1 table.
 	inline Bit8u QCow2Image::write_l1_table_entry(Bit64u address, Bit64u l2_table_offset){
-		const Bit64u l1_entry_offset = header.l1_table_offset + ((address >> l1_bits) << 3);
-		return write_table_entry(l1_entry_offset, l2_table_offset | copy_flag);
+		const Bit64u l1_index = address >> l1_bits;
+		if (l1_index >= l1_table.size()){
+			return 0x05;
+		}
+		l1_table[(size_t)l1_index] = l2_table_offset | copy_flag;
+		mark_dirty(NULL);
+		return 0;
 	}
 
 
 //Write a data cluster offset into an L2 table.
 	inline Bit8u QCow2Image::write_l2_table_entry(Bit64u l2_table_offset, Bit64u address, Bit64u data_cluster_offset){
-		const Bit64u l2_entry_offset = l2_table_offset + (((address >> header.cluster_bits) & l2_mask) << 3);
-		return write_table_entry(l2_entry_offset, data_cluster_offset | copy_flag);
+		Bit8u* l2_table;
+		if (0 != get_table(l2_table_offset, false, false, l2_table)){
+			return 0x05;
+		}
+		Bit64u buffer = host_read64(data_cluster_offset | copy_flag);
+		memcpy(l2_table + (((address >> header.cluster_bits) & l2_mask) << 3), &buffer, sizeof buffer);
+		mark_dirty(l2_table);
+		return 0;
 	}
 
 
 //Write a refcount.
 	inline Bit8u QCow2Image::write_refcount(Bit64u cluster_offset, Bit64u refcount_cluster_offset, Bit16u refcount){
-		const Bit64u refcount_offset = refcount_cluster_offset + (((cluster_offset/cluster_size) & refcount_mask) << 1);
+		Bit8u* refcount_block;
+		if (0 != get_table(refcount_cluster_offset, true, false, refcount_block)){
+			return 0x05;
+		}
 		Bit16u buffer = host_read16(refcount);
-		return write_data(refcount_offset, (Bit8u*)&buffer, sizeof buffer);
+		memcpy(refcount_block + (((cluster_offset/cluster_size) & refcount_mask) << 1), &buffer, sizeof buffer);
+		mark_dirty(refcount_block);
+		return 0;
 	}
 
 
-//Write a refcount table entry.
+//Write a refcount table entry. The new refcount block is already on disk, so this is written right away.
 	inline Bit8u QCow2Image::write_refcount_table_entry(Bit64u cluster_offset, Bit64u refcount_cluster_offset){
-		const Bit64u refcount_entry_offset = header.refcount_table_offset + (((cluster_offset/cluster_size) >> refcount_bits) << 3);
+		const Bit64u refcount_index = (cluster_offset/cluster_size) >> refcount_bits;
+		if (refcount_index >= refcount_table.size()){
+			return 0x05;
+		}
+		refcount_table[(size_t)refcount_index] = refcount_cluster_offset;
+		const Bit64u refcount_entry_offset = header.refcount_table_offset + (refcount_index << 3);
 		return write_table_entry(refcount_entry_offset, refcount_cluster_offset);
 	}
 
@@ -453,3 +714,15 @@ using namespace std;
 	Bit8u QCow2Disk::Write_AbsoluteSector(Bit32u sectnum, void* data){
 		return qcowImage.write_sector(sectnum, (Bit8u*)data);
 	}
+
+
+//Public function to read several sectors.
+	Bit8u QCow2Disk::Read_Sectors(Bit32u sectnum, Bit32u count, void* data){
+		return qcowImage.read_sectors(sectnum, count, (Bit8u*)data);
+	}
+
+
+//Public function to write several sectors.
+	Bit8u QCow2Disk::Write_Sectors(Bit32u sectnum, Bit32u count, void* data){
+		return qcowImage.write_sectors(sectnum, count, (Bit8u*)data);
+	}
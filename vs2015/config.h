@@ -83,6 +83,9 @@
 /* Define to 1 if you have libpng */
 #define C_LIBPNG 1
 
+/* Define to 1 to read LZMA compressed CHD images, requires liblzma */
+#undef C_LZMA
+
 /* Define to 1 to enable internal modem support, requires SDL_net */
 #undef C_MODEM
 
@@ -104,6 +107,9 @@
 /* define to 1 if you have XKBlib.h and X11 lib */
 #undef C_X11_XKB
 
+/* Define to 1 if you have zlib, needed for compressed CHD images */
+#define C_ZLIB 1
+
 /* libm doesn't include powf */
 #undef DB_HAVE_NO_POWF
 